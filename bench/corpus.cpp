@@ -0,0 +1,306 @@
+#include "corpus.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+#include "locales.h"
+
+namespace {
+
+constexpr uint32_t kCorpusVersion = 1;  // Bump when the generated content changes
+constexpr size_t kChunkSize = 64 * 1024;
+
+// SplitMix64. The standard distributions differ between standard libraries, this
+// produces the same numbers everywhere.
+class CorpusRandom {
+public:
+    explicit CorpusRandom(uint64_t seed) : state(seed) {}
+
+    uint64_t Next() {
+        uint64_t z = (state += 0x9E3779B97F4A7C15ULL);
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+        return z ^ (z >> 31);
+    }
+
+    // The modulo bias is irrelevant for corpus shapes
+    uint64_t Between(uint64_t min, uint64_t max) { return min + Next() % (max - min + 1); }
+
+private:
+    uint64_t state;
+};
+
+enum class Content {
+    TEXT,   // Words and lines, compresses like game data tables
+    NOISE,  // Random bytes, like audio, video and textures that are already compressed
+    WAVE    // PCM WAVE file, so ADPCM rules see a real header
+};
+
+struct FileSpec {
+    std::string archivePath;
+    uint64_t size;
+    Content content;
+    uint64_t seed;
+};
+
+// Directories and extensions that the masks of the game profiles match
+struct MixedKind {
+    const char *directory;
+    const char *extension;
+    Content content;
+    uint64_t minSize;
+    uint64_t maxSize;
+};
+
+constexpr std::array<MixedKind, 16> kMixedKinds = {{
+    {"Sound\\Units\\", ".wav", Content::WAVE, 8 << 10, 256 << 10},
+    {"Abilities\\Spells\\", ".wav", Content::WAVE, 8 << 10, 128 << 10},
+    {"Music\\", ".mp3", Content::NOISE, 512 << 10, 2 << 20},
+    {"Music\\", ".ogg", Content::NOISE, 256 << 10, 1 << 20},
+    {"Video\\", ".smk", Content::NOISE, 256 << 10, 1 << 20},
+    {"Video\\", ".bik", Content::NOISE, 256 << 10, 1 << 20},
+    {"data\\global\\excel\\", ".txt", Content::TEXT, 1 << 10, 128 << 10},
+    {"data\\local\\lng\\", ".tbl", Content::TEXT, 1 << 10, 64 << 10},
+    {"data\\global\\ui\\", ".dc6", Content::NOISE, 1 << 10, 64 << 10},
+    {"ReplaceableTextures\\Selection\\", ".blp", Content::NOISE, 4 << 10, 64 << 10},
+    {"UI\\Widgets\\", ".blp", Content::NOISE, 4 << 10, 64 << 10},
+    {"Units\\Human\\Footman\\", ".mdx", Content::TEXT, 16 << 10, 256 << 10},
+    {"Units\\", ".slk", Content::TEXT, 1 << 10, 64 << 10},
+    {"Scripts\\", ".j", Content::TEXT, 4 << 10, 128 << 10},
+    {"Interface\\AddOns\\", ".toc", Content::TEXT, 256, 4 << 10},
+    {"Maps\\", ".w3m", Content::NOISE, 64 << 10, 512 << 10},
+}};
+
+// Neutral, deDE, enUS, frFR, itIT, koKR and zhCN
+constexpr std::array<LCID, 7> kLocales = {0x000, 0x407, 0x409, 0x40c, 0x410, 0x412, 0x804};
+
+uint64_t Scaled(uint64_t value, double scale) {
+    return std::max<uint64_t>(1, static_cast<uint64_t>(std::llround(value * scale)));
+}
+
+std::string NumberedName(const char *format, unsigned int a, unsigned int b = 0,
+                         unsigned int c = 0) {
+    char name[64];
+    std::snprintf(name, sizeof(name), format, a, b, c);
+    return name;
+}
+
+std::vector<FileSpec> PlanCorpus(CorpusKind kind, double scale) {
+    CorpusRandom random(0x4D5051000 + static_cast<uint64_t>(kind));
+    std::vector<FileSpec> specs;
+    switch (kind) {
+        case CorpusKind::TINY_FILES: {
+            const uint64_t count = Scaled(10000, scale);
+            for (uint64_t i = 0; i < count; i++) {
+                std::string path = NumberedName("dir%02u\\sub%02u\\file%05u.txt", i % 32,
+                                                (i / 32) % 8, static_cast<unsigned int>(i));
+                specs.push_back({path, random.Between(16, 1024), Content::TEXT, random.Next()});
+            }
+            break;
+        }
+        case CorpusKind::HUGE_FILES: {
+            const uint64_t size = std::max<uint64_t>(Scaled(64 << 20, scale), 1 << 20);
+            for (unsigned int i = 0; i < 4; i++) {
+                // Half of them compress, the other half is stored after compression fails
+                const bool text = i % 2 == 0;
+                specs.push_back({NumberedName(text ? "huge%u.dat" : "huge%u.bin", i), size,
+                                 text ? Content::TEXT : Content::NOISE, random.Next()});
+            }
+            break;
+        }
+        case CorpusKind::MIXED_EXTENSIONS: {
+            const uint64_t count = Scaled(2000, scale);
+            for (uint64_t i = 0; i < count; i++) {
+                const MixedKind &mixed = kMixedKinds[i % kMixedKinds.size()];
+                std::string path = mixed.directory +
+                                   NumberedName("file%04u", static_cast<unsigned int>(i)) +
+                                   mixed.extension;
+                uint64_t size = random.Between(mixed.minSize, mixed.maxSize);
+                if (mixed.content == Content::WAVE) {
+                    size &= ~1ULL;  // Whole 16-bit samples
+                }
+                specs.push_back({path, size, mixed.content, random.Next()});
+            }
+            break;
+        }
+        case CorpusKind::MULTI_LOCALE: {
+            const uint64_t count = Scaled(500, scale);
+            for (uint64_t i = 0; i < count; i++) {
+                std::string path =
+                    NumberedName("strings\\file%04u.txt", static_cast<unsigned int>(i));
+                specs.push_back(
+                    {path, random.Between(1 << 10, 64 << 10), Content::TEXT, random.Next()});
+            }
+            break;
+        }
+    }
+    return specs;
+}
+
+// Words shared by every text file, so text compresses about as well as game data
+const std::vector<std::string> &Vocabulary() {
+    static const std::vector<std::string> words = [] {
+        CorpusRandom random(0x574F524453);
+        std::vector<std::string> list(1024);
+        for (std::string &word : list) {
+            word.resize(random.Between(2, 10));
+            for (char &c : word) {
+                c = static_cast<char>('a' + random.Next() % 26);
+            }
+        }
+        return list;
+    }();
+    return words;
+}
+
+void PutLittleEndian(std::string *buffer, uint32_t value, int bytes) {
+    for (int i = 0; i < bytes; i++) {
+        buffer->push_back(static_cast<char>((value >> (8 * i)) & 0xFF));
+    }
+}
+
+// Append at most maxBytes of the content to the buffer
+void GenerateChunk(Content content, CorpusRandom *random, uint64_t offset, size_t maxBytes,
+                   std::string *buffer) {
+    switch (content) {
+        case Content::TEXT: {
+            const std::vector<std::string> &words = Vocabulary();
+            while (buffer->size() < maxBytes) {
+                buffer->append(words[random->Next() % words.size()]);
+                buffer->push_back(random->Next() % 12 == 0 ? '\n' : ' ');
+            }
+            break;
+        }
+        case Content::NOISE:
+            while (buffer->size() < maxBytes) {
+                PutLittleEndian(buffer, static_cast<uint32_t>(random->Next()), 4);
+            }
+            break;
+        case Content::WAVE: {
+            // Triangle wave with a little noise, mono 16-bit at 22050 Hz
+            uint64_t sample = offset / 2;
+            while (buffer->size() < maxBytes) {
+                const int32_t phase = static_cast<int32_t>(sample++ % 200);
+                const int32_t value = (phase < 100 ? phase : 200 - phase) * 300 - 15000 +
+                                      static_cast<int32_t>(random->Next() % 512);
+                PutLittleEndian(buffer, static_cast<uint16_t>(static_cast<int16_t>(value)), 2);
+            }
+            break;
+        }
+    }
+    buffer->resize(maxBytes);
+}
+
+bool WriteCorpusFile(const fs::path &path, const FileSpec &spec) {
+    std::error_code ec;
+    fs::create_directories(path.parent_path(), ec);
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    if (!file) {
+        return false;
+    }
+
+    CorpusRandom random(spec.seed);
+    uint64_t written = 0;
+    std::string buffer;
+    if (spec.content == Content::WAVE && spec.size >= 44) {
+        const uint32_t dataSize = static_cast<uint32_t>(spec.size - 44);
+        buffer.append("RIFF");
+        PutLittleEndian(&buffer, dataSize + 36, 4);
+        buffer.append("WAVEfmt ");
+        PutLittleEndian(&buffer, 16, 4);         // Format chunk size
+        PutLittleEndian(&buffer, 1, 2);          // PCM
+        PutLittleEndian(&buffer, 1, 2);          // Mono
+        PutLittleEndian(&buffer, 22050, 4);      // Sample rate
+        PutLittleEndian(&buffer, 22050 * 2, 4);  // Byte rate
+        PutLittleEndian(&buffer, 2, 2);          // Block align
+        PutLittleEndian(&buffer, 16, 2);         // Bits per sample
+        buffer.append("data");
+        PutLittleEndian(&buffer, dataSize, 4);
+        file.write(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+        written = buffer.size();
+    }
+
+    uint64_t dataOffset = 0;
+    while (written < spec.size) {
+        buffer.clear();
+        const size_t length =
+            static_cast<size_t>(std::min<uint64_t>(kChunkSize, spec.size - written));
+        GenerateChunk(spec.content, &random, dataOffset, length, &buffer);
+        file.write(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+        written += length;
+        dataOffset += length;
+    }
+    return static_cast<bool>(file.flush());
+}
+
+}  // namespace
+
+std::string CorpusName(CorpusKind kind) {
+    switch (kind) {
+        case CorpusKind::TINY_FILES:
+            return "tiny";
+        case CorpusKind::HUGE_FILES:
+            return "huge";
+        case CorpusKind::MIXED_EXTENSIONS:
+            return "mixed";
+        case CorpusKind::MULTI_LOCALE:
+            return "locales";
+    }
+    return "unknown";
+}
+
+bool GenerateCorpus(CorpusKind kind, double scale, const fs::path &root, Corpus *corpus) {
+    corpus->name = CorpusName(kind);
+    corpus->directory = root / corpus->name;
+    corpus->files.clear();
+    corpus->totalBytes = 0;
+    if (kind == CorpusKind::MULTI_LOCALE) {
+        corpus->locales.assign(kLocales.begin(), kLocales.end());
+    } else {
+        corpus->locales = {defaultLocale};
+    }
+
+    const std::vector<FileSpec> specs = PlanCorpus(kind, scale);
+    for (const FileSpec &spec : specs) {
+        std::string localName = spec.archivePath;
+        std::replace(localName.begin(), localName.end(), '\\', '/');
+        corpus->files.push_back({corpus->directory / fs::u8path(localName), spec.archivePath,
+                                 spec.size});
+        corpus->totalBytes += spec.size;
+    }
+
+    // The stamp is written last, so an interrupted run generates the corpus again
+    std::ostringstream stampText;
+    stampText << "version=" << kCorpusVersion << " scale=" << scale
+              << " files=" << corpus->files.size() << " bytes=" << corpus->totalBytes << "\n";
+    const fs::path stampPath = root / (corpus->name + ".stamp");
+    std::ifstream stampFile(stampPath);
+    std::stringstream existingStamp;
+    existingStamp << stampFile.rdbuf();
+    if (existingStamp.str() == stampText.str() && fs::is_directory(corpus->directory)) {
+        return true;
+    }
+    stampFile.close();
+
+    std::cout << "[*] Generating corpus: " << corpus->name << " (" << corpus->files.size()
+              << " files, " << corpus->totalBytes << " bytes)" << std::endl;
+    std::error_code ec;
+    fs::remove(stampPath, ec);
+    fs::remove_all(corpus->directory, ec);
+    for (size_t i = 0; i < specs.size(); i++) {
+        if (!WriteCorpusFile(corpus->files[i].localPath, specs[i])) {
+            std::cerr << "[!] Failed to write corpus file: " << corpus->files[i].localPath
+                      << std::endl;
+            return false;
+        }
+    }
+
+    std::ofstream stampOutput(stampPath, std::ios::trunc);
+    stampOutput << stampText.str();
+    return static_cast<bool>(stampOutput.flush());
+}
@@ -0,0 +1,41 @@
+#ifndef CORPUS_H
+#define CORPUS_H
+
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+#include <StormLib.h>
+
+namespace fs = std::filesystem;
+
+enum class CorpusKind {
+    TINY_FILES,        // Many small text files in nested directories
+    HUGE_FILES,        // A few files large enough for the multi-threaded sector paths
+    MIXED_EXTENSIONS,  // Files matching the masks of the game profiles (wav, blp, mdx, ...)
+    MULTI_LOCALE       // Files that are added once for every locale
+};
+
+struct CorpusFile {
+    fs::path localPath;       // File on disk
+    std::string archivePath;  // Name inside the archive, with backslashes
+    uint64_t size;
+};
+
+struct Corpus {
+    std::string name;
+    fs::path directory;
+    std::vector<CorpusFile> files;
+    std::vector<LCID> locales;  // Every file is stored once per locale
+    uint64_t totalBytes = 0;    // Size of the files on disk, not counting locales
+};
+
+std::string CorpusName(CorpusKind kind);
+
+// Write a corpus to a directory below root, unless an earlier run left the same one
+// there. File names, sizes and content only depend on kind and scale, so results are
+// comparable across machines and releases. Returns false if writing a file failed.
+bool GenerateCorpus(CorpusKind kind, double scale, const fs::path &root, Corpus *corpus);
+
+#endif  // CORPUS_H
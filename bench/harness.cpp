@@ -0,0 +1,176 @@
+#include "harness.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+#include "instrumentation.h"
+
+namespace {
+
+constexpr uint64_t kMaxIterations = 1000000000;
+
+double WallSeconds() {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+
+// CPU time of every thread of the process, so multi-threaded compression counts in full
+double ProcessCpuSeconds() {
+#ifdef _WIN32
+    FILETIME creation, exit, kernel, user;
+    if (!GetProcessTimes(GetCurrentProcess(), &creation, &exit, &kernel, &user)) {
+        return 0;
+    }
+    auto toSeconds = [](const FILETIME &time) {
+        return ((static_cast<uint64_t>(time.dwHighDateTime) << 32) | time.dwLowDateTime) / 1e7;
+    };
+    return toSeconds(kernel) + toSeconds(user);
+#else
+    timespec time{};
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &time);
+    return static_cast<double>(time.tv_sec) + static_cast<double>(time.tv_nsec) / 1e9;
+#endif
+}
+
+std::string JsonString(const std::string &text) {
+    std::string escaped = "\"";
+    for (const char c : text) {
+        if (c == '"' || c == '\\') {
+            escaped += '\\';
+            escaped += c;
+        } else if (static_cast<unsigned char>(c) < 0x20) {
+            char code[8];
+            std::snprintf(code, sizeof(code), "\\u%04x", c);
+            escaped += code;
+        } else {
+            escaped += c;
+        }
+    }
+    return escaped + "\"";
+}
+
+}  // namespace
+
+void BenchState::PauseTiming() {
+    if (running) {
+        realSeconds += WallSeconds() - realStart;
+        cpuSeconds += ProcessCpuSeconds() - cpuStart;
+        running = false;
+    }
+}
+
+void BenchState::ResumeTiming() {
+    if (!running) {
+        realStart = WallSeconds();
+        cpuStart = ProcessCpuSeconds();
+        running = true;
+    }
+}
+
+BenchResult RunBenchmark(const std::string &name,
+                         const std::function<void(BenchState &)> &function, double minSeconds) {
+    BenchResult result;
+    result.name = name;
+
+    uint64_t iterations = 1;
+    while (true) {
+        BenchState state(iterations);
+        function(state);
+        state.PauseTiming();
+        if (!state.error.empty()) {
+            result.error = state.error;
+            break;
+        }
+
+        if (state.realSeconds >= minSeconds || iterations >= kMaxIterations) {
+            result.iterations = iterations;
+            result.realSeconds = state.realSeconds / static_cast<double>(iterations);
+            result.cpuSeconds = state.cpuSeconds / static_cast<double>(iterations);
+            if (state.realSeconds > 0) {
+                result.itemsPerSecond = static_cast<double>(state.items) / state.realSeconds;
+                result.bytesPerSecond = static_cast<double>(state.bytes) / state.realSeconds;
+            }
+            break;
+        }
+        iterations = std::min(iterations * 10, kMaxIterations);
+    }
+
+    result.peakRssBytes = PeakRssBytes();
+    return result;
+}
+
+void PrintConsoleHeader(std::ostream &output) {
+    output << std::left << std::setw(28) << "Benchmark" << std::right << std::setw(12)
+           << "Time (ms)" << std::setw(12) << "CPU (ms)" << std::setw(12) << "Iterations"
+           << std::setw(14) << "Files/s" << std::setw(12) << "MB/s" << std::setw(14)
+           << "Peak RSS (MB)" << "\n"
+           << std::string(104, '-') << "\n";
+}
+
+void PrintConsoleResult(std::ostream &output, const BenchResult &result) {
+    output << std::left << std::setw(28) << result.name << std::right;
+    if (!result.error.empty()) {
+        output << " ERROR: " << result.error << std::endl;
+        return;
+    }
+    output << std::fixed << std::setprecision(2) << std::setw(12) << result.realSeconds * 1e3
+           << std::setw(12) << result.cpuSeconds * 1e3 << std::setw(12) << result.iterations
+           << std::setw(14) << std::setprecision(0) << result.itemsPerSecond << std::setw(12)
+           << std::setprecision(1) << result.bytesPerSecond / 1e6 << std::setw(14)
+           << static_cast<double>(result.peakRssBytes) / 1e6 << std::endl;
+}
+
+bool WriteJsonReport(const fs::path &path, const BenchContext &context,
+                     const std::vector<BenchResult> &results) {
+    std::ofstream file(path, std::ios::trunc);
+    if (!file) {
+        return false;
+    }
+
+    file << std::setprecision(17);
+    file << "{\n  \"context\": {\n";
+    file << "    \"date\": " << JsonString(context.date) << ",\n";
+    file << "    \"executable\": " << JsonString(context.executable) << ",\n";
+    file << "    \"num_cpus\": " << context.numCpus << ",\n";
+#ifdef NDEBUG
+    file << "    \"library_build_type\": \"release\",\n";
+#else
+    file << "    \"library_build_type\": \"debug\",\n";
+#endif
+    file << "    \"mpqcli_version\": " << JsonString(context.version) << ",\n";
+    file << "    \"corpus_scale\": " << context.corpusScale << "\n";
+    file << "  },\n  \"benchmarks\": [";
+    for (size_t i = 0; i < results.size(); i++) {
+        const BenchResult &result = results[i];
+        file << (i == 0 ? "\n" : ",\n") << "    {\n";
+        file << "      \"name\": " << JsonString(result.name) << ",\n";
+        file << "      \"family_index\": " << i << ",\n";
+        file << "      \"run_name\": " << JsonString(result.name) << ",\n";
+        file << "      \"run_type\": \"iteration\",\n";
+        file << "      \"repetitions\": 1,\n";
+        if (!result.error.empty()) {
+            file << "      \"error_occurred\": true,\n";
+            file << "      \"error_message\": " << JsonString(result.error) << "\n    }";
+            continue;
+        }
+        file << "      \"iterations\": " << result.iterations << ",\n";
+        file << "      \"real_time\": " << result.realSeconds * 1e3 << ",\n";
+        file << "      \"cpu_time\": " << result.cpuSeconds * 1e3 << ",\n";
+        file << "      \"time_unit\": \"ms\",\n";
+        file << "      \"bytes_per_second\": " << result.bytesPerSecond << ",\n";
+        file << "      \"items_per_second\": " << result.itemsPerSecond << ",\n";
+        file << "      \"peak_rss_bytes\": " << result.peakRssBytes << "\n    }";
+    }
+    file << "\n  ]\n}\n";
+    return static_cast<bool>(file.flush());
+}
@@ -0,0 +1,108 @@
+#ifndef HARNESS_H
+#define HARNESS_H
+
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+struct BenchResult;
+
+// Timing state of one benchmark run, used like Google Benchmark's:
+//   for (auto _ : state) { ... }
+// Only the loop body is timed, minus any PauseTiming/ResumeTiming sections.
+class BenchState {
+public:
+    class Iterator {
+    public:
+        struct Value {
+            ~Value() {}  // Non-trivial, so unused loop variables do not warn
+        };
+
+        Iterator(BenchState *state, uint64_t remaining) : state(state), remaining(remaining) {}
+        Value operator*() const { return Value(); }
+        void operator++() { remaining--; }
+        bool operator!=(const Iterator &) {
+            if (remaining > 0 && state->error.empty()) {
+                return true;
+            }
+            state->PauseTiming();
+            return false;
+        }
+
+    private:
+        BenchState *state;
+        uint64_t remaining;
+    };
+
+    explicit BenchState(uint64_t iterations) : iterations(iterations) {}
+
+    Iterator begin() {
+        ResumeTiming();
+        return Iterator(this, iterations);
+    }
+    Iterator end() { return Iterator(this, 0); }
+
+    void PauseTiming();
+    void ResumeTiming();
+    // Totals over all iterations, reported per second
+    void SetItemsProcessed(uint64_t count) { items = count; }
+    void SetBytesProcessed(uint64_t count) { bytes = count; }
+    // Stop the loop and report the case as failed
+    void SkipWithError(const std::string &message) { error = message; }
+
+    [[nodiscard]] uint64_t Iterations() const { return iterations; }
+
+private:
+    friend BenchResult RunBenchmark(const std::string &name,
+                                    const std::function<void(BenchState &)> &function,
+                                    double minSeconds);
+
+    uint64_t iterations;
+    bool running = false;
+    double realSeconds = 0;
+    double cpuSeconds = 0;
+    double realStart = 0;
+    double cpuStart = 0;
+    uint64_t items = 0;
+    uint64_t bytes = 0;
+    std::string error;
+};
+
+// Machine and settings of a run, the "context" object of the JSON report
+struct BenchContext {
+    std::string date;
+    std::string executable;
+    std::string version;
+    unsigned int numCpus = 0;
+    double corpusScale = 1;
+};
+
+struct BenchResult {
+    std::string name;
+    uint64_t iterations = 0;
+    double realSeconds = 0;  // Per iteration
+    double cpuSeconds = 0;   // Per iteration, all threads of the process
+    double itemsPerSecond = 0;
+    double bytesPerSecond = 0;
+    uint64_t peakRssBytes = 0;  // High-water mark of the process after the run
+    std::string error;
+};
+
+// Run a case with 1, 10, 100, ... iterations until one run takes at least minSeconds
+BenchResult RunBenchmark(const std::string &name,
+                         const std::function<void(BenchState &)> &function, double minSeconds);
+
+void PrintConsoleHeader(std::ostream &output);
+void PrintConsoleResult(std::ostream &output, const BenchResult &result);
+
+// Write the results in the JSON layout of Google Benchmark (--benchmark_format=json),
+// with peak_rss_bytes as an additional counter, so its compare tools can read them
+bool WriteJsonReport(const fs::path &path, const BenchContext &context,
+                     const std::vector<BenchResult> &results);
+
+#endif  // HARNESS_H
@@ -0,0 +1,382 @@
+#include <algorithm>
+#include <ctime>
+#include <filesystem>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <optional>
+#include <regex>
+#include <streambuf>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <CLI/CLI.hpp>
+#include <StormLib.h>
+
+#include "corpus.h"
+#include "gamerules.h"
+#include "harness.h"
+#include "helpers.h"
+#include "locales.h"
+#include "mpq.h"
+#include "mpqcli.h"
+
+namespace fs = std::filesystem;
+
+namespace {
+
+// Swallows what the archive functions print, so console output is not part of the timings
+class NullBuffer : public std::streambuf {
+protected:
+    int overflow(int c) override { return traits_type::not_eof(c); }
+    std::streamsize xsputn(const char *, std::streamsize count) override { return count; }
+};
+
+// Keeps the compiler from dropping results that are computed but never used
+volatile DWORD benchSink = 0;
+
+struct BenchCase {
+    std::string name;
+    CorpusKind corpus;
+    std::function<void(BenchState &)> function;
+};
+
+class BenchSuite {
+public:
+    explicit BenchSuite(fs::path root) : root(std::move(root)) {}
+
+    bool PrepareCorpus(CorpusKind kind, double scale) {
+        if (corpora.count(kind) != 0) {
+            return true;
+        }
+        return GenerateCorpus(kind, scale, root, &corpora[kind]);
+    }
+
+    std::vector<BenchCase> Cases() {
+        std::vector<BenchCase> cases;
+        for (CorpusKind kind : {CorpusKind::TINY_FILES, CorpusKind::HUGE_FILES,
+                                CorpusKind::MIXED_EXTENSIONS}) {
+            cases.push_back({"create/" + CorpusName(kind), kind,
+                             [this, kind](BenchState &state) { Create(state, corpora[kind]); }});
+        }
+        cases.push_back({"add/locales", CorpusKind::MULTI_LOCALE, [this](BenchState &state) {
+                             AddLocales(state, corpora[CorpusKind::MULTI_LOCALE]);
+                         }});
+        for (CorpusKind kind : {CorpusKind::TINY_FILES, CorpusKind::HUGE_FILES,
+                                CorpusKind::MIXED_EXTENSIONS, CorpusKind::MULTI_LOCALE}) {
+            const std::string name = CorpusName(kind);
+            cases.push_back({"list_detailed/" + name, kind, [this, kind](BenchState &state) {
+                                 ListDetailed(state, corpora[kind]);
+                             }});
+            cases.push_back({"read/" + name, kind,
+                             [this, kind](BenchState &state) { Read(state, corpora[kind]); }});
+            cases.push_back({"extract/" + name, kind,
+                             [this, kind](BenchState &state) { Extract(state, corpora[kind]); }});
+            cases.push_back({"verify/" + name, kind,
+                             [this, kind](BenchState &state) { Verify(state, corpora[kind]); }});
+        }
+        for (const std::string &profile : GameRules::GetCanonicalProfiles()) {
+            cases.push_back({"rules/" + profile, CorpusKind::MIXED_EXTENSIONS,
+                             [this, profile](BenchState &state) {
+                                 MatchRules(state, corpora[CorpusKind::MIXED_EXTENSIONS],
+                                            profile);
+                             }});
+        }
+        return cases;
+    }
+
+    void Cleanup() {
+        std::error_code ec;
+        fs::remove_all(root / "work", ec);
+    }
+
+private:
+    fs::path root;
+    std::map<CorpusKind, Corpus> corpora;
+    std::map<std::string, fs::path> archives;  // Signed archive of each corpus
+
+    fs::path WorkPath(const std::string &name) {
+        std::error_code ec;
+        fs::create_directories(root / "work", ec);
+        return root / "work" / name;
+    }
+
+    static uint64_t EntryCount(const Corpus &corpus) {
+        return corpus.files.size() * corpus.locales.size();
+    }
+
+    // Archive with every file of a corpus under every locale, with (attributes) and a weak
+    // signature so verify has something to check. Built once, outside of the timings.
+    fs::path Archive(const Corpus &corpus) {
+        auto it = archives.find(corpus.name);
+        if (it != archives.end()) {
+            return it->second;
+        }
+
+        const fs::path archivePath = WorkPath(corpus.name + ".mpq");
+        std::error_code ec;
+        fs::remove(archivePath, ec);
+        GameRules gameRules(GameRules::GetDefaultProfile());
+        MpqCreateSettingsOverrides overrides;
+        overrides.attrFlags = MPQ_ATTRIBUTE_CRC32 | MPQ_ATTRIBUTE_FILETIME | MPQ_ATTRIBUTE_MD5;
+        gameRules.OverrideCreateSettings(overrides);
+
+        const uint32_t maxFiles = NextPowerOfTwo(static_cast<uint32_t>(EntryCount(corpus) + 3));
+        HANDLE hArchive = CreateMpqArchive(archivePath.u8string(), std::max(maxFiles, 32u),
+                                           gameRules);
+        if (hArchive == nullptr) {
+            return fs::path();
+        }
+        for (LCID locale : corpus.locales) {
+            for (const CorpusFile &file : corpus.files) {
+                AddFile(hArchive, file.localPath, file.archivePath, locale, gameRules);
+            }
+        }
+        SignMpqArchive(hArchive);
+        CloseMpqArchive(hArchive);
+        archives[corpus.name] = archivePath;
+        return archivePath;
+    }
+
+    void Create(BenchState &state, const Corpus &corpus) {
+        GameRules gameRules(GameRules::GetDefaultProfile());
+        const fs::path archivePath = WorkPath("create.mpq");
+        const uint32_t maxFiles = CalculateMpqMaxFileValue(corpus.directory.u8string());
+        for (auto _ : state) {
+            state.PauseTiming();
+            std::error_code ec;
+            fs::remove(archivePath, ec);
+            state.ResumeTiming();
+
+            HANDLE hArchive = CreateMpqArchive(archivePath.u8string(), maxFiles, gameRules);
+            if (hArchive == nullptr) {
+                state.SkipWithError("Failed to create MPQ archive");
+                break;
+            }
+            AddFiles(hArchive, corpus.directory.u8string(), defaultLocale, gameRules);
+            CloseMpqArchive(hArchive);
+        }
+        state.SetItemsProcessed(state.Iterations() * corpus.files.size());
+        state.SetBytesProcessed(state.Iterations() * corpus.totalBytes);
+    }
+
+    void AddLocales(BenchState &state, const Corpus &corpus) {
+        GameRules gameRules(GameRules::GetDefaultProfile());
+        const fs::path archivePath = WorkPath("add.mpq");
+        // Start from the minimum hash table, so its growth is part of the timings
+        for (auto _ : state) {
+            state.PauseTiming();
+            std::error_code ec;
+            fs::remove(archivePath, ec);
+            HANDLE hArchive = CreateMpqArchive(archivePath.u8string(), 32, gameRules);
+            state.ResumeTiming();
+
+            if (hArchive == nullptr) {
+                state.SkipWithError("Failed to create MPQ archive");
+                break;
+            }
+            for (LCID locale : corpus.locales) {
+                for (const CorpusFile &file : corpus.files) {
+                    AddFile(hArchive, file.localPath, file.archivePath, locale, gameRules);
+                }
+            }
+            CloseMpqArchive(hArchive);
+        }
+        state.SetItemsProcessed(state.Iterations() * EntryCount(corpus));
+        state.SetBytesProcessed(state.Iterations() * corpus.totalBytes * corpus.locales.size());
+    }
+
+    void ListDetailed(BenchState &state, const Corpus &corpus) {
+        const fs::path archivePath = Archive(corpus);
+        for (auto _ : state) {
+            HANDLE hArchive;
+            if (!OpenMpqArchive(archivePath.u8string(), &hArchive, MPQ_OPEN_READ_ONLY)) {
+                state.SkipWithError("Failed to open MPQ archive");
+                break;
+            }
+            ListFiles(hArchive, std::nullopt, false, true, {});
+            CloseMpqArchive(hArchive);
+        }
+        state.SetItemsProcessed(state.Iterations() * EntryCount(corpus));
+    }
+
+    void Read(BenchState &state, const Corpus &corpus) {
+        const fs::path archivePath = Archive(corpus);
+        HANDLE hArchive;
+        if (!OpenMpqArchive(archivePath.u8string(), &hArchive, MPQ_OPEN_READ_ONLY)) {
+            state.SkipWithError("Failed to open MPQ archive");
+            return;
+        }
+        for (auto _ : state) {
+            for (LCID locale : corpus.locales) {
+                for (const CorpusFile &file : corpus.files) {
+                    unsigned int fileSize = 0;
+                    auto content = ReadFile(hArchive, file.archivePath.c_str(), &fileSize, locale);
+                    if (!content) {
+                        state.SkipWithError("Failed to read " + file.archivePath);
+                        break;
+                    }
+                    benchSink = benchSink + static_cast<unsigned char>(content[0]);
+                }
+            }
+        }
+        CloseMpqArchive(hArchive);
+        state.SetItemsProcessed(state.Iterations() * EntryCount(corpus));
+        state.SetBytesProcessed(state.Iterations() * corpus.totalBytes * corpus.locales.size());
+    }
+
+    void Extract(BenchState &state, const Corpus &corpus) {
+        const fs::path archivePath = Archive(corpus);
+        const fs::path outputPath = WorkPath("extract");
+        for (auto _ : state) {
+            state.PauseTiming();
+            std::error_code ec;
+            fs::remove_all(outputPath, ec);
+            state.ResumeTiming();
+
+            HANDLE hArchive;
+            if (!OpenMpqArchive(archivePath.u8string(), &hArchive, MPQ_OPEN_READ_ONLY)) {
+                state.SkipWithError("Failed to open MPQ archive");
+                break;
+            }
+            ExtractFiles(hArchive, outputPath.u8string(), std::nullopt, defaultLocale, false);
+            CloseMpqArchive(hArchive);
+        }
+        // One locale of every file is extracted
+        state.SetItemsProcessed(state.Iterations() * corpus.files.size());
+        state.SetBytesProcessed(state.Iterations() * corpus.totalBytes);
+    }
+
+    void Verify(BenchState &state, const Corpus &corpus) {
+        const fs::path archivePath = Archive(corpus);
+        std::error_code ec;
+        const uint64_t archiveSize = fs::file_size(archivePath, ec);
+        if (ec) {
+            state.SkipWithError("Failed to create MPQ archive");
+            return;
+        }
+        for (auto _ : state) {
+            HANDLE hArchive;
+            if (!OpenMpqArchive(archivePath.u8string(), &hArchive, MPQ_OPEN_READ_ONLY)) {
+                state.SkipWithError("Failed to open MPQ archive");
+                break;
+            }
+            if (VerifyMpqArchive(hArchive) != ERROR_WEAK_SIGNATURE_OK) {
+                state.SkipWithError("Weak signature did not verify");
+            }
+            CloseMpqArchive(hArchive);
+        }
+        state.SetItemsProcessed(state.Iterations() * EntryCount(corpus));
+        state.SetBytesProcessed(state.Iterations() * archiveSize);
+    }
+
+    static void MatchRules(BenchState &state, const Corpus &corpus, const std::string &profile) {
+        const GameRules gameRules(GameRules::StringToProfile(profile));
+        for (auto _ : state) {
+            for (const CorpusFile &file : corpus.files) {
+                CompressionSettings settings = gameRules.GetCompressionSettings(
+                    file.archivePath, static_cast<DWORD>(file.size));
+                benchSink = benchSink ^ settings.mpqFlags ^ settings.compressionFirst;
+            }
+        }
+        state.SetItemsProcessed(state.Iterations() * corpus.files.size());
+    }
+};
+
+std::string CurrentDate() {
+    std::time_t now = std::time(nullptr);
+    char date[32];
+    std::strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%S%z", std::localtime(&now));
+    return date;
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+    CLI::App app{"Benchmark suite for mpqcli, runs the archive operations on generated corpora"};
+
+    std::string corpusRoot = (fs::temp_directory_path() / "mpqcli_bench").u8string();
+    double scale = 1.0;
+    double minTime = 0.5;
+    std::string filter = ".*";
+    std::optional<std::string> output;
+    bool listCases = false;
+    bool keepWork = false;
+
+    app.add_option("--corpus-dir", corpusRoot, "Directory of the generated corpora (reused)");
+    app.add_option("--scale", scale, "Multiply the corpus file counts and sizes")
+        ->check(CLI::PositiveNumber);
+    app.add_option("--min-time", minTime, "Minimum seconds to run each case")
+        ->check(CLI::NonNegativeNumber);
+    app.add_option("--filter", filter, "Only run cases matching a regular expression");
+    app.add_option("-o,--output", output, "Write the results as JSON");
+    app.add_flag("--list", listCases, "List the cases without running them");
+    app.add_flag("--keep", keepWork, "Keep the archives written by the cases");
+
+    try {
+        app.parse(argc, argv);
+    } catch (const CLI::ParseError &e) {
+        return app.exit(e);
+    }
+
+    BenchSuite suite(fs::u8path(corpusRoot));
+    std::vector<BenchCase> cases;
+    try {
+        const std::regex pattern(filter);
+        for (BenchCase &benchCase : suite.Cases()) {
+            if (std::regex_search(benchCase.name, pattern)) {
+                cases.push_back(std::move(benchCase));
+            }
+        }
+    } catch (const std::regex_error &) {
+        std::cerr << "[!] Invalid filter: " << filter << std::endl;
+        return 1;
+    }
+
+    if (listCases) {
+        for (const BenchCase &benchCase : cases) {
+            std::cout << benchCase.name << std::endl;
+        }
+        return 0;
+    }
+
+    for (const BenchCase &benchCase : cases) {
+        if (!suite.PrepareCorpus(benchCase.corpus, scale)) {
+            return 1;
+        }
+    }
+
+    // Results go to the console, everything the archive functions print goes nowhere
+    std::ostream console(std::cout.rdbuf());
+    NullBuffer nullBuffer;
+    std::cout.rdbuf(&nullBuffer);
+
+    PrintConsoleHeader(console);
+    std::vector<BenchResult> results;
+    bool failed = false;
+    for (const BenchCase &benchCase : cases) {
+        results.push_back(RunBenchmark(benchCase.name, benchCase.function, minTime));
+        PrintConsoleResult(console, results.back());
+        failed |= !results.back().error.empty();
+    }
+    std::cout.rdbuf(console.rdbuf());
+
+    if (!keepWork) {
+        suite.Cleanup();
+    }
+
+    if (output.has_value()) {
+        BenchContext context;
+        context.date = CurrentDate();
+        context.executable = argv[0];
+        context.version = MPQCLI_VERSION;
+        context.numCpus = std::thread::hardware_concurrency();
+        context.corpusScale = scale;
+        if (!WriteJsonReport(fs::u8path(output.value()), context, results)) {
+            std::cerr << "[!] Failed to write results: " << output.value() << std::endl;
+            return 1;
+        }
+    }
+    return failed ? 1 : 0;
+}
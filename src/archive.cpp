@@ -0,0 +1,212 @@
+#include "archive.h"
+
+#include <algorithm>
+#include <set>
+#include <utility>
+#include <vector>
+
+#include "filelookup.h"
+#include "instrumentation.h"
+
+namespace {
+constexpr size_t kExtractChunkBytes = 256 * 1024;  // Handed to the sink at a time
+}  // namespace
+
+struct MpqEntryIterator::State {
+    HANDLE hArchive = nullptr;
+    HANDLE findHandle = nullptr;
+    SFILE_FIND_DATA findData{};
+    bool found = false;               // findData holds a name not yet expanded
+    std::set<std::string> seenNames;  // The search returns a name once per locale
+    std::vector<MpqEntryInfo> entries;
+    size_t nextEntry = 0;
+    MpqEntry entry;
+
+    ~State() {
+        if (findHandle != nullptr) {
+            SFileFindClose(findHandle);
+        }
+    }
+
+    // Move to the next locale of the current name, or the first of the next name
+    bool Advance() {
+        while (nextEntry >= entries.size()) {
+            if (!found) {
+                return false;
+            }
+            std::string name = findData.cFileName;
+            found = SFileFindNextFile(findHandle, &findData);
+            if (!seenNames.insert(name).second) {
+                continue;
+            }
+            entries = GetFileEntries(hArchive, name.c_str());
+            nextEntry = 0;
+            entry.name = std::move(name);
+        }
+        entry.info = entries[nextEntry++];
+        return true;
+    }
+};
+
+MpqEntryIterator::MpqEntryIterator(HANDLE hArchive,
+                                   const std::optional<std::string> &listfileName)
+    : state(std::make_shared<State>()) {
+    state->hArchive = hArchive;
+    state->findHandle =
+        SFileFindFirstFile(hArchive, "*", &state->findData,
+                           listfileName.has_value() ? listfileName->c_str() : nullptr);
+    state->found = state->findHandle != nullptr;
+    if (!state->Advance()) {
+        state.reset();
+    }
+}
+
+MpqEntryIterator::reference MpqEntryIterator::operator*() const { return state->entry; }
+
+MpqEntryIterator &MpqEntryIterator::operator++() {
+    if (!state->Advance()) {
+        state.reset();
+    }
+    return *this;
+}
+
+MpqArchive::~MpqArchive() { Close(); }
+
+MpqArchive::MpqArchive(MpqArchive &&other) noexcept
+    : hArchive(std::exchange(other.hArchive, nullptr)) {}
+
+MpqArchive &MpqArchive::operator=(MpqArchive &&other) noexcept {
+    if (this != &other) {
+        Close();
+        hArchive = std::exchange(other.hArchive, nullptr);
+    }
+    return *this;
+}
+
+bool MpqArchive::Open(const std::string &path, int32_t flags, bool useMmap) {
+    Close();
+    PhaseSpan span("open");
+    if (useMmap) {
+        // StormLib copies sectors out of the mapping instead of issuing a read for each
+        flags |= MPQ_OPEN_READ_ONLY;
+        if (SFileOpenArchive(path.c_str(), 0, flags | STREAM_PROVIDER_FLAT | BASE_PROVIDER_MAP,
+                             &hArchive)) {
+            return true;
+        }
+        // Mapping can fail where reading does not, so fall back to plain reads
+    }
+    if (!SFileOpenArchive(path.c_str(), 0, flags, &hArchive)) {
+        hArchive = nullptr;
+        return false;
+    }
+    return true;
+}
+
+bool MpqArchive::Create(const std::string &path, uint32_t fileCount,
+                        const GameRules &gameRules) {
+    Close();
+    hArchive = CreateMpqArchive(path, fileCount, gameRules);
+    return hArchive != nullptr;
+}
+
+bool MpqArchive::Close() {
+    if (hArchive == nullptr) {
+        return true;
+    }
+    PhaseSpan span("close");
+    return SFileCloseArchive(std::exchange(hArchive, nullptr));
+}
+
+MpqArchiveInfo MpqArchive::Info() const { return GetMpqArchiveInfo(hArchive); }
+
+std::optional<MpqEntryInfo> MpqArchive::Find(const std::string &name, LCID locale) const {
+    HANDLE hFile;
+    if (!OpenFileForLocale(hArchive, name.c_str(), locale, &hFile)) {
+        return std::nullopt;
+    }
+    MpqEntryInfo info = GetEntryInfo(hFile);
+    SFileCloseFile(hFile);
+    return info;
+}
+
+std::optional<size_t> MpqArchive::Read(const std::string &name, char *buffer, size_t size,
+                                       uint64_t offset, LCID locale) const {
+    HANDLE hFile;
+    if (!OpenFileForLocale(hArchive, name.c_str(), locale, &hFile)) {
+        return std::nullopt;
+    }
+
+    LONG offsetHigh = static_cast<LONG>(offset >> 32);
+    SFileSetFilePointer(hFile, static_cast<LONG>(offset & 0xFFFFFFFF), &offsetHigh, FILE_BEGIN);
+    size_t total = 0;
+    bool failed = false;
+    // SFileReadFile takes a DWORD length, larger buffers are filled in pieces
+    while (total < size) {
+        const auto length = static_cast<DWORD>(std::min<size_t>(size - total, 1u << 30));
+        DWORD bytesRead = 0;
+        PhaseSpan span("decompress");
+        const bool ok = SFileReadFile(hFile, buffer + total, length, &bytesRead, nullptr);
+        total += bytesRead;
+        if (!ok) {
+            // Reading past the end is not an error, the caller gets what there was
+            failed = SErrGetLastError() != ERROR_HANDLE_EOF;
+            break;
+        }
+    }
+    SFileCloseFile(hFile);
+    if (failed) {
+        return std::nullopt;
+    }
+    return total;
+}
+
+bool MpqArchive::Extract(const std::string &name, const ExtractSink &sink, LCID locale) const {
+    HANDLE hFile;
+    if (!OpenFileForLocale(hArchive, name.c_str(), locale, &hFile)) {
+        return false;
+    }
+
+    std::vector<char> buffer(kExtractChunkBytes);
+    uint64_t total = 0;
+    bool ok = true;
+    while (ok) {
+        DWORD bytesRead = 0;
+        bool read;
+        {
+            PhaseSpan span("decompress");
+            read = SFileReadFile(hFile, buffer.data(), static_cast<DWORD>(buffer.size()),
+                                 &bytesRead, nullptr);
+        }
+        if (!read && SErrGetLastError() != ERROR_HANDLE_EOF) {
+            ok = false;
+            break;
+        }
+        if (bytesRead > 0) {
+            ok = sink(buffer.data(), bytesRead);
+            total += bytesRead;
+        }
+        if (!read || bytesRead < buffer.size()) {
+            break;  // The end of the file
+        }
+    }
+    SFileCloseFile(hFile);
+    if (ok) {
+        CountFile(total);
+    }
+    return ok;
+}
+
+bool MpqArchive::Add(const fs::path &localFile, const std::string &archiveFilePath,
+                     LCID locale, const GameRules &gameRules,
+                     const CompressionSettingsOverrides &overrides, bool overwrite) {
+    return AddFile(hArchive, localFile, archiveFilePath, locale, gameRules, overrides,
+                   overwrite) == 0;
+}
+
+bool MpqArchive::Remove(const std::string &archiveFilePath, LCID locale) {
+    return RemoveFile(hArchive, archiveFilePath, locale) == 0;
+}
+
+bool MpqArchive::Sign() { return SignMpqArchive(hArchive); }
+
+uint32_t MpqArchive::Verify() const { return VerifyMpqArchive(hArchive); }
@@ -0,0 +1,122 @@
+#ifndef ARCHIVE_H
+#define ARCHIVE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <optional>
+#include <string>
+
+#include <StormLib.h>
+
+#include "gamerules.h"
+#include "locales.h"
+#include "mpq.h"
+
+// One file of an archive, under one of the locales it is stored with
+struct MpqEntry {
+    std::string name;
+    MpqEntryInfo info;
+};
+
+// Receives the data of a file in order, a piece at a time. Returning false stops the
+// extraction.
+using ExtractSink = std::function<bool(const char *data, size_t size)>;
+
+// Walks the files named by the archive's listfile (or an external one), yielding an
+// entry for each locale a name is stored under. An input iterator: copies share their
+// position, and advancing one advances them all.
+class MpqEntryIterator {
+public:
+    using iterator_category = std::input_iterator_tag;
+    using value_type = MpqEntry;
+    using difference_type = std::ptrdiff_t;
+    using pointer = const MpqEntry *;
+    using reference = const MpqEntry &;
+
+    MpqEntryIterator() = default;  // The end
+    MpqEntryIterator(HANDLE hArchive, const std::optional<std::string> &listfileName);
+
+    reference operator*() const;
+    pointer operator->() const { return &**this; }
+    MpqEntryIterator &operator++();
+
+    bool operator==(const MpqEntryIterator &other) const { return state == other.state; }
+    bool operator!=(const MpqEntryIterator &other) const { return state != other.state; }
+
+private:
+    struct State;
+    std::shared_ptr<State> state;  // Null at the end
+};
+
+class MpqEntryRange {
+public:
+    MpqEntryRange(HANDLE hArchive, std::optional<std::string> listfileName)
+        : hArchive(hArchive), listfileName(std::move(listfileName)) {}
+
+    MpqEntryIterator begin() const { return MpqEntryIterator(hArchive, listfileName); }
+    MpqEntryIterator end() const { return {}; }
+
+private:
+    HANDLE hArchive;
+    std::optional<std::string> listfileName;
+};
+
+// An open MPQ archive, closed when it goes out of scope. This is the in-process API of
+// libmpqcli: it hands back data rather than printing it. Failures return false or an
+// empty optional, with the reason in SErrGetLastError. Create, Add and Remove share
+// the code of the commands, which print errors to stderr and a line per file through
+// LogFile (silenced by StartLogging(LogLevel::QUIET)).
+class MpqArchive {
+public:
+    MpqArchive() = default;
+    ~MpqArchive();
+
+    MpqArchive(MpqArchive &&other) noexcept;
+    MpqArchive &operator=(MpqArchive &&other) noexcept;
+    MpqArchive(const MpqArchive &) = delete;
+    MpqArchive &operator=(const MpqArchive &) = delete;
+
+    // Open an existing archive with SFileOpenArchive flags. Read-only archives can be
+    // read through a memory mapping of the whole file.
+    bool Open(const std::string &path, int32_t flags = MPQ_OPEN_READ_ONLY, bool useMmap = false);
+    // Create a new archive with room for fileCount files, using the game's create settings
+    bool Create(const std::string &path, uint32_t fileCount, const GameRules &gameRules);
+    // Close the archive, writing the tables of a changed one. Safe to call twice.
+    bool Close();
+
+    bool IsOpen() const { return hArchive != nullptr; }
+    // For StormLib calls the class does not cover. Stays owned by the archive.
+    HANDLE Handle() const { return hArchive; }
+
+    MpqArchiveInfo Info() const;
+    MpqEntryRange Entries(const std::optional<std::string> &listfileName = std::nullopt) const {
+        return MpqEntryRange(hArchive, listfileName);
+    }
+    // The file StormLib picks for the locale, which falls back to the neutral locale
+    std::optional<MpqEntryInfo> Find(const std::string &name, LCID locale = defaultLocale) const;
+
+    // Read up to size bytes of a file, from offset on, into the caller's buffer. Returns
+    // the number of bytes read, fewer than size only at the end of the file.
+    std::optional<size_t> Read(const std::string &name, char *buffer, size_t size,
+                               uint64_t offset = 0, LCID locale = defaultLocale) const;
+    // Decompress a whole file through a sink, without holding all of it in memory
+    bool Extract(const std::string &name, const ExtractSink &sink,
+                 LCID locale = defaultLocale) const;
+
+    bool Add(const fs::path &localFile, const std::string &archiveFilePath, LCID locale,
+             const GameRules &gameRules,
+             const CompressionSettingsOverrides &overrides = CompressionSettingsOverrides(),
+             bool overwrite = false);
+    bool Remove(const std::string &archiveFilePath, LCID locale = defaultLocale);
+    bool Sign();
+    // One of the ERROR_*_SIGNATURE_* codes of SFileVerifyArchive
+    uint32_t Verify() const;
+
+private:
+    HANDLE hArchive = nullptr;
+};
+
+#endif  // ARCHIVE_H
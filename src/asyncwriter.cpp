@@ -0,0 +1,220 @@
+#include "asyncwriter.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <iostream>
+#include <vector>
+
+#ifdef MPQCLI_WITH_IO_URING
+#include <fcntl.h>
+#include <liburing.h>
+
+#include <cerrno>
+#endif
+
+#include "logging.h"
+
+#ifdef MPQCLI_WITH_IO_URING
+namespace {
+constexpr unsigned int kWindowFiles = 64;          // Direct descriptor slots
+constexpr size_t kWindowBytes = 256 * 1024 * 1024;  // Decompressed data waiting to be written
+constexpr size_t kMaxWriteBytes = 1024 * 1024 * 1024;  // Linux writes at most 2 GiB at once
+
+enum Operation : uint64_t { kOpen = 0, kWrite = 1, kClose = 2 };
+
+struct PendingFile {
+    std::string path;
+    std::string displayName;
+    std::unique_ptr<char[]> data;
+    size_t size = 0;
+    size_t written = 0;
+    int inFlight = 0;  // Operations queued and not completed yet
+    bool opened = false;
+    bool closing = false;
+    int error = 0;
+};
+}  // namespace
+
+struct AsyncFileWriter::Ring {
+    io_uring ring{};
+    bool initialized = false;
+    std::vector<std::unique_ptr<PendingFile>> slots;  // Indexed by direct descriptor
+    std::vector<unsigned int> freeSlots;
+    size_t inFlightBytes = 0;
+    int failures = 0;
+
+    ~Ring() {
+        if (initialized) {
+            io_uring_queue_exit(&ring);
+        }
+    }
+
+    [[nodiscard]] bool Busy() const { return freeSlots.size() < slots.size(); }
+
+    io_uring_sqe *Queue(unsigned int slot, Operation operation) {
+        io_uring_sqe *sqe = io_uring_get_sqe(&ring);
+        if (sqe == nullptr) {  // Cannot happen, the ring has room for every slot
+            io_uring_submit(&ring);
+            sqe = io_uring_get_sqe(&ring);
+        }
+        io_uring_sqe_set_data64(sqe, (static_cast<uint64_t>(slot) << 2) | operation);
+        slots[slot]->inFlight++;
+        return sqe;
+    }
+
+    // Write the data not written yet, from where the previous write stopped
+    void QueueWrite(unsigned int slot) {
+        PendingFile &file = *slots[slot];
+        const size_t length = std::min(file.size - file.written, kMaxWriteBytes);
+        io_uring_sqe *sqe = Queue(slot, kWrite);
+        io_uring_prep_write(sqe, static_cast<int>(slot), file.data.get() + file.written,
+                            static_cast<unsigned int>(length), file.written);
+        sqe->flags |= IOSQE_FIXED_FILE;
+    }
+
+    // Called once every queued operation of a file has completed
+    void Advance(unsigned int slot) {
+        PendingFile &file = *slots[slot];
+        if (file.opened && !file.closing) {
+            if (file.error == 0 && file.written < file.size) {
+                QueueWrite(slot);  // A short write, continue with the rest
+            } else {
+                // Closed exactly once, the direct descriptor is released even if it fails
+                io_uring_prep_close_direct(Queue(slot, kClose), slot);
+                file.closing = true;
+            }
+            io_uring_submit(&ring);
+            return;
+        }
+
+        if (file.error != 0) {
+            std::cerr << "[!] Failed: (" << file.error << ") " << file.displayName << std::endl;
+            failures++;
+        } else {
+            LogFile("[*] Extracted: " + file.displayName);
+        }
+        inFlightBytes -= file.size;
+        slots[slot].reset();
+        freeSlots.push_back(slot);
+    }
+
+    // Handle completions, waiting for at least one if wait is set
+    void Reap(bool wait) {
+        io_uring_cqe *cqe;
+        int result = wait ? io_uring_wait_cqe(&ring, &cqe) : io_uring_peek_cqe(&ring, &cqe);
+        while (result == 0) {
+            const uint64_t userData = io_uring_cqe_get_data64(cqe);
+            const auto slot = static_cast<unsigned int>(userData >> 2);
+            const auto operation = static_cast<Operation>(userData & 3);
+            const int res = cqe->res;
+            io_uring_cqe_seen(&ring, cqe);
+
+            PendingFile &file = *slots[slot];
+            if (operation == kOpen) {
+                file.opened = res >= 0;
+            } else if (operation == kClose) {
+                file.opened = false;
+            } else if (res > 0) {
+                file.written += static_cast<size_t>(res);
+            } else if (res == 0 && file.written < file.size && file.error == 0) {
+                file.error = EIO;  // The write made no progress
+            }
+            if (file.error == 0 && res < 0 && res != -ECANCELED) {
+                file.error = -res;
+            }
+            if (--file.inFlight == 0) {
+                Advance(slot);
+            }
+            result = io_uring_peek_cqe(&ring, &cqe);
+        }
+    }
+};
+
+AsyncFileWriter::AsyncFileWriter() = default;
+
+AsyncFileWriter::~AsyncFileWriter() { Finish(); }
+
+bool AsyncFileWriter::Start() {
+    auto newRing = std::make_unique<Ring>();
+    if (io_uring_queue_init(kWindowFiles * 4, &newRing->ring, 0) < 0) {
+        return false;  // Kernel without io_uring, or disabled by seccomp or sysctl
+    }
+    newRing->initialized = true;
+
+    // Direct descriptors (Linux 5.15) let the write and close refer to the opened file
+    io_uring_probe *probe = io_uring_get_probe_ring(&newRing->ring);
+    const bool supported = probe != nullptr && io_uring_opcode_supported(probe, IORING_OP_OPENAT) &&
+                           io_uring_opcode_supported(probe, IORING_OP_WRITE) &&
+                           io_uring_opcode_supported(probe, IORING_OP_CLOSE);
+    if (probe != nullptr) {
+        io_uring_free_probe(probe);
+    }
+    if (!supported || io_uring_register_files_sparse(&newRing->ring, kWindowFiles) < 0) {
+        return false;
+    }
+
+    newRing->slots.resize(kWindowFiles);
+    for (unsigned int slot = kWindowFiles; slot > 0; slot--) {
+        newRing->freeSlots.push_back(slot - 1);
+    }
+    ring = std::move(newRing);
+    return true;
+}
+
+void AsyncFileWriter::Write(const std::string &path, std::unique_ptr<char[]> data, size_t size,
+                            const std::string &displayName) {
+    while (ring->freeSlots.empty() || (ring->Busy() && ring->inFlightBytes + size > kWindowBytes)) {
+        ring->Reap(true);
+    }
+
+    const unsigned int slot = ring->freeSlots.back();
+    ring->freeSlots.pop_back();
+    auto file = std::make_unique<PendingFile>();
+    file->path = path;
+    file->displayName = displayName;
+    file->data = std::move(data);
+    file->size = size;
+    ring->inFlightBytes += size;
+    ring->slots[slot] = std::move(file);
+
+    // The first write only runs once the open succeeded, the close is queued when done
+    io_uring_sqe *sqe = ring->Queue(slot, kOpen);
+    io_uring_prep_openat_direct(sqe, AT_FDCWD, ring->slots[slot]->path.c_str(),
+                                O_WRONLY | O_CREAT | O_TRUNC, 0644, slot);
+    sqe->flags |= IOSQE_IO_LINK;
+    ring->QueueWrite(slot);
+
+    io_uring_submit(&ring->ring);
+    ring->Reap(false);
+}
+
+int AsyncFileWriter::Finish() {
+    if (ring == nullptr) {
+        return 0;
+    }
+    while (ring->Busy()) {
+        ring->Reap(true);
+    }
+    const int failures = ring->failures;
+    ring->failures = 0;
+    return failures;
+}
+#else
+struct AsyncFileWriter::Ring {};
+
+AsyncFileWriter::AsyncFileWriter() = default;
+
+AsyncFileWriter::~AsyncFileWriter() = default;
+
+bool AsyncFileWriter::Start() { return false; }
+
+void AsyncFileWriter::Write(const std::string &path, std::unique_ptr<char[]> data, size_t size,
+                            const std::string &displayName) {
+    (void)path;
+    (void)data;
+    (void)size;
+    (void)displayName;
+}
+
+int AsyncFileWriter::Finish() { return 0; }
+#endif
@@ -0,0 +1,36 @@
+#ifndef ASYNCWRITER_H
+#define ASYNCWRITER_H
+
+#include <cstddef>
+#include <memory>
+#include <string>
+
+// Writes whole files in the background using io_uring (Linux), so the caller can
+// keep decompressing while output files are opened, written and closed. Each file
+// is opened and written by linked operations, written on after a short write and
+// then closed once, with a bounded number of files and bytes in flight. Start fails
+// where io_uring is unavailable, and callers then write files themselves.
+class AsyncFileWriter {
+public:
+    AsyncFileWriter();
+    ~AsyncFileWriter();
+
+    AsyncFileWriter(const AsyncFileWriter &) = delete;
+    AsyncFileWriter &operator=(const AsyncFileWriter &) = delete;
+
+    bool Start();
+
+    // Queue a file, waiting while the in-flight window is full. The display name is
+    // printed once the file is written.
+    void Write(const std::string &path, std::unique_ptr<char[]> data, size_t size,
+               const std::string &displayName);
+
+    // Wait for all queued files, returns the number of files that failed
+    int Finish();
+
+private:
+    struct Ring;
+    std::unique_ptr<Ring> ring;
+};
+
+#endif  // ASYNCWRITER_H
@@ -0,0 +1,135 @@
+#include "atomicwrite.h"
+
+#include <iostream>
+#include <system_error>
+
+#if defined(__linux__)
+#include <fcntl.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#ifndef FICLONE
+#define FICLONE _IOW(0x94, 9, int)  // From linux/fs.h, which musl toolchains may lack
+#endif
+#elif defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/clonefile.h>
+#include <unistd.h>
+#endif
+
+bool CloneFile(const fs::path &source, const fs::path &destination) {
+#if defined(__linux__)
+    int sourceFd = open(source.c_str(), O_RDONLY);
+    if (sourceFd < 0) {
+        return false;
+    }
+    struct stat sourceStat {};
+    if (fstat(sourceFd, &sourceStat) != 0) {
+        close(sourceFd);
+        return false;
+    }
+    int destinationFd = open(destination.c_str(), O_WRONLY | O_CREAT | O_EXCL,
+                             sourceStat.st_mode & 07777);
+    if (destinationFd < 0) {
+        close(sourceFd);
+        return false;
+    }
+
+    const bool cloned = ioctl(destinationFd, FICLONE, sourceFd) == 0;
+    close(destinationFd);
+    close(sourceFd);
+    if (!cloned) {
+        std::error_code error;
+        fs::remove(destination, error);
+    }
+    return cloned;
+#elif defined(__APPLE__)
+    return clonefile(source.c_str(), destination.c_str(), 0) == 0;
+#else
+    (void)source;
+    (void)destination;
+    return false;
+#endif
+}
+
+// Flush a file or directory to disk, so the rename of a file is not persisted before its
+// data, and the rename itself survives a crash. Windows is not handled.
+static bool SyncPath(const fs::path &path) {
+#if defined(__linux__) || defined(__APPLE__)
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+#if defined(__APPLE__)
+    // fsync leaves the data in the drive cache on macOS
+    const bool synced = fcntl(fd, F_FULLFSYNC) == 0 || fsync(fd) == 0;
+#else
+    const bool synced = fsync(fd) == 0;
+#endif
+    close(fd);
+    return synced;
+#else
+    (void)path;
+    return true;
+#endif
+}
+
+AtomicArchiveWrite::AtomicArchiveWrite(const std::string &target)
+    : targetPath(fs::u8path(target)), workingPath(fs::u8path(target + ".atomic")) {}
+
+AtomicArchiveWrite::~AtomicArchiveWrite() {
+    // An uncommitted working copy is discarded, leaving the target untouched
+    if (active) {
+        std::error_code error;
+        fs::remove(workingPath, error);
+    }
+}
+
+bool AtomicArchiveWrite::Begin() {
+    // The working copy doubles as a lock against concurrent atomic writers. One left by an
+    // interrupted run looks the same, so it is never overwritten or removed here.
+    if (fs::exists(workingPath)) {
+        std::cerr << "[!] Another atomic write is in progress, or was interrupted: "
+                  << workingPath.u8string() << std::endl;
+        std::cerr << "[!] Remove the working copy if no other mpqcli is using the archive."
+                  << std::endl;
+        return false;
+    }
+
+    if (!CloneFile(targetPath, workingPath)) {
+        std::error_code error;
+        if (!fs::copy_file(targetPath, workingPath, error)) {
+            std::cerr << "[!] Failed to copy MPQ archive: " << targetPath.u8string() << " ("
+                      << error.message() << ")" << std::endl;
+            return false;
+        }
+    }
+    active = true;
+    return true;
+}
+
+bool AtomicArchiveWrite::Commit() {
+    // Without this, a crash after the rename can leave an empty or torn archive
+    if (!SyncPath(workingPath)) {
+        std::cerr << "[!] Failed to flush the working copy to disk: " << workingPath.u8string()
+                  << std::endl;
+        return false;
+    }
+
+    std::error_code error;
+    fs::rename(workingPath, targetPath, error);
+    if (error) {
+        std::cerr << "[!] Failed to replace MPQ archive: " << targetPath.u8string() << " ("
+                  << error.message() << ")" << std::endl;
+        return false;
+    }
+    active = false;
+
+    const fs::path directory = targetPath.has_parent_path() ? targetPath.parent_path() : ".";
+    if (!SyncPath(directory)) {
+        std::cerr << "[!] Warning: The archive was replaced, but its directory could not be "
+                     "flushed to disk: "
+                  << directory.u8string() << std::endl;
+    }
+    return true;
+}
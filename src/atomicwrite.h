@@ -0,0 +1,39 @@
+#ifndef ATOMICWRITE_H
+#define ATOMICWRITE_H
+
+#include <filesystem>
+#include <string>
+
+namespace fs = std::filesystem;
+
+// Create destination sharing the data blocks of source instead of copying them, which is
+// instant on filesystems with reflink support (Btrfs, XFS, APFS). False where unsupported.
+bool CloneFile(const fs::path &source, const fs::path &destination);
+
+// Copy-on-write update of an archive. Changes are made to a working copy next to
+// the target (a reflink clone where the filesystem supports it), which is renamed
+// over the target on Commit. Readers of the target always see a complete archive.
+class AtomicArchiveWrite {
+public:
+    explicit AtomicArchiveWrite(const std::string &target);
+    ~AtomicArchiveWrite();
+
+    AtomicArchiveWrite(const AtomicArchiveWrite &) = delete;
+    AtomicArchiveWrite &operator=(const AtomicArchiveWrite &) = delete;
+
+    // Create the working copy. Fails if another atomic write to the target is running.
+    bool Begin();
+
+    // Replace the target with the working copy
+    bool Commit();
+
+    // Path of the working copy to open for writing
+    [[nodiscard]] std::string Path() const { return workingPath.u8string(); }
+
+private:
+    fs::path targetPath;
+    fs::path workingPath;
+    bool active = false;  // Working copy exists and is not committed yet
+};
+
+#endif  // ATOMICWRITE_H
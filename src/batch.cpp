@@ -0,0 +1,336 @@
+#include "batch.h"
+
+#include <cctype>
+#include <map>
+#include <sstream>
+#include <vector>
+
+#include <StormLib.h>
+
+#include "gamerules.h"
+#include "helpers.h"
+#include "locales.h"
+#include "mpq.h"
+
+namespace {
+using BatchArguments = std::map<std::string, std::string>;
+
+// Names of the positional arguments of plain text commands, these are also the keys
+// used in NDJSON commands
+const std::map<std::string, std::vector<std::string>> kBatchCommands = {
+    {"read", {"file", "locale"}},
+    {"list", {"options", "properties"}},
+    {"extract", {"file", "output", "locale"}},
+    {"add", {"path", "name", "locale"}},
+    {"remove", {"file", "locale"}},
+};
+
+// Redirects std::cout and std::cerr into buffers while a command runs, so messages
+// printed by the command end up in its response instead of the framed output
+class CaptureOutput {
+public:
+    CaptureOutput()
+        : coutBuffer(std::cout.rdbuf(messages.rdbuf())),
+          cerrBuffer(std::cerr.rdbuf(messages.rdbuf())) {}
+    ~CaptureOutput() {
+        std::cout.rdbuf(coutBuffer);
+        std::cerr.rdbuf(cerrBuffer);
+    }
+
+    CaptureOutput(const CaptureOutput &) = delete;
+    CaptureOutput &operator=(const CaptureOutput &) = delete;
+
+    [[nodiscard]] std::string Messages() const { return messages.str(); }
+
+private:
+    std::ostringstream messages;
+    std::streambuf *coutBuffer;
+    std::streambuf *cerrBuffer;
+};
+
+void AppendUtf8(std::string &out, unsigned int codePoint) {
+    if (codePoint < 0x80) {
+        out += static_cast<char>(codePoint);
+    } else if (codePoint < 0x800) {
+        out += static_cast<char>(0xC0 | (codePoint >> 6));
+        out += static_cast<char>(0x80 | (codePoint & 0x3F));
+    } else {
+        out += static_cast<char>(0xE0 | (codePoint >> 12));
+        out += static_cast<char>(0x80 | ((codePoint >> 6) & 0x3F));
+        out += static_cast<char>(0x80 | (codePoint & 0x3F));
+    }
+}
+
+// Parse a flat JSON object with string values, which is all batch commands need
+bool ParseJsonObject(const std::string &line, BatchArguments *arguments) {
+    size_t pos = 0;
+    auto skipSpace = [&]() {
+        while (pos < line.size() && std::isspace(static_cast<unsigned char>(line[pos]))) {
+            pos++;
+        }
+    };
+    auto parseString = [&](std::string *value) {
+        if (pos >= line.size() || line[pos] != '"') {
+            return false;
+        }
+        for (pos++; pos < line.size(); pos++) {
+            char c = line[pos];
+            if (c == '"') {
+                pos++;
+                return true;
+            }
+            if (c != '\\') {
+                *value += c;
+                continue;
+            }
+            if (++pos >= line.size()) {
+                return false;
+            }
+            switch (line[pos]) {
+                case 'n':
+                    *value += '\n';
+                    break;
+                case 't':
+                    *value += '\t';
+                    break;
+                case 'r':
+                    *value += '\r';
+                    break;
+                case 'b':
+                    *value += '\b';
+                    break;
+                case 'f':
+                    *value += '\f';
+                    break;
+                case 'u': {
+                    const std::string hex = line.substr(pos + 1, 4);
+                    if (hex.size() != 4 ||
+                        hex.find_first_not_of("0123456789abcdefABCDEF") != std::string::npos) {
+                        return false;
+                    }
+                    AppendUtf8(*value, std::stoul(hex, nullptr, 16));
+                    pos += 4;
+                    break;
+                }
+                default:  // \" \\ and \/
+                    *value += line[pos];
+                    break;
+            }
+        }
+        return false;
+    };
+
+    skipSpace();
+    if (pos >= line.size() || line[pos++] != '{') {
+        return false;
+    }
+    skipSpace();
+    if (pos < line.size() && line[pos] == '}') {
+        return true;
+    }
+    while (pos < line.size()) {
+        std::string key;
+        std::string value;
+        skipSpace();
+        if (!parseString(&key)) {
+            return false;
+        }
+        skipSpace();
+        if (pos >= line.size() || line[pos++] != ':') {
+            return false;
+        }
+        skipSpace();
+        if (!parseString(&value)) {
+            return false;
+        }
+        (*arguments)[key] = value;
+        skipSpace();
+        if (pos < line.size() && line[pos] == ',') {
+            pos++;
+        } else if (pos < line.size() && line[pos] == '}') {
+            return true;
+        } else {
+            return false;
+        }
+    }
+    return false;
+}
+
+void WriteResponse(std::ostream &output, bool json, bool ok, const std::string &payload) {
+    if (json) {
+        output << "{\"status\":\"" << (ok ? "ok" : "error") << "\",\"length\":" << payload.size()
+               << "}\n";
+    } else {
+        output << (ok ? "ok " : "error ") << payload.size() << "\n";
+    }
+    output.write(payload.data(), static_cast<std::streamsize>(payload.size()));
+    output.flush();
+}
+
+// Flags of the list subcommand in one token, like -a, -d or -ad
+bool ParseListOptions(const std::string &options, bool *listAll, bool *listDetailed) {
+    if (options.empty()) {
+        return true;
+    }
+    if (options.size() < 2 || options.front() != '-') {
+        return false;
+    }
+    for (size_t i = 1; i < options.size(); i++) {
+        if (options[i] == 'a') {
+            *listAll = true;
+        } else if (options[i] == 'd') {
+            *listDetailed = true;
+        } else {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Run one command, the payload is the file content for read and the printed messages
+// for every other command
+bool RunCommand(HANDLE hArchive, const std::string &command, const BatchArguments &arguments,
+                const std::optional<std::string> &listfileName, const GameRules &gameRules,
+                std::string *payload) {
+    auto argument = [&arguments](const std::string &key) {
+        auto it = arguments.find(key);
+        return it == arguments.end() ? std::string() : it->second;
+    };
+    const std::string locale = argument("locale");
+    const LCID lcid = locale.empty() ? defaultLocale : LangToLocale(locale);
+
+    CaptureOutput capture;
+    int result = 0;
+    if (command == "read") {
+        unsigned int fileSize;
+        auto fileContent = ReadFile(hArchive, argument("file").c_str(), &fileSize, lcid);
+        if (fileContent) {
+            payload->assign(fileContent.get(), fileSize);
+            return true;
+        }
+        result = 1;
+
+    } else if (command == "list") {
+        bool listAll = false;
+        bool listDetailed = false;
+        std::vector<std::string> properties;
+        std::istringstream propertyList(argument("properties"));
+        for (std::string property; std::getline(propertyList, property, ',');) {
+            properties.push_back(property);
+        }
+        if (ParseListOptions(argument("options"), &listAll, &listDetailed)) {
+            result = ListFiles(hArchive, listfileName, listAll, listDetailed, properties);
+        } else {
+            std::cerr << "[!] Unknown list options, expected -a, -d or both: "
+                      << argument("options") << std::endl;
+            result = 1;
+        }
+
+    } else if (command == "extract") {
+        const std::string output = argument("output").empty() ? "." : argument("output");
+        result = ExtractFile(hArchive, output, argument("file"), true, lcid);
+
+    } else if (command == "add") {
+        const fs::path localFile = fs::u8path(argument("path"));
+        const std::string name = argument("name").empty()
+                                     ? WindowsifyFilePath(localFile.filename())
+                                     : argument("name");
+        result = AddFile(hArchive, localFile, name, lcid, gameRules);
+
+    } else if (command == "remove") {
+        result = RemoveFile(hArchive, argument("file"), lcid);
+    }
+
+    *payload = capture.Messages();
+    return result == 0;
+}
+}  // namespace
+
+// Quotes are dropped from the tokens, so quoted and unquoted names are equivalent
+bool TokenizeBatchCommand(const std::string &line, std::vector<std::string> *tokens) {
+    std::string token;
+    bool inToken = false;
+    bool inQuotes = false;
+    for (char c : line) {
+        if (c == '"') {
+            inQuotes = !inQuotes;
+            inToken = true;
+        } else if (!inQuotes && (c == ' ' || c == '\t' || c == '\r')) {
+            if (inToken) {
+                tokens->push_back(token);
+                token.clear();
+                inToken = false;
+            }
+        } else {
+            token += c;
+            inToken = true;
+        }
+    }
+    if (inToken) {
+        tokens->push_back(token);
+    }
+    return !inQuotes;
+}
+
+int RunBatch(HANDLE hArchive, std::istream &input, std::ostream &output, bool json,
+             bool readOnly, const std::optional<std::string> &listfileName) {
+    SetBinaryStdout();
+    // Responses go to the original stream, even while std::cout is captured
+    std::ostream responses(output.rdbuf());
+    const GameRules gameRules(GameRules::GetDefaultProfile());
+
+    int result = 0;
+    std::string line;
+    while (std::getline(input, line)) {
+        std::string command;
+        BatchArguments arguments;
+        if (json) {
+            if (line.find_first_not_of(" \t\r") == std::string::npos) {
+                continue;
+            }
+            if (!ParseJsonObject(line, &arguments)) {
+                WriteResponse(responses, json, false, "Invalid JSON command: " + line);
+                result = 1;
+                continue;
+            }
+            command = arguments["cmd"];
+        } else {
+            std::vector<std::string> tokens;
+            if (!TokenizeBatchCommand(line, &tokens)) {
+                WriteResponse(responses, json, false, "Unterminated quote: " + line);
+                result = 1;
+                continue;
+            }
+            if (tokens.empty() || (!tokens.front().empty() && tokens.front().front() == '#')) {
+                continue;  // Blank lines and comments
+            }
+            command = tokens.front();
+            auto it = kBatchCommands.find(command);
+            if (it != kBatchCommands.end()) {
+                for (size_t i = 1; i < tokens.size() && i <= it->second.size(); i++) {
+                    arguments[it->second[i - 1]] = tokens[i];
+                }
+            }
+        }
+
+        if (command == "quit" || command == "exit") {
+            break;
+        }
+        if (kBatchCommands.find(command) == kBatchCommands.end()) {
+            WriteResponse(responses, json, false, "Unknown command: " + command);
+            result = 1;
+            continue;
+        }
+        if (readOnly && (command == "add" || command == "remove")) {
+            WriteResponse(responses, json, false, "Archive is opened read-only: " + command);
+            result = 1;
+            continue;
+        }
+
+        std::string payload;
+        const bool ok = RunCommand(hArchive, command, arguments, listfileName, gameRules, &payload);
+        WriteResponse(responses, json, ok, payload);
+        result |= ok ? 0 : 1;
+    }
+    return result;
+}
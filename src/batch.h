@@ -0,0 +1,25 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include <iostream>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include <StormLib.h>
+
+// Run commands read line by line from input against one opened archive. Lines are
+// either plain commands ("read <file> [locale]") or, with json, NDJSON objects
+// ({"cmd": "read", "file": "...", "locale": "..."}). Every command is answered with
+// a header line carrying the payload length, followed by exactly that many bytes:
+//   ok <length>\n<payload>       or      {"status":"ok","length":N}\n<payload>
+//   error <length>\n<message>    or      {"status":"error","length":N}\n<message>
+// Returns 0 if every command succeeded, otherwise 1.
+int RunBatch(HANDLE hArchive, std::istream &input, std::ostream &output, bool json,
+             bool readOnly, const std::optional<std::string> &listfileName);
+
+// Split a plain text command on whitespace, double quotes group words with spaces.
+// Returns false on an unterminated quote.
+bool TokenizeBatchCommand(const std::string &line, std::vector<std::string> *tokens);
+
+#endif  // BATCH_H
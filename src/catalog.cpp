@@ -0,0 +1,682 @@
+#include "catalog.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <numeric>
+#include <set>
+#include <system_error>
+#include <thread>
+#include <type_traits>
+#include <unordered_map>
+#include <unordered_set>
+
+#include <StormLib.h>
+
+#include "gamerules.h"
+#include "instrumentation.h"
+#include "locales.h"
+#include "logging.h"
+#include "mpq.h"
+#include "progress.h"
+
+namespace fs = std::filesystem;
+
+namespace {
+constexpr char kCatalogMagic[8] = {'M', 'P', 'Q', 'C', 'A', 'T', '\r', '\n'};
+constexpr uint32_t kCatalogVersion = 1;
+constexpr uint32_t kByteOrderMark = 0x01020304;  // Rejects a catalog from another byte order
+constexpr uint32_t kHashedFlag = 0x1;            // Built with --hash
+
+// Files scanned as archives: MPQs, Warcraft III maps and campaigns, StarCraft II maps,
+// mods and replays
+const std::set<std::string> kArchiveExtensions = {".mpq",    ".w3m",    ".w3x",
+                                                  ".w3n",    ".sc2map", ".sc2mod",
+                                                  ".s2ma",   ".sc2replay"};
+
+// Layout of the catalog: CatalogHeader, CatalogArchive[archiveCount],
+// CatalogEntry[entryCount], the entry indices in name order (uint64_t[entryCount])
+// and in MD5 order (uint64_t[md5Count]), then all strings
+struct CatalogHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t byteOrder;
+    uint32_t flags;
+    uint32_t rootLength;
+    uint64_t rootOffset;
+    uint64_t archiveCount;
+    uint64_t entryCount;
+    uint64_t md5Count;
+    uint64_t stringsSize;
+};
+
+struct CatalogArchive {
+    uint64_t pathOffset;
+    uint32_t pathLength;
+    uint32_t reserved;
+    uint64_t archiveSize;
+    int64_t archiveTime;
+    uint64_t firstEntry;
+    uint64_t entryCount;
+};
+
+struct CatalogEntry {
+    uint64_t nameOffset;
+    uint32_t nameLength;
+    uint32_t archiveIndex;
+    uint32_t locale;
+    uint32_t fileSize;
+    uint32_t compressedSize;
+    uint32_t flags;
+    uint32_t crc32;
+    Md5Digest md5;
+    uint32_t reserved;
+};
+
+static_assert(std::is_trivially_copyable_v<CatalogHeader>);
+static_assert(std::is_trivially_copyable_v<CatalogArchive>);
+static_assert(std::is_trivially_copyable_v<CatalogEntry>);
+static_assert(sizeof(CatalogHeader) % alignof(CatalogArchive) == 0);
+static_assert(sizeof(CatalogArchive) % alignof(CatalogEntry) == 0);
+static_assert(sizeof(CatalogEntry) % alignof(uint64_t) == 0);
+
+struct ScannedEntry {
+    std::string name;
+    uint32_t locale = 0;
+    uint32_t fileSize = 0;
+    uint32_t compressedSize = 0;
+    uint32_t flags = 0;
+    uint32_t crc32 = 0;
+    Md5Digest md5{};
+};
+
+// An archive found under the root, with its entries once scanned
+struct ScannedArchive {
+    std::string path;  // Relative to the root, with forward slashes
+    uint64_t size = 0;
+    int64_t time = 0;
+    bool scanned = false;  // Archives that fail to open are left out of the catalog
+    std::vector<ScannedEntry> entries;
+};
+
+const CatalogHeader *HeaderOf(const char *data) {
+    return reinterpret_cast<const CatalogHeader *>(data);
+}
+
+const CatalogArchive *ArchivesOf(const char *data) {
+    return reinterpret_cast<const CatalogArchive *>(data + sizeof(CatalogHeader));
+}
+
+const CatalogEntry *EntriesOf(const char *data) {
+    return reinterpret_cast<const CatalogEntry *>(ArchivesOf(data) +
+                                                  HeaderOf(data)->archiveCount);
+}
+
+const uint64_t *NameOrderOf(const char *data) {
+    return reinterpret_cast<const uint64_t *>(EntriesOf(data) + HeaderOf(data)->entryCount);
+}
+
+const uint64_t *Md5OrderOf(const char *data) {
+    return NameOrderOf(data) + HeaderOf(data)->entryCount;
+}
+
+const char *StringsOf(const char *data) {
+    return reinterpret_cast<const char *>(Md5OrderOf(data) + HeaderOf(data)->md5Count);
+}
+
+// Archive file names compare in any case and with either slash, like StormLib finds them
+int CompareNames(std::string_view a, std::string_view b) {
+    auto keyChar = [](char c) -> unsigned char {
+        return c == '/' ? '\\' : std::toupper(static_cast<unsigned char>(c));
+    };
+    const size_t length = std::min(a.size(), b.size());
+    for (size_t i = 0; i < length; i++) {
+        const unsigned char first = keyChar(a[i]);
+        const unsigned char second = keyChar(b[i]);
+        if (first != second) {
+            return first < second ? -1 : 1;
+        }
+    }
+    return a.size() == b.size() ? 0 : (a.size() < b.size() ? -1 : 1);
+}
+
+// The archives under a directory, by extension, sorted by path
+bool FindArchives(const fs::path &root, std::vector<ScannedArchive> *archives) {
+    PhaseSpan span("find");
+    std::error_code ec;
+    fs::recursive_directory_iterator it(root, fs::directory_options::skip_permission_denied, ec);
+    for (; !ec && it != fs::recursive_directory_iterator(); it.increment(ec)) {
+        std::string extension = it->path().extension().u8string();
+        std::transform(extension.begin(), extension.end(), extension.begin(),
+                       [](unsigned char c) { return std::tolower(c); });
+        std::error_code fileError;
+        if (kArchiveExtensions.count(extension) == 0 || !it->is_regular_file(fileError)) {
+            continue;
+        }
+        ScannedArchive archive;
+        archive.path = it->path().lexically_relative(root).generic_u8string();
+        archive.size = it->file_size(fileError);
+        if (fileError) {
+            continue;
+        }
+        archive.time = it->last_write_time(fileError).time_since_epoch().count();
+        if (fileError) {
+            continue;
+        }
+        archives->push_back(std::move(archive));
+    }
+    if (ec) {
+        std::cerr << "[!] Failed to read directory: " << root.u8string() << ": " << ec.message()
+                  << std::endl;
+        return false;
+    }
+    std::sort(archives->begin(), archives->end(),
+              [](const ScannedArchive &a, const ScannedArchive &b) { return a.path < b.path; });
+    return true;
+}
+
+// Record the entries of an archive from its hash and block tables, with the checksums
+// of (attributes). Only hashing decompresses files.
+bool ScanArchive(const fs::path &archivePath, bool hashFiles, ScannedArchive *archive) {
+    HANDLE hArchive;
+    if (!OpenMpqArchive(archivePath.u8string(), &hArchive, MPQ_OPEN_READ_ONLY)) {
+        return false;
+    }
+    const MpqFileAttributes attributes = ReadFileAttributes(hArchive);
+
+    {
+        PhaseSpan span("list");
+        SFILE_FIND_DATA findData;
+        HANDLE findHandle = SFileFindFirstFile(hArchive, "*", &findData, nullptr);
+        if (findHandle != nullptr) {
+            do {
+                ScannedEntry entry;
+                entry.name = findData.cFileName;
+                entry.locale = findData.lcLocale;
+                entry.fileSize = findData.dwFileSize;
+                entry.compressedSize = findData.dwCompSize;
+                entry.flags = findData.dwFileFlags;
+                const size_t fileIndex = findData.dwBlockIndex;
+                if (fileIndex < attributes.crc32s.size()) {
+                    entry.crc32 = attributes.crc32s[fileIndex];
+                }
+                if (fileIndex < attributes.md5s.size()) {
+                    entry.md5 = attributes.md5s[fileIndex];
+                }
+                archive->entries.push_back(std::move(entry));
+            } while (SFileFindNextFile(findHandle, &findData));
+            SFileFindClose(findHandle);
+        }
+    }
+
+    for (auto &entry : archive->entries) {
+        if (!hashFiles || entry.md5 != Md5Digest{}) {
+            continue;
+        }
+        unsigned int fileSize;
+        const auto fileContent = ReadFile(hArchive, entry.name.c_str(), &fileSize, entry.locale);
+        if (fileContent) {
+            PhaseSpan span("hash");
+            entry.md5 = ComputeMd5(fileContent.get(), fileSize);
+        }
+    }
+    CloseMpqArchive(hArchive);
+    archive->scanned = true;
+    return true;
+}
+
+// Scan the pending archives on several threads. Returns the number that failed.
+size_t ScanArchives(const fs::path &root, const std::vector<size_t> &pending,
+                    unsigned int threads, bool hashFiles, std::vector<ScannedArchive> *archives) {
+    ProgressBar progress("Cataloguing");
+    ProgressExpectFiles(pending.size());
+    std::atomic<size_t> nextArchive{0};
+    std::atomic<size_t> failed{0};
+    auto work = [&]() {
+        for (size_t i = nextArchive++; i < pending.size(); i = nextArchive++) {
+            ScannedArchive &archive = (*archives)[pending[i]];
+            if (!ScanArchive(root / fs::u8path(archive.path), hashFiles, &archive)) {
+                failed++;
+            }
+            ProgressFileDone(archive.size);
+        }
+    };
+
+    const unsigned int threadCount = static_cast<unsigned int>(
+        std::min<size_t>(threads > 0 ? threads : std::max(1u, std::thread::hardware_concurrency()),
+                         std::max<size_t>(pending.size(), 1)));
+    std::vector<std::thread> workers;
+    for (unsigned int i = 1; i < threadCount; i++) {
+        workers.emplace_back(work);
+    }
+    work();
+    for (auto &worker : workers) {
+        worker.join();
+    }
+
+    for (size_t index : pending) {
+        if ((*archives)[index].scanned) {
+            LogFile("[*] Scanned: " + (*archives)[index].path);
+        }
+    }
+    return failed;
+}
+
+bool WriteCatalog(const std::string &catalogPath, const fs::path &root,
+                  const std::vector<ScannedArchive> &archives, bool hashed) {
+    PhaseSpan span("write");
+    const std::string rootString = root.u8string();
+    std::string strings = rootString;
+    std::unordered_map<std::string, uint64_t> nameOffsets;  // Names shared by archives, once
+    std::vector<CatalogArchive> archiveRecords;
+    std::vector<CatalogEntry> entries;
+    for (const auto &archive : archives) {
+        if (!archive.scanned) {
+            continue;
+        }
+        CatalogArchive record{};
+        record.pathOffset = strings.size();
+        record.pathLength = static_cast<uint32_t>(archive.path.size());
+        strings += archive.path;
+        record.archiveSize = archive.size;
+        record.archiveTime = archive.time;
+        record.firstEntry = entries.size();
+        record.entryCount = archive.entries.size();
+
+        for (const auto &file : archive.entries) {
+            const auto inserted = nameOffsets.emplace(file.name, strings.size());
+            if (inserted.second) {
+                strings += file.name;
+            }
+            CatalogEntry entry{};
+            entry.nameOffset = inserted.first->second;
+            entry.nameLength = static_cast<uint32_t>(file.name.size());
+            entry.archiveIndex = static_cast<uint32_t>(archiveRecords.size());
+            entry.locale = file.locale;
+            entry.fileSize = file.fileSize;
+            entry.compressedSize = file.compressedSize;
+            entry.flags = file.flags;
+            entry.crc32 = file.crc32;
+            entry.md5 = file.md5;
+            entries.push_back(entry);
+        }
+        archiveRecords.push_back(record);
+    }
+
+    // The sorted orders keep entries of the same key in archive order
+    auto nameOf = [&](uint64_t index) {
+        return std::string_view(strings.data() + entries[index].nameOffset,
+                                entries[index].nameLength);
+    };
+    std::vector<uint64_t> nameOrder(entries.size());
+    std::iota(nameOrder.begin(), nameOrder.end(), 0);
+    std::stable_sort(nameOrder.begin(), nameOrder.end(), [&](uint64_t a, uint64_t b) {
+        return CompareNames(nameOf(a), nameOf(b)) < 0;
+    });
+    std::vector<uint64_t> md5Order;
+    for (uint64_t i = 0; i < entries.size(); i++) {
+        if (entries[i].md5 != Md5Digest{}) {
+            md5Order.push_back(i);
+        }
+    }
+    std::stable_sort(md5Order.begin(), md5Order.end(),
+                     [&](uint64_t a, uint64_t b) { return entries[a].md5 < entries[b].md5; });
+
+    CatalogHeader header{};
+    std::memcpy(header.magic, kCatalogMagic, sizeof(kCatalogMagic));
+    header.version = kCatalogVersion;
+    header.byteOrder = kByteOrderMark;
+    header.flags = hashed ? kHashedFlag : 0;
+    header.rootOffset = 0;
+    header.rootLength = static_cast<uint32_t>(rootString.size());
+    header.archiveCount = archiveRecords.size();
+    header.entryCount = entries.size();
+    header.md5Count = md5Order.size();
+    header.stringsSize = strings.size();
+
+    // Readers never see a partly written catalog
+    const fs::path temporaryPath = fs::u8path(catalogPath + ".tmp");
+    std::error_code error;
+    {
+        std::ofstream catalog(temporaryPath, std::ios::binary | std::ios::trunc);
+        catalog.write(reinterpret_cast<const char *>(&header), sizeof(header));
+        catalog.write(reinterpret_cast<const char *>(archiveRecords.data()),
+                      static_cast<std::streamsize>(archiveRecords.size() * sizeof(CatalogArchive)));
+        catalog.write(reinterpret_cast<const char *>(entries.data()),
+                      static_cast<std::streamsize>(entries.size() * sizeof(CatalogEntry)));
+        catalog.write(reinterpret_cast<const char *>(nameOrder.data()),
+                      static_cast<std::streamsize>(nameOrder.size() * sizeof(uint64_t)));
+        catalog.write(reinterpret_cast<const char *>(md5Order.data()),
+                      static_cast<std::streamsize>(md5Order.size() * sizeof(uint64_t)));
+        catalog.write(strings.data(), static_cast<std::streamsize>(strings.size()));
+        if (!catalog) {
+            error = std::make_error_code(std::errc::io_error);
+        }
+    }
+    if (!error) {
+        fs::rename(temporaryPath, fs::u8path(catalogPath), error);
+    }
+    if (error) {
+        std::error_code removeError;
+        fs::remove(temporaryPath, removeError);
+        return false;
+    }
+    return true;
+}
+
+int SaveCatalog(const std::string &catalogPath, const fs::path &root,
+                const std::vector<ScannedArchive> &archives, bool hashed, size_t failed) {
+    if (!WriteCatalog(catalogPath, root, archives, hashed)) {
+        std::cerr << "[!] Failed to write catalog: " << catalogPath << std::endl;
+        return 1;
+    }
+    size_t fileCount = 0;
+    for (const auto &archive : archives) {
+        fileCount += archive.entries.size();
+    }
+    std::cout << "[*] Catalogued " << fileCount << " files in " << archives.size() - failed
+              << " archives" << std::endl;
+    if (failed > 0) {
+        std::cerr << "[!] Failed to catalog " << failed << " archives." << std::endl;
+        return 1;
+    }
+    return 0;
+}
+}  // namespace
+
+bool MpqCatalog::Open(const std::string &catalogPath) {
+    if (!mapping.Open(catalogPath)) {
+        return false;
+    }
+
+    // Counts are checked against the file size before they are multiplied
+    const size_t size = mapping.Size();
+    const CatalogHeader *header = HeaderOf(mapping.Data());
+    bool valid = size >= sizeof(CatalogHeader) &&
+                 std::memcmp(header->magic, kCatalogMagic, sizeof(kCatalogMagic)) == 0 &&
+                 header->version == kCatalogVersion && header->byteOrder == kByteOrderMark &&
+                 header->archiveCount <= size && header->entryCount <= size &&
+                 header->md5Count <= header->entryCount && header->stringsSize <= size &&
+                 size == sizeof(CatalogHeader) + header->archiveCount * sizeof(CatalogArchive) +
+                             header->entryCount * (sizeof(CatalogEntry) + sizeof(uint64_t)) +
+                             header->md5Count * sizeof(uint64_t) + header->stringsSize &&
+                 header->rootOffset + header->rootLength <= header->stringsSize;
+    for (uint64_t i = 0; valid && i < header->archiveCount; i++) {
+        const CatalogArchive &archive = ArchivesOf(mapping.Data())[i];
+        valid = archive.firstEntry <= header->entryCount &&
+                archive.entryCount <= header->entryCount - archive.firstEntry;
+    }
+    if (!valid) {
+        mapping.Close();
+        return false;
+    }
+    data = mapping.Data();
+    return true;
+}
+
+std::string_view MpqCatalog::StringAt(uint64_t offset, uint64_t length) const {
+    if (offset > HeaderOf(data)->stringsSize || length > HeaderOf(data)->stringsSize - offset) {
+        return {};  // Corrupt entry
+    }
+    return {StringsOf(data) + offset, static_cast<size_t>(length)};
+}
+
+bool MpqCatalog::Hashed() const { return (HeaderOf(data)->flags & kHashedFlag) != 0; }
+
+std::string_view MpqCatalog::Root() const {
+    return StringAt(HeaderOf(data)->rootOffset, HeaderOf(data)->rootLength);
+}
+
+size_t MpqCatalog::ArchiveCount() const {
+    return static_cast<size_t>(HeaderOf(data)->archiveCount);
+}
+
+std::string_view MpqCatalog::ArchivePath(size_t index) const {
+    const CatalogArchive &archive = ArchivesOf(data)[index];
+    return StringAt(archive.pathOffset, archive.pathLength);
+}
+
+uint64_t MpqCatalog::ArchiveSize(size_t index) const { return ArchivesOf(data)[index].archiveSize; }
+
+int64_t MpqCatalog::ArchiveTime(size_t index) const { return ArchivesOf(data)[index].archiveTime; }
+
+size_t MpqCatalog::ArchiveFirstEntry(size_t index) const {
+    return static_cast<size_t>(ArchivesOf(data)[index].firstEntry);
+}
+
+size_t MpqCatalog::ArchiveEntryCount(size_t index) const {
+    return static_cast<size_t>(ArchivesOf(data)[index].entryCount);
+}
+
+size_t MpqCatalog::EntryCount() const { return static_cast<size_t>(HeaderOf(data)->entryCount); }
+
+std::string_view MpqCatalog::EntryName(size_t index) const {
+    const CatalogEntry &entry = EntriesOf(data)[index];
+    return StringAt(entry.nameOffset, entry.nameLength);
+}
+
+CatalogFile MpqCatalog::Entry(size_t index) const {
+    const CatalogEntry &entry = EntriesOf(data)[index];
+    CatalogFile file;
+    if (entry.archiveIndex < HeaderOf(data)->archiveCount) {
+        file.archivePath = ArchivePath(entry.archiveIndex);
+    }
+    file.name = EntryName(index);
+    file.locale = entry.locale;
+    file.fileSize = entry.fileSize;
+    file.compressedSize = entry.compressedSize;
+    file.flags = entry.flags;
+    file.crc32 = entry.crc32;
+    file.md5 = entry.md5;
+    return file;
+}
+
+std::vector<size_t> MpqCatalog::FindName(const std::string &name) const {
+    const uint64_t *order = NameOrderOf(data);
+    const uint64_t *end = order + HeaderOf(data)->entryCount;
+    const std::string_view key(name);
+    const uint64_t *first =
+        std::lower_bound(order, end, key, [this](uint64_t index, std::string_view value) {
+            return CompareNames(EntryName(index), value) < 0;
+        });
+    const uint64_t *last =
+        std::upper_bound(first, end, key, [this](std::string_view value, uint64_t index) {
+            return CompareNames(value, EntryName(index)) < 0;
+        });
+    return {first, last};
+}
+
+std::vector<size_t> MpqCatalog::FindMask(const std::string &mask) const {
+    const size_t wildcard = mask.find_first_of("*?");
+    if (wildcard == std::string::npos) {
+        return FindName(mask);
+    }
+
+    // Names matching the mask all start with its part before the first wildcard
+    const std::string_view prefix(mask.data(), wildcard);
+    const uint64_t *order = NameOrderOf(data);
+    const uint64_t *end = order + HeaderOf(data)->entryCount;
+    const uint64_t *first =
+        std::lower_bound(order, end, prefix, [this](uint64_t index, std::string_view value) {
+            return CompareNames(EntryName(index), value) < 0;
+        });
+    std::vector<size_t> matches;
+    for (const uint64_t *it = first; it != end; ++it) {
+        const std::string_view name = EntryName(*it);
+        if (CompareNames(name.substr(0, prefix.size()), prefix) != 0) {
+            break;
+        }
+        if (GameRules::MatchFileMask(std::string(name), mask)) {
+            matches.push_back(*it);
+        }
+    }
+    return matches;
+}
+
+std::vector<size_t> MpqCatalog::FindMd5(const Md5Digest &md5) const {
+    const uint64_t *order = Md5OrderOf(data);
+    const uint64_t *end = order + HeaderOf(data)->md5Count;
+    const CatalogEntry *entries = EntriesOf(data);
+    const uint64_t *first =
+        std::lower_bound(order, end, md5, [entries](uint64_t index, const Md5Digest &value) {
+            return entries[index].md5 < value;
+        });
+    const uint64_t *last =
+        std::upper_bound(first, end, md5, [entries](const Md5Digest &value, uint64_t index) {
+            return value < entries[index].md5;
+        });
+    return {first, last};
+}
+
+std::vector<size_t> MpqCatalog::FindCrc32(uint32_t crc32) const {
+    std::vector<size_t> matches;
+    const CatalogEntry *entries = EntriesOf(data);
+    for (size_t i = 0; i < EntryCount(); i++) {
+        if (entries[i].crc32 == crc32) {
+            matches.push_back(i);
+        }
+    }
+    return matches;
+}
+
+int BuildCatalog(const std::string &directory, const std::string &catalogPath,
+                 unsigned int threads, bool hashFiles) {
+    std::error_code ec;
+    const fs::path root = fs::canonical(fs::u8path(directory), ec);
+    if (ec) {
+        std::cerr << "[!] Failed to read directory: " << directory << std::endl;
+        return 1;
+    }
+    std::vector<ScannedArchive> archives;
+    if (!FindArchives(root, &archives)) {
+        return 1;
+    }
+
+    std::vector<size_t> pending(archives.size());
+    std::iota(pending.begin(), pending.end(), 0);
+    const size_t failed = ScanArchives(root, pending, threads, hashFiles, &archives);
+    return SaveCatalog(catalogPath, root, archives, hashFiles, failed);
+}
+
+int UpdateCatalog(const std::string &catalogPath, unsigned int threads) {
+    fs::path root;
+    bool hashed;
+    std::vector<ScannedArchive> archives;
+    std::vector<size_t> pending;
+    size_t removed = 0;
+    {
+        MpqCatalog catalog;
+        if (!catalog.Open(catalogPath)) {
+            std::cerr << "[!] Failed to open catalog: " << catalogPath << std::endl;
+            return 1;
+        }
+        root = fs::u8path(std::string(catalog.Root()));
+        hashed = catalog.Hashed();
+        if (!FindArchives(root, &archives)) {
+            return 1;
+        }
+
+        // Archives with the size and modification time they were catalogued with keep
+        // their entries, the others are scanned again
+        std::unordered_map<std::string_view, size_t> catalogued;
+        for (size_t i = 0; i < catalog.ArchiveCount(); i++) {
+            catalogued.emplace(catalog.ArchivePath(i), i);
+        }
+        std::unordered_set<std::string_view> found;
+        for (size_t i = 0; i < archives.size(); i++) {
+            ScannedArchive &archive = archives[i];
+            found.insert(archive.path);
+            const auto known = catalogued.find(archive.path);
+            if (known == catalogued.end() || catalog.ArchiveSize(known->second) != archive.size ||
+                catalog.ArchiveTime(known->second) != archive.time) {
+                pending.push_back(i);
+                continue;
+            }
+            const size_t first = catalog.ArchiveFirstEntry(known->second);
+            const size_t count = catalog.ArchiveEntryCount(known->second);
+            for (size_t index = first; index < first + count; index++) {
+                const CatalogFile file = catalog.Entry(index);
+                ScannedEntry entry;
+                entry.name = std::string(file.name);
+                entry.locale = file.locale;
+                entry.fileSize = file.fileSize;
+                entry.compressedSize = file.compressedSize;
+                entry.flags = file.flags;
+                entry.crc32 = file.crc32;
+                entry.md5 = file.md5;
+                archive.entries.push_back(std::move(entry));
+            }
+            archive.scanned = true;
+        }
+        for (const auto &known : catalogued) {
+            if (found.count(known.first) == 0) {
+                removed++;
+            }
+        }
+    }
+
+    std::cout << "[*] Rescanning " << pending.size() << " of " << archives.size()
+              << " archives, " << removed << " removed" << std::endl;
+    const size_t failed = ScanArchives(root, pending, threads, hashed, &archives);
+    return SaveCatalog(catalogPath, root, archives, hashed, failed);
+}
+
+int QueryCatalog(const std::string &catalogPath, const std::optional<std::string> &pattern,
+                 const std::optional<std::string> &md5, const std::optional<std::string> &crc32) {
+    MpqCatalog catalog;
+    if (!catalog.Open(catalogPath)) {
+        std::cerr << "[!] Failed to open catalog: " << catalogPath << std::endl;
+        return 1;
+    }
+
+    std::vector<size_t> matches;
+    if (md5.has_value()) {
+        Md5Digest digest;
+        if (!Md5FromHex(md5.value(), &digest)) {
+            std::cerr << "[!] Invalid MD5, expected 32 hex digits: " << md5.value() << std::endl;
+            return 1;
+        }
+        matches = catalog.FindMd5(digest);
+    } else if (crc32.has_value()) {
+        char *end = nullptr;
+        const unsigned long value = std::strtoul(crc32->c_str(), &end, 16);
+        if (crc32->empty() || crc32->size() > 8 || *end != '\0') {
+            std::cerr << "[!] Invalid CRC32, expected up to 8 hex digits: " << crc32.value()
+                      << std::endl;
+            return 1;
+        }
+        matches = catalog.FindCrc32(static_cast<uint32_t>(value));
+    } else if (pattern.has_value()) {
+        matches = catalog.FindMask(pattern.value());
+    } else {
+        std::cerr << "[!] Give a file name or mask, --md5 or --crc32 to search for." << std::endl;
+        return 1;
+    }
+
+    if (matches.empty()) {
+        std::cerr << "[!] No file in the catalog matches." << std::endl;
+        return 1;
+    }
+    const fs::path root = fs::u8path(std::string(catalog.Root()));
+    for (size_t index : matches) {
+        const CatalogFile file = catalog.Entry(index);
+        std::cout << std::setw(4) << LocaleToLang(static_cast<uint16_t>(file.locale)) << " "
+                  << std::setw(8) << file.fileSize << " ";
+        if (file.crc32 != 0) {
+            std::cout << std::setfill('0') << std::hex << std::setw(8) << file.crc32
+                      << std::setfill(' ') << std::dec << " ";
+        } else {
+            std::cout << std::string(8, '-') << " ";
+        }
+        std::cout << (file.md5 != Md5Digest{} ? Md5ToHex(file.md5) : std::string(32, '-')) << " "
+                  << (root / fs::u8path(std::string(file.archivePath))).u8string() << " "
+                  << file.name << '\n';
+    }
+    return 0;
+}
@@ -0,0 +1,77 @@
+#ifndef CATALOG_H
+#define CATALOG_H
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "mappedfile.h"
+#include "md5.h"
+
+// A file entry of a catalogued archive, pointing into the mapped catalog
+struct CatalogFile {
+    std::string_view archivePath;  // Relative to the catalog root
+    std::string_view name;
+    uint32_t locale = 0;
+    uint32_t fileSize = 0;
+    uint32_t compressedSize = 0;
+    uint32_t flags = 0;
+    uint32_t crc32 = 0;  // From (attributes), 0 when unknown
+    Md5Digest md5{};     // From (attributes) or hashed, all zero when unknown
+};
+
+// Catalog of the file entries of every archive under a directory, in one file
+// (usually <directory>/catalog.mpqcat). Entries are kept sorted by name, in any case
+// and with either slash, and by MD5, so a lookup of either is a binary search over
+// the memory-mapped catalog. Each archive is recorded with its size and modification
+// time, which decide whether an update scans it again.
+class MpqCatalog {
+public:
+    bool Open(const std::string &catalogPath);
+
+    // Whether files without an (attributes) MD5 were decompressed to hash them
+    [[nodiscard]] bool Hashed() const;
+    // The directory the archives were found in
+    [[nodiscard]] std::string_view Root() const;
+    [[nodiscard]] size_t ArchiveCount() const;
+    [[nodiscard]] std::string_view ArchivePath(size_t index) const;
+    [[nodiscard]] uint64_t ArchiveSize(size_t index) const;
+    [[nodiscard]] int64_t ArchiveTime(size_t index) const;
+    // Entries of an archive are stored together, in the order StormLib finds them
+    [[nodiscard]] size_t ArchiveFirstEntry(size_t index) const;
+    [[nodiscard]] size_t ArchiveEntryCount(size_t index) const;
+    [[nodiscard]] size_t EntryCount() const;
+    [[nodiscard]] CatalogFile Entry(size_t index) const;
+
+    // Indices of the entries with a name, or matching a mask with * and ? wildcards.
+    // A mask is searched from the sorted position of its part before the first wildcard.
+    [[nodiscard]] std::vector<size_t> FindName(const std::string &name) const;
+    [[nodiscard]] std::vector<size_t> FindMask(const std::string &mask) const;
+    [[nodiscard]] std::vector<size_t> FindMd5(const Md5Digest &md5) const;
+    // CRC32s are not sorted, so this reads every entry
+    [[nodiscard]] std::vector<size_t> FindCrc32(uint32_t crc32) const;
+
+private:
+    MappedFile mapping;
+    const char *data = nullptr;
+
+    [[nodiscard]] std::string_view StringAt(uint64_t offset, uint64_t length) const;
+    [[nodiscard]] std::string_view EntryName(size_t index) const;
+};
+
+// Scan the archives under a directory on several threads (0 for one per CPU) and write
+// their catalog. With hashFiles, files without an (attributes) MD5 are decompressed and
+// hashed, which reads every such file.
+int BuildCatalog(const std::string &directory, const std::string &catalogPath,
+                 unsigned int threads, bool hashFiles);
+// Scan the archives under the catalog root again, skipping those whose size and
+// modification time are unchanged, and drop the archives that are gone
+int UpdateCatalog(const std::string &catalogPath, unsigned int threads);
+// Print the entries with a name or mask, or with an MD5 or CRC32 (given in hex)
+int QueryCatalog(const std::string &catalogPath, const std::optional<std::string> &pattern,
+                 const std::optional<std::string> &md5, const std::optional<std::string> &crc32);
+
+#endif  // CATALOG_H
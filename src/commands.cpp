@@ -1,18 +1,47 @@
 #include "commands.h"
 
+#include <algorithm>
+#include <cstdio>
 #include <filesystem>
+#include <fstream>
 #include <iostream>
+#include <thread>
 
 #include <StormLib.h>
 
+#include "archive.h"
+#include "atomicwrite.h"
+#include "batch.h"
+#include "catalog.h"
 #include "gamerules.h"
 #include "helpers.h"
 #include "locales.h"
 #include "mpq.h"
+#include "mpqindex.h"
+#include "mount.h"
 #include "mpqcli.h"
+#include "overlay.h"
+#include "parallelread.h"
+#include "progress.h"
+#include "serve.h"
 
 namespace fs = std::filesystem;
 
+// With a sidecar index, file names come from the index instead of the internal
+// listfile, so StormLib can skip loading (listfile) and (attributes)
+constexpr int32_t kIndexedOpenFlags =
+    MPQ_OPEN_READ_ONLY | MPQ_OPEN_NO_LISTFILE | MPQ_OPEN_NO_ATTRIBUTES;
+
+// Read-only commands read the archive through a memory mapping unless told otherwise
+static bool OpenMpqArchiveForReading(const std::string &target, MpqArchive *archive,
+                                     int32_t flags, bool useMmap) {
+    if (!archive->Open(target, flags, useMmap)) {
+        std::cerr << "[!] Failed to open: " << target << std::endl;
+        return false;
+    }
+    return true;
+}
+
 int HandleVersion() {
     std::cout << MPQCLI_VERSION << "-" << GIT_COMMIT_HASH << std::endl;
     return 0;
@@ -30,14 +59,22 @@ int HandleAbout() {
     return 0;
 }
 
-int HandleInfo(const std::string &target, const std::optional<std::string> &property) {
-    HANDLE hArchive;
-    if (!OpenMpqArchive(target, &hArchive, MPQ_OPEN_READ_ONLY)) {
+int HandleInfo(const std::string &target, const std::optional<std::string> &property,
+               bool useIndex) {
+    if (useIndex) {
+        MpqIndex index;
+        if (index.Open(target)) {
+            PrintMpqInfo(index.ArchiveInfo(), property);
+            return 0;
+        }
+    }
+
+    MpqArchive archive;
+    if (!OpenMpqArchiveForReading(target, &archive, MPQ_OPEN_READ_ONLY, false)) {
         std::cerr << "[!] Failed to open MPQ archive." << std::endl;
         return 1;
     }
-    PrintMpqInfo(hArchive, property);
-    CloseMpqArchive(hArchive);
+    PrintMpqInfo(archive.Info(), property);
     return 0;
 }
 
@@ -47,11 +84,21 @@ int HandleCreate(const std::string &target, const std::optional<std::string> &na
                  const std::optional<std::string> &gameProfile, int32_t mpqVersion,
                  int64_t streamFlags, int64_t sectorSize, int64_t rawChunkSize, int64_t fileFlags1,
                  int64_t fileFlags2, int64_t fileFlags3, int64_t attrFlags, int64_t fileDwFlags,
-                 int64_t fileDwCompression, int64_t fileDwCompressionNext) {
+                 int64_t fileDwCompression, int64_t fileDwCompressionNext, bool fromTar) {
+    if (fromTar && nameInArchive.has_value()) {
+        std::cerr << "[!] Cannot specify --name-in-archive when adding a tar file." << std::endl;
+        return 1;
+    }
     if (!fs::is_regular_file(target) && nameInArchive.has_value()) {
         std::cerr << "[!] Cannot specify --name-in-archive when adding a directory." << std::endl;
         return 1;
     }
+    // A tar stream read from stdin has no name to derive the output from
+    const bool fromStdin = target == "-";
+    if (fromStdin && (!fromTar || !output.has_value())) {
+        std::cerr << "[!] Creating from stdin needs --from-tar and --output." << std::endl;
+        return 1;
+    }
 
     fs::path outputFilePath;
     if (output.has_value()) {
@@ -94,12 +141,15 @@ int HandleCreate(const std::string &target, const std::optional<std::string> &na
     if (rawChunkSize >= 0) overrides.rawChunkSize = static_cast<DWORD>(rawChunkSize);
     gameRules.OverrideCreateSettings(overrides);
 
-    // Determine the number of files we are going to add
-    uint32_t fileCount = CalculateMpqMaxFileValue(target);
+    // Determine the number of files we are going to add. The members of a tar
+    // stream are unknown up front, the hash table grows as they are added.
+    uint32_t fileCount = fromTar ? 32 : CalculateMpqMaxFileValue(target);
 
     // Create the MPQ archive and add files
     HANDLE hArchive = CreateMpqArchive(outputFile, fileCount, gameRules);
     if (hArchive) {
+        ProgressBar progress("Adding");
+        WatchAddProgress(hArchive);
         LCID lcid = locale.has_value() ? LangToLocale(locale.value()) : defaultLocale;
 
         // Apply AddFileSettings overrides if provided
@@ -110,7 +160,21 @@ int HandleCreate(const std::string &target, const std::optional<std::string> &na
         if (fileDwCompressionNext >= 0)
             addOverrides.dwCompressionNext = static_cast<DWORD>(fileDwCompressionNext);
 
-        if (fs::is_regular_file(target)) {
+        if (fromTar) {
+            std::ifstream tarFile;
+            if (fromStdin) {
+                SetBinaryStdin();
+            } else {
+                tarFile.open(fs::u8path(target), std::ios::binary);
+            }
+            std::istream &input = fromStdin ? std::cin : tarFile;
+            if (AddFilesFromTar(hArchive, input, lcid, gameRules, addOverrides, false) != 0) {
+                CloseMpqArchive(hArchive);
+                std::error_code ec;
+                fs::remove(outputFilePath, ec);  // Do not leave a partial archive behind
+                return 1;
+            }
+        } else if (fs::is_regular_file(target)) {
             // Default: use the filename as path, saves file to root of MPQ
             fs::path filePath = fs::path(target);
             std::string archivePath = filePath.filename().u8string();
@@ -140,10 +204,32 @@ int HandleAdd(const std::string &file, const std::string &target,
               const std::optional<std::string> &nameInArchive, bool overwrite,
               const std::optional<std::string> &locale,
               const std::optional<std::string> &gameProfile, int64_t fileDwFlags,
-              int64_t fileDwCompression, int64_t fileDwCompressionNext) {
+              int64_t fileDwCompression, int64_t fileDwCompressionNext, bool atomic,
+              const std::optional<uint32_t> &size, bool fromTar) {
+    // Data piped to stdin has no name and no size of its own
+    const bool fromStdin = file == "-";
+    if (fromTar && (path.has_value() || dirInArchive.has_value() || nameInArchive.has_value())) {
+        std::cerr << "[!] Cannot specify --path, --directory-in-archive or "
+                     "--filename-in-archive when adding a tar file."
+                  << std::endl;
+        return 1;
+    }
+    if (fromStdin && !fromTar &&
+        (!size.has_value() || (!path.has_value() && !nameInArchive.has_value()))) {
+        std::cerr << "[!] Adding from stdin needs --size and --path or --filename-in-archive."
+                  << std::endl;
+        return 1;
+    }
+
+    // With --atomic, a working copy is changed and then renamed over the target
+    AtomicArchiveWrite atomicWrite(target);
+    if (atomic && !atomicWrite.Begin()) {
+        return 1;
+    }
+
     HANDLE hArchive;
     // Open the MPQ archive for writing (this is why we set flag as 0)
-    if (!OpenMpqArchive(target, &hArchive, 0)) {
+    if (!OpenMpqArchive(atomic ? atomicWrite.Path() : target, &hArchive, 0)) {
         std::cerr << "[!] Failed to open MPQ archive." << std::endl;
         return 1;
     }
@@ -193,42 +279,103 @@ int HandleAdd(const std::string &file, const std::string &target,
     if (fileDwCompressionNext >= 0)
         addOverrides.dwCompressionNext = static_cast<DWORD>(fileDwCompressionNext);
 
-    AddFile(hArchive, file, archivePath, lcid, gameRules, addOverrides, overwrite);
-    CloseMpqArchive(hArchive);
+    ProgressBar progress("Adding");
+    WatchAddProgress(hArchive);
+    int result;
+    if (fromTar) {
+        std::ifstream tarFile;
+        if (fromStdin) {
+            SetBinaryStdin();
+        } else {
+            tarFile.open(fs::u8path(file), std::ios::binary);
+        }
+        std::istream &input = fromStdin ? std::cin : tarFile;
+        result = AddFilesFromTar(hArchive, input, lcid, gameRules, addOverrides, overwrite);
+    } else if (fromStdin) {
+        SetBinaryStdin();
+        result = AddFileFromStream(hArchive, std::cin, size.value(), archivePath, lcid, gameRules,
+                                   addOverrides, overwrite, CurrentFileTime());
+    } else {
+        result = AddFile(hArchive, file, archivePath, lcid, gameRules, addOverrides, overwrite);
+    }
+    // The tables are written on close, a working copy that failed to close is discarded
+    if (!CloseMpqArchive(hArchive)) {
+        return 1;
+    }
+    if (atomic && result == 0 && !atomicWrite.Commit()) {
+        return 1;
+    }
+    // A discarded working copy, a short stdin or a damaged tar file fails the command, as
+    // for create. A plain add that skips an existing file keeps exiting with 0, as it
+    // always has.
+    if (result != 0 && (atomic || fromStdin || fromTar)) {
+        return 1;
+    }
     return 0;
 }
 
 int HandleRemove(const std::string &file, const std::string &target,
-                 const std::optional<std::string> &locale) {
+                 const std::optional<std::string> &locale, bool atomic) {
+    AtomicArchiveWrite atomicWrite(target);
+    if (atomic && !atomicWrite.Begin()) {
+        return 1;
+    }
+
     HANDLE hArchive;
     // Open the MPQ archive for writing (this is why we set flag as 0)
-    if (!OpenMpqArchive(target, &hArchive, 0)) {
+    if (!OpenMpqArchive(atomic ? atomicWrite.Path() : target, &hArchive, 0)) {
         std::cerr << "[!] Failed to open MPQ archive." << std::endl;
         return 1;
     }
 
     LCID lcid = locale.has_value() ? LangToLocale(locale.value()) : defaultLocale;
     int result = RemoveFile(hArchive, file, lcid);
-    CloseMpqArchive(hArchive);
+    if (!CloseMpqArchive(hArchive)) {
+        return 1;
+    }
+    if (atomic && result == 0 && !atomicWrite.Commit()) {
+        return 1;
+    }
     return result;
 }
 
 int HandleList(const std::string &target, const std::optional<std::string> &listfileName,
-               bool listAll, bool listDetailed, const std::vector<std::string> &properties) {
-    HANDLE hArchive;
-    if (!OpenMpqArchive(target, &hArchive, MPQ_OPEN_READ_ONLY)) {
+               bool listAll, bool listDetailed, const std::vector<std::string> &properties,
+               const std::vector<std::string> &overlays, const std::vector<std::string> &patches,
+               bool useIndex, bool useMmap) {
+    if (!overlays.empty() || !patches.empty()) {
+        MpqOverlay overlay;
+        if (!overlay.Open(target, overlays, patches, listfileName)) {
+            std::cerr << "[!] Failed to open MPQ archive." << std::endl;
+            return 1;
+        }
+        return ListFiles(overlay, listAll, listDetailed, properties);
+    }
+
+    // The index is built from the internal listfile, so it cannot answer for another one
+    if (useIndex && !listfileName.has_value()) {
+        MpqIndex index;
+        if (index.Open(target)) {
+            return ListFiles(index, listAll, listDetailed, properties);
+        }
+    }
+
+    MpqArchive archive;
+    if (!OpenMpqArchiveForReading(target, &archive, MPQ_OPEN_READ_ONLY, useMmap)) {
         std::cerr << "[!] Failed to open MPQ archive." << std::endl;
         return 1;
     }
-    ListFiles(hArchive, listfileName, listAll, listDetailed, properties);
-    CloseMpqArchive(hArchive);
-    return 0;
+    return ListFiles(archive.Handle(), listfileName, listAll, listDetailed, properties);
 }
 
 int HandleExtract(const std::string &target, const std::optional<std::string> &output,
                   const std::optional<std::string> &file, bool keepFolderStructure,
                   const std::optional<std::string> &listfileName,
-                  const std::optional<std::string> &locale) {
+                  const std::optional<std::string> &locale,
+                  const std::vector<std::string> &overlays,
+                  const std::vector<std::string> &patches, bool useIndex, bool useMmap,
+                  bool reportBandwidth, bool allLocales, bool linkIdentical,
+                  const std::optional<std::string> &storeDirectory, bool trustAttributes) {
     // If no output directory specified, use MPQ path without extension
     // If output directory specified, create it if it doesn't exist
     std::string effectiveOutput;
@@ -244,25 +391,67 @@ int HandleExtract(const std::string &target, const std::optional<std::string> &o
         return 1;
     }
 
-    HANDLE hArchive;
-    if (!OpenMpqArchive(target, &hArchive, MPQ_OPEN_READ_ONLY)) {
-        std::cerr << "[!] Failed to open MPQ archive." << std::endl;
-        return 1;
-    }
-
     LCID lcid = locale.has_value() ? LangToLocale(locale.value()) : defaultLocale;
     if (locale.has_value() && lcid == defaultLocale) {
         std::cout << "[!] Warning: The locale '" << locale.value()
                   << "' is unknown. Will use default locale instead." << std::endl;
     }
 
+    ProgressBar progress("Extracting");
     int result;
-    if (file.has_value()) {
+    if (!overlays.empty() || !patches.empty()) {
+        MpqOverlay overlay;
+        if (!overlay.Open(target, overlays, patches, listfileName)) {
+            std::cerr << "[!] Failed to open MPQ archive." << std::endl;
+            return 1;
+        }
+
+        if (file.has_value()) {
+            HANDLE hProvider = overlay.Resolve(file.value(), lcid);
+            if (hProvider == nullptr) {
+                std::cerr << "[!] Failed: File doesn't exist in any archive: " << file.value()
+                          << std::endl;
+                result = 1;
+            } else {
+                result = ExtractFile(hProvider, effectiveOutput, file.value(), keepFolderStructure,
+                                     lcid);
+            }
+        } else {
+            result = ExtractFiles(overlay, effectiveOutput, lcid);
+        }
+
+        if (result != 0) {
+            std::cerr << std::endl << "[!] Failed to extract all files." << std::endl;
+        }
+        return result;
+    }
+
+    // A single file is extracted by name, which needs neither the index nor a listfile
+    MpqIndex index;
+    const bool indexed =
+        useIndex && !file.has_value() && !listfileName.has_value() && index.Open(target);
+    const bool skipListfile = indexed || (useIndex && file.has_value());
+    MpqArchive archive;
+    if (!OpenMpqArchiveForReading(target, &archive,
+                                  skipListfile ? kIndexedOpenFlags : MPQ_OPEN_READ_ONLY, useMmap)) {
+        std::cerr << "[!] Failed to open MPQ archive." << std::endl;
+        return 1;
+    }
+    HANDLE hArchive = archive.Handle();
+    if (storeDirectory.has_value()) {
+        result = ExtractFilesToStore(hArchive, effectiveOutput, listfileName, lcid,
+                                     storeDirectory.value(), trustAttributes);
+    } else if (allLocales) {
+        result = ExtractAllLocales(hArchive, effectiveOutput, listfileName, linkIdentical,
+                                   reportBandwidth);
+    } else if (file.has_value()) {
         result = ExtractFile(hArchive, effectiveOutput, file.value(), keepFolderStructure, lcid);
+    } else if (indexed) {
+        result = ExtractFiles(hArchive, index, effectiveOutput, lcid, reportBandwidth);
     } else {
-        result = ExtractFiles(hArchive, effectiveOutput, listfileName, lcid);
+        result = ExtractFiles(hArchive, effectiveOutput, listfileName, lcid, reportBandwidth);
     }
-    CloseMpqArchive(hArchive);
+    archive.Close();
 
     if (result != 0) {
         std::cerr << std::endl << "[!] Failed to extract all files." << std::endl;
@@ -271,19 +460,84 @@ int HandleExtract(const std::string &target, const std::optional<std::string> &o
 }
 
 int HandleRead(const std::string &file, const std::string &target,
-               const std::optional<std::string> &locale) {
-    HANDLE hArchive;
-    if (!OpenMpqArchive(target, &hArchive, MPQ_OPEN_READ_ONLY)) {
-        std::cerr << "[!] Failed to open MPQ archive." << std::endl;
-        return 1;
-    }
-
+               const std::optional<std::string> &locale, const std::vector<std::string> &overlays,
+               const std::vector<std::string> &patches, bool useIndex, bool useMmap) {
     LCID lcid = locale.has_value() ? LangToLocale(locale.value()) : defaultLocale;
     if (locale.has_value() && lcid == defaultLocale) {
         std::cout << "[!] Warning: The locale '" << locale.value()
                   << "' is unknown. Will use default locale instead." << std::endl;
     }
 
+    if (!overlays.empty() || !patches.empty()) {
+        MpqOverlay overlay;
+        if (!overlay.Open(target, overlays, patches, std::nullopt)) {
+            std::cerr << "[!] Failed to open MPQ archive." << std::endl;
+            return 1;
+        }
+
+        HANDLE hProvider = overlay.Resolve(file, lcid);
+        if (hProvider == nullptr) {
+            std::cerr << "[!] Failed: File doesn't exist in any archive: " << file << std::endl;
+            return 1;
+        }
+
+        uint32_t fileSize;
+        auto fileContent = ReadFile(hProvider, file.c_str(), &fileSize, lcid);
+        if (!fileContent) {
+            return 1;
+        }
+        PrintAsBinary(fileContent.get(), fileSize);
+        return 0;
+    }
+
+    // The index resolves the name and locale to an entry, without looking it up in the
+    // archive. Names missing from it (not in the internal listfile) are looked up as usual.
+    std::optional<MpqEntryInfo> indexedEntry;
+    if (useIndex) {
+        MpqIndex index;
+        if (index.Open(target)) {
+            const auto entryIndex = index.FindEntry(file, lcid);
+            if (entryIndex.has_value()) {
+                indexedEntry = index.Entry(entryIndex.value());
+                lcid = static_cast<LCID>(indexedEntry->locale);
+            }
+        }
+    }
+
+    // Reading a file by name needs no listfile, so an indexed read skips loading it
+    MpqArchive archive;
+    if (!OpenMpqArchiveForReading(target, &archive,
+                                  useIndex ? kIndexedOpenFlags : MPQ_OPEN_READ_ONLY, useMmap)) {
+        std::cerr << "[!] Failed to open MPQ archive." << std::endl;
+        return 1;
+    }
+    HANDLE hArchive = archive.Handle();
+
+    // Stored files are sent from the archive file to stdout without passing through memory
+    std::cout.flush();
+    const RangeCopyResult stored =
+        indexedEntry.has_value()
+            ? WriteStoredFile(hArchive, indexedEntry.value(), fileno(stdout))
+            : WriteStoredFile(hArchive, file.c_str(), lcid, fileno(stdout));
+    if (stored != RangeCopyResult::kUnsupported) {
+        if (stored == RangeCopyResult::kFailed) {
+            std::cerr << "[!] Failed: Cannot read file contents for: " << file << std::endl;
+            return 1;
+        }
+        return 0;
+    }
+
+    // Huge compressed files are decompressed on several threads, in order to stdout
+    if (ShouldReadInParallel(hArchive, file.c_str(), lcid)) {
+        SetBinaryStdout();
+        const bool read = ReadFileInParallel(hArchive, file.c_str(), lcid, std::cout);
+        if (!read) {
+            std::cerr << "[!] Failed: Cannot read file contents for: " << file << std::endl;
+            return 1;
+        }
+        return 0;
+    }
+
     uint32_t fileSize;
     auto fileContent = ReadFile(hArchive, file.c_str(), &fileSize, lcid);
     if (!fileContent) {
@@ -291,27 +545,28 @@ int HandleRead(const std::string &file, const std::string &target,
     }
 
     PrintAsBinary(fileContent.get(), fileSize);
-
-    CloseMpqArchive(hArchive);
     return 0;
 }
 
-int HandleVerify(const std::string &target, bool printSignature) {
-    HANDLE hArchive;
-    if (!OpenMpqArchive(target, &hArchive, MPQ_OPEN_READ_ONLY)) {
+int HandleVerify(const std::string &target, bool printSignature, bool useMmap) {
+    MpqArchive archive;
+    if (!OpenMpqArchiveForReading(target, &archive, MPQ_OPEN_READ_ONLY, useMmap)) {
         std::cerr << "[!] Failed to open MPQ archive." << std::endl;
         return 1;
     }
+    if (useMmap) {
+        PrefetchFile(target);  // Verifying a signature reads the whole archive
+    }
 
     int result = 0;
-    uint32_t verifyResult = VerifyMpqArchive(hArchive);
+    uint32_t verifyResult = archive.Verify();
     if (verifyResult == ERROR_WEAK_SIGNATURE_OK || verifyResult == ERROR_STRONG_SIGNATURE_OK ||
         verifyResult == ERROR_WEAK_SIGNATURE_ERROR ||
         verifyResult == ERROR_STRONG_SIGNATURE_ERROR) {
         if (printSignature) {
             // If printing the signature, don't print success message
             // because the user might want to pipe/redirect the signature data
-            PrintMpqSignature(hArchive, target);
+            PrintMpqSignature(archive.Handle(), target);
         } else {
             // Just print verification success
             std::cout << "[*] Verify success" << std::endl;
@@ -322,6 +577,119 @@ int HandleVerify(const std::string &target, bool printSignature) {
         std::cout << "[!] Verify failed" << std::endl;
         result = 1;
     }
+    return result;
+}
+
+int HandleFlatten(const std::string &target, const std::string &output,
+                  const std::optional<std::string> &listfileName,
+                  const std::vector<std::string> &overlays,
+                  const std::vector<std::string> &patches, unsigned int threads) {
+    return FlattenArchives(target, overlays, patches, listfileName, output, threads);
+}
+
+int HandleCopy(const std::string &source, const std::string &target,
+               const std::vector<std::string> &files,
+               const std::optional<std::string> &nameInArchive, bool overwrite,
+               const std::optional<std::string> &listfileName) {
+    HANDLE hSourceArchive;
+    if (!OpenMpqArchive(source, &hSourceArchive, MPQ_OPEN_READ_ONLY)) {
+        std::cerr << "[!] Failed to open MPQ archive." << std::endl;
+        return 1;
+    }
+
+    // Without file names or wildcards, every file of the source archive is copied
+    const std::vector<std::string> fileMasks =
+        files.empty() ? std::vector<std::string>{"*"} : files;
+    int result =
+        CopyFiles(hSourceArchive, target, fileMasks, nameInArchive, overwrite, listfileName);
+    CloseMpqArchive(hSourceArchive);
+    return result;
+}
+
+int HandleMerge(const std::vector<std::string> &archives, const std::string &output,
+                const std::optional<std::string> &listfileName, unsigned int threads) {
+    if (archives.size() < 2) {
+        std::cerr << "[!] At least two MPQ archives are needed to merge." << std::endl;
+        return 1;
+    }
+    return MergeArchives(archives, listfileName, output, threads);
+}
+
+int HandleRename(const std::string &target, const std::string &oldName,
+                 const std::string &newName, const std::optional<std::string> &locale,
+                 const std::optional<std::string> &listfileName, bool atomic) {
+    AtomicArchiveWrite atomicWrite(target);
+    if (atomic && !atomicWrite.Begin()) {
+        return 1;
+    }
+
+    HANDLE hArchive;
+    // Open the MPQ archive for writing (this is why we set flag as 0)
+    if (!OpenMpqArchive(atomic ? atomicWrite.Path() : target, &hArchive, 0)) {
+        std::cerr << "[!] Failed to open MPQ archive." << std::endl;
+        return 1;
+    }
+
+    std::optional<LCID> lcid;
+    if (locale.has_value()) {
+        lcid = LangToLocale(locale.value());
+    }
+    int result = RenameFiles(hArchive, oldName, newName, lcid, listfileName);
+    if (!CloseMpqArchive(hArchive)) {
+        return 1;
+    }
+    if (atomic && result == 0 && !atomicWrite.Commit()) {
+        return 1;
+    }
+    return result;
+}
+
+int HandleBatch(const std::string &target, bool json, bool readOnly,
+                const std::optional<std::string> &listfileName) {
+    HANDLE hArchive;
+    // The archive stays open for all commands, and is only flushed once when closed
+    if (!OpenMpqArchive(target, &hArchive, readOnly ? MPQ_OPEN_READ_ONLY : 0)) {
+        std::cerr << "[!] Failed to open MPQ archive." << std::endl;
+        return 1;
+    }
+
+    int result = RunBatch(hArchive, std::cin, std::cout, json, readOnly, listfileName);
     CloseMpqArchive(hArchive);
     return result;
 }
+
+int HandleServe(const std::string &target, const std::string &socketPath,
+                const std::optional<uint16_t> &httpPort, size_t cacheMegabytes,
+                unsigned int threads, unsigned int maxClients) {
+    ServeSettings settings;
+    settings.socketPath = socketPath;
+    settings.httpPort = httpPort;
+    settings.cacheBytes = cacheMegabytes * 1024 * 1024;
+    settings.handles = threads > 0 ? threads : std::max(1u, std::thread::hardware_concurrency());
+    settings.maxClients = maxClients;
+    return RunServer(target, settings);
+}
+
+int HandleMount(const std::string &target, const std::string &mountPoint,
+                const std::optional<std::string> &listfileName, size_t cacheMegabytes,
+                bool foreground) {
+    return RunMount(target, mountPoint, listfileName, cacheMegabytes * 1024 * 1024, foreground);
+}
+
+int HandleCatalogBuild(const std::string &directory, const std::optional<std::string> &output,
+                       unsigned int threads, bool hashFiles) {
+    const std::string catalogPath =
+        output.has_value() ? output.value()
+                           : (fs::u8path(directory) / "catalog.mpqcat").u8string();
+    return BuildCatalog(directory, catalogPath, threads, hashFiles);
+}
+
+int HandleCatalogUpdate(const std::string &catalogPath, unsigned int threads) {
+    return UpdateCatalog(catalogPath, threads);
+}
+
+int HandleCatalogQuery(const std::string &catalogPath, const std::optional<std::string> &pattern,
+                       const std::optional<std::string> &md5,
+                       const std::optional<std::string> &crc32) {
+    return QueryCatalog(catalogPath, pattern, md5, crc32);
+}
@@ -1,6 +1,7 @@
 #ifndef COMMANDS_H
 #define COMMANDS_H
 
+#include <cstddef>
 #include <cstdint>
 #include <optional>
 #include <string>
@@ -8,31 +9,67 @@
 
 int HandleVersion();
 int HandleAbout();
-int HandleInfo(const std::string &target, const std::optional<std::string> &property);
+int HandleInfo(const std::string &target, const std::optional<std::string> &property,
+               bool useIndex);
 int HandleCreate(const std::string &target, const std::optional<std::string> &nameInArchive,
                  const std::optional<std::string> &output, bool signArchive,
                  const std::optional<std::string> &locale,
                  const std::optional<std::string> &gameProfile, int32_t mpqVersion,
                  int64_t streamFlags, int64_t sectorSize, int64_t rawChunkSize, int64_t fileFlags1,
                  int64_t fileFlags2, int64_t fileFlags3, int64_t attrFlags, int64_t fileDwFlags,
-                 int64_t fileDwCompression, int64_t fileDwCompressionNext);
+                 int64_t fileDwCompression, int64_t fileDwCompressionNext, bool fromTar);
 int HandleAdd(const std::string &file, const std::string &target,
               const std::optional<std::string> &path,
               const std::optional<std::string> &dirInArchive,
               const std::optional<std::string> &nameInArchive, bool overwrite,
               const std::optional<std::string> &locale,
               const std::optional<std::string> &gameProfile, int64_t fileDwFlags,
-              int64_t fileDwCompression, int64_t fileDwCompressionNext);
+              int64_t fileDwCompression, int64_t fileDwCompressionNext, bool atomic,
+              const std::optional<uint32_t> &size, bool fromTar);
 int HandleRemove(const std::string &file, const std::string &target,
-                 const std::optional<std::string> &locale);
+                 const std::optional<std::string> &locale, bool atomic);
 int HandleList(const std::string &target, const std::optional<std::string> &listfileName,
-               bool listAll, bool listDetailed, const std::vector<std::string> &properties);
+               bool listAll, bool listDetailed, const std::vector<std::string> &properties,
+               const std::vector<std::string> &overlays, const std::vector<std::string> &patches,
+               bool useIndex, bool useMmap);
 int HandleExtract(const std::string &target, const std::optional<std::string> &output,
                   const std::optional<std::string> &file, bool keepFolderStructure,
                   const std::optional<std::string> &listfileName,
-                  const std::optional<std::string> &locale);
+                  const std::optional<std::string> &locale,
+                  const std::vector<std::string> &overlays,
+                  const std::vector<std::string> &patches, bool useIndex, bool useMmap,
+                  bool reportBandwidth, bool allLocales, bool linkIdentical,
+                  const std::optional<std::string> &storeDirectory, bool trustAttributes);
 int HandleRead(const std::string &file, const std::string &target,
-               const std::optional<std::string> &locale);
-int HandleVerify(const std::string &target, bool printSignature);
+               const std::optional<std::string> &locale, const std::vector<std::string> &overlays,
+               const std::vector<std::string> &patches, bool useIndex, bool useMmap);
+int HandleVerify(const std::string &target, bool printSignature, bool useMmap);
+int HandleFlatten(const std::string &target, const std::string &output,
+                  const std::optional<std::string> &listfileName,
+                  const std::vector<std::string> &overlays,
+                  const std::vector<std::string> &patches, unsigned int threads);
+int HandleCopy(const std::string &source, const std::string &target,
+               const std::vector<std::string> &files,
+               const std::optional<std::string> &nameInArchive, bool overwrite,
+               const std::optional<std::string> &listfileName);
+int HandleMerge(const std::vector<std::string> &archives, const std::string &output,
+                const std::optional<std::string> &listfileName, unsigned int threads);
+int HandleRename(const std::string &target, const std::string &oldName,
+                 const std::string &newName, const std::optional<std::string> &locale,
+                 const std::optional<std::string> &listfileName, bool atomic);
+int HandleBatch(const std::string &target, bool json, bool readOnly,
+                const std::optional<std::string> &listfileName);
+int HandleServe(const std::string &target, const std::string &socketPath,
+                const std::optional<uint16_t> &httpPort, size_t cacheMegabytes,
+                unsigned int threads, unsigned int maxClients);
+int HandleMount(const std::string &target, const std::string &mountPoint,
+                const std::optional<std::string> &listfileName, size_t cacheMegabytes,
+                bool foreground);
+int HandleCatalogBuild(const std::string &directory, const std::optional<std::string> &output,
+                       unsigned int threads, bool hashFiles);
+int HandleCatalogUpdate(const std::string &catalogPath, unsigned int threads);
+int HandleCatalogQuery(const std::string &catalogPath, const std::optional<std::string> &pattern,
+                       const std::optional<std::string> &md5,
+                       const std::optional<std::string> &crc32);
 
 #endif  // COMMANDS_H
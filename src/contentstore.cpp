@@ -0,0 +1,95 @@
+#include "contentstore.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <random>
+#include <system_error>
+#include <vector>
+
+#include "atomicwrite.h"
+
+bool ContentStore::Open(const std::string &directory) {
+    root = fs::u8path(directory);
+    std::error_code ec;
+    fs::create_directories(root / "tmp", ec);
+    return !ec;
+}
+
+fs::path ContentStore::ObjectPath(const Md5Digest &digest) const {
+    const std::string hex = Md5ToHex(digest);
+    return root / hex.substr(0, 2) / hex.substr(2);
+}
+
+bool ContentStore::Has(const Md5Digest &digest) const {
+    std::error_code ec;
+    return fs::is_regular_file(ObjectPath(digest), ec);
+}
+
+bool ContentStore::Matches(const Md5Digest &digest, const char *data, size_t size) const {
+    const fs::path objectPath = ObjectPath(digest);
+    std::error_code ec;
+    if (fs::file_size(objectPath, ec) != size || ec) {
+        return false;
+    }
+    std::ifstream object(objectPath, std::ios::binary);
+    std::vector<char> buffer(0x10000);
+    for (size_t offset = 0; offset < size;) {
+        const size_t length = std::min(buffer.size(), size - offset);
+        if (!object.read(buffer.data(), static_cast<std::streamsize>(length)) ||
+            std::memcmp(buffer.data(), data + offset, length) != 0) {
+            return false;
+        }
+        offset += length;
+    }
+    return true;
+}
+
+bool ContentStore::Put(const Md5Digest &digest, const char *data, size_t size) {
+    const fs::path objectPath = ObjectPath(digest);
+    if (Has(digest)) {
+        return true;
+    }
+
+    // Another run may be storing the same content, so the temporary name is its own
+    static std::random_device randomDevice;
+    const fs::path tempPath =
+        root / "tmp" / (Md5ToHex(digest) + "." + std::to_string(randomDevice()));
+    std::error_code ec;
+    {
+        std::ofstream tempFile(tempPath, std::ios::binary | std::ios::trunc);
+        if (!tempFile.write(data, static_cast<std::streamsize>(size)) || !tempFile.flush()) {
+            tempFile.close();
+            fs::remove(tempPath, ec);
+            return false;
+        }
+    }
+    fs::permissions(tempPath, fs::perms::owner_read | fs::perms::group_read |
+                                  fs::perms::others_read, ec);
+    fs::create_directories(objectPath.parent_path(), ec);
+    fs::rename(tempPath, objectPath, ec);
+    if (ec) {
+        std::error_code removeError;
+        fs::remove(tempPath, removeError);
+        return false;
+    }
+    return true;
+}
+
+bool ContentStore::Materialize(const Md5Digest &digest, const fs::path &destination) const {
+    const fs::path objectPath = ObjectPath(digest);
+    std::error_code ec;
+    fs::remove(destination, ec);
+
+    fs::create_hard_link(objectPath, destination, ec);
+    if (!ec) {
+        return true;
+    }
+    // Hard links fail across filesystems and on some network shares
+    if (CloneFile(objectPath, destination)) {
+        return true;
+    }
+    ec.clear();
+    fs::copy_file(objectPath, destination, fs::copy_options::overwrite_existing, ec);
+    return !ec;
+}
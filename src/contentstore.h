@@ -0,0 +1,37 @@
+#ifndef CONTENTSTORE_H
+#define CONTENTSTORE_H
+
+#include <cstddef>
+#include <filesystem>
+#include <string>
+
+#include "md5.h"
+
+namespace fs = std::filesystem;
+
+// A directory of file contents named by their MD5, stored once however many archives
+// and files have them: <store>/<first 2 hex digits>/<other 30>. Objects are written
+// to <store>/tmp and renamed into place, so a store shared between runs only ever
+// holds complete objects. They are made read-only, since extracted files link to them.
+class ContentStore {
+public:
+    // Use the directory as the store, creating it if needed
+    bool Open(const std::string &directory);
+
+    bool Has(const Md5Digest &digest) const;
+    // Whether the object stored under the digest holds exactly this content. MD5
+    // collisions can be made on purpose, so a digest found in the store is not proof.
+    bool Matches(const Md5Digest &digest, const char *data, size_t size) const;
+    // Store content under its digest. Content already stored is kept as is.
+    bool Put(const Md5Digest &digest, const char *data, size_t size);
+    // Create a file with stored content: a hard link to the object, else a reflink
+    // clone, else a copy. Replaces an existing file.
+    bool Materialize(const Md5Digest &digest, const fs::path &destination) const;
+
+private:
+    fs::path ObjectPath(const Md5Digest &digest) const;
+
+    fs::path root;
+};
+
+#endif  // CONTENTSTORE_H
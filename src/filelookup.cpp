@@ -0,0 +1,64 @@
+#include "filelookup.h"
+
+#include <algorithm>
+
+#include <StormLib.h>
+
+#include "locales.h"
+
+namespace {
+std::mutex localeMutex;  // Guards StormLib's process-wide locale
+}  // namespace
+
+LocaleLock::LocaleLock(LCID locale) : lock(localeMutex), changed(locale != defaultLocale) {
+    if (changed) {
+        SFileSetLocale(locale);
+    }
+}
+
+LocaleLock::~LocaleLock() {
+    if (changed) {
+        SFileSetLocale(defaultLocale);
+    }
+}
+
+std::optional<std::vector<LCID>> LookupFileLocales(HANDLE hArchive, const char *fileName) {
+    // SFileEnumLocales walks the hash table entries of the name, ignoring the global locale
+    DWORD localeCount = 8;
+    std::vector<LCID> locales(localeCount);
+    DWORD result = SFileEnumLocales(hArchive, fileName, locales.data(), &localeCount, 0);
+    if (result == ERROR_INSUFFICIENT_BUFFER) {
+        locales.resize(localeCount);
+        result = SFileEnumLocales(hArchive, fileName, locales.data(), &localeCount, 0);
+    }
+    if (result != ERROR_SUCCESS) {
+        return std::nullopt;
+    }
+    locales.resize(std::min<size_t>(localeCount, locales.size()));
+    return locales;
+}
+
+LCID ResolveFileLocale(HANDLE hArchive, const char *fileName, LCID locale) {
+    const auto locales = LookupFileLocales(hArchive, fileName);
+    if (!locales.has_value() || locales->empty()) {
+        return locale;
+    }
+    if (std::find(locales->begin(), locales->end(), locale) != locales->end()) {
+        return locale;
+    }
+    if (std::find(locales->begin(), locales->end(), defaultLocale) != locales->end()) {
+        return defaultLocale;
+    }
+    return locale;  // Not stored for the locale, the open fails like StormLib's own lookup
+}
+
+bool OpenFileForLocale(HANDLE hArchive, const char *fileName, LCID locale, HANDLE *hFile) {
+    const LCID fileLocale = ResolveFileLocale(hArchive, fileName, locale);
+    LocaleLock lock(fileLocale);
+    return SFileOpenFileEx(hArchive, fileName, SFILE_OPEN_FROM_MPQ, hFile);
+}
+
+bool HasFile(HANDLE hArchive, const char *fileName) {
+    LocaleLock lock(defaultLocale);
+    return SFileHasFile(hArchive, fileName);
+}
@@ -0,0 +1,48 @@
+#ifndef FILELOOKUP_H
+#define FILELOOKUP_H
+
+#include <mutex>
+#include <optional>
+#include <vector>
+
+#include <StormLib.h>
+
+// StormLib looks files up by name under one process-wide locale (SFileSetLocale), so
+// threads opening files under different locales, even in different archives, would open
+// each other's files. Here the locale a name resolves to is worked out from the archive's
+// hash table first, and StormLib is handed exactly that locale under a lock held only for
+// the lookup. Reading and decompressing an opened file needs no lock.
+
+// Holds StormLib's locale at a value for the calls in its scope that find a file by name:
+// SFileOpenFileEx, SFileExtractFile, SFileHasFile, SFileAddFileEx, SFileRemoveFile and
+// SFileRenameFile. Outside of a lock the locale is the default one.
+class LocaleLock {
+public:
+    explicit LocaleLock(LCID locale);
+    ~LocaleLock();
+
+    LocaleLock(const LocaleLock &) = delete;
+    LocaleLock &operator=(const LocaleLock &) = delete;
+
+private:
+    std::lock_guard<std::mutex> lock;
+    bool changed;
+};
+
+// The locales a name is stored under, in hash table order, without opening anything.
+// Empty for names the hash table does not have. No value for pseudo names (File00000001.xxx)
+// and archives without a classic hash table, which only StormLib can look up.
+std::optional<std::vector<LCID>> LookupFileLocales(HANDLE hArchive, const char *fileName);
+
+// The locale of the entry a lookup for the locale finds: the locale itself, else the
+// neutral one. Names the hash table does not have (files only a patch adds, pseudo
+// names) keep the locale, StormLib has the last word on them.
+LCID ResolveFileLocale(HANDLE hArchive, const char *fileName, LCID locale);
+
+// Open the file a name resolves to for the locale
+bool OpenFileForLocale(HANDLE hArchive, const char *fileName, LCID locale, HANDLE *hFile);
+
+// SFileHasFile, which looks the name up for the default locale
+bool HasFile(HANDLE hArchive, const char *fileName);
+
+#endif  // FILELOOKUP_H
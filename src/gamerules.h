@@ -129,9 +129,6 @@ private:
     std::vector<CompressionRule> rules;
     MpqCreateSettings createSettings;
 
-    // Helper function to match file mask pattern
-    static bool MatchFileMask(const std::string &filename, const std::string &mask);
-
     // Add rule by file mask
     void AddRuleByFileMask(const std::string &fileMask, DWORD mpqFlags, DWORD compressionFirst,
                            DWORD compressionNext = MPQ_COMPRESSION_NEXT_SAME);
@@ -154,6 +151,10 @@ public:
     // Constructor
     explicit GameRules(GameProfile gameProfile);
 
+    // Match a file name against a mask with * and ? wildcards, in any case and with
+    // either slash
+    static bool MatchFileMask(const std::string &filename, const std::string &mask);
+
     // Get compression settings for a specific file
     [[nodiscard]] CompressionSettings GetCompressionSettings(const std::string &filename,
                                                              DWORD fileSize) const;
@@ -1,6 +1,7 @@
 #include "helpers.h"
 
 #include <algorithm>
+#include <cctype>
 #include <ctime>
 #include <filesystem>
 #include <iostream>
@@ -8,10 +9,19 @@
 #ifdef _WIN32
 #include <fcntl.h>
 #include <io.h>
+#elif defined(__linux__)
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+#ifndef _WIN32
+#include <sys/stat.h>
+#include <unistd.h>
 #endif
 
 #include <StormLib.h>
 
+#include "instrumentation.h"
+
 namespace fs = std::filesystem;
 
 std::string FileTimeToLsTime(int64_t fileTime) {
@@ -31,6 +41,28 @@ std::string FileTimeToLsTime(int64_t fileTime) {
     return std::string(buf);
 }
 
+int64_t FileWriteTime(const fs::path &path) {
+#ifdef _WIN32
+    // The filesystem clock of MSVC counts 100 ns intervals since 1601, like FILETIME
+    std::error_code error;
+    const auto writeTime = fs::last_write_time(path, error);
+    return error ? CurrentFileTime() : static_cast<int64_t>(writeTime.time_since_epoch().count());
+#else
+    struct stat fileStat {};
+    if (stat(path.c_str(), &fileStat) != 0) {
+        return CurrentFileTime();
+    }
+    return UnixTimeToFileTime(static_cast<int64_t>(fileStat.st_mtime));
+#endif
+}
+
+int64_t CurrentFileTime() { return UnixTimeToFileTime(static_cast<int64_t>(std::time(nullptr))); }
+
+int64_t UnixTimeToFileTime(int64_t unixTime) {
+    constexpr int64_t EPOCH_DIFF = 11644473600LL;
+    return (unixTime + EPOCH_DIFF) * 10000000;
+}
+
 std::string NormalizeFilePath(const fs::path &path) {
     std::string filePath = path.u8string();
 #ifndef _WIN32
@@ -47,6 +79,16 @@ std::string WindowsifyFilePath(const fs::path &path) {
     return filePath;
 }
 
+// MPQ file names are case-insensitive and treat '/' and '\\' alike, so build
+// a lookup key that compares equal for all spellings of the same name
+std::string ArchivePathKey(const std::string &path) {
+    std::string key = path;
+    std::transform(key.begin(), key.end(), key.begin(), [](unsigned char c) {
+        return c == '/' ? '\\' : static_cast<char>(std::toupper(c));
+    });
+    return key;
+}
+
 uint32_t CalculateMpqMaxFileValue(const std::string &path) {
     uint32_t fileCount = 0;
 
@@ -84,9 +126,71 @@ uint32_t NextPowerOfTwo(uint32_t n) {
     return n + 1;
 }
 
-void PrintAsBinary(const char *buffer, uint32_t size) {
+void SetBinaryStdin() {
+#ifdef _WIN32
+    _setmode(_fileno(stdin), _O_BINARY);
+#endif
+}
+
+void SetBinaryStdout() {
 #ifdef _WIN32
     _setmode(_fileno(stdout), _O_BINARY);
 #endif
+}
+
+bool IsTerminal(FILE *stream) {
+#ifdef _WIN32
+    return _isatty(_fileno(stream)) != 0;
+#else
+    return isatty(fileno(stream)) != 0;
+#endif
+}
+
+void PrintAsBinary(const char *buffer, uint32_t size) {
+    CountFile(size);
+    PhaseSpan span("write");
+    SetBinaryStdout();
     std::cout.write(buffer, size);
 }
+
+// Ask the kernel to start reading a file into the page cache, ahead of a bulk read
+// of the whole file. Memory-mapped reads then find their pages already loaded.
+void PrefetchFile(const std::string &path) {
+#if defined(__linux__)
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd >= 0) {
+        posix_fadvise(fd, 0, 0, POSIX_FADV_WILLNEED);
+        close(fd);
+    }
+#else
+    (void)path;
+#endif
+}
+
+FileReadahead::FileReadahead(const std::string &path) {
+#if defined(__linux__)
+    fd = open(path.c_str(), O_RDONLY);
+#else
+    (void)path;
+#endif
+}
+
+FileReadahead::~FileReadahead() {
+#if defined(__linux__)
+    if (fd >= 0) {
+        close(fd);
+    }
+#endif
+}
+
+void FileReadahead::WillNeed(uint64_t offset, uint64_t length) {
+#if defined(__linux__)
+    if (fd >= 0 && length > 0) {
+        posix_fadvise(fd, static_cast<off_t>(offset), static_cast<off_t>(length),
+                      POSIX_FADV_WILLNEED);
+    }
+#else
+    (void)offset;
+    (void)length;
+#endif
+}
@@ -1,16 +1,42 @@
 #ifndef HELPERS_H
 #define HELPERS_H
 
+#include <cstdint>
+#include <cstdio>
 #include <filesystem>
 #include <string>
 
 namespace fs = std::filesystem;
 
 std::string FileTimeToLsTime(int64_t fileTime);
+// Times as the FILETIME values StormLib stores, in whole seconds like StormLib reads them
+int64_t FileWriteTime(const fs::path &path);
+int64_t CurrentFileTime();
+int64_t UnixTimeToFileTime(int64_t unixTime);
 std::string NormalizeFilePath(const fs::path &path);
 std::string WindowsifyFilePath(const fs::path &path);
+std::string ArchivePathKey(const std::string &path);
 uint32_t CalculateMpqMaxFileValue(const std::string &path);
 uint32_t NextPowerOfTwo(uint32_t n);
+void SetBinaryStdout();
+void SetBinaryStdin();
+bool IsTerminal(FILE *stream);
 void PrintAsBinary(const char *buffer, uint32_t size);
+void PrefetchFile(const std::string &path);
+
+// Hints the kernel about byte ranges of a file that are read soon (Linux only)
+class FileReadahead {
+public:
+    explicit FileReadahead(const std::string &path);
+    ~FileReadahead();
+
+    FileReadahead(const FileReadahead &) = delete;
+    FileReadahead &operator=(const FileReadahead &) = delete;
+
+    void WillNeed(uint64_t offset, uint64_t length);
+
+private:
+    int fd = -1;
+};
 
 #endif
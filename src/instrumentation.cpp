@@ -0,0 +1,334 @@
+#include "instrumentation.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#include <time.h>
+#endif
+
+bool instrumentationStats = false;
+bool instrumentationTrace = false;
+
+namespace {
+
+struct TraceEvent {
+    const char *name;      // Phase, or the operation of a file span
+    std::string fileName;  // Empty for phases
+    uint64_t start;        // Nanoseconds since StartInstrumentation
+    uint64_t duration;
+};
+
+struct PhaseTotal {
+    const char *name;
+    uint64_t calls;
+    uint64_t wall;  // Nanoseconds
+    uint64_t cpu;
+};
+
+// Only written by its own thread, and only read once every thread is done, so recording
+// takes no lock
+struct ThreadBuffer {
+    size_t index = 0;
+    std::vector<PhaseTotal> phases;
+    std::vector<TraceEvent> events;
+    uint64_t files = 0;
+    uint64_t bytes = 0;
+};
+
+std::mutex buffersMutex;
+std::vector<std::unique_ptr<ThreadBuffer>> buffers;
+thread_local ThreadBuffer *threadBuffer = nullptr;
+
+std::chrono::steady_clock::time_point sessionStart;
+std::ofstream traceFile;
+std::string traceFileName;
+
+ThreadBuffer &LocalBuffer() {
+    if (threadBuffer == nullptr) {
+        std::lock_guard<std::mutex> lock(buffersMutex);
+        buffers.push_back(std::make_unique<ThreadBuffer>());
+        threadBuffer = buffers.back().get();
+        threadBuffer->index = buffers.size() - 1;
+    }
+    return *threadBuffer;
+}
+
+uint64_t WallNanos() {
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                     std::chrono::steady_clock::now() - sessionStart)
+                                     .count());
+}
+
+uint64_t ThreadCpuNanos() {
+#ifdef _WIN32
+    FILETIME creation, exit, kernel, user;
+    if (!GetThreadTimes(GetCurrentThread(), &creation, &exit, &kernel, &user)) {
+        return 0;
+    }
+    auto ticks = [](const FILETIME &time) {
+        return (static_cast<uint64_t>(time.dwHighDateTime) << 32) | time.dwLowDateTime;
+    };
+    return (ticks(kernel) + ticks(user)) * 100;
+#else
+    timespec time{};
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &time);
+    return static_cast<uint64_t>(time.tv_sec) * 1000000000 + static_cast<uint64_t>(time.tv_nsec);
+#endif
+}
+
+// User and system CPU time of the whole process, in seconds
+std::pair<double, double> ProcessCpuSeconds() {
+#ifdef _WIN32
+    FILETIME creation, exit, kernel, user;
+    if (!GetProcessTimes(GetCurrentProcess(), &creation, &exit, &kernel, &user)) {
+        return {0, 0};
+    }
+    auto seconds = [](const FILETIME &time) {
+        return ((static_cast<uint64_t>(time.dwHighDateTime) << 32) | time.dwLowDateTime) / 1e7;
+    };
+    return {seconds(user), seconds(kernel)};
+#else
+    rusage usage{};
+    getrusage(RUSAGE_SELF, &usage);
+    auto seconds = [](const timeval &time) {
+        return static_cast<double>(time.tv_sec) + static_cast<double>(time.tv_usec) / 1e6;
+    };
+    return {seconds(usage.ru_utime), seconds(usage.ru_stime)};
+#endif
+}
+
+std::string JsonString(const std::string &text) {
+    std::string escaped = "\"";
+    for (const char c : text) {
+        if (c == '"' || c == '\\') {
+            escaped += '\\';
+            escaped += c;
+        } else if (static_cast<unsigned char>(c) < 0x20) {
+            char code[8];
+            std::snprintf(code, sizeof(code), "\\u%04x", c);
+            escaped += code;
+        } else {
+            escaped += c;
+        }
+    }
+    return escaped + "\"";
+}
+
+void PrintStats() {
+    // Phases in the order they first finished, main thread first
+    std::vector<PhaseTotal> phases;
+    uint64_t files = 0;
+    uint64_t bytes = 0;
+    for (const auto &buffer : buffers) {
+        for (const PhaseTotal &phase : buffer->phases) {
+            auto it = std::find_if(phases.begin(), phases.end(), [&](const PhaseTotal &total) {
+                return std::strcmp(total.name, phase.name) == 0;
+            });
+            if (it == phases.end()) {
+                phases.push_back(phase);
+            } else {
+                it->calls += phase.calls;
+                it->wall += phase.wall;
+                it->cpu += phase.cpu;
+            }
+        }
+        files += buffer->files;
+        bytes += buffer->bytes;
+    }
+
+    const double wallSeconds = static_cast<double>(WallNanos()) / 1e9;
+    const auto [userSeconds, systemSeconds] = ProcessCpuSeconds();
+    const double mebibytes = static_cast<double>(bytes) / (1024.0 * 1024.0);
+
+    std::ostream &out = std::cerr;
+    out << "[*] Stats:" << "\n";
+    out << "    " << std::left << std::setw(16) << "Phase" << std::right << std::setw(10)
+        << "Calls" << std::setw(14) << "Wall (ms)" << std::setw(14) << "CPU (ms)" << "\n";
+    out << std::fixed << std::setprecision(2);
+    for (const PhaseTotal &phase : phases) {
+        out << "    " << std::left << std::setw(16) << phase.name << std::right << std::setw(10)
+            << phase.calls << std::setw(14) << static_cast<double>(phase.wall) / 1e6
+            << std::setw(14) << static_cast<double>(phase.cpu) / 1e6 << "\n";
+    }
+    out << "    Files: " << files << ", Bytes: " << bytes << " (" << mebibytes
+        << " MiB), Throughput: " << (wallSeconds > 0 ? mebibytes / wallSeconds : 0.0)
+        << " MiB/s\n";
+    out << std::setprecision(3) << "    Time: " << wallSeconds << " s wall, " << userSeconds
+        << " s user, " << systemSeconds << " s system\n";
+#ifndef _WIN32
+    rusage usage{};
+    getrusage(RUSAGE_SELF, &usage);
+    out << "    Context switches: " << usage.ru_nvcsw << " voluntary, " << usage.ru_nivcsw
+        << " involuntary\n";
+#endif
+#ifdef __linux__
+    // Read and write calls of any kind (read, pread, readv, ...), from the kernel's counters
+    std::ifstream io("/proc/self/io");
+    std::string key;
+    uint64_t value;
+    uint64_t reads = 0;
+    uint64_t writes = 0;
+    while (io >> key >> value) {
+        if (key == "syscr:") {
+            reads = value;
+        } else if (key == "syscw:") {
+            writes = value;
+        }
+    }
+    out << "    Syscalls: " << reads << " read, " << writes << " write\n";
+#endif
+    out << std::setprecision(1) << "    Peak RSS: "
+        << static_cast<double>(PeakRssBytes()) / (1024.0 * 1024.0) << " MiB" << std::endl;
+    out.unsetf(std::ios_base::floatfield);
+    out << std::setprecision(6);
+}
+
+// Chrome trace event format, loadable in chrome://tracing and Perfetto
+void WriteTrace() {
+    traceFile << std::fixed << std::setprecision(3);
+    traceFile << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+    bool first = true;
+    for (const auto &buffer : buffers) {
+        traceFile << (first ? "\n" : ",\n")
+                  << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << buffer->index
+                  << ",\"args\":{\"name\":\""
+                  << (buffer->index == 0 ? "main" : "worker " + std::to_string(buffer->index))
+                  << "\"}}";
+        first = false;
+        for (const TraceEvent &event : buffer->events) {
+            const bool file = !event.fileName.empty();
+            traceFile << ",\n{\"name\":" << JsonString(file ? event.fileName : event.name)
+                      << ",\"cat\":\"" << (file ? event.name : "phase") << "\",\"ph\":\"X\""
+                      << ",\"ts\":" << static_cast<double>(event.start) / 1e3
+                      << ",\"dur\":" << static_cast<double>(event.duration) / 1e3
+                      << ",\"pid\":1,\"tid\":" << buffer->index << "}";
+        }
+    }
+    traceFile << "\n]}\n";
+    traceFile.close();
+    if (!traceFile) {
+        std::cerr << "[!] Failed to write trace file: " << traceFileName << std::endl;
+    }
+}
+
+}  // namespace
+
+bool StartInstrumentation(bool stats, const std::optional<std::string> &tracePath) {
+    sessionStart = std::chrono::steady_clock::now();
+    if (tracePath.has_value()) {
+        traceFileName = tracePath.value();
+        traceFile.open(std::filesystem::u8path(traceFileName), std::ios::trunc);
+        if (!traceFile) {
+            std::cerr << "[!] Failed to open trace file: " << traceFileName << std::endl;
+            return false;
+        }
+    }
+    instrumentationStats = stats;
+    instrumentationTrace = tracePath.has_value();
+    if (InstrumentationEnabled()) {
+        LocalBuffer();  // The main thread is thread 0
+    }
+    return true;
+}
+
+void FinishInstrumentation() {
+    if (!InstrumentationEnabled()) {
+        return;
+    }
+    if (instrumentationStats) {
+        PrintStats();
+    }
+    if (instrumentationTrace) {
+        WriteTrace();
+    }
+    instrumentationStats = false;
+    instrumentationTrace = false;
+}
+
+void PhaseSpan::Begin() {
+    active = true;
+    wallStart = WallNanos();
+    if (instrumentationStats) {
+        cpuStart = ThreadCpuNanos();
+    }
+}
+
+void PhaseSpan::End() {
+    const uint64_t wall = WallNanos() - wallStart;
+    ThreadBuffer &buffer = LocalBuffer();
+    if (instrumentationStats) {
+        const uint64_t cpu = ThreadCpuNanos() - cpuStart;
+        // Names are literals, so the pointer usually matches without comparing strings
+        auto it = std::find_if(buffer.phases.begin(), buffer.phases.end(),
+                               [this](const PhaseTotal &total) {
+                                   return total.name == name || std::strcmp(total.name, name) == 0;
+                               });
+        if (it == buffer.phases.end()) {
+            buffer.phases.push_back({name, 1, wall, cpu});
+        } else {
+            it->calls++;
+            it->wall += wall;
+            it->cpu += cpu;
+        }
+    }
+    if (instrumentationTrace) {
+        buffer.events.push_back({name, std::string(), wallStart, wall});
+    }
+}
+
+void FileSpan::Begin(const std::string &fileName) {
+    ThreadBuffer &buffer = LocalBuffer();
+    active = true;
+    event = buffer.events.size();
+    buffer.events.push_back({operation, fileName.empty() ? "(unnamed)" : fileName, WallNanos(), 0});
+}
+
+void FileSpan::End() {
+    TraceEvent &traceEvent = LocalBuffer().events[event];
+    traceEvent.duration = WallNanos() - traceEvent.start;
+}
+
+void CountFile(uint64_t bytes) {
+    if (!InstrumentationEnabled()) {
+        return;
+    }
+    ThreadBuffer &buffer = LocalBuffer();
+    buffer.files++;
+    buffer.bytes += bytes;
+}
+
+uint64_t PeakRssBytes() {
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS counters{};
+    if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) {
+        return 0;
+    }
+    return counters.PeakWorkingSetSize;
+#else
+    rusage usage{};
+    if (getrusage(RUSAGE_SELF, &usage) != 0) {
+        return 0;
+    }
+#ifdef __APPLE__
+    return static_cast<uint64_t>(usage.ru_maxrss);  // Bytes on macOS
+#else
+    return static_cast<uint64_t>(usage.ru_maxrss) * 1024;  // Kilobytes elsewhere
+#endif
+#endif
+}
@@ -0,0 +1,94 @@
+#ifndef INSTRUMENTATION_H
+#define INSTRUMENTATION_H
+
+#include <cstdint>
+#include <optional>
+#include <string>
+
+// Set once at startup, before any thread is started
+extern bool instrumentationStats;
+extern bool instrumentationTrace;
+
+inline bool InstrumentationEnabled() { return instrumentationStats || instrumentationTrace; }
+
+// Enable --stats and/or --trace. Opens the trace file up front, so a bad path fails
+// before any work is done. Returns false if it cannot be opened.
+bool StartInstrumentation(bool stats, const std::optional<std::string> &tracePath);
+
+// Print the --stats report to stderr and write the --trace file. Every thread that
+// recorded spans must have finished.
+void FinishInstrumentation();
+
+// Runs FinishInstrumentation when main returns, whichever subcommand ran
+class InstrumentationGuard {
+public:
+    InstrumentationGuard() = default;
+    ~InstrumentationGuard() { FinishInstrumentation(); }
+
+    InstrumentationGuard(const InstrumentationGuard &) = delete;
+    InstrumentationGuard &operator=(const InstrumentationGuard &) = delete;
+};
+
+// Times a phase of a command (open, compress, flush, ...) in wall and thread CPU time.
+// Phases of the same name are summed over all threads for --stats, and recorded as
+// spans for --trace. The name must be a string literal. Costs one branch when disabled.
+class PhaseSpan {
+public:
+    explicit PhaseSpan(const char *name) : name(name) {
+        if (InstrumentationEnabled()) {
+            Begin();
+        }
+    }
+    ~PhaseSpan() {
+        if (active) {
+            End();
+        }
+    }
+
+    PhaseSpan(const PhaseSpan &) = delete;
+    PhaseSpan &operator=(const PhaseSpan &) = delete;
+
+private:
+    void Begin();
+    void End();
+
+    const char *name;
+    bool active = false;
+    uint64_t wallStart = 0;
+    uint64_t cpuStart = 0;
+};
+
+// Times the work on one file, as a span named after the file in --trace only. The
+// operation (add, extract, ...) must be a string literal.
+class FileSpan {
+public:
+    FileSpan(const char *operation, const std::string &fileName) : operation(operation) {
+        if (instrumentationTrace) {
+            Begin(fileName);
+        }
+    }
+    ~FileSpan() {
+        if (active) {
+            End();
+        }
+    }
+
+    FileSpan(const FileSpan &) = delete;
+    FileSpan &operator=(const FileSpan &) = delete;
+
+private:
+    void Begin(const std::string &fileName);
+    void End();
+
+    const char *operation;
+    bool active = false;
+    size_t event = 0;
+};
+
+// Count a file handled by the command, for the totals of --stats
+void CountFile(uint64_t bytes);
+
+// Peak resident set size of this process, or 0 where unknown
+uint64_t PeakRssBytes();
+
+#endif  // INSTRUMENTATION_H
@@ -0,0 +1,34 @@
+#include "logging.h"
+
+#include <cstdio>
+#include <iostream>
+
+#include "helpers.h"
+
+namespace {
+constexpr size_t kStdoutBufferBytes = 64 * 1024;
+
+LogLevel logLevel = LogLevel::NORMAL;
+}  // namespace
+
+void StartLogging(LogLevel level) {
+    logLevel = level;
+    // A terminal keeps its line buffering, so lines show up as they are printed
+    if (!IsTerminal(stdout)) {
+        std::setvbuf(stdout, nullptr, _IOFBF, kStdoutBufferBytes);
+    }
+}
+
+LogLevel GetLogLevel() { return logLevel; }
+
+void LogFile(const std::string &message) {
+    if (logLevel >= LogLevel::NORMAL) {
+        std::cout << message << '\n';
+    }
+}
+
+void LogVerbose(const std::string &message) {
+    if (logLevel >= LogLevel::VERBOSE) {
+        std::cout << message << '\n';
+    }
+}
@@ -0,0 +1,28 @@
+#ifndef LOGGING_H
+#define LOGGING_H
+
+#include <string>
+
+enum class LogLevel {
+    QUIET,    // Errors and warnings only (-q)
+    NORMAL,   // A line for each file added, extracted or removed
+    VERBOSE,  // Also the settings chosen for each file (-v)
+};
+
+// Set the level for the rest of the run, before anything is printed. When stdout is
+// not a terminal it gets a large buffer, so per-file lines leave in blocks instead of
+// a write each.
+void StartLogging(LogLevel level);
+
+LogLevel GetLogLevel();
+
+inline bool LogEnabled(LogLevel level) { return GetLogLevel() >= level; }
+
+// Print a per-file line to stdout, without flushing. Errors still go to std::cerr,
+// which flushes stdout first, so the two stay in order.
+void LogFile(const std::string &message);
+
+// Print a line to stdout in verbose mode only
+void LogVerbose(const std::string &message);
+
+#endif  // LOGGING_H
@@ -0,0 +1,87 @@
+#ifndef LRUCACHE_H
+#define LRUCACHE_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+
+// Thread-safe least-recently-used cache of decompressed data, bounded by the total
+// size of the cached values rather than their count. Values are shared, so a value
+// evicted while a reader still uses it stays alive until that reader is done.
+template <typename Key>
+class LruCache {
+public:
+    using Value = std::shared_ptr<const std::string>;
+
+    explicit LruCache(size_t byteBudget) : byteBudget(byteBudget) {}
+
+    // Get a cached value and mark it as most recently used, or nullptr
+    Value Get(const Key &key) {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = index.find(key);
+        if (it == index.end()) {
+            misses++;
+            return nullptr;
+        }
+        entries.splice(entries.begin(), entries, it->second);
+        hits++;
+        return it->second->second;
+    }
+
+    // Insert a value, evicting the least recently used values to stay in budget.
+    // Values larger than the whole budget are not cached.
+    void Put(const Key &key, Value value) {
+        if (value == nullptr || value->size() > byteBudget) {
+            return;
+        }
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = index.find(key);
+        if (it != index.end()) {
+            byteCount -= it->second->second->size();
+            entries.erase(it->second);
+            index.erase(it);
+        }
+        byteCount += value->size();
+        entries.emplace_front(key, std::move(value));
+        index.emplace(key, entries.begin());
+
+        while (byteCount > byteBudget && !entries.empty()) {
+            byteCount -= entries.back().second->size();
+            index.erase(entries.back().first);
+            entries.pop_back();
+        }
+    }
+
+    [[nodiscard]] size_t ByteBudget() const { return byteBudget; }
+    [[nodiscard]] uint64_t Hits() const { return hits; }
+    [[nodiscard]] uint64_t Misses() const { return misses; }
+
+    [[nodiscard]] size_t Size() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return entries.size();
+    }
+
+    [[nodiscard]] size_t Bytes() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return byteCount;
+    }
+
+private:
+    using Entry = std::pair<Key, Value>;
+
+    const size_t byteBudget;
+    size_t byteCount = 0;
+    std::list<Entry> entries;  // Most recently used first
+    std::unordered_map<Key, typename std::list<Entry>::iterator> index;
+    mutable std::mutex mutex;
+    std::atomic<uint64_t> hits{0};
+    std::atomic<uint64_t> misses{0};
+};
+
+#endif  // LRUCACHE_H
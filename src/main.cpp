@@ -8,6 +8,8 @@
 
 #include "commands.h"
 #include "gamerules.h"
+#include "instrumentation.h"
+#include "logging.h"
 #include "validators.h"
 
 int main(int argc, char **argv) {
@@ -17,24 +19,43 @@ int main(int argc, char **argv) {
 
     // Require at least one subcommand
     app.require_subcommand(1);
+    // Global options are also accepted after the subcommand
+    app.fallthrough();
 
+    // CLI: global
+    bool globalQuiet = false;
+    bool globalVerbose = false;
+    bool globalStats = false;
+    std::optional<std::string> globalTrace;
     // CLI: base
     // These are reused in multiple subcommands
     std::string baseTarget;                        // all subcommands
     std::string baseFile;                          // add, remove, extract, read
     std::optional<std::string> basePath;           // add
-    std::optional<std::string> baseLocale;         // create, add, remove, extract, read
-    std::optional<std::string> baseNameInArchive;  // add, create
+    std::optional<std::string> baseLocale;         // create, add, remove, extract, read, rename
+    std::optional<std::string> baseNameInArchive;  // add, create, copy
     std::optional<std::string> baseOutput;         // create, extract
-    std::optional<std::string> baseListfileName;   // list, extract
+    std::optional<std::string> baseListfileName;   // list, extract, flatten, copy, merge
     std::optional<std::string> baseGameProfile;    // create, add
+    std::vector<std::string> baseOverlays;         // list, extract, read, flatten
+    std::vector<std::string> basePatches;          // list, extract, read, flatten
+    bool baseAtomic = false;                       // add, remove, rename
+    bool baseIndex = false;                        // info, list, extract, read
+    bool baseNoMmap = false;                       // list, extract, read, verify
+    bool baseFromTar = false;                      // create, add
     // CLI: info
     std::optional<std::string> infoProperty;
     // CLI: add
     std::optional<std::string> baseDirInArchive;  // add
     bool addOverwrite = false;
+    std::optional<uint32_t> addSize;  // Bytes read from stdin
     // CLI: extract
     bool extractKeepFolderStructure = false;
+    bool extractBandwidth = false;
+    bool extractAllLocales = false;
+    bool extractLinkIdentical = false;
+    std::optional<std::string> extractStore;
+    bool extractTrustAttributes = false;
     // CLI: create
     bool createSignArchive = false;
     int32_t createMpqVersion = -1;
@@ -55,6 +76,42 @@ int main(int argc, char **argv) {
     std::vector<std::string> listProperties;
     // CLI: verify
     bool verifyPrintSignature = false;
+    // CLI: flatten
+    std::string flattenOutput;
+    unsigned int flattenThreads = 0;
+    // CLI: copy
+    std::string copySource;
+    std::vector<std::string> copyFiles;
+    bool copyOverwrite = false;
+    // CLI: merge
+    std::vector<std::string> mergeArchives;
+    std::string mergeOutput;
+    unsigned int mergeThreads = 0;
+    // CLI: rename
+    std::string renameOld;
+    std::string renameNew;
+    // CLI: batch
+    bool batchJson = false;
+    bool batchReadOnly = false;
+    // CLI: serve
+    std::string serveSocket;
+    std::optional<uint16_t> serveHttpPort;
+    size_t serveCacheSize = 64;
+    unsigned int serveThreads = 0;
+    unsigned int serveMaxClients = 64;
+    // CLI: mount
+    std::string mountPoint;
+    size_t mountCacheSize = 64;
+    bool mountForeground = false;
+    // CLI: catalog
+    std::string catalogDirectory;
+    std::optional<std::string> catalogOutput;
+    std::string catalogFile;
+    std::optional<std::string> catalogPattern;
+    std::optional<std::string> catalogMd5;
+    std::optional<std::string> catalogCrc32;
+    bool catalogHash = false;
+    unsigned int catalogThreads = 0;
 
     // clang-format off: preserve vertical alignment of string set initialisers
     std::set<std::string> validInfoProperties = {
@@ -83,6 +140,15 @@ int main(int argc, char **argv) {
     };
     // clang-format on
 
+    CLI::Option *quietFlag =
+        app.add_flag("-q,--quiet", globalQuiet, "Print only warnings and errors, no line per file");
+    app.add_flag("-v,--verbose", globalVerbose, "Also print the settings chosen for each file")
+        ->excludes(quietFlag);
+    app.add_flag("--stats", globalStats,
+                 "Print time spent per phase, throughput and resource usage to stderr");
+    app.add_option("--trace", globalTrace,
+                   "Write a Chrome trace of phases and files to the given JSON file");
+
     // Subcommand: Version
     CLI::App *version = app.add_subcommand("version", "Prints program version");
 
@@ -96,14 +162,16 @@ int main(int argc, char **argv) {
         ->check(CLI::ExistingFile);
     info->add_option("-p,--property", infoProperty, "Prints only a specific property value")
         ->check(CLI::IsMember(validInfoProperties));
+    info->add_flag("--index", baseIndex, "Use the sidecar index, rebuilding it when stale");
 
     // Subcommand: Create
     CLI::App *create =
         app.add_subcommand("create", "Create an MPQ archive from target file or directory");
     create->add_option("target", baseTarget, "Directory or file to put in MPQ archive")
         ->required()
-        ->check(CLI::ExistingPath);
+        ->check(CLI::ExistingPath | CLI::IsMember(std::vector<std::string>{"-"}));
     create->add_option("-n,--name-in-archive", baseNameInArchive, "Filename inside MPQ archive");
+    create->add_flag("--from-tar", baseFromTar, "Target is a tar file, or - to read it from stdin");
     create->add_option("-o,--output", baseOutput, "Output MPQ archive");
     create->add_flag("-s,--sign", createSignArchive, "Sign the MPQ archive (default false)");
     create->add_option("--locale", baseLocale, "Locale to use for added files")->check(LocaleValid);
@@ -146,7 +214,9 @@ int main(int argc, char **argv) {
 
     // Subcommand: Add
     CLI::App *add = app.add_subcommand("add", "Add a file to an existing MPQ archive");
-    add->add_option("file", baseFile, "File to add")->required()->check(CLI::ExistingFile);
+    add->add_option("file", baseFile, "File to add, or - to read from stdin")
+        ->required()
+        ->check(CLI::ExistingFile | CLI::IsMember(std::vector<std::string>{"-"}));
     add->add_option("target", baseTarget, "Target MPQ archive")
         ->required()
         ->check(CLI::ExistingFile);
@@ -156,7 +226,10 @@ int main(int argc, char **argv) {
                     "Directory to put file inside within MPQ archive");
     add->add_option("-f,--filename-in-archive", baseNameInArchive, "Filename inside MPQ archive");
     add->add_flag("-w,--overwrite", addOverwrite, "Overwrite file if it already is in MPQ archive");
+    add->add_option("--size", addSize, "Number of bytes to read when adding from stdin");
+    add->add_flag("--from-tar", baseFromTar, "Add every file of a tar file, or - for stdin");
     add->add_option("--locale", baseLocale, "Locale to use for added file")->check(LocaleValid);
+    add->add_flag("--atomic", baseAtomic, "Change a copy of the archive, then replace it");
     add->add_option("-g,--game", baseGameProfile,
                     "Game profile for compression rules. Valid options:\n" +
                         GameRules::GetAvailableProfiles())
@@ -177,6 +250,7 @@ int main(int argc, char **argv) {
         ->required()
         ->check(CLI::ExistingFile);
     remove->add_option("--locale", baseLocale, "Locale of file to remove")->check(LocaleValid);
+    remove->add_flag("--atomic", baseAtomic, "Change a copy of the archive, then replace it");
 
     // Subcommand: List
     CLI::App *list = app.add_subcommand("list", "List files from the MPQ archive");
@@ -190,6 +264,16 @@ int main(int argc, char **argv) {
     list->add_flag("-a,--all", listAll, "File listing including hidden files (default false)");
     list->add_option("-p,--property", listProperties, "Prints only specific property values")
         ->check(CLI::IsMember(validFileListProperties));
+    list->add_option("--overlay", baseOverlays,
+                     "Archives layered on top of target, in load order (comma separated)")
+        ->delimiter(',')
+        ->check(CLI::ExistingFile);
+    list->add_option("--patch", basePatches,
+                     "Patch archives applied to target, in load order (comma separated)")
+        ->delimiter(',')
+        ->check(CLI::ExistingFile);
+    list->add_flag("--no-mmap", baseNoMmap, "Read the archive with file reads, not a memory map");
+    list->add_flag("--index", baseIndex, "Use the sidecar index, rebuilding it when stale");
 
     // Subcommand: Extract
     CLI::App *extract = app.add_subcommand("extract", "Extract files from the MPQ archive");
@@ -197,12 +281,59 @@ int main(int argc, char **argv) {
         ->required()
         ->check(CLI::ExistingFile);
     extract->add_option("-o,--output", baseOutput, "Output directory");
-    extract->add_option("-f,--file", baseFile, "Target file to extract");
+    CLI::Option *extractFileOption =
+        extract->add_option("-f,--file", baseFile, "Target file to extract");
     extract->add_flag("-k,--keep", extractKeepFolderStructure,
                       "Keep folder structure (default false)");
     extract->add_option("-l,--listfile", baseListfileName, "File listing content of an MPQ archive")
         ->check(CLI::ExistingFile);
-    extract->add_option("--locale", baseLocale, "Preferred locale for extracted file");
+    CLI::Option *extractLocaleOption =
+        extract->add_option("--locale", baseLocale, "Preferred locale for extracted file");
+    CLI::Option *extractOverlayOption =
+        extract
+            ->add_option("--overlay", baseOverlays,
+                         "Archives layered on top of target, in load order (comma separated)")
+            ->delimiter(',')
+            ->check(CLI::ExistingFile);
+    CLI::Option *extractPatchOption =
+        extract
+            ->add_option("--patch", basePatches,
+                         "Patch archives applied to target, in load order (comma separated)")
+            ->delimiter(',')
+            ->check(CLI::ExistingFile);
+    extract->add_flag("--no-mmap", baseNoMmap,
+                      "Read the archive with file reads, not a memory map");
+    CLI::Option *extractIndexFlag =
+        extract->add_flag("--index", baseIndex, "Use the sidecar index, rebuilding it when stale");
+    extract->add_flag("--bandwidth", extractBandwidth,
+                      "Print the archive read bandwidth after extracting all files");
+    CLI::Option *extractAllLocalesFlag =
+        extract
+            ->add_flag("--all-locales", extractAllLocales,
+                       "Extract every locale of every file, into a directory per locale")
+            ->excludes(extractFileOption)
+            ->excludes(extractLocaleOption)
+            ->excludes(extractOverlayOption)
+            ->excludes(extractPatchOption)
+            ->excludes(extractIndexFlag);
+    extract
+        ->add_flag("--link-identical", extractLinkIdentical,
+                   "Hard link files identical to another locale instead of copying them")
+        ->needs(extractAllLocalesFlag);
+    CLI::Option *extractStoreOption =
+        extract
+            ->add_option("--cas", extractStore,
+                         "Store each distinct content once in a content-addressed store, "
+                         "linking the extracted files to it")
+            ->excludes(extractFileOption)
+            ->excludes(extractOverlayOption)
+            ->excludes(extractPatchOption)
+            ->excludes(extractIndexFlag)
+            ->excludes(extractAllLocalesFlag);
+    extract
+        ->add_flag("--trust-attributes", extractTrustAttributes,
+                   "Link files whose (attributes) MD5 is already stored without decompressing")
+        ->needs(extractStoreOption);
 
     // Subcommand: Read
     CLI::App *read = app.add_subcommand("read", "Read a file from an MPQ archive");
@@ -211,6 +342,16 @@ int main(int argc, char **argv) {
         ->required()
         ->check(CLI::ExistingFile);
     read->add_option("--locale", baseLocale, "Preferred locale for read file");
+    read->add_option("--overlay", baseOverlays,
+                     "Archives layered on top of target, in load order (comma separated)")
+        ->delimiter(',')
+        ->check(CLI::ExistingFile);
+    read->add_option("--patch", basePatches,
+                     "Patch archives applied to target, in load order (comma separated)")
+        ->delimiter(',')
+        ->check(CLI::ExistingFile);
+    read->add_flag("--no-mmap", baseNoMmap, "Read the archive with file reads, not a memory map");
+    read->add_flag("--index", baseIndex, "Open the archive without loading its listfile");
 
     // Subcommand: Verify
     CLI::App *verify = app.add_subcommand("verify", "Verify the MPQ archive");
@@ -218,6 +359,150 @@ int main(int argc, char **argv) {
         ->required()
         ->check(CLI::ExistingFile);
     verify->add_flag("-p,--print", verifyPrintSignature, "Print the digital signature (in hex)");
+    verify->add_flag("--no-mmap", baseNoMmap, "Read the archive with file reads, not a memory map");
+
+    // Subcommand: Flatten
+    CLI::App *flatten =
+        app.add_subcommand("flatten", "Merge an archive and its overlays or patches into one");
+    flatten->add_option("target", baseTarget, "Base MPQ archive")
+        ->required()
+        ->check(CLI::ExistingFile);
+    flatten->add_option("-o,--output", flattenOutput, "Output MPQ archive")->required();
+    flatten->add_option("-l,--listfile", baseListfileName, "File listing content of an MPQ archive")
+        ->check(CLI::ExistingFile);
+    flatten
+        ->add_option("--overlay", baseOverlays,
+                     "Archives layered on top of target, in load order (comma separated)")
+        ->delimiter(',')
+        ->check(CLI::ExistingFile);
+    flatten
+        ->add_option("--patch", basePatches,
+                     "Patch archives applied to target, in load order (comma separated)")
+        ->delimiter(',')
+        ->check(CLI::ExistingFile);
+    flatten->add_option("-j,--threads", flattenThreads,
+                        "Threads compressing large files (default CPU count)");
+
+    // Subcommand: Copy
+    CLI::App *copy =
+        app.add_subcommand("copy", "Copy files between MPQ archives without recompressing them");
+    copy->add_option("source", copySource, "Source MPQ archive")
+        ->required()
+        ->check(CLI::ExistingFile);
+    copy->add_option("target", baseTarget, "Target MPQ archive")
+        ->required()
+        ->check(CLI::ExistingFile);
+    copy->add_option("files", copyFiles, "Files or wildcards to copy (default all files)");
+    copy->add_option("-n,--name-in-archive", baseNameInArchive,
+                     "New name of the copied file (requires a single file)");
+    copy->add_flag("-w,--overwrite", copyOverwrite, "Overwrite files already in target archive");
+    copy->add_option("-l,--listfile", baseListfileName, "File listing content of an MPQ archive")
+        ->check(CLI::ExistingFile);
+
+    // Subcommand: Merge
+    CLI::App *merge =
+        app.add_subcommand("merge", "Merge MPQ archives into one without recompressing files");
+    merge->add_option("archives", mergeArchives, "MPQ archives to merge, in load order")
+        ->required()
+        ->check(CLI::ExistingFile);
+    merge->add_option("-o,--output", mergeOutput, "Output MPQ archive")->required();
+    merge->add_option("-l,--listfile", baseListfileName, "File listing content of an MPQ archive")
+        ->check(CLI::ExistingFile);
+    merge->add_option("-j,--threads", mergeThreads,
+                      "Threads compressing large files (default CPU count)");
+
+    // Subcommand: Rename
+    CLI::App *rename = app.add_subcommand("rename", "Rename files inside an MPQ archive");
+    rename->add_option("target", baseTarget, "Target MPQ archive")
+        ->required()
+        ->check(CLI::ExistingFile);
+    rename->add_option("old", renameOld, "File to rename, or pattern with one '*' wildcard")
+        ->required();
+    rename->add_option("new", renameNew, "New file name, or pattern with one '*' wildcard")
+        ->required();
+    rename->add_option("--locale", baseLocale, "Locale of file to rename (default all locales)")
+        ->check(LocaleValid);
+    rename->add_option("-l,--listfile", baseListfileName, "File listing content of an MPQ archive")
+        ->check(CLI::ExistingFile);
+    rename->add_flag("--atomic", baseAtomic, "Change a copy of the archive, then replace it");
+
+    // Subcommand: Batch
+    CLI::App *batch =
+        app.add_subcommand("batch", "Run commands from stdin against one opened MPQ archive");
+    batch->add_option("target", baseTarget, "Target MPQ archive")
+        ->required()
+        ->check(CLI::ExistingFile);
+    batch->add_flag("--json", batchJson, "Read commands as NDJSON (default plain text)");
+    batch->add_flag("-r,--read-only", batchReadOnly, "Open the archive read-only");
+    batch->add_option("-l,--listfile", baseListfileName, "File listing content of an MPQ archive")
+        ->check(CLI::ExistingFile);
+
+    // Subcommand: Serve
+    CLI::App *serve =
+        app.add_subcommand("serve", "Serve files of an MPQ archive to local clients");
+    serve->add_option("target", baseTarget, "Target MPQ archive")
+        ->required()
+        ->check(CLI::ExistingFile);
+    serve->add_option("-s,--socket", serveSocket, "Unix domain socket to listen on")->required();
+    serve->add_option("--http", serveHttpPort, "Also serve HTTP on this port of 127.0.0.1");
+    serve->add_option("--cache-size", serveCacheSize, "File cache size in megabytes (default 64)")
+        ->check(CLI::NonNegativeNumber);
+    serve->add_option("-j,--threads", serveThreads,
+                      "Archive handles for concurrent reads (default CPU count)");
+    serve->add_option("--max-clients", serveMaxClients,
+                      "Clients served at the same time (default 64)")
+        ->check(CLI::PositiveNumber);
+
+    // Subcommand: Mount
+    CLI::App *mount =
+        app.add_subcommand("mount", "Mount an MPQ archive as a read-only directory (FUSE)");
+    mount->add_option("target", baseTarget, "Target MPQ archive")
+        ->required()
+        ->check(CLI::ExistingFile);
+    mount->add_option("mountpoint", mountPoint, "Directory to mount the MPQ archive at")
+        ->required()
+        ->check(CLI::ExistingDirectory);
+    mount->add_option("-l,--listfile", baseListfileName, "File listing content of an MPQ archive")
+        ->check(CLI::ExistingFile);
+    mount->add_option("--cache-size", mountCacheSize, "Sector cache size in megabytes (default 64)")
+        ->check(CLI::NonNegativeNumber);
+    mount->add_flag("-f,--foreground", mountForeground, "Stay in the foreground until unmounted");
+
+    // Subcommand: Catalog
+    CLI::App *catalog =
+        app.add_subcommand("catalog", "Index the files of many MPQ archives for searching");
+    catalog->require_subcommand(1);
+    CLI::App *catalogBuild =
+        catalog->add_subcommand("build", "Catalog the archives under a directory");
+    catalogBuild->add_option("directory", catalogDirectory, "Directory to search for archives")
+        ->required()
+        ->check(CLI::ExistingDirectory);
+    catalogBuild->add_option("-o,--output", catalogOutput,
+                             "Catalog file (default catalog.mpqcat in the directory)");
+    catalogBuild->add_flag("--hash", catalogHash,
+                           "Decompress files without an (attributes) MD5 to hash them");
+    catalogBuild->add_option("-j,--threads", catalogThreads,
+                             "Archives scanned at once (default CPU count)");
+    CLI::App *catalogUpdate = catalog->add_subcommand(
+        "update", "Rescan the archives that changed since the catalog was written");
+    catalogUpdate->add_option("catalog", catalogFile, "Catalog file")
+        ->required()
+        ->check(CLI::ExistingFile);
+    catalogUpdate->add_option("-j,--threads", catalogThreads,
+                              "Archives scanned at once (default CPU count)");
+    CLI::App *catalogQuery =
+        catalog->add_subcommand("query", "Find files in the catalogued archives");
+    catalogQuery->add_option("catalog", catalogFile, "Catalog file")
+        ->required()
+        ->check(CLI::ExistingFile);
+    CLI::Option *catalogPatternOption = catalogQuery->add_option(
+        "pattern", catalogPattern, "File name, or mask with * and ? wildcards");
+    CLI::Option *catalogMd5Option =
+        catalogQuery->add_option("--md5", catalogMd5, "Find files with this MD5 (hex)")
+            ->excludes(catalogPatternOption);
+    catalogQuery->add_option("--crc32", catalogCrc32, "Find files with this CRC32 (hex)")
+        ->excludes(catalogPatternOption)
+        ->excludes(catalogMd5Option);
 
     // Parse command line arguments and handle errors
     try {
@@ -232,6 +517,14 @@ int main(int argc, char **argv) {
         return app.exit(e);
     }
 
+    StartLogging(globalQuiet     ? LogLevel::QUIET
+                 : globalVerbose ? LogLevel::VERBOSE
+                                 : LogLevel::NORMAL);
+    if (!StartInstrumentation(globalStats, globalTrace)) {
+        return 1;
+    }
+    InstrumentationGuard instrumentationGuard;
+
     if (app.got_subcommand(version)) {
         return HandleVersion();
     }
@@ -241,7 +534,7 @@ int main(int argc, char **argv) {
     }
 
     if (app.got_subcommand(info)) {
-        return HandleInfo(baseTarget, infoProperty);
+        return HandleInfo(baseTarget, infoProperty, baseIndex);
     }
 
     if (app.got_subcommand(create)) {
@@ -249,36 +542,84 @@ int main(int argc, char **argv) {
                             baseLocale, baseGameProfile, createMpqVersion, createStreamFlags,
                             createSectorSize, createRawChunkSize, createFileFlags1,
                             createFileFlags2, createFileFlags3, createAttrFlags, fileDwFlags,
-                            fileDwCompression, fileDwCompressionNext);
+                            fileDwCompression, fileDwCompressionNext, baseFromTar);
     }
 
     if (app.got_subcommand(add)) {
         return HandleAdd(baseFile, baseTarget, basePath, baseDirInArchive, baseNameInArchive,
                          addOverwrite, baseLocale, baseGameProfile, fileDwFlags, fileDwCompression,
-                         fileDwCompressionNext);
+                         fileDwCompressionNext, baseAtomic, addSize, baseFromTar);
     }
 
     if (app.got_subcommand(remove)) {
-        return HandleRemove(baseFile, baseTarget, baseLocale);
+        return HandleRemove(baseFile, baseTarget, baseLocale, baseAtomic);
     }
 
     if (app.got_subcommand(list)) {
-        return HandleList(baseTarget, baseListfileName, listAll, listDetailed, listProperties);
+        return HandleList(baseTarget, baseListfileName, listAll, listDetailed, listProperties,
+                          baseOverlays, basePatches, baseIndex, !baseNoMmap);
     }
 
     if (app.got_subcommand(extract)) {
         std::optional<std::string> extractFile =
             baseFile.empty() ? std::nullopt : std::make_optional(baseFile);
         return HandleExtract(baseTarget, baseOutput, extractFile, extractKeepFolderStructure,
-                             baseListfileName, baseLocale);
+                             baseListfileName, baseLocale, baseOverlays, basePatches, baseIndex,
+                             !baseNoMmap, extractBandwidth, extractAllLocales,
+                             extractLinkIdentical, extractStore, extractTrustAttributes);
     }
 
     if (app.got_subcommand(read)) {
-        return HandleRead(baseFile, baseTarget, baseLocale);
+        return HandleRead(baseFile, baseTarget, baseLocale, baseOverlays, basePatches, baseIndex,
+                          !baseNoMmap);
     }
 
     if (app.got_subcommand(verify)) {
-        return HandleVerify(baseTarget, verifyPrintSignature);
+        return HandleVerify(baseTarget, verifyPrintSignature, !baseNoMmap);
+    }
+
+    if (app.got_subcommand(flatten)) {
+        return HandleFlatten(baseTarget, flattenOutput, baseListfileName, baseOverlays,
+                             basePatches, flattenThreads);
+    }
+
+    if (app.got_subcommand(copy)) {
+        return HandleCopy(copySource, baseTarget, copyFiles, baseNameInArchive, copyOverwrite,
+                          baseListfileName);
+    }
+
+    if (app.got_subcommand(merge)) {
+        return HandleMerge(mergeArchives, mergeOutput, baseListfileName, mergeThreads);
+    }
+
+    if (app.got_subcommand(rename)) {
+        return HandleRename(baseTarget, renameOld, renameNew, baseLocale, baseListfileName,
+                            baseAtomic);
+    }
+
+    if (app.got_subcommand(batch)) {
+        return HandleBatch(baseTarget, batchJson, batchReadOnly, baseListfileName);
+    }
+
+    if (app.got_subcommand(serve)) {
+        return HandleServe(baseTarget, serveSocket, serveHttpPort, serveCacheSize, serveThreads,
+                           serveMaxClients);
+    }
+
+    if (app.got_subcommand(mount)) {
+        return HandleMount(baseTarget, mountPoint, baseListfileName, mountCacheSize,
+                           mountForeground);
+    }
+
+    if (app.got_subcommand(catalog)) {
+        if (catalog->got_subcommand(catalogBuild)) {
+            return HandleCatalogBuild(catalogDirectory, catalogOutput, catalogThreads,
+                                      catalogHash);
+        }
+        if (catalog->got_subcommand(catalogUpdate)) {
+            return HandleCatalogUpdate(catalogFile, catalogThreads);
+        }
+        return HandleCatalogQuery(catalogFile, catalogPattern, catalogMd5, catalogCrc32);
     }
 
     return 0;
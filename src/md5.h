@@ -0,0 +1,18 @@
+#ifndef MD5_H
+#define MD5_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// MD5, the hash the (attributes) file stores for each file's data
+using Md5Digest = std::array<uint8_t, 16>;
+
+Md5Digest ComputeMd5(const void *data, size_t size);
+// Lowercase hex, 32 characters
+std::string Md5ToHex(const Md5Digest &digest);
+// Parse 32 hex digits, in either case
+bool Md5FromHex(const std::string &hex, Md5Digest *digest);
+
+#endif  // MD5_H
@@ -0,0 +1,356 @@
+#include "mount.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <ctime>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <vector>
+
+#ifdef MPQCLI_WITH_FUSE
+#define FUSE_USE_VERSION 31
+#include <fuse.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include <StormLib.h>
+
+#include "filelookup.h"
+#include "lrucache.h"
+#include "mpq.h"
+
+#ifdef MPQCLI_WITH_FUSE
+namespace {
+struct MountNode {
+    uint32_t id = 0;
+    bool directory = false;
+    std::string archiveName;  // Name of a file inside the archive
+    LCID locale = 0;
+    uint64_t size = 0;
+    time_t mtime = 0;
+    std::set<std::string> children;  // Entry names of a directory
+};
+
+// StormLib handles are not thread-safe, so every FUSE thread opens its own
+struct ThreadHandles {
+    HANDLE hArchive = nullptr;
+    HANDLE hFile = nullptr;  // Kept open, consecutive reads are mostly from one file
+    const MountNode *file = nullptr;
+};
+
+thread_local ThreadHandles *threadHandles = nullptr;
+
+class MountedArchive {
+public:
+    MountedArchive(std::string archiveName, DWORD sectorSize, size_t cacheBytes, time_t mtime)
+        : archiveName(std::move(archiveName)),
+          sectorSize(std::max<DWORD>(sectorSize, 512)),
+          mtime(mtime),
+          cache(cacheBytes) {
+        MountNode &root = nodes["/"];
+        root.directory = true;
+        root.mtime = mtime;
+    }
+
+    ~MountedArchive() {
+        for (const auto &handles : threads) {
+            if (handles->hFile != nullptr) {
+                SFileCloseFile(handles->hFile);
+            }
+            CloseMpqArchive(handles->hArchive);
+        }
+    }
+
+    MountedArchive(const MountedArchive &) = delete;
+    MountedArchive &operator=(const MountedArchive &) = delete;
+
+    // Build the directory tree from the file names found in the archive
+    bool Load(HANDLE hArchive, const std::optional<std::string> &listfileName) {
+        const char *listfile = listfileName.has_value() ? listfileName->c_str() : nullptr;
+        SFILE_FIND_DATA findData;
+        HANDLE findHandle = SFileFindFirstFile(hArchive, "*", &findData, listfile);
+        if (findHandle == nullptr) {
+            std::cerr << "[!] Failed to find first file in MPQ archive." << std::endl;
+            return false;
+        }
+
+        do {
+            std::string path = "/" + std::string(findData.cFileName);
+            std::replace(path.begin(), path.end(), '\\', '/');
+            auto existing = nodes.find(path);
+            // Files stored in several locales are shown once, preferring the neutral one
+            if (existing != nodes.end() &&
+                (existing->second.directory || findData.lcLocale != 0)) {
+                continue;
+            }
+
+            MountNode &node = nodes[path];
+            node.id = nextId++;
+            node.archiveName = findData.cFileName;
+            node.locale = findData.lcLocale;
+            node.size = findData.dwFileSize;
+            const uint64_t fileTime =
+                (static_cast<uint64_t>(findData.dwFileTimeHi) << 32) | findData.dwFileTimeLo;
+            node.mtime = FileTimeToUnixTime(fileTime);
+            AddToParents(path);
+        } while (SFileFindNextFile(findHandle, &findData));
+
+        SFileFindClose(findHandle);
+        return true;
+    }
+
+    [[nodiscard]] const MountNode *Find(const std::string &path) const {
+        auto it = nodes.find(path);
+        return it != nodes.end() ? &it->second : nullptr;
+    }
+
+    // Copy file content, decompressing only the sectors that overlap the range
+    int Read(const MountNode &node, char *buffer, size_t size, off_t offset) {
+        if (offset < 0) {
+            return -EINVAL;
+        }
+        if (static_cast<uint64_t>(offset) >= node.size) {
+            return 0;
+        }
+        size = static_cast<size_t>(std::min<uint64_t>(size, node.size - offset));
+
+        size_t copied = 0;
+        while (copied < size) {
+            const uint64_t position = static_cast<uint64_t>(offset) + copied;
+            LruCache<uint64_t>::Value sector = ReadSector(node, position / sectorSize);
+            if (sector == nullptr) {
+                return -EIO;
+            }
+            const size_t withinSector = position % sectorSize;
+            if (withinSector >= sector->size()) {
+                break;
+            }
+            const size_t count = std::min(size - copied, sector->size() - withinSector);
+            std::memcpy(buffer + copied, sector->data() + withinSector, count);
+            copied += count;
+        }
+        return static_cast<int>(copied);
+    }
+
+private:
+    const std::string archiveName;
+    const DWORD sectorSize;
+    const time_t mtime;
+    std::map<std::string, MountNode> nodes;  // Keyed on absolute path, like "/dir/file"
+    uint32_t nextId = 0;
+    LruCache<uint64_t> cache;               // Decompressed sectors, keyed on node and index
+    std::mutex mutex;
+    std::vector<std::unique_ptr<ThreadHandles>> threads;
+
+    time_t FileTimeToUnixTime(uint64_t fileTime) const {
+        constexpr uint64_t EPOCH_DIFF = 116444736000000000ULL;
+        if (fileTime <= EPOCH_DIFF) {
+            return mtime;  // Archives without (attributes) have no file times
+        }
+        return static_cast<time_t>((fileTime - EPOCH_DIFF) / 10000000);
+    }
+
+    void AddToParents(const std::string &path) {
+        std::string child = path;
+        while (child != "/") {
+            const size_t slash = child.rfind('/');
+            const std::string parent = slash == 0 ? "/" : child.substr(0, slash);
+            MountNode &node = nodes[parent];
+            node.directory = true;
+            node.mtime = mtime;
+            node.children.insert(child.substr(slash + 1));
+            child = parent;
+        }
+    }
+
+    // Archive handles are opened lazily, so that they belong to the FUSE process
+    // (which forks when not running in the foreground)
+    ThreadHandles *Handles() {
+        if (threadHandles != nullptr) {
+            return threadHandles;
+        }
+        auto handles = std::make_unique<ThreadHandles>();
+        if (!OpenMpqArchive(archiveName, &handles->hArchive, MPQ_OPEN_READ_ONLY)) {
+            return nullptr;
+        }
+        std::lock_guard<std::mutex> lock(mutex);
+        threadHandles = handles.get();
+        threads.push_back(std::move(handles));
+        return threadHandles;
+    }
+
+    LruCache<uint64_t>::Value ReadSector(const MountNode &node, uint64_t sector) {
+        const uint64_t key = (static_cast<uint64_t>(node.id) << 32) | sector;
+        LruCache<uint64_t>::Value value = cache.Get(key);
+        if (value != nullptr) {
+            return value;
+        }
+
+        ThreadHandles *handles = Handles();
+        if (handles == nullptr) {
+            return nullptr;
+        }
+        if (handles->file != &node) {
+            if (handles->hFile != nullptr) {
+                SFileCloseFile(handles->hFile);
+                handles->hFile = nullptr;
+                handles->file = nullptr;
+            }
+            if (!OpenFileForLocale(handles->hArchive, node.archiveName.c_str(), node.locale,
+                                   &handles->hFile)) {
+                return nullptr;
+            }
+            handles->file = &node;
+        }
+
+        // A read aligned on a sector boundary makes StormLib decompress just that sector
+        const uint64_t start = sector * sectorSize;
+        auto data = std::make_shared<std::string>(
+            static_cast<size_t>(std::min<uint64_t>(sectorSize, node.size - start)), '\0');
+        LONG startHigh = static_cast<LONG>(start >> 32);
+        SFileSetFilePointer(handles->hFile, static_cast<LONG>(start), &startHigh, FILE_BEGIN);
+        DWORD bytesRead = 0;
+        SFileReadFile(handles->hFile, data->data(), static_cast<DWORD>(data->size()), &bytesRead,
+                      nullptr);
+        if (bytesRead != data->size()) {
+            return nullptr;
+        }
+        cache.Put(key, data);
+        return data;
+    }
+};
+
+MountedArchive *Mounted() {
+    return static_cast<MountedArchive *>(fuse_get_context()->private_data);
+}
+
+void *MountInit(struct fuse_conn_info *, struct fuse_config *config) {
+    // The archive never changes while mounted, so the kernel may keep pages and
+    // attributes cached for as long as it likes
+    config->kernel_cache = 1;
+    config->entry_timeout = 3600;
+    config->attr_timeout = 3600;
+    config->negative_timeout = 3600;
+    return Mounted();
+}
+
+int MountGetAttr(const char *path, struct stat *st, struct fuse_file_info *) {
+    const MountNode *node = Mounted()->Find(path);
+    if (node == nullptr) {
+        return -ENOENT;
+    }
+    std::memset(st, 0, sizeof(*st));
+    st->st_uid = getuid();
+    st->st_gid = getgid();
+    st->st_mtime = node->mtime;
+    if (node->directory) {
+        st->st_mode = S_IFDIR | 0555;
+        st->st_nlink = 2;
+    } else {
+        st->st_mode = S_IFREG | 0444;
+        st->st_nlink = 1;
+        st->st_size = static_cast<off_t>(node->size);
+        st->st_blocks = static_cast<blkcnt_t>((node->size + 511) / 512);
+    }
+    return 0;
+}
+
+int MountReadDir(const char *path, void *buffer, fuse_fill_dir_t filler, off_t,
+                 struct fuse_file_info *, enum fuse_readdir_flags) {
+    const MountNode *node = Mounted()->Find(path);
+    if (node == nullptr) {
+        return -ENOENT;
+    }
+    if (!node->directory) {
+        return -ENOTDIR;
+    }
+    filler(buffer, ".", nullptr, 0, static_cast<fuse_fill_dir_flags>(0));
+    filler(buffer, "..", nullptr, 0, static_cast<fuse_fill_dir_flags>(0));
+    for (const auto &child : node->children) {
+        filler(buffer, child.c_str(), nullptr, 0, static_cast<fuse_fill_dir_flags>(0));
+    }
+    return 0;
+}
+
+int MountOpen(const char *path, struct fuse_file_info *fileInfo) {
+    const MountNode *node = Mounted()->Find(path);
+    if (node == nullptr) {
+        return -ENOENT;
+    }
+    if (node->directory) {
+        return -EISDIR;
+    }
+    if ((fileInfo->flags & O_ACCMODE) != O_RDONLY) {
+        return -EROFS;
+    }
+    fileInfo->keep_cache = 1;
+    fileInfo->fh = reinterpret_cast<uint64_t>(node);
+    return 0;
+}
+
+int MountRead(const char *, char *buffer, size_t size, off_t offset,
+              struct fuse_file_info *fileInfo) {
+    const auto *node = reinterpret_cast<const MountNode *>(fileInfo->fh);
+    return Mounted()->Read(*node, buffer, size, offset);
+}
+}  // namespace
+
+int RunMount(const std::string &archiveName, const std::string &mountPoint,
+             const std::optional<std::string> &listfileName, size_t cacheBytes, bool foreground) {
+    HANDLE hArchive;
+    if (!OpenMpqArchive(archiveName, &hArchive, MPQ_OPEN_READ_ONLY)) {
+        std::cerr << "[!] Failed to open MPQ archive." << std::endl;
+        return 1;
+    }
+    struct stat archiveStat {};
+    stat(archiveName.c_str(), &archiveStat);
+
+    MountedArchive mounted(archiveName, GetFileInfo<DWORD>(hArchive, SFileMpqSectorSize),
+                           cacheBytes, archiveStat.st_mtime);
+    const bool loaded = mounted.Load(hArchive, listfileName);
+    CloseMpqArchive(hArchive);
+    if (!loaded) {
+        return 1;
+    }
+
+    struct fuse_operations operations {};
+    operations.init = MountInit;
+    operations.getattr = MountGetAttr;
+    operations.readdir = MountReadDir;
+    operations.open = MountOpen;
+    operations.read = MountRead;
+
+    std::vector<std::string> arguments = {"mpqcli", mountPoint, "-o",
+                                          "ro,fsname=mpqcli,subtype=mpq"};
+    if (foreground) {
+        arguments.emplace_back("-f");
+    }
+    std::vector<char *> argv;
+    for (auto &argument : arguments) {
+        argv.push_back(argument.data());
+    }
+    argv.push_back(nullptr);
+
+    std::cout << "[*] Mounting " << archiveName << " at " << mountPoint << std::endl;
+    return fuse_main(static_cast<int>(arguments.size()), argv.data(), &operations, &mounted) == 0
+               ? 0
+               : 1;
+}
+#else
+int RunMount(const std::string &archiveName, const std::string &mountPoint,
+             const std::optional<std::string> &listfileName, size_t cacheBytes, bool foreground) {
+    (void)archiveName;
+    (void)mountPoint;
+    (void)listfileName;
+    (void)cacheBytes;
+    (void)foreground;
+    std::cerr << "[!] This build of mpqcli has no FUSE support (configure with -DWITH_FUSE=ON)."
+              << std::endl;
+    return 1;
+}
+#endif
@@ -0,0 +1,14 @@
+#ifndef MOUNT_H
+#define MOUNT_H
+
+#include <cstddef>
+#include <optional>
+#include <string>
+
+// Mount an archive read-only as a directory tree using FUSE, blocking until it is
+// unmounted when running in the foreground. Only available in builds configured
+// with -DWITH_FUSE=ON.
+int RunMount(const std::string &archiveName, const std::string &mountPoint,
+             const std::optional<std::string> &listfileName, size_t cacheBytes, bool foreground);
+
+#endif  // MOUNT_H
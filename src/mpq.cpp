@@ -1,20 +1,42 @@
 #include "mpq.h"
 
 #include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
 #include <filesystem>
 #include <fstream>
 #include <functional>
 #include <iomanip>
 #include <iostream>
+#include <limits>
 #include <map>
 #include <set>
+#include <sstream>
+#include <tuple>
 #include <vector>
 
 #include <StormLib.h>
 
+#include "archive.h"
+#include "asyncwriter.h"
+#include "atomicwrite.h"
+#include "contentstore.h"
 #include "gamerules.h"
+#include "filelookup.h"
 #include "helpers.h"
+#include "instrumentation.h"
 #include "locales.h"
+#include "logging.h"
+#include "mappedfile.h"
+#include "md5.h"
+#include "mpqindex.h"
+#include "mpqwriter.h"
+#include "overlay.h"
+#include "parallelread.h"
+#include "progress.h"
+#include "tarreader.h"
 
 namespace fs = std::filesystem;
 
@@ -22,6 +44,7 @@ static const std::vector<std::string> kSpecialMpqFiles = {"(listfile)", "(signat
                                                           "(attributes)"};
 
 bool OpenMpqArchive(const std::string &filename, HANDLE *hArchive, int32_t flags) {
+    PhaseSpan span("open");
     if (!SFileOpenArchive(filename.c_str(), 0, flags, hArchive)) {
         std::cerr << "[!] Failed to open: " << filename << std::endl;
         return false;
@@ -29,7 +52,21 @@ bool OpenMpqArchive(const std::string &filename, HANDLE *hArchive, int32_t flags
     return true;
 }
 
+bool OpenMpqArchiveMapped(const std::string &filename, HANDLE *hArchive, int32_t flags) {
+    PhaseSpan span("open");
+    // StormLib copies sectors out of the mapping instead of issuing a read for each
+    const int32_t mappedFlags =
+        flags | MPQ_OPEN_READ_ONLY | STREAM_PROVIDER_FLAT | BASE_PROVIDER_MAP;
+    if (SFileOpenArchive(filename.c_str(), 0, mappedFlags, hArchive)) {
+        return true;
+    }
+    // Mapping can fail where reading does not, for example for huge files on 32-bit systems
+    return OpenMpqArchive(filename, hArchive, flags | MPQ_OPEN_READ_ONLY);
+}
+
 bool CloseMpqArchive(HANDLE hArchive) {
+    // Changed archives write their tables here
+    PhaseSpan span("close");
     if (!SFileCloseArchive(hArchive)) {
         std::cerr << "[!] Failed to close MPQ archive." << std::endl;
         return false;
@@ -39,12 +76,17 @@ bool CloseMpqArchive(HANDLE hArchive) {
 
 bool FileExistsInArchiveForLocale(const HANDLE hArchive, const std::string &filePath,
                                   const LCID locale) {
+    const auto locales = LookupFileLocales(hArchive, filePath.c_str());
+    if (locales.has_value() && !locales->empty()) {
+        return std::find(locales->begin(), locales->end(), locale) != locales->end();
+    }
+
+    // Names only StormLib can look up are opened, and the locale it found compared
     bool fileExists = false;
-    SFileSetLocale(locale);
     HANDLE hFile;
-    if (SFileOpenFileEx(hArchive, filePath.c_str(), SFILE_OPEN_FROM_MPQ, &hFile)) {
+    if (OpenFileForLocale(hArchive, filePath.c_str(), locale, &hFile)) {
         const auto fileLocale = GetFileInfo<int32_t>(hFile, SFileInfoLocale);
-        if (fileLocale == locale) {
+        if (fileLocale == static_cast<int32_t>(locale)) {
             fileExists = true;
         }
         SFileCloseFile(hFile);
@@ -53,6 +95,7 @@ bool FileExistsInArchiveForLocale(const HANDLE hArchive, const std::string &file
 }
 
 bool SignMpqArchive(HANDLE hArchive) {
+    PhaseSpan span("sign");
     if (!SFileSignArchive(hArchive, SIGNATURE_TYPE_WEAK)) {
         std::cerr << "[!] Failed to sign MPQ archive." << std::endl;
         return false;
@@ -60,9 +103,253 @@ bool SignMpqArchive(HANDLE hArchive) {
     return true;
 }
 
+// Work out where a file is extracted to, creating its directories. Fails for names
+// that would escape the output directory.
+static bool ResolveExtractPath(const std::string &output, const std::string &fileName,
+                               bool keepFolderStructure, std::string *outputFileName,
+                               std::string *fileNameString) {
+    // Change forward slashes on non-Windows systems
+    fs::path fileNamePath(fileName);
+    std::string displayName = NormalizeFilePath(fileNamePath);
+
+    // Remove folder structure if keepFolderStructure is false
+    if (!keepFolderStructure) {
+        fileNamePath = fs::path(displayName);
+        displayName = fileNamePath.filename().u8string();
+    }
+
+    // Create output directory
+    fs::path outputPathAbsolute = fs::canonical(output);
+    fs::path outputPathBase = outputPathAbsolute.parent_path() / outputPathAbsolute.filename();
+    std::filesystem::create_directories(fs::path(outputPathBase).parent_path());
+
+    // Ensure sub-directories for folder-nested files exist before calling canonical
+    fs::path outputFilePathName = outputPathBase / displayName;
+    std::filesystem::create_directories(outputFilePathName.parent_path());
+
+    // Guard against path traversal attacks: resolve symlinks and ".." with canonical
+    // (requires path to exist, hence create_directories above)
+    fs::path resolvedOutput =
+        fs::canonical(outputFilePathName.parent_path()) / outputFilePathName.filename();
+    if (std::mismatch(outputPathBase.begin(), outputPathBase.end(), resolvedOutput.begin(),
+                      resolvedOutput.end())
+            .first != outputPathBase.end()) {
+        std::cerr << "[!] Blocked: path traversal attempt detected: " << displayName << std::endl;
+        return false;
+    }
+
+    *outputFileName = resolvedOutput.u8string();
+    *fileNameString = std::move(displayName);
+    return true;
+}
+
+// Whether a file's data is stored in the archive as is: not compressed, encrypted or
+// a patch. Such a file is one contiguous block that can be copied without StormLib.
+static bool IsStoredVerbatim(const MpqEntryInfo &entry) {
+    const auto flags = static_cast<uint32_t>(entry.flags);
+    const uint32_t transformed =
+        MPQ_FILE_COMPRESS_MASK | MPQ_FILE_ENCRYPTED | MPQ_FILE_PATCH_FILE | MPQ_FILE_DELETE_MARKER;
+    return (flags & transformed) == 0 && entry.fileSize > 0 &&
+           entry.fileSize == entry.compressedSize;
+}
+
+// Where a stored entry's block is in the archive file, if the archive is a plain file
+static std::optional<std::pair<uint64_t, uint64_t>> FindStoredBlock(HANDLE hArchive,
+                                                                     const MpqEntryInfo &entry) {
+    DWORD streamFlags = 0;
+    SFileGetFileInfo(hArchive, SFileMpqStreamFlags, &streamFlags, sizeof(streamFlags), nullptr);
+    if ((streamFlags & STREAM_PROVIDER_MASK) != STREAM_PROVIDER_FLAT) {
+        return std::nullopt;  // Partial, encrypted or block-checksummed archive stream
+    }
+    // With patches applied, the entry may be the base file or live in a patch archive
+    if (!IsStoredVerbatim(entry) || SFileIsPatchedArchive(hArchive)) {
+        return std::nullopt;
+    }
+
+    ULONGLONG headerOffset = 0;
+    SFileGetFileInfo(hArchive, SFileMpqHeaderOffset, &headerOffset, sizeof(headerOffset),
+                     nullptr);
+    return std::make_pair(headerOffset + static_cast<uint64_t>(entry.byteOffset),
+                          static_cast<uint64_t>(static_cast<uint32_t>(entry.fileSize)));
+}
+
+// Where a stored file's block is in the archive file, looking the file up by name
+static std::optional<std::pair<uint64_t, uint64_t>> FindStoredBlock(HANDLE hArchive,
+                                                                     const char *fileName,
+                                                                     LCID locale) {
+    HANDLE hFile;
+    if (!OpenFileForLocale(hArchive, fileName, locale, &hFile)) {
+        return std::nullopt;
+    }
+    const MpqEntryInfo entry = GetEntryInfo(hFile);
+    SFileCloseFile(hFile);
+    return FindStoredBlock(hArchive, entry);
+}
+
+// Copy a stored file from the archive file to the output file inside the kernel
+static RangeCopyResult ExtractStoredFile(HANDLE hArchive, const char *fileName, LCID locale,
+                                         const std::string &outputFileName) {
+    const auto block = FindStoredBlock(hArchive, fileName, locale);
+    const std::string archiveName = GetArchiveFileName(hArchive);
+    if (!block.has_value() || archiveName.empty()) {
+        return RangeCopyResult::kUnsupported;
+    }
+    PhaseSpan span("copy");
+    return CopyRangeToFile(archiveName, block->first, block->second, outputFileName);
+}
+
+static RangeCopyResult SendStoredBlock(HANDLE hArchive,
+                                       const std::optional<std::pair<uint64_t, uint64_t>> &block,
+                                       int outputFd) {
+    const std::string archiveName = GetArchiveFileName(hArchive);
+    if (!block.has_value() || archiveName.empty()) {
+        return RangeCopyResult::kUnsupported;
+    }
+    PhaseSpan span("copy");
+    return SendRangeToDescriptor(archiveName, block->first, block->second, outputFd);
+}
+
+RangeCopyResult WriteStoredFile(HANDLE hArchive, const char *fileName, LCID preferredLocale,
+                                int outputFd) {
+    return SendStoredBlock(hArchive, FindStoredBlock(hArchive, fileName, preferredLocale),
+                           outputFd);
+}
+
+RangeCopyResult WriteStoredFile(HANDLE hArchive, const MpqEntryInfo &entry, int outputFd) {
+    return SendStoredBlock(hArchive, FindStoredBlock(hArchive, entry), outputFd);
+}
+
+// A file to extract, with where its data is stored in the archive
+struct ExtractJob {
+    std::string fileName;
+    LCID locale = defaultLocale;
+    std::string output;                // Directory the file is extracted into
+    uint64_t byteOffset = UINT64_MAX;  // From the start of the archive file, unknown sorts last
+    uint64_t compressedSize = 0;
+    uint64_t fileSize = 0;
+    int32_t fileIndex = -1;  // In the block table, which (attributes) follows
+    bool direct = false;     // Stored or huge, extracted on its own rather than queued
+};
+
+// Look up where each file is stored and sort them by offset, so the archive is read
+// front to back instead of in hash table order
+static void PlanExtraction(HANDLE hArchive, std::vector<ExtractJob> *jobs) {
+    ULONGLONG headerOffset = 0;
+    SFileGetFileInfo(hArchive, SFileMpqHeaderOffset, &headerOffset, sizeof(headerOffset),
+                     nullptr);
+
+    for (auto &job : *jobs) {
+        HANDLE hFile;
+        if (OpenFileForLocale(hArchive, job.fileName.c_str(), job.locale, &hFile)) {
+            MpqEntryInfo entry = GetEntryInfo(hFile);
+            job.byteOffset = headerOffset + static_cast<uint64_t>(entry.byteOffset);
+            job.compressedSize = static_cast<uint32_t>(entry.compressedSize);
+            job.fileSize = static_cast<uint32_t>(entry.fileSize);
+            job.fileIndex = entry.fileIndex;
+            job.direct = IsStoredVerbatim(entry) || ShouldReadInParallel(hArchive, entry);
+            SFileCloseFile(hFile);
+        }
+    }
+    std::stable_sort(jobs->begin(), jobs->end(), [](const ExtractJob &a, const ExtractJob &b) {
+        return a.byteOffset < b.byteOffset;
+    });
+}
+
+// Extract files in archive order, writing them asynchronously where the platform allows.
+// The jobs are left sorted in that order.
+static int ExtractJobs(HANDLE hArchive, std::vector<ExtractJob> *extractJobs,
+                       bool reportBandwidth) {
+    constexpr uint64_t kReadaheadBytes = 8 * 1024 * 1024;  // Hinted ahead of the reader
+
+    const auto start = std::chrono::steady_clock::now();
+    {
+        PhaseSpan span("plan");
+        PlanExtraction(hArchive, extractJobs);
+    }
+    const std::vector<ExtractJob> &jobs = *extractJobs;
+    ProgressExpectFiles(jobs.size());
+
+    FileReadahead readahead(GetArchiveFileName(hArchive));
+    size_t hinted = 0;       // Jobs whose block has been hinted
+    uint64_t bytesRead = 0;  // Compressed bytes read from the archive
+
+    AsyncFileWriter writer;
+    const bool async = writer.Start();
+    int32_t result = 0;
+    for (size_t i = 0; i < jobs.size(); i++) {
+        // Keep the next few MiB of blocks on their way into the page cache
+        while (hinted < jobs.size() && jobs[hinted].byteOffset != UINT64_MAX &&
+               jobs[hinted].byteOffset < jobs[i].byteOffset + kReadaheadBytes) {
+            readahead.WillNeed(jobs[hinted].byteOffset, jobs[hinted].compressedSize);
+            hinted++;
+        }
+
+        const std::string &fileName = jobs[i].fileName;
+        if (!async || jobs[i].direct) {
+            const int32_t fileResult = ExtractFile(hArchive, jobs[i].output, fileName,
+                                                   true,  // Keep folder structure
+                                                   jobs[i].locale);
+            if (fileResult == 0) {
+                bytesRead += jobs[i].compressedSize;
+            }
+            result |= fileResult;
+            continue;
+        }
+
+        FileSpan fileSpan("extract", fileName);
+        unsigned int fileSize;
+        auto fileContent = ReadFile(hArchive, fileName.c_str(), &fileSize, jobs[i].locale);
+        std::string outputFileName;
+        std::string fileNameString;
+        if (!fileContent || !ResolveExtractPath(jobs[i].output, fileName, true, &outputFileName,
+                                                &fileNameString)) {
+            result = 1;
+            continue;
+        }
+        bytesRead += jobs[i].compressedSize;
+        CountFile(fileSize);
+        ProgressFileDone(fileSize);
+        // Decompression of the next file overlaps with writing this one
+        PhaseSpan span("write");
+        writer.Write(outputFileName, std::move(fileContent), fileSize, fileNameString);
+    }
+    {
+        PhaseSpan span("write");
+        if (writer.Finish() > 0) {
+            result = 1;
+        }
+    }
+
+    if (reportBandwidth) {
+        const double seconds =
+            std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        const double mebibytes = static_cast<double>(bytesRead) / (1024.0 * 1024.0);
+        // Formatted on its own stream, so std::cout keeps its number formatting
+        std::ostringstream report;
+        report << "[*] Read " << std::fixed << std::setprecision(2) << mebibytes
+               << " MiB from the archive in " << seconds << " s ("
+               << (seconds > 0 ? mebibytes / seconds : 0.0) << " MiB/s)";
+        std::cout << report.str() << std::endl;
+    }
+    return result;
+}
+
+// Extract files by name, each for the same locale into the same directory
+static int ExtractFileNames(HANDLE hArchive, const std::string &output,
+                            const std::vector<std::string> &fileNames, LCID preferredLocale,
+                            bool reportBandwidth) {
+    std::vector<ExtractJob> jobs(fileNames.size());
+    for (size_t i = 0; i < fileNames.size(); i++) {
+        jobs[i].fileName = fileNames[i];
+        jobs[i].locale = preferredLocale;
+        jobs[i].output = output;
+    }
+    return ExtractJobs(hArchive, &jobs, reportBandwidth);
+}
+
 int ExtractFiles(HANDLE hArchive, const std::string &output,
-                 const std::optional<std::string> &listfileName, LCID preferredLocale) {
-    SFileSetLocale(preferredLocale);
+                 const std::optional<std::string> &listfileName, LCID preferredLocale,
+                 bool reportBandwidth) {
     // Check if the user provided a listfile input
     const char *listfile = listfileName.has_value() ? listfileName->c_str() : nullptr;
 
@@ -74,20 +361,391 @@ int ExtractFiles(HANDLE hArchive, const std::string &output,
         return 1;
     }
 
-    int32_t result = 0;
+    std::vector<std::string> fileNames;
     do {
-        result |= ExtractFile(hArchive, output, findData.cFileName,
+        fileNames.emplace_back(findData.cFileName);
+    } while (SFileFindNextFile(findHandle, &findData));
+
+    SFileFindClose(findHandle);
+    return ExtractFileNames(hArchive, output, fileNames, preferredLocale, reportBandwidth);
+}
+
+int ExtractFiles(HANDLE hArchive, const MpqIndex &index, const std::string &output,
+                 LCID preferredLocale, bool reportBandwidth) {
+    // The index holds the names the listfile search would find, in the same order
+    std::vector<std::string> fileNames;
+    fileNames.reserve(index.EntryCount());
+    for (size_t i = 0; i < index.EntryCount(); i++) {
+        fileNames.emplace_back(index.EntryName(i));
+    }
+    return ExtractFileNames(hArchive, output, fileNames, preferredLocale, reportBandwidth);
+}
+
+int ExtractFiles(MpqOverlay &overlay, const std::string &output, LCID preferredLocale) {
+    // Every name is extracted once, from the highest-priority archive providing it
+    int32_t result = 0;
+    const auto &fileNames = overlay.FileNames();
+    ProgressExpectFiles(fileNames.size());
+    for (const auto &fileName : fileNames) {
+        // A name no archive stores for the locale fails like in a single archive
+        HANDLE hProvider = overlay.Resolve(fileName, preferredLocale);
+        if (hProvider == nullptr) {
+            hProvider = overlay.Resolve(fileName);
+        }
+        result |= ExtractFile(hProvider, output, fileName,
                               true,  // Keep folder structure
                               preferredLocale);
+    }
+    return result;
+}
+
+// The directory a locale's files go to when extracting every locale. The neutral locale
+// has its own, since LocaleToLang calls it enUS.
+static std::string LocaleDirectoryName(LCID locale) {
+    return locale == defaultLocale ? "neutral" : LocaleToLang(static_cast<uint16_t>(locale));
+}
+
+// Whether two extracted files have the same content
+static bool SameFileContent(const fs::path &first, const fs::path &second) {
+    std::error_code firstError;
+    std::error_code secondError;
+    if (fs::file_size(first, firstError) != fs::file_size(second, secondError) || firstError ||
+        secondError) {
+        return false;
+    }
+    std::ifstream firstFile(first, std::ios::binary);
+    std::ifstream secondFile(second, std::ios::binary);
+    std::vector<char> firstBuffer(0x10000);
+    std::vector<char> secondBuffer(0x10000);
+    while (firstFile && secondFile) {
+        firstFile.read(firstBuffer.data(), static_cast<std::streamsize>(firstBuffer.size()));
+        secondFile.read(secondBuffer.data(), static_cast<std::streamsize>(secondBuffer.size()));
+        const std::streamsize length = firstFile.gcount();
+        if (length != secondFile.gcount() ||
+            !std::equal(firstBuffer.begin(), firstBuffer.begin() + length, secondBuffer.begin())) {
+            return false;
+        }
+    }
+    return firstFile.eof() && secondFile.eof();
+}
+
+// Replace the extracted files whose content is identical to another locale of the same
+// name with hard links to the first of them. Returns the number of files linked.
+static size_t LinkIdenticalLocales(const std::vector<ExtractJob> &jobs) {
+    std::map<std::string, std::vector<fs::path>> variants;  // Extracted files of each name
+    for (const auto &job : jobs) {
+        variants[job.fileName].push_back(fs::u8path(job.output) /
+                                         NormalizeFilePath(fs::path(job.fileName)));
+    }
+
+    size_t linked = 0;
+    for (const auto &variant : variants) {
+        const std::vector<fs::path> &paths = variant.second;
+        if (paths.size() < 2) {
+            continue;
+        }
+        std::vector<fs::path> originals;  // One file for each distinct content
+        for (const auto &path : paths) {
+            std::error_code ec;
+            if (!fs::is_regular_file(path, ec)) {
+                continue;  // The file failed to extract
+            }
+            const auto original =
+                std::find_if(originals.begin(), originals.end(),
+                             [&](const fs::path &other) { return SameFileContent(other, path); });
+            if (original == originals.end()) {
+                originals.push_back(path);
+                continue;
+            }
+
+            // The link is made next to the copy and renamed over it, so a failure keeps the copy
+            fs::path linkPath = path;
+            linkPath += ".link";
+            fs::create_hard_link(*original, linkPath, ec);
+            if (!ec) {
+                fs::rename(linkPath, path, ec);
+            }
+            if (ec) {
+                std::error_code removeError;
+                fs::remove(linkPath, removeError);
+                std::cerr << "[!] Warning: Cannot hard link identical files, keeping copies: "
+                          << ec.message() << std::endl;
+                return linked;
+            }
+            linked++;
+        }
+    }
+    return linked;
+}
+
+int ExtractAllLocales(HANDLE hArchive, const std::string &output,
+                      const std::optional<std::string> &listfileName, bool linkIdentical,
+                      bool reportBandwidth) {
+    const char *listfile = listfileName.has_value() ? listfileName->c_str() : nullptr;
+    SFILE_FIND_DATA findData;
+    HANDLE findHandle = SFileFindFirstFile(hArchive, "*", &findData, listfile);
+    if (findHandle == nullptr) {
+        std::cerr << "[!] Failed to find first file in MPQ archive." << std::endl;
+        return 1;
+    }
+
+    // One search over the entries finds every name, and the hash table its locales
+    std::set<std::string> seenNames;
+    std::vector<ExtractJob> jobs;
+    do {
+        if (!seenNames.insert(findData.cFileName).second) {
+            continue;
+        }
+        const auto locales = LookupFileLocales(hArchive, findData.cFileName);
+        for (LCID locale : locales.value_or(std::vector<LCID>{findData.lcLocale})) {
+            ExtractJob job;
+            job.fileName = findData.cFileName;
+            job.locale = locale;
+            job.output = (fs::u8path(output) / LocaleDirectoryName(locale)).u8string();
+            jobs.push_back(std::move(job));
+        }
     } while (SFileFindNextFile(findHandle, &findData));
+    SFileFindClose(findHandle);
 
+    // Extraction resolves paths inside the locale directories, so they must exist first
+    std::set<std::string> outputs;
+    for (const auto &job : jobs) {
+        if (outputs.insert(job.output).second) {
+            std::error_code ec;
+            fs::create_directories(fs::u8path(job.output), ec);
+            if (ec) {
+                std::cerr << "[!] Failed to create output directory: " << job.output << std::endl;
+                return 1;
+            }
+        }
+    }
+
+    const int result = ExtractJobs(hArchive, &jobs, reportBandwidth);
+    if (linkIdentical) {
+        PhaseSpan span("link");
+        const size_t linked = LinkIdenticalLocales(jobs);
+        std::cout << "[*] Linked " << linked << " files identical to another locale"
+                  << std::endl;
+    }
+    return result;
+}
+
+MpqFileAttributes ReadFileAttributes(HANDLE hArchive) {
+    HANDLE hFile;
+    if (!OpenFileForLocale(hArchive, "(attributes)", defaultLocale, &hFile)) {
+        return {};
+    }
+    const DWORD size = SFileGetFileSize(hFile, nullptr);
+    std::vector<uint8_t> data(size == SFILE_INVALID_SIZE ? 0 : size);
+    DWORD bytesRead = 0;
+    const bool read =
+        data.size() >= 8 && SFileReadFile(hFile, data.data(), size, &bytesRead, nullptr);
+    SFileCloseFile(hFile);
+    if (!read || bytesRead != size) {
+        return {};
+    }
+
+    // A version and flags, then an array for each attribute with an element per file
+    uint32_t version;
+    uint32_t flags;
+    std::memcpy(&version, data.data(), sizeof(version));
+    std::memcpy(&flags, data.data() + 4, sizeof(flags));
+    const size_t crc32Bytes = (flags & MPQ_ATTRIBUTE_CRC32) != 0 ? sizeof(uint32_t) : 0;
+    const size_t fileTimeBytes = (flags & MPQ_ATTRIBUTE_FILETIME) != 0 ? sizeof(uint64_t) : 0;
+    const size_t md5Bytes = (flags & MPQ_ATTRIBUTE_MD5) != 0 ? sizeof(Md5Digest) : 0;
+    const size_t entryBytes = crc32Bytes + fileTimeBytes + md5Bytes;
+    if (version != MPQ_ATTRIBUTES_V1 || entryBytes == 0) {
+        return {};
+    }
+
+    // The file count is not stored. It follows from the size, where the patch bits take
+    // a bit per file rounded up to bytes.
+    const bool patchBits = (flags & MPQ_ATTRIBUTE_PATCH_BIT) != 0;
+    const size_t arrayBytes = data.size() - 8;
+    const size_t fileCount =
+        patchBits ? arrayBytes * 8 / (entryBytes * 8 + 1) : arrayBytes / entryBytes;
+    if (fileCount * entryBytes + (patchBits ? (fileCount + 7) / 8 : 0) != arrayBytes) {
+        return {};
+    }
+
+    static_assert(sizeof(Md5Digest) == 16);
+    MpqFileAttributes attributes;
+    const uint8_t *arrays = data.data() + 8;
+    if (crc32Bytes > 0) {
+        attributes.crc32s.resize(fileCount);
+        std::memcpy(attributes.crc32s.data(), arrays, fileCount * crc32Bytes);
+    }
+    if (md5Bytes > 0) {
+        attributes.md5s.resize(fileCount);
+        std::memcpy(attributes.md5s.data(), arrays + fileCount * (crc32Bytes + fileTimeBytes),
+                    fileCount * md5Bytes);
+    }
+    return attributes;
+}
+
+int ExtractFilesToStore(HANDLE hArchive, const std::string &output,
+                        const std::optional<std::string> &listfileName, LCID preferredLocale,
+                        const std::string &storeDirectory, bool trustAttributes) {
+    ContentStore store;
+    if (!store.Open(storeDirectory)) {
+        std::cerr << "[!] Failed to open content store: " << storeDirectory << std::endl;
+        return 1;
+    }
+
+    const char *listfile = listfileName.has_value() ? listfileName->c_str() : nullptr;
+    SFILE_FIND_DATA findData;
+    HANDLE findHandle = SFileFindFirstFile(hArchive, "*", &findData, listfile);
+    if (findHandle == nullptr) {
+        std::cerr << "[!] Failed to find first file in MPQ archive." << std::endl;
+        return 1;
+    }
+    std::set<std::string> seenNames;
+    std::vector<ExtractJob> jobs;
+    do {
+        if (seenNames.insert(findData.cFileName).second) {
+            ExtractJob job;
+            job.fileName = findData.cFileName;
+            job.locale = preferredLocale;
+            job.output = output;
+            jobs.push_back(std::move(job));
+        }
+    } while (SFileFindNextFile(findHandle, &findData));
     SFileFindClose(findHandle);
+
+    {
+        PhaseSpan span("plan");
+        PlanExtraction(hArchive, &jobs);
+    }
+    ProgressExpectFiles(jobs.size());
+    const MpqFileAttributes attributes = ReadFileAttributes(hArchive);
+
+    size_t stored = 0;        // New content written to the store
+    size_t deduplicated = 0;  // Decompressed, but the store had the content already
+    size_t skipped = 0;       // Linked by the (attributes) MD5 without decompressing
+    size_t collisions = 0;    // The store has other content under the same MD5
+    int32_t result = 0;
+    for (const auto &job : jobs) {
+        FileSpan fileSpan("extract", job.fileName);
+        std::string outputFileName;
+        std::string fileNameString;
+        if (!ResolveExtractPath(job.output, job.fileName, true, &outputFileName,
+                                &fileNameString)) {
+            result = 1;
+            continue;
+        }
+        std::optional<Md5Digest> attributeMd5;
+        if (job.fileIndex >= 0 && static_cast<size_t>(job.fileIndex) < attributes.md5s.size() &&
+            attributes.md5s[job.fileIndex] != Md5Digest{}) {
+            attributeMd5 = attributes.md5s[job.fileIndex];
+        }
+
+        Md5Digest digest;
+        if (trustAttributes && attributeMd5.has_value() && store.Has(*attributeMd5)) {
+            digest = *attributeMd5;
+            skipped++;
+        } else {
+            unsigned int fileSize;
+            auto fileContent = ReadFile(hArchive, job.fileName.c_str(), &fileSize, job.locale);
+            if (!fileContent) {
+                result = 1;
+                continue;
+            }
+            {
+                PhaseSpan span("hash");
+                digest = ComputeMd5(fileContent.get(), fileSize);
+            }
+            // The content is stored under its own hash either way, so a wrong
+            // (attributes) never puts the wrong content under a hash
+            if (attributeMd5.has_value() && *attributeMd5 != digest) {
+                std::cerr << "[!] Warning: The (attributes) MD5 does not match the content of: "
+                          << job.fileName << std::endl;
+            }
+            if (store.Has(digest) && !store.Matches(digest, fileContent.get(), fileSize)) {
+                // Keep the stored object, which other extracted files may link to, and
+                // write this file on its own
+                std::cerr << "[!] Warning: The content store has other content with the same "
+                          << "MD5 as: " << job.fileName << std::endl;
+                PhaseSpan span("write");
+                std::ofstream outputFile(fs::u8path(outputFileName),
+                                         std::ios::binary | std::ios::trunc);
+                if (!outputFile.write(fileContent.get(), fileSize)) {
+                    std::cerr << "[!] Failed: Cannot write file: " << job.fileName << std::endl;
+                    result = 1;
+                    continue;
+                }
+                collisions++;
+                LogFile("[*] Extracted: " + fileNameString);
+                CountFile(job.fileSize);
+                ProgressFileDone(job.fileSize);
+                continue;
+            }
+            if (store.Has(digest)) {
+                deduplicated++;
+            } else {
+                PhaseSpan span("write");
+                if (!store.Put(digest, fileContent.get(), fileSize)) {
+                    std::cerr << "[!] Failed: Cannot write to content store: " << job.fileName
+                              << std::endl;
+                    result = 1;
+                    continue;
+                }
+                stored++;
+            }
+        }
+
+        PhaseSpan span("link");
+        if (!store.Materialize(digest, fs::u8path(outputFileName))) {
+            std::cerr << "[!] Failed: Cannot link from content store: " << job.fileName
+                      << std::endl;
+            result = 1;
+            continue;
+        }
+        LogFile("[*] Extracted: " + fileNameString);
+        CountFile(job.fileSize);
+        ProgressFileDone(job.fileSize);
+    }
+
+    std::cout << "[*] Content store: " << stored << " stored, " << deduplicated
+              << " already stored, " << skipped << " linked without decompressing" << std::endl;
+    if (collisions > 0) {
+        std::cout << "[*] Extracted " << collisions
+                  << " files outside the content store, because of MD5 collisions" << std::endl;
+    }
     return result;
 }
 
+// Read, decompress and write a file in one go, timed as one phase. Like SFileExtractFile,
+// but the file is opened for an explicit locale.
+static bool ExtractWithStormLib(HANDLE hArchive, const char *fileName, LCID locale,
+                                const std::string &outputFileName) {
+    PhaseSpan span("extract");
+    HANDLE hFile;
+    if (!OpenFileForLocale(hArchive, fileName, locale, &hFile)) {
+        return false;
+    }
+    std::ofstream outputFile(fs::u8path(outputFileName), std::ios::binary | std::ios::trunc);
+    std::vector<char> buffer(0x10000);
+    bool extracted = static_cast<bool>(outputFile);
+    while (extracted) {
+        DWORD bytesRead = 0;
+        const bool read = SFileReadFile(hFile, buffer.data(), static_cast<DWORD>(buffer.size()),
+                                        &bytesRead, nullptr);
+        extracted = static_cast<bool>(outputFile.write(buffer.data(), bytesRead));
+        if (!read) {
+            // A short read at the end of the file is reported as ERROR_HANDLE_EOF
+            extracted = extracted && SErrGetLastError() == ERROR_HANDLE_EOF;
+            break;
+        }
+    }
+    SFileCloseFile(hFile);
+    if (!outputFile) {
+        SErrSetLastError(ERROR_CAN_NOT_COMPLETE);  // Writing the output failed
+    }
+    return extracted;
+}
+
 int ExtractFile(HANDLE hArchive, const std::string &output, const std::string &fileName,
                 bool keepFolderStructure, LCID preferredLocale) {
-    SFileSetLocale(preferredLocale);
     const char *szFileName = fileName.c_str();
     if (!FileExistsInArchiveForLocale(hArchive, szFileName, preferredLocale) &&
         !FileExistsInArchiveForLocale(hArchive, szFileName, defaultLocale)) {
@@ -97,47 +755,45 @@ int ExtractFile(HANDLE hArchive, const std::string &output, const std::string &f
         return 1;
     }
 
-    // Change forward slashes on non-Windows systems
-    fs::path fileNamePath(fileName);
-    std::string fileNameString = NormalizeFilePath(fileNamePath);
-
-    // Remove folder structure if keepFolderStructure is false
-    if (!keepFolderStructure) {
-        fileNamePath = fs::path(fileNameString);
-        fileNameString = fileNamePath.filename().u8string();
+    std::string outputFileName;
+    std::string fileNameString;
+    if (!ResolveExtractPath(output, fileName, keepFolderStructure, &outputFileName,
+                            &fileNameString)) {
+        return 1;
     }
 
-    // Create output directory
-    fs::path outputPathAbsolute = fs::canonical(output);
-    fs::path outputPathBase = outputPathAbsolute.parent_path() / outputPathAbsolute.filename();
-    std::filesystem::create_directories(fs::path(outputPathBase).parent_path());
-
-    // Ensure sub-directories for folder-nested files exist before calling canonical
-    fs::path outputFilePathName = outputPathBase / fileNameString;
-    std::filesystem::create_directories(outputFilePathName.parent_path());
-
-    // Guard against path traversal attacks: resolve symlinks and ".." with canonical
-    // (requires path to exist, hence create_directories above)
-    fs::path resolvedOutput =
-        fs::canonical(outputFilePathName.parent_path()) / outputFilePathName.filename();
-    if (std::mismatch(outputPathBase.begin(), outputPathBase.end(), resolvedOutput.begin(),
-                      resolvedOutput.end())
-            .first != outputPathBase.end()) {
-        std::cerr << "[!] Blocked: path traversal attempt detected: " << fileNameString
-                  << std::endl;
+    FileSpan fileSpan("extract", fileName);
+    // Stored files are copied straight from the archive file, others go through StormLib
+    const RangeCopyResult stored =
+        ExtractStoredFile(hArchive, szFileName, preferredLocale, outputFileName);
+    if (stored == RangeCopyResult::kFailed) {
+        std::cerr << "[!] Failed: Cannot copy file contents for: " << szFileName << std::endl;
         return 1;
     }
-
-    std::string outputFileName{resolvedOutput.u8string()};
-
-    if (SFileExtractFile(hArchive, szFileName, outputFileName.c_str(), 0)) {
-        std::cout << "[*] Extracted: " << fileNameString << std::endl;
+    if (stored == RangeCopyResult::kUnsupported &&
+        ShouldReadInParallel(hArchive, szFileName, preferredLocale)) {
+        // Huge compressed files are decompressed on several threads
+        std::ofstream outputFile(fs::u8path(outputFileName), std::ios::binary | std::ios::trunc);
+        if (!ReadFileInParallel(hArchive, szFileName, preferredLocale, outputFile)) {
+            std::cerr << "[!] Failed: Cannot read file contents for: " << szFileName << std::endl;
+            return 1;
+        }
+        LogFile("[*] Extracted: " + fileNameString);
+    } else if (stored == RangeCopyResult::kCopied ||
+               ExtractWithStormLib(hArchive, szFileName, preferredLocale, outputFileName)) {
+        LogFile("[*] Extracted: " + fileNameString);
     } else {
         int32_t error = SErrGetLastError();
         std::cerr << "[!] Failed: " << "(" << error << ") " << szFileName << std::endl;
         return 1;
     }
 
+    if (InstrumentationEnabled() || ProgressShown()) {
+        std::error_code ec;
+        const auto fileSize = fs::file_size(fs::u8path(outputFileName), ec);
+        CountFile(ec ? 0 : fileSize);
+        ProgressFileDone(ec ? 0 : fileSize);
+    }
     return 0;
 }
 
@@ -167,6 +823,7 @@ HANDLE CreateMpqArchive(const std::string &outputArchiveName, const uint32_t fil
     createInfo.dwRawChunkSize = settings.rawChunkSize;
     createInfo.dwMaxFileCount = fileCount;
 
+    PhaseSpan span("create");
     const bool result = SFileCreateArchive2(outputArchiveName.c_str(), &createInfo, &hMpq);
 
     if (!result) {
@@ -185,56 +842,53 @@ int AddFiles(HANDLE hArchive, const std::string &inputPath, LCID locale, const G
     // and to strip any directory structure from the files we add
     fs::path targetPath = fs::path(inputPath);
 
+    // Walk the directory first, so progress can tell how many files are left
+    std::vector<fs::path> inputFiles;
     for (const auto &entry : fs::recursive_directory_iterator(inputPath)) {
         if (fs::is_regular_file(entry.path())) {
-            // Strip the target path from the file name
-            fs::path inputFilePath = fs::relative(entry, targetPath);
+            inputFiles.push_back(entry.path());
+        }
+    }
+    ProgressExpectFiles(inputFiles.size());
 
-            // Normalise path for MPQ
-            std::string archiveFilePath = WindowsifyFilePath(inputFilePath.u8string());
+    for (const auto &inputFile : inputFiles) {
+        // Strip the target path from the file name
+        fs::path inputFilePath = fs::relative(inputFile, targetPath);
 
-            // Skip special MPQ files that StormLib manages automatically
-            if (std::find(kSpecialMpqFiles.begin(), kSpecialMpqFiles.end(), archiveFilePath) !=
-                kSpecialMpqFiles.end()) {
-                std::cout << "[*] Skipping special MPQ file: " << archiveFilePath << std::endl;
-                continue;
-            }
+        // Normalise path for MPQ
+        std::string archiveFilePath = WindowsifyFilePath(inputFilePath.u8string());
 
-            AddFile(hArchive, entry.path().u8string(), archiveFilePath, locale, gameRules,
-                    overrides, false);
+        // Skip special MPQ files that StormLib manages automatically
+        if (std::find(kSpecialMpqFiles.begin(), kSpecialMpqFiles.end(), archiveFilePath) !=
+            kSpecialMpqFiles.end()) {
+            LogFile("[*] Skipping special MPQ file: " + archiveFilePath);
+            ProgressFileDone(0);
+            continue;
         }
+
+        AddFile(hArchive, inputFile.u8string(), archiveFilePath, locale, gameRules, overrides,
+                false);
     }
     return 0;
 }
 
-int AddFile(HANDLE hArchive, const fs::path &localFile, const std::string &archiveFilePath,
-            const LCID locale, const GameRules &gameRules,
-            const CompressionSettingsOverrides &overrides, bool overwrite) {
-    // Return if file doesn't exist on disk
-    if (!fs::exists(localFile)) {
-        std::cerr << "[!] File doesn't exist on disk: " << localFile << std::endl;
-        return -1;
-    }
-
+// Checks shared by all ways of adding a file: skip existing files unless overwriting,
+// and make room in the hash table
+static int PrepareFileAdd(HANDLE hArchive, const std::string &archiveFilePath, LCID locale,
+                          bool overwrite) {
     // Check if file exists in MPQ archive
-    SFileSetLocale(locale);
-    HANDLE hFile;
-    if (SFileOpenFileEx(hArchive, archiveFilePath.c_str(), SFILE_OPEN_FROM_MPQ, &hFile)) {
-        int32_t fileLocale = GetFileInfo<int32_t>(hFile, SFileInfoLocale);
-        SFileCloseFile(hFile);
-        if (fileLocale == locale && !overwrite) {
+    if (FileExistsInArchiveForLocale(hArchive, archiveFilePath, locale)) {
+        if (!overwrite) {
             std::cerr << "[!] File" << PrettyPrintLocale(locale, " for locale ")
                       << " already exists in MPQ archive: " << archiveFilePath << " - Skipping..."
                       << std::endl;
             return -1;
-        } else if (fileLocale == locale) {
-            std::cout << "[+] File" << PrettyPrintLocale(locale, " for locale ")
-                      << " already exists in MPQ archive: " << archiveFilePath
-                      << " - Overwriting..." << std::endl;
         }
+        LogFile("[+] File" + PrettyPrintLocale(locale, " for locale ") +
+                " already exists in MPQ archive: " + archiveFilePath + " - Overwriting...");
     }
-    std::cout << "[+] Adding file" << PrettyPrintLocale(locale, " for locale ") << ": "
-              << archiveFilePath << std::endl;
+    LogFile("[+] Adding file" + PrettyPrintLocale(locale, " for locale ") + ": " +
+            archiveFilePath);
 
     // Verify that we are not exceeding maxFile size of the archive, and if we do, increase it
     int32_t numberOfFiles = GetFileInfo<int32_t>(hArchive, SFileMpqNumberOfFiles);
@@ -250,6 +904,79 @@ int AddFile(HANDLE hArchive, const fs::path &localFile, const std::string &archi
             return -1;
         }
     }
+    return 0;
+}
+
+// Flags and compressions for a file: game rules matched on its name and size, then overrides
+static std::tuple<DWORD, DWORD, DWORD> GetAddSettings(
+    const std::string &archiveFilePath, DWORD fileSize, const GameRules &gameRules,
+    const CompressionSettingsOverrides &overrides, bool overwrite) {
+    PhaseSpan span("rules");
+    // Get game-specific rules
+    auto [flags, compressionFirst, compressionNext] =
+        gameRules.GetCompressionSettings(archiveFilePath, fileSize);
+
+    // Apply overrides where specified, otherwise use game rules
+    DWORD dwFlags = overrides.dwFlags.value_or(flags);
+    DWORD dwCompression = overrides.dwCompression.value_or(compressionFirst);
+    DWORD dwCompressionNext = overrides.dwCompressionNext.value_or(compressionNext);
+
+    if (overwrite) {
+        dwFlags += MPQ_FILE_REPLACEEXISTING;
+    }
+    if (LogEnabled(LogLevel::VERBOSE)) {
+        std::ostringstream settings;
+        settings << std::hex << "    Flags: 0x" << dwFlags << ", compression: 0x" << dwCompression
+                 << ", next: 0x" << dwCompressionNext;
+        LogVerbose(settings.str());
+    }
+    return {dwFlags, dwCompression, dwCompressionNext};
+}
+
+// Write a file through SFileCreateFile and SFileWriteFile. The first sector is written
+// with the first compression and the rest with the next one, like SFileAddFileEx does.
+// nextData returns the next length bytes of the file, or nullptr when they cannot be read.
+static bool WriteArchivedFile(HANDLE hArchive, const std::string &archiveFilePath,
+                              ULONGLONG fileTime, DWORD fileSize, LCID locale, DWORD flags,
+                              DWORD compression, DWORD compressionNext,
+                              const std::function<const char *(DWORD length)> &nextData) {
+    if (compressionNext == MPQ_COMPRESSION_NEXT_SAME) {
+        compressionNext = compression;
+    }
+    PhaseSpan span("compress");
+    HANDLE hFile;
+    if (!SFileCreateFile(hArchive, archiveFilePath.c_str(), fileTime, fileSize, locale, flags,
+                         &hFile)) {
+        return false;
+    }
+
+    const DWORD sectorSize = GetFileInfo<DWORD>(hArchive, SFileMpqSectorSize);
+    bool written = true;
+    for (DWORD position = 0; written && position < fileSize;) {
+        // After the first sector, the rest is handed over in large pieces
+        const DWORD length = position == 0 ? std::min(sectorSize, fileSize)
+                                           : std::min<DWORD>(fileSize - position, 1 << 24);
+        const char *data = nextData(length);
+        written = data != nullptr && SFileWriteFile(hFile, data, length,
+                                                    position == 0 ? compression : compressionNext);
+        position += length;
+    }
+    // Finishing fails, and discards the file, if not all of its data was written
+    return SFileFinishFile(hFile) && written;
+}
+
+int AddFile(HANDLE hArchive, const fs::path &localFile, const std::string &archiveFilePath,
+            const LCID locale, const GameRules &gameRules,
+            const CompressionSettingsOverrides &overrides, bool overwrite) {
+    // Return if file doesn't exist on disk
+    if (!fs::exists(localFile)) {
+        std::cerr << "[!] File doesn't exist on disk: " << localFile << std::endl;
+        return -1;
+    }
+    FileSpan fileSpan("add", archiveFilePath);
+    if (PrepareFileAdd(hArchive, archiveFilePath, locale, overwrite) != 0) {
+        return -1;
+    }
 
     // Get file size for rule matching
     const std::uintmax_t rawFileSize = fs::file_size(localFile);
@@ -261,35 +988,149 @@ int AddFile(HANDLE hArchive, const fs::path &localFile, const std::string &archi
     const DWORD fileSize = static_cast<DWORD>(
         std::min(rawFileSize, static_cast<std::uintmax_t>(std::numeric_limits<DWORD>::max())));
 
-    // Get game-specific rules
-    auto [flags, compressionFirst, compressionNext] =
-        gameRules.GetCompressionSettings(archiveFilePath, fileSize);
+    auto [dwFlags, dwCompression, dwCompressionNext] =
+        GetAddSettings(archiveFilePath, fileSize, gameRules, overrides, overwrite);
+
+    // Sectors are fed straight from a mapping of the input, saving StormLib's buffered
+    // reads. ADPCM needs StormLib to inspect the WAVE header, and empty or oversized
+    // files cannot be mapped, so those are added from the path.
+    const DWORD adpcm = MPQ_COMPRESSION_ADPCM_MONO | MPQ_COMPRESSION_ADPCM_STEREO;
+    MappedFile mappedFile;
+    bool addedFile;
+    if (((dwCompression | dwCompressionNext) & adpcm) == 0 && rawFileSize == fileSize &&
+        mappedFile.Open(localFile.u8string())) {
+        DWORD position = 0;
+        addedFile = WriteArchivedFile(hArchive, archiveFilePath, FileWriteTime(localFile),
+                                      fileSize, locale, dwFlags, dwCompression, dwCompressionNext,
+                                      [&](DWORD length) {
+                                          const char *data = mappedFile.Data() + position;
+                                          position += length;
+                                          return data;
+                                      });
+    } else {
+        // SFileAddFileEx takes the locale of the new file from the global setting
+        PhaseSpan span("compress");
+        LocaleLock lock(locale);
+        addedFile = SFileAddFileEx(hArchive, localFile.u8string().c_str(),
+                                   archiveFilePath.c_str(), dwFlags, dwCompression,
+                                   dwCompressionNext);
+    }
 
-    // Apply overrides where specified, otherwise use game rules
-    DWORD dwFlags = overrides.dwFlags.value_or(flags);
-    DWORD dwCompression = overrides.dwCompression.value_or(compressionFirst);
-    DWORD dwCompressionNext = overrides.dwCompressionNext.value_or(compressionNext);
+    if (!addedFile) {
+        int32_t error = SErrGetLastError();
+        std::cerr << "[!] Error: " << error << " Failed to add: " << archiveFilePath << std::endl;
+        return -1;
+    }
 
-    if (overwrite) {
-        dwFlags += MPQ_FILE_REPLACEEXISTING;
+    CountFile(rawFileSize);
+    ProgressFileDone(rawFileSize);
+    return 0;
+}
+
+int AddFileFromStream(HANDLE hArchive, std::istream &input, DWORD fileSize,
+                      const std::string &archiveFilePath, const LCID locale,
+                      const GameRules &gameRules, const CompressionSettingsOverrides &overrides,
+                      bool overwrite, int64_t fileTime) {
+    FileSpan fileSpan("add", archiveFilePath);
+    if (PrepareFileAdd(hArchive, archiveFilePath, locale, overwrite) != 0) {
+        return -1;
+    }
+
+    // Size-based game rules match on the declared size
+    auto [dwFlags, dwCompression, dwCompressionNext] =
+        GetAddSettings(archiveFilePath, fileSize, gameRules, overrides, overwrite);
+    const DWORD adpcm = MPQ_COMPRESSION_ADPCM_MONO | MPQ_COMPRESSION_ADPCM_STEREO;
+    if (((dwCompression | dwCompressionNext) & adpcm) != 0) {
+        std::cout << "[!] Warning: ADPCM compression needs a file on disk, compressing "
+                     "losslessly instead: "
+                  << archiveFilePath << std::endl;
+        dwCompression &= ~adpcm;
+        dwCompressionNext &= ~adpcm;
     }
 
-    bool addedFile = SFileAddFileEx(hArchive, localFile.u8string().c_str(), archiveFilePath.c_str(),
-                                    dwFlags, dwCompression, dwCompressionNext);
+    std::vector<char> buffer;
+    DWORD bytesRead = 0;
+    const bool addedFile = WriteArchivedFile(
+        hArchive, archiveFilePath, fileTime, fileSize, locale, dwFlags, dwCompression,
+        dwCompressionNext, [&](DWORD length) -> const char * {
+            buffer.resize(length);
+            input.read(buffer.data(), length);
+            bytesRead += static_cast<DWORD>(input.gcount());
+            return input.gcount() == static_cast<std::streamsize>(length) ? buffer.data()
+                                                                          : nullptr;
+        });
 
     if (!addedFile) {
+        if (bytesRead < fileSize) {
+            std::cerr << "[!] Failed: Input ended after " << bytesRead << " of " << fileSize
+                      << " bytes: " << archiveFilePath << std::endl;
+            return -1;
+        }
         int32_t error = SErrGetLastError();
         std::cerr << "[!] Error: " << error << " Failed to add: " << archiveFilePath << std::endl;
         return -1;
     }
 
+    CountFile(fileSize);
+    ProgressFileDone(fileSize);
     return 0;
 }
 
+int AddFilesFromTar(HANDLE hArchive, std::istream &input, LCID locale,
+                    const GameRules &gameRules, const CompressionSettingsOverrides &overrides,
+                    bool overwrite) {
+    TarReader reader(input);
+    TarMember member;
+    int result = 0;
+    while (reader.Next(&member)) {
+        if (!member.regularFile) {
+            continue;  // Directories exist implicitly through the paths of their files
+        }
+
+        // Member paths are relative to where the tarball was made, "./" included
+        std::string memberPath = member.path;
+        while (memberPath.rfind("./", 0) == 0 || memberPath.rfind('/', 0) == 0) {
+            memberPath.erase(0, memberPath[0] == '/' ? 1 : 2);
+        }
+        if (memberPath.empty()) {
+            continue;
+        }
+
+        // Normalise path for MPQ
+        std::string archiveFilePath = WindowsifyFilePath(fs::u8path(memberPath));
+
+        // Skip special MPQ files that StormLib manages automatically
+        if (std::find(kSpecialMpqFiles.begin(), kSpecialMpqFiles.end(), archiveFilePath) !=
+            kSpecialMpqFiles.end()) {
+            LogFile("[*] Skipping special MPQ file: " + archiveFilePath);
+            continue;
+        }
+        if (member.size > std::numeric_limits<DWORD>::max()) {
+            std::cerr << "[!] File exceeds 4GB and cannot be added: " << archiveFilePath
+                      << std::endl;
+            result = -1;
+            continue;
+        }
+
+        // The data is compressed straight from the stream, the next member is read after it
+        if (AddFileFromStream(hArchive, reader.Data(), static_cast<DWORD>(member.size),
+                              archiveFilePath, locale, gameRules, overrides, overwrite,
+                              UnixTimeToFileTime(member.modifiedTime)) != 0) {
+            result = -1;
+        }
+    }
+
+    if (reader.Failed()) {
+        std::cerr << "[!] Failed: The tar stream is damaged or ends early." << std::endl;
+        return -1;
+    }
+    return result;
+}
+
 int RemoveFile(HANDLE hArchive, const std::string &archiveFilePath, LCID locale) {
-    SFileSetLocale(locale);
-    std::cout << "[-] Removing file" << PrettyPrintLocale(locale, " for locale ") << ": "
-              << archiveFilePath << std::endl;
+    FileSpan fileSpan("remove", archiveFilePath);
+    LogFile("[-] Removing file" + PrettyPrintLocale(locale, " for locale ") + ": " +
+            archiveFilePath);
 
     if (!FileExistsInArchiveForLocale(hArchive, archiveFilePath, locale)) {
         std::cerr << "[!] Failed: File doesn't exist"
@@ -298,7 +1139,12 @@ int RemoveFile(HANDLE hArchive, const std::string &archiveFilePath, LCID locale)
         return 1;
     }
 
-    if (!SFileRemoveFile(hArchive, archiveFilePath.c_str(), 0)) {
+    bool removed;
+    {
+        LocaleLock lock(locale);
+        removed = SFileRemoveFile(hArchive, archiveFilePath.c_str(), 0);
+    }
+    if (!removed) {
         std::cerr << "[!] Failed: File cannot be removed"
                   << PrettyPrintLocale(locale, " for locale ", true) << ": " << archiveFilePath
                   << std::endl;
@@ -330,8 +1176,151 @@ std::string GetFlagString(uint32_t flags) {
     return result;
 }
 
+std::vector<LCID> GetFileLocales(HANDLE hArchive, const char *fileName) {
+    DWORD maxLocales = 32;  // This will be updated in the call to SFileEnumLocales
+    std::vector<LCID> fileLocales(maxLocales);
+
+    DWORD result = SFileEnumLocales(hArchive, fileName, fileLocales.data(), &maxLocales, 0);
+
+    if (result == ERROR_INVALID_PARAMETER) {
+        // This ought to mean that the file name is unknown, whereupon `SFileEnumLocales`
+        // exits early since its check for `IsPseudoFileName` returns true. If that is the
+        // case, it will not have populated `fileLocales` or have updated `maxLocales`. Just
+        // use the default locale, so the file with the unknown name is handled once.
+        return {defaultLocale};
+
+    } else if (result == ERROR_INVALID_HANDLE || result == ERROR_NOT_SUPPORTED) {
+        std::cerr << "[!] Internal error for file: " << fileName << std::endl;
+        return {};
+
+    } else if (result == ERROR_INSUFFICIENT_BUFFER) {
+        std::cerr << "[!] There are more than " << maxLocales << " locales for the file: "
+                  << fileName << ". Will only use the " << maxLocales << " first files."
+                  << std::endl;
+    }
+
+    fileLocales.resize(std::min<DWORD>(maxLocales, fileLocales.size()));
+    return fileLocales;
+}
+
+std::string GetArchiveFileName(HANDLE hArchive) {
+    DWORD length = 0;
+    SFileGetFileInfo(hArchive, SFileMpqFileName, nullptr, 0, &length);
+    if (length == 0) {
+        return "";
+    }
+    std::vector<TCHAR> fileName(length);
+    if (!SFileGetFileInfo(hArchive, SFileMpqFileName, fileName.data(), length, nullptr)) {
+        return "";
+    }
+    return {fileName.data()};
+}
+
+MpqEntryInfo GetEntryInfo(HANDLE hFile) {
+    MpqEntryInfo entry;
+    entry.hashIndex = GetFileInfo<int32_t>(hFile, SFileInfoHashIndex);
+    entry.nameHash1 = GetFileInfo<int32_t>(hFile, SFileInfoNameHash1);
+    entry.nameHash2 = GetFileInfo<int32_t>(hFile, SFileInfoNameHash2);
+    entry.nameHash3 = GetFileInfo<int64_t>(hFile, SFileInfoNameHash3);
+    entry.locale = GetFileInfo<int32_t>(hFile, SFileInfoLocale);
+    entry.fileIndex = GetFileInfo<int32_t>(hFile, SFileInfoFileIndex);
+    entry.byteOffset = GetFileInfo<int64_t>(hFile, SFileInfoByteOffset);
+    entry.fileTime = GetFileInfo<int64_t>(hFile, SFileInfoFileTime);
+    entry.fileSize = GetFileInfo<int32_t>(hFile, SFileInfoFileSize);
+    entry.compressedSize = GetFileInfo<int32_t>(hFile, SFileInfoCompressedSize);
+    entry.flags = GetFileInfo<int32_t>(hFile, SFileInfoFlags);
+    entry.encryptionKey = GetFileInfo<int64_t>(hFile, SFileInfoEncryptionKey);
+    entry.encryptionKeyRaw = GetFileInfo<int64_t>(hFile, SFileInfoEncryptionKeyRaw);
+    return entry;
+}
+
+// Print one line of the detailed (long) listing
+static void PrintEntryDetails(const MpqEntryInfo &entry, const char *fileName,
+                              const std::vector<std::string> &propertiesToPrint) {
+    for (const auto &prop : propertiesToPrint) {
+        if (prop == "hash-index") {
+            std::cout << std::setw(5) << entry.hashIndex << " ";
+        } else if (prop == "file-index") {
+            std::cout << std::setw(5) << entry.fileIndex << " ";
+        } else if (prop == "name-hash1" || prop == "name-hash2") {
+            std::cout << std::setfill('0') << std::hex << std::setw(8)
+                      << (prop == "name-hash1" ? entry.nameHash1 : entry.nameHash2)
+                      << std::setfill(' ') << std::dec << " ";
+        } else if (prop == "name-hash3") {
+            std::cout << std::setfill('0') << std::hex << std::setw(16) << entry.nameHash3
+                      << std::setfill(' ') << std::dec << " ";
+        } else if (prop == "locale") {
+            std::cout << std::setw(4) << LocaleToLang(entry.locale) << " ";
+        } else if (prop == "byte-offset") {
+            std::cout << std::hex << std::setw(8) << entry.byteOffset << std::dec << " ";
+        } else if (prop == "file-time") {
+            std::cout << std::setw(19) << FileTimeToLsTime(entry.fileTime) << " ";
+        } else if (prop == "file-size" || prop == "compressed-size") {
+            std::cout << std::setw(8)
+                      << (prop == "file-size" ? entry.fileSize : entry.compressedSize) << " ";
+        } else if (prop == "flags") {
+            std::cout << std::setw(8) << GetFlagString(entry.flags) << " ";
+        } else if (prop == "encryption-key" || prop == "encryption-key-raw") {
+            std::cout << std::setfill('0') << std::hex << std::setw(8)
+                      << (prop == "encryption-key" ? entry.encryptionKey : entry.encryptionKeyRaw)
+                      << std::setfill(' ') << std::dec << " ";
+        }
+    }
+
+    std::cout << " " << fileName << '\n';
+}
+
+std::vector<MpqEntryInfo> GetFileEntries(HANDLE hArchive, const char *fileName) {
+    // Multiple files can be stored with identical filenames under different locales.
+    // Loop over all locales and get the file details for each locale.
+    std::vector<MpqEntryInfo> entries;
+    for (LCID locale : GetFileLocales(hArchive, fileName)) {
+        HANDLE hFile;
+
+        // We need to open the file to get detailed information
+        if (!OpenFileForLocale(hArchive, fileName, locale, &hFile)) {
+            std::cerr << "[!] Failed to open file: " << fileName << std::endl;
+            continue;  // Skip to the next file
+        }
+
+        entries.push_back(GetEntryInfo(hFile));
+        SFileCloseFile(hFile);
+    }
+    return entries;
+}
+
+// Print the detailed (long) listing of a file, once for every locale it is stored under
+static void PrintFileDetails(HANDLE hArchive, const char *fileName,
+                             const std::vector<std::string> &propertiesToPrint) {
+    for (const MpqEntryInfo &entry : GetFileEntries(hArchive, fileName)) {
+        PrintEntryDetails(entry, fileName, propertiesToPrint);
+    }
+}
+
 int ListFiles(HANDLE hArchive, const std::optional<std::string> &listfileName, bool listAll,
               bool listDetailed, const std::vector<std::string> &properties) {
+    PhaseSpan span("list");
+    std::vector<std::string> propertiesToPrint =
+        properties.empty() ? std::vector<std::string>{"file-size", "locale", "file-time"}
+                           : properties;
+    if (!properties.empty()) {
+        listDetailed =
+            true;  // If the user specified properties, we need to print the detailed output
+    }
+
+    // Print the detailed (long) file listing (like ls -l), a line per locale of each name
+    if (listDetailed) {
+        for (const MpqEntry &entry : MpqEntryRange(hArchive, listfileName)) {
+            // Skip special files unless user wants to list all (like ls -a)
+            if (!listAll && std::find(kSpecialMpqFiles.begin(), kSpecialMpqFiles.end(),
+                                      entry.name) != kSpecialMpqFiles.end()) {
+                continue;
+            }
+            PrintEntryDetails(entry.info, entry.name.c_str(), propertiesToPrint);
+        }
+        return 0;
+    }
+
     // Check if the user provided a listfile input
     const char *listfile = listfileName.has_value() ? listfileName->c_str() : nullptr;
 
@@ -339,10 +1328,28 @@ int ListFiles(HANDLE hArchive, const std::optional<std::string> &listfileName, b
     HANDLE findHandle = SFileFindFirstFile(hArchive, "*", &findData, listfile);
     if (findHandle == nullptr) {
         std::cerr << "[!] Failed to find first file in MPQ archive." << std::endl;
-        SFileCloseArchive(hArchive);
-        return -1;
+        return 1;
     }
 
+    // Loop through all files in the MPQ archive
+    do {
+        // Skip special files unless user wants to list all (like ls -a)
+        if (!listAll && std::find(kSpecialMpqFiles.begin(), kSpecialMpqFiles.end(),
+                                  findData.cFileName) != kSpecialMpqFiles.end()) {
+            continue;
+        }
+
+        // Print just the filename (like default ls command output)
+        std::cout << findData.cFileName << '\n';
+    } while (SFileFindNextFile(findHandle, &findData));
+
+    SFileFindClose(findHandle);
+    return 0;
+}
+
+int ListFiles(MpqOverlay &overlay, bool listAll, bool listDetailed,
+              const std::vector<std::string> &properties) {
+    PhaseSpan span("list");
     std::vector<std::string> propertiesToPrint =
         properties.empty() ? std::vector<std::string>{"file-size", "locale", "file-time"}
                            : properties;
@@ -351,135 +1358,71 @@ int ListFiles(HANDLE hArchive, const std::optional<std::string> &listfileName, b
             true;  // If the user specified properties, we need to print the detailed output
     }
 
-    // Map of property name to SFileInfoClass — defined once, outside the loop
-    static const std::map<std::string, SFileInfoClass> kPropertyInfoClass = {
-        {"hash-index", SFileInfoHashIndex},
-        {"name-hash1", SFileInfoNameHash1},
-        {"name-hash2", SFileInfoNameHash2},
-        {"name-hash3", SFileInfoNameHash3},
-        {"locale", SFileInfoLocale},
-        {"file-index", SFileInfoFileIndex},
-        {"byte-offset", SFileInfoByteOffset},
-        {"file-time", SFileInfoFileTime},
-        {"file-size", SFileInfoFileSize},
-        {"compressed-size", SFileInfoCompressedSize},
-        {"flags", SFileInfoFlags},
-        {"encryption-key", SFileInfoEncryptionKey},
-        {"encryption-key-raw", SFileInfoEncryptionKeyRaw},
-    };
-
-    std::set<std::string>
-        seenFileNames;  // Used to prevent printing the same file name multiple times
-    // Loop through all files in the MPQ archive
-    do {
-        // Skip special files unless user wants to list all (like ls -a)
-        if (!listAll && std::find(kSpecialMpqFiles.begin(), kSpecialMpqFiles.end(),
-                                  findData.cFileName) != kSpecialMpqFiles.end()) {
+    // The merged index already holds every name once, with its resolved provider
+    for (const auto &fileName : overlay.FileNames()) {
+        if (!listAll && std::find(kSpecialMpqFiles.begin(), kSpecialMpqFiles.end(), fileName) !=
+                            kSpecialMpqFiles.end()) {
             continue;
         }
 
-        // Print the detailed (long) file listing (like ls -l)
         if (listDetailed) {
-            if (seenFileNames.find(findData.cFileName) != seenFileNames.end()) {
-                // Filename has been seen before, and thus printed before. Skip over it.
-                continue;
-            }
-            seenFileNames.insert(findData.cFileName);
-
-            // Multiple files can be stored with identical filenames under different locales.
-            // Loop over all locales and print the file details for each locale.
-            DWORD maxLocales = 32;  // This will be updated in the call to SFileEnumLocales
-            std::vector<LCID> fileLocaleVec(maxLocales);
-            LCID *fileLocales = fileLocaleVec.data();
-
-            DWORD result =
-                SFileEnumLocales(hArchive, findData.cFileName, fileLocales, &maxLocales, 0);
-
-            if (result == ERROR_INVALID_PARAMETER) {
-                // This ought to mean that the file name is unknown, whereupon `SFileEnumLocales`
-                // exits early since its check for `IsPseudoFileName` returns true. If that is the
-                // case, it will not have populated `fileLocales` or have updated `maxLocales`. Just
-                // set the maxLocales to 1 and list the file with the unknown name once.
-                maxLocales = 1;
-                fileLocales[0] = defaultLocale;
-
-            } else if (result == ERROR_INVALID_HANDLE || result == ERROR_NOT_SUPPORTED) {
-                std::cerr << "[!] Internal error for file: " << findData.cFileName << std::endl;
-                continue;
+            PrintFileDetails(overlay.Resolve(fileName), fileName.c_str(), propertiesToPrint);
+        } else {
+            std::cout << fileName << '\n';
+        }
+    }
+    return 0;
+}
 
-            } else if (result == ERROR_INSUFFICIENT_BUFFER) {
-                std::cerr << "[!] There are more than " << maxLocales
-                          << " locales for the file: " << findData.cFileName
-                          << ". Will only list the " << maxLocales << " first files." << std::endl;
-            }
+int ListFiles(const MpqIndex &index, bool listAll, bool listDetailed,
+              const std::vector<std::string> &properties) {
+    PhaseSpan span("list");
+    std::vector<std::string> propertiesToPrint =
+        properties.empty() ? std::vector<std::string>{"file-size", "locale", "file-time"}
+                           : properties;
+    if (!properties.empty()) {
+        listDetailed =
+            true;  // If the user specified properties, we need to print the detailed output
+    }
 
-            // Loop through all found locales
-            for (DWORD i = 0; i < maxLocales; i++) {
-                LCID locale = fileLocales[i];
-                SFileSetLocale(locale);
-                HANDLE hFile;
-
-                // We need to open the file to get detailed information
-                // Use our custom GetFileInfo function
-                if (!SFileOpenFileEx(hArchive, findData.cFileName, SFILE_OPEN_FROM_MPQ, &hFile)) {
-                    std::cerr << "[!] Failed to open file: " << findData.cFileName << std::endl;
-                    continue;  // Skip to the next file
-                }
+    // Entries of one name (one per locale) are printed together in the detailed listing
+    std::map<std::string_view, std::vector<size_t>> entriesByName;
+    if (listDetailed) {
+        for (size_t i = 0; i < index.EntryCount(); i++) {
+            entriesByName[index.EntryName(i)].push_back(i);
+        }
+        for (auto &[name, entries] : entriesByName) {
+            std::stable_sort(entries.begin(), entries.end(), [&index](size_t a, size_t b) {
+                return index.LocaleRank(a) < index.LocaleRank(b);
+            });
+        }
+    }
 
-                for (const auto &prop : propertiesToPrint) {
-                    auto it = kPropertyInfoClass.find(prop);
-                    if (it == kPropertyInfoClass.end()) continue;
-
-                    if (prop == "hash-index" || prop == "file-index") {
-                        std::cout << std::setw(5) << GetFileInfo<int32_t>(hFile, it->second) << " ";
-                    } else if (prop == "name-hash1" || prop == "name-hash2") {
-                        std::cout << std::setfill('0') << std::hex << std::setw(8)
-                                  << GetFileInfo<int32_t>(hFile, it->second) << std::setfill(' ')
-                                  << std::dec << " ";
-                    } else if (prop == "name-hash3") {
-                        std::cout << std::setfill('0') << std::hex << std::setw(16)
-                                  << GetFileInfo<int64_t>(hFile, it->second) << std::setfill(' ')
-                                  << std::dec << " ";
-                    } else if (prop == "locale") {
-                        std::cout << std::setw(4)
-                                  << LocaleToLang(GetFileInfo<int32_t>(hFile, it->second)) << " ";
-                    } else if (prop == "byte-offset") {
-                        std::cout << std::hex << std::setw(8)
-                                  << GetFileInfo<int64_t>(hFile, it->second) << std::dec << " ";
-                    } else if (prop == "file-time") {
-                        std::cout << std::setw(19)
-                                  << FileTimeToLsTime(GetFileInfo<int64_t>(hFile, it->second))
-                                  << " ";
-                    } else if (prop == "file-size" || prop == "compressed-size") {
-                        std::cout << std::setw(8) << GetFileInfo<int32_t>(hFile, it->second) << " ";
-                    } else if (prop == "flags") {
-                        std::cout << std::setw(8)
-                                  << GetFlagString(GetFileInfo<int32_t>(hFile, it->second)) << " ";
-                    } else if (prop == "encryption-key" || prop == "encryption-key-raw") {
-                        std::cout << std::setfill('0') << std::hex << std::setw(8)
-                                  << GetFileInfo<int64_t>(hFile, it->second) << std::setfill(' ')
-                                  << std::dec << " ";
-                    }
-                }
+    for (size_t i = 0; i < index.EntryCount(); i++) {
+        const std::string fileName(index.EntryName(i));
+        if (!listAll && std::find(kSpecialMpqFiles.begin(), kSpecialMpqFiles.end(), fileName) !=
+                            kSpecialMpqFiles.end()) {
+            continue;
+        }
 
-                std::cout << " " << findData.cFileName << std::endl;
-                SFileCloseFile(hFile);
+        if (listDetailed) {
+            auto it = entriesByName.find(index.EntryName(i));
+            if (it->second.empty()) {
+                continue;  // Already printed with an earlier entry of the name
+            }
+            for (size_t entry : it->second) {
+                PrintEntryDetails(index.Entry(entry), fileName.c_str(), propertiesToPrint);
             }
-            SFileSetLocale(defaultLocale);  // Reset locale to default after changing it
+            it->second.clear();
         } else {
-            // Print just the filename (like default ls command output)
-            std::cout << findData.cFileName << std::endl;
+            std::cout << fileName << '\n';
         }
-
-    } while (SFileFindNextFile(findHandle, &findData));
-
-    SFileFindClose(findHandle);
+    }
     return 0;
 }
 
 std::unique_ptr<char[]> ReadFile(HANDLE hArchive, const char *szFileName, unsigned int *fileSize,
                                  LCID preferredLocale) {
-    SFileSetLocale(preferredLocale);
     if (!FileExistsInArchiveForLocale(hArchive, szFileName, preferredLocale) &&
         !FileExistsInArchiveForLocale(hArchive, szFileName, defaultLocale)) {
         std::cerr << "[!] Failed: File doesn't exist"
@@ -489,7 +1432,7 @@ std::unique_ptr<char[]> ReadFile(HANDLE hArchive, const char *szFileName, unsign
     }
 
     HANDLE hFile;
-    if (!SFileOpenFileEx(hArchive, szFileName, SFILE_OPEN_FROM_MPQ, &hFile)) {
+    if (!OpenFileForLocale(hArchive, szFileName, preferredLocale, &hFile)) {
         std::cerr << "[!] Failed: File cannot be opened: " << szFileName << std::endl;
         return nullptr;
     }
@@ -503,6 +1446,7 @@ std::unique_ptr<char[]> ReadFile(HANDLE hArchive, const char *szFileName, unsign
 
     auto fileContent = std::make_unique<char[]>(*fileSize);
     DWORD dwBytesRead;
+    PhaseSpan span("decompress");
     if (!SFileReadFile(hFile, fileContent.get(), *fileSize, &dwBytesRead, nullptr)) {
         std::cerr << "[!] Failed: Cannot read file contents for: " << szFileName << std::endl;
         SFileCloseFile(hFile);
@@ -513,69 +1457,77 @@ std::unique_ptr<char[]> ReadFile(HANDLE hArchive, const char *szFileName, unsign
     return fileContent;
 }
 
+MpqArchiveInfo GetMpqArchiveInfo(HANDLE hArchive) {
+    MpqArchiveInfo info;
+    TMPQHeader header = GetFileInfo<TMPQHeader>(hArchive, SFileMpqHeader);
+    info.formatVersion = header.wFormatVersion + 1;  // Add +1 because StormLib starts at 0
+    info.headerOffset = GetFileInfo<int64_t>(hArchive, SFileMpqHeaderOffset);
+    info.headerSize = GetFileInfo<int64_t>(hArchive, SFileMpqHeaderSize);
+    info.archiveSize = GetFileInfo<int32_t>(hArchive, SFileMpqArchiveSize);
+    info.fileCount = GetFileInfo<int32_t>(hArchive, SFileMpqNumberOfFiles);
+    info.maxFiles = GetFileInfo<int32_t>(hArchive, SFileMpqMaxFileCount);
+    info.signatureType = GetFileInfo<int32_t>(hArchive, SFileMpqSignatures);
+    return info;
+}
+
 void PrintMpqInfo(HANDLE hArchive, const std::optional<std::string> &infoProperty) {
+    PrintMpqInfo(GetMpqArchiveInfo(hArchive), infoProperty);
+}
+
+void PrintMpqInfo(const MpqArchiveInfo &info, const std::optional<std::string> &infoProperty) {
     // Map of property names to their corresponding actions
     std::map<std::string, std::function<void(bool)>> propertyActions = {
         {"format-version",
          [&](bool printName) {
-             TMPQHeader header = GetFileInfo<TMPQHeader>(hArchive, SFileMpqHeader);
-             uint16_t formatVersion =
-                 header.wFormatVersion + 1;  // Add +1 because StormLib starts at 0
              if (printName) {
                  std::cout << "Format version: ";
              }
-             std::cout << formatVersion << std::endl;
+             std::cout << info.formatVersion << std::endl;
          }},
         {"header-offset",
          [&](bool printName) {
-             int64_t headerOffset = GetFileInfo<int64_t>(hArchive, SFileMpqHeaderOffset);
              if (printName) {
                  std::cout << "Header offset: ";
              }
-             std::cout << headerOffset << std::endl;
+             std::cout << info.headerOffset << std::endl;
          }},
         {"header-size",
          [&](bool printName) {
-             int64_t headerSize = GetFileInfo<int64_t>(hArchive, SFileMpqHeaderSize);
              if (printName) {
                  std::cout << "Header size: ";
              }
-             std::cout << headerSize << std::endl;
+             std::cout << info.headerSize << std::endl;
          }},
         {"archive-size",
          [&](bool printName) {
-             int32_t archiveSize = GetFileInfo<int32_t>(hArchive, SFileMpqArchiveSize);
              if (printName) {
                  std::cout << "Archive size: ";
              }
-             std::cout << archiveSize << std::endl;
+             std::cout << info.archiveSize << std::endl;
          }},
         {"file-count",
          [&](bool printName) {
-             int32_t numberOfFiles = GetFileInfo<int32_t>(hArchive, SFileMpqNumberOfFiles);
              if (printName) {
                  std::cout << "File count: ";
              }
-             std::cout << numberOfFiles << std::endl;
+             std::cout << info.fileCount << std::endl;
          }},
         {"max-files",
          [&](bool printName) {
-             int32_t maxFiles = GetFileInfo<int32_t>(hArchive, SFileMpqMaxFileCount);
              if (printName) {
                  std::cout << "Max files: ";
              }
-             std::cout << maxFiles << std::endl;
+             std::cout << info.maxFiles << std::endl;
          }},
         {"signature-type", [&](bool printName) {
-             int32_t signatureType = GetFileInfo<int32_t>(hArchive, SFileMpqSignatures);
              if (printName) {
                  std::cout << "Signature type: ";
              }
-             if (signatureType == SIGNATURE_TYPE_NONE) {
+             if (info.signatureType == SIGNATURE_TYPE_NONE) {
                  std::cout << "None" << std::endl;
-             } else if (signatureType == SIGNATURE_TYPE_WEAK) {
+             } else if (info.signatureType == SIGNATURE_TYPE_WEAK) {
                  std::cout << "Weak" << std::endl;
-             } else if (signatureType == SIGNATURE_TYPE_STRONG) {
+             } else if (info.signatureType == SIGNATURE_TYPE_STRONG) {
                  std::cout << "Strong" << std::endl;
              }
          }}};
@@ -595,6 +1547,7 @@ void PrintMpqInfo(HANDLE hArchive, const std::optional<std::string> &infoPropert
 }
 
 uint32_t VerifyMpqArchive(HANDLE hArchive) {
+    PhaseSpan span("verify");
     return SFileVerifyArchive(hArchive);
 }
 
@@ -647,3 +1600,516 @@ int32_t PrintMpqSignature(HANDLE hArchive, const std::string &target) {
 
     return 0;
 }
+
+// Check whether a file is assembled from the base archive alone, using its patch chain
+// (the null-separated names of every archive the file is assembled from). A patch can
+// also replace a file whole, or add one, which leaves a chain of one patch archive.
+static bool IsUnpatchedFile(HANDLE hArchive, const std::string &fileName, LCID locale) {
+    HANDLE hFile;
+    if (!OpenFileForLocale(hArchive, fileName.c_str(), locale, &hFile)) {
+        return false;  // Let the caller report the error when reading the file
+    }
+
+    DWORD length = 0;
+    SFileGetFileInfo(hFile, SFileInfoPatchChain, nullptr, 0, &length);
+    std::vector<TCHAR> patchChain(length + 1);
+    SFileGetFileInfo(hFile, SFileInfoPatchChain, patchChain.data(), length, nullptr);
+    SFileCloseFile(hFile);
+
+    std::vector<std::string> chain;
+    for (size_t i = 0; i < length && patchChain[i] != 0; i += std::strlen(&patchChain[i]) + 1) {
+        chain.emplace_back(&patchChain[i]);
+    }
+    return chain.size() == 1 && chain.front() == GetArchiveFileName(hArchive);
+}
+
+int FlattenArchives(const std::string &baseArchive, const std::vector<std::string> &overlays,
+                    const std::vector<std::string> &patches,
+                    const std::optional<std::string> &listfileName,
+                    const std::string &outputArchiveName, unsigned int threads) {
+    MpqOverlay overlay;
+    if (!overlay.Open(baseArchive, overlays, patches, listfileName)) {
+        return 1;
+    }
+
+    // Files no patch touches are copied from an unpatched handle of the base archive,
+    // since StormLib only exposes the patched (decompressed) data of a patched archive.
+    // Files a patch changes, replaces or adds are read through the patched handle.
+    HANDLE hBaseUnpatched = overlay.Base();
+    if (!patches.empty() && !OpenMpqArchive(baseArchive, &hBaseUnpatched, MPQ_OPEN_READ_ONLY)) {
+        return 1;
+    }
+
+    MpqWriter writer(GetFileInfo<DWORD>(overlay.Base(), SFileMpqSectorSize), threads);
+    if (!writer.Open(outputArchiveName)) {
+        if (hBaseUnpatched != overlay.Base()) {
+            CloseMpqArchive(hBaseUnpatched);
+        }
+        return 1;
+    }
+
+    int result = 0;
+    size_t copiedRawCount = 0;
+    for (const auto &fileName : overlay.FileNames()) {
+        // Special files describe the source archives, the writer creates its own (listfile)
+        if (std::find(kSpecialMpqFiles.begin(), kSpecialMpqFiles.end(), fileName) !=
+            kSpecialMpqFiles.end()) {
+            continue;
+        }
+
+        HANDLE hProvider = overlay.Resolve(fileName);
+        for (LCID locale : GetFileLocales(hProvider, fileName.c_str())) {
+            HANDLE hSource = hProvider;
+            if (hProvider == overlay.Base() && hBaseUnpatched != hProvider &&
+                IsUnpatchedFile(hProvider, fileName, locale)) {
+                hSource = hBaseUnpatched;
+            }
+
+            // Files deleted by a patch are left out of the flattened archive
+            HANDLE hFile;
+            if (OpenFileForLocale(hSource, fileName.c_str(), locale, &hFile)) {
+                const auto flags = GetFileInfo<DWORD>(hFile, SFileInfoFlags);
+                SFileCloseFile(hFile);
+                if (flags & MPQ_FILE_DELETE_MARKER) {
+                    continue;
+                }
+            }
+
+            bool copiedRaw = false;
+            if (writer.TransplantFile(hSource, fileName, locale, fileName, &copiedRaw) != 0) {
+                result = 1;
+                continue;
+            }
+            copiedRawCount += copiedRaw ? 1 : 0;
+        }
+    }
+
+    if (hBaseUnpatched != overlay.Base()) {
+        CloseMpqArchive(hBaseUnpatched);
+    }
+
+    // An archive missing files is not written, the writer removes its working file
+    if (result != 0) {
+        std::cerr << "[!] Failed: Not every file could be copied, no archive was written: "
+                  << outputArchiveName << std::endl;
+        return 1;
+    }
+
+    // The (listfile) written by Finish is not counted as a flattened file
+    const size_t fileCount = writer.FileCount();
+    if (!writer.Finish()) {
+        return 1;
+    }
+    std::cout << "[*] Flattened " << fileCount << " files (" << copiedRawCount
+              << " copied without recompression) into: " << outputArchiveName << std::endl;
+    return result;
+}
+
+// StormLib names files missing from the listfile "File00000123.xxx", after their block index
+static bool IsPseudoFileName(const std::string &fileName) {
+    return fileName.size() == 16 && fileName.compare(0, 4, "File") == 0 &&
+           std::all_of(fileName.begin() + 4, fileName.begin() + 12,
+                       [](unsigned char c) { return std::isdigit(c); }) &&
+           fileName[12] == '.';
+}
+
+// Names of the files matching a file name or wildcard mask, each name once
+static std::vector<std::string> FindArchiveFiles(HANDLE hArchive, const std::string &mask,
+                                                 const std::optional<std::string> &listfileName) {
+    const char *listfile = listfileName.has_value() ? listfileName->c_str() : nullptr;
+
+    std::vector<std::string> fileNames;
+    std::set<std::string> seenFileNames;
+    SFILE_FIND_DATA findData;
+    HANDLE findHandle = SFileFindFirstFile(hArchive, mask.c_str(), &findData, listfile);
+    if (findHandle != nullptr) {
+        do {
+            if (seenFileNames.insert(findData.cFileName).second) {
+                fileNames.emplace_back(findData.cFileName);
+            }
+        } while (SFileFindNextFile(findHandle, &findData));
+        SFileFindClose(findHandle);
+    }
+
+    // A plain file name that is missing from the listfile can still be opened
+    if (fileNames.empty() && mask.find_first_of("*?") == std::string::npos &&
+        HasFile(hArchive, mask.c_str())) {
+        fileNames.push_back(mask);
+    }
+    return fileNames;
+}
+
+// Copy every locale of a file into the writer, leaving out locales it already has
+static int TransplantFileLocales(MpqWriter &writer, HANDLE hSourceArchive,
+                                 const std::string &fileName, const std::string &archiveFilePath,
+                                 size_t *copiedRawCount) {
+    int result = 0;
+    for (LCID locale : GetFileLocales(hSourceArchive, fileName.c_str())) {
+        if (writer.HasEntry(archiveFilePath, locale)) {
+            continue;
+        }
+
+        bool copiedRaw = false;
+        if (writer.TransplantFile(hSourceArchive, fileName, locale, archiveFilePath,
+                                  &copiedRaw) != 0) {
+            result = 1;
+            continue;
+        }
+        *copiedRawCount += copiedRaw ? 1 : 0;
+    }
+    return result;
+}
+
+// Copy files into an archive through StormLib, decompressing and compressing them again
+// like add does, so the archive keeps its format version, (attributes) and signature
+// file. The files are added to a working copy that replaces the archive.
+static int AddFilesFromArchive(HANDLE hSourceArchive, const std::string &targetArchiveName,
+                               const std::vector<std::string> &fileNames,
+                               const std::optional<std::string> &nameInArchive,
+                               bool overwrite) {
+    AtomicArchiveWrite atomicWrite(targetArchiveName);
+    if (!atomicWrite.Begin()) {
+        return 1;
+    }
+    HANDLE hTargetArchive;
+    if (!OpenMpqArchive(atomicWrite.Path(), &hTargetArchive, 0)) {
+        return 1;
+    }
+
+    const GameRules gameRules(GameRules::GetDefaultProfile());
+    int result = 0;
+    size_t copiedCount = 0;
+    for (const auto &fileName : fileNames) {
+        const std::string archiveFilePath = nameInArchive.value_or(fileName);
+        for (LCID locale : GetFileLocales(hSourceArchive, fileName.c_str())) {
+            if (!overwrite && FileExistsInArchiveForLocale(hTargetArchive, archiveFilePath,
+                                                           locale)) {
+                std::cerr << "[!] File" << PrettyPrintLocale(locale, " for locale ")
+                          << " already exists in MPQ archive: " << archiveFilePath
+                          << " - Skipping..." << std::endl;
+                continue;
+            }
+
+            HANDLE hFile;
+            if (!OpenFileForLocale(hSourceArchive, fileName.c_str(), locale, &hFile)) {
+                std::cerr << "[!] Failed: File cannot be opened: " << fileName << std::endl;
+                result = 1;
+                continue;
+            }
+            const auto fileTime = GetFileInfo<int64_t>(hFile, SFileInfoFileTime);
+            SFileCloseFile(hFile);
+            unsigned int fileSize = 0;
+            auto fileContent = ReadFile(hSourceArchive, fileName.c_str(), &fileSize, locale);
+            if (!fileContent) {
+                result = 1;
+                continue;
+            }
+
+            std::istringstream input(std::string(fileContent.get(), fileSize));
+            if (AddFileFromStream(hTargetArchive, input, fileSize, archiveFilePath, locale,
+                                  gameRules, CompressionSettingsOverrides(), overwrite,
+                                  fileTime) != 0) {
+                result = 1;
+                continue;
+            }
+            copiedCount++;
+        }
+    }
+
+    // The tables are written on close, a working copy that failed to close is discarded
+    if (!CloseMpqArchive(hTargetArchive) || !atomicWrite.Commit()) {
+        return 1;
+    }
+    std::cout << "[*] Copied " << copiedCount << " files (0 without recompression) into: "
+              << targetArchiveName << std::endl;
+    return result;
+}
+
+int CopyFiles(HANDLE hSourceArchive, const std::string &targetArchiveName,
+              const std::vector<std::string> &fileMasks,
+              const std::optional<std::string> &nameInArchive, bool overwrite,
+              const std::optional<std::string> &listfileName) {
+    // Resolve the names and wildcards to copy first, so nothing is written on typos
+    std::vector<std::string> fileNames;
+    for (const auto &fileMask : fileMasks) {
+        std::vector<std::string> matches = FindArchiveFiles(hSourceArchive, fileMask, listfileName);
+        if (matches.empty()) {
+            std::cerr << "[!] Failed: No file in source archive matches: " << fileMask
+                      << std::endl;
+            return 1;
+        }
+        for (auto &match : matches) {
+            if (std::find(kSpecialMpqFiles.begin(), kSpecialMpqFiles.end(), match) ==
+                    kSpecialMpqFiles.end() &&
+                std::find(fileNames.begin(), fileNames.end(), match) == fileNames.end()) {
+                fileNames.push_back(std::move(match));
+            }
+        }
+    }
+    if (nameInArchive.has_value() && fileNames.size() != 1) {
+        std::cerr << "[!] Cannot use --name-in-archive when copying more than one file."
+                  << std::endl;
+        return 1;
+    }
+
+    HANDLE hTargetArchive;
+    if (!OpenMpqArchive(targetArchiveName, &hTargetArchive, MPQ_OPEN_READ_ONLY)) {
+        return 1;
+    }
+
+    // The rebuilt archive is written in format version 1 (or 2 above 4 GB) and without
+    // (attributes) or (signature), so targets that have them are added to instead
+    const MpqArchiveInfo targetInfo = GetMpqArchiveInfo(hTargetArchive);
+    if (targetInfo.formatVersion > 2 || HasFile(hTargetArchive, "(attributes)") ||
+        HasFile(hTargetArchive, "(signature)") ||
+        targetInfo.signatureType != SIGNATURE_TYPE_NONE) {
+        CloseMpqArchive(hTargetArchive);
+        return AddFilesFromArchive(hSourceArchive, targetArchiveName, fileNames, nameInArchive,
+                                   overwrite);
+    }
+
+    // Every file of the target archive must be copied over to the rebuilt archive,
+    // which is impossible for files whose name is unknown
+    std::vector<std::string> targetFileNames = FindArchiveFiles(hTargetArchive, "*", std::nullopt);
+    for (const auto &targetFileName : targetFileNames) {
+        if (IsPseudoFileName(targetFileName)) {
+            std::cerr << "[!] Target archive contains files with unknown names: "
+                      << targetFileName << " Exiting..." << std::endl;
+            CloseMpqArchive(hTargetArchive);
+            return 1;
+        }
+    }
+
+    // The target archive is rebuilt next to itself, then replaces the original
+    const std::string rebuiltArchiveName = targetArchiveName + ".rebuild";
+    MpqWriter writer(GetFileInfo<DWORD>(hTargetArchive, SFileMpqSectorSize));
+    if (!writer.Open(rebuiltArchiveName)) {
+        CloseMpqArchive(hTargetArchive);
+        return 1;
+    }
+
+    // Files written first win, so the order decides what happens to existing files
+    int result = 0;
+    size_t copiedRawCount = 0;
+    auto copyTargetFiles = [&]() {
+        for (const auto &targetFileName : targetFileNames) {
+            if (std::find(kSpecialMpqFiles.begin(), kSpecialMpqFiles.end(), targetFileName) !=
+                kSpecialMpqFiles.end()) {
+                continue;
+            }
+            size_t unused = 0;
+            result |= TransplantFileLocales(writer, hTargetArchive, targetFileName,
+                                            targetFileName, &unused);
+        }
+    };
+    if (!overwrite) {
+        copyTargetFiles();
+    }
+
+    const size_t targetFileCount = writer.FileCount();
+    for (const auto &fileName : fileNames) {
+        const std::string archiveFilePath = nameInArchive.value_or(fileName);
+        std::vector<LCID> locales = GetFileLocales(hSourceArchive, fileName.c_str());
+        for (LCID locale : locales) {
+            if (writer.HasEntry(archiveFilePath, locale)) {
+                std::cerr << "[!] File" << PrettyPrintLocale(locale, " for locale ")
+                          << " already exists in MPQ archive: " << archiveFilePath
+                          << " - Skipping..." << std::endl;
+                continue;
+            }
+            LogFile("[+] Copying file" + PrettyPrintLocale(locale, " for locale ") + ": " +
+                    archiveFilePath);
+        }
+        result |= TransplantFileLocales(writer, hSourceArchive, fileName, archiveFilePath,
+                                        &copiedRawCount);
+    }
+    const size_t copiedCount = writer.FileCount() - (overwrite ? 0 : targetFileCount);
+
+    if (overwrite) {
+        copyTargetFiles();
+    }
+    CloseMpqArchive(hTargetArchive);
+
+    if (!writer.Finish()) {
+        fs::remove(rebuiltArchiveName);
+        return 1;
+    }
+    std::error_code error;
+    fs::rename(rebuiltArchiveName, targetArchiveName, error);
+    if (error) {
+        std::cerr << "[!] Failed to replace MPQ archive: " << targetArchiveName << " ("
+                  << error.message() << ")" << std::endl;
+        fs::remove(rebuiltArchiveName);
+        return 1;
+    }
+
+    std::cout << "[*] Copied " << copiedCount << " files (" << copiedRawCount
+              << " without recompression) into: " << targetArchiveName << std::endl;
+    return result;
+}
+
+int MergeArchives(const std::vector<std::string> &archiveNames,
+                  const std::optional<std::string> &listfileName,
+                  const std::string &outputArchiveName, unsigned int threads) {
+    std::vector<HANDLE> archives;
+    auto closeArchives = [&archives]() {
+        for (HANDLE hArchive : archives) {
+            CloseMpqArchive(hArchive);
+        }
+    };
+    for (const auto &archiveName : archiveNames) {
+        HANDLE hArchive;
+        if (!OpenMpqArchive(archiveName, &hArchive, MPQ_OPEN_READ_ONLY)) {
+            closeArchives();
+            return 1;
+        }
+        archives.push_back(hArchive);
+    }
+
+    MpqWriter writer(GetFileInfo<DWORD>(archives.front(), SFileMpqSectorSize), threads);
+    if (!writer.Open(outputArchiveName)) {
+        closeArchives();
+        return 1;
+    }
+
+    // Later archives take priority, so they are written first and win every
+    // name and locale they share with earlier archives
+    int result = 0;
+    bool copyFailed = false;
+    size_t copiedRawCount = 0;
+    for (size_t i = archives.size(); i-- > 0;) {
+        for (const auto &fileName : FindArchiveFiles(archives[i], "*", listfileName)) {
+            if (std::find(kSpecialMpqFiles.begin(), kSpecialMpqFiles.end(), fileName) !=
+                kSpecialMpqFiles.end()) {
+                continue;
+            }
+            if (IsPseudoFileName(fileName)) {
+                std::cerr << "[!] Skipping file with unknown name in " << archiveNames[i]
+                          << ": " << fileName << std::endl;
+                result = 1;
+                continue;
+            }
+            copyFailed |= TransplantFileLocales(writer, archives[i], fileName, fileName,
+                                                &copiedRawCount) != 0;
+        }
+    }
+    closeArchives();
+
+    // Files with unknown names are skipped, but an archive missing files that failed to
+    // copy is not written, the writer removes its working file
+    if (copyFailed) {
+        std::cerr << "[!] Failed: Not every file could be copied, no archive was written: "
+                  << outputArchiveName << std::endl;
+        return 1;
+    }
+
+    const size_t fileCount = writer.FileCount();
+    if (!writer.Finish()) {
+        return 1;
+    }
+    std::cout << "[*] Merged " << fileCount << " files (" << copiedRawCount
+              << " copied without recompression) into: " << outputArchiveName << std::endl;
+    return result;
+}
+
+// Rename one file for every given locale, counting the renamed entries
+static int RenameFileLocales(HANDLE hArchive, const std::string &oldName,
+                             const std::string &newName, const std::vector<LCID> &locales,
+                             size_t *renamedCount) {
+    int result = 0;
+    for (LCID locale : locales) {
+        LogFile("[+] Renaming file" + PrettyPrintLocale(locale, " for locale ") + ": " + oldName +
+                " -> " + newName);
+
+        // StormLib re-encrypts the file if its key is derived from the name
+        bool renamed;
+        {
+            LocaleLock lock(locale);
+            renamed = SFileRenameFile(hArchive, oldName.c_str(), newName.c_str());
+        }
+        if (!renamed) {
+            int32_t error = SErrGetLastError();
+            std::cerr << "[!] Error: " << error << " Failed to rename: " << oldName << std::endl;
+            result = 1;
+            continue;
+        }
+        (*renamedCount)++;
+    }
+    return result;
+}
+
+int RenameFiles(HANDLE hArchive, const std::string &oldPattern, const std::string &newPattern,
+                const std::optional<LCID> &locale,
+                const std::optional<std::string> &listfileName) {
+    const auto wildcards = std::count(oldPattern.begin(), oldPattern.end(), '*');
+    if (wildcards > 1 || wildcards != std::count(newPattern.begin(), newPattern.end(), '*') ||
+        oldPattern.find('?') != std::string::npos) {
+        std::cerr << "[!] Rename patterns must both contain one '*' wildcard, or none."
+                  << std::endl;
+        return 1;
+    }
+
+    std::string newNamePattern = newPattern;
+    std::replace(newNamePattern.begin(), newNamePattern.end(), '/', '\\');
+
+    // Collect every rename before changing the archive, so renamed files are not matched again
+    std::vector<std::pair<std::string, std::string>> renames;
+    if (wildcards == 0) {
+        renames.emplace_back(oldPattern, newNamePattern);
+    } else {
+        const size_t wildcard = oldPattern.find('*');
+        const std::string prefix = ArchivePathKey(oldPattern.substr(0, wildcard));
+        const std::string suffix = ArchivePathKey(oldPattern.substr(wildcard + 1));
+        const size_t newWildcard = newNamePattern.find('*');
+
+        for (const auto &fileName : FindArchiveFiles(hArchive, oldPattern, listfileName)) {
+            const std::string key = ArchivePathKey(fileName);
+            if (key.size() < prefix.size() + suffix.size() ||
+                key.compare(0, prefix.size(), prefix) != 0 ||
+                key.compare(key.size() - suffix.size(), suffix.size(), suffix) != 0) {
+                continue;
+            }
+            const std::string matched =
+                fileName.substr(prefix.size(), fileName.size() - prefix.size() - suffix.size());
+            std::string newName = newNamePattern;
+            newName.replace(newWildcard, 1, matched);
+            renames.emplace_back(fileName, newName);
+        }
+    }
+
+    if (renames.empty()) {
+        std::cerr << "[!] Failed: No file in archive matches: " << oldPattern << std::endl;
+        return 1;
+    }
+
+    int result = 0;
+    size_t renamedCount = 0;
+    for (const auto &[oldName, newName] : renames) {
+        // Without a locale, every locale the file is stored under is renamed, including
+        // files stored under no neutral locale
+        std::vector<LCID> locales;
+        if (locale.has_value()) {
+            if (FileExistsInArchiveForLocale(hArchive, oldName, *locale)) {
+                locales.push_back(*locale);
+            }
+        } else if (const auto stored = LookupFileLocales(hArchive, oldName.c_str())) {
+            locales = *stored;
+        } else if (HasFile(hArchive, oldName.c_str())) {
+            // Names only StormLib can look up
+            locales = GetFileLocales(hArchive, oldName.c_str());
+        }
+        if (locales.empty()) {
+            std::cerr << "[!] Failed: File doesn't exist"
+                      << PrettyPrintLocale(locale.value_or(defaultLocale), " for locale ",
+                                           locale.has_value())
+                      << ": " << oldName << std::endl;
+            result = 1;
+            continue;
+        }
+        result |= RenameFileLocales(hArchive, oldName, newName, locales, &renamedCount);
+    }
+
+    // The (listfile) is written once, when the archive is closed
+    std::cout << "[*] Renamed " << renamedCount << " files" << std::endl;
+    return result;
+}
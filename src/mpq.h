@@ -2,6 +2,7 @@
 #define MPQ_H
 
 #include <filesystem>
+#include <istream>
 #include <memory>
 #include <optional>
 #include <vector>
@@ -9,16 +10,85 @@
 #include <StormLib.h>
 
 #include "gamerules.h"
+#include "md5.h"
+#include "overlay.h"
+#include "zerocopy.h"
 
 namespace fs = std::filesystem;
 
+class MpqIndex;
+
+// Archive properties printed by the info subcommand
+struct MpqArchiveInfo {
+    uint16_t formatVersion = 0;  // Labelled 1-4
+    int64_t headerOffset = 0;
+    int64_t headerSize = 0;
+    int32_t archiveSize = 0;
+    int32_t fileCount = 0;
+    int32_t maxFiles = 0;
+    int32_t signatureType = 0;
+};
+
+// File properties printed by the detailed listing, for one locale of a file
+struct MpqEntryInfo {
+    int32_t hashIndex = 0;
+    int32_t nameHash1 = 0;
+    int32_t nameHash2 = 0;
+    int64_t nameHash3 = 0;
+    int32_t locale = 0;
+    int32_t fileIndex = 0;
+    int64_t byteOffset = 0;
+    int64_t fileTime = 0;
+    int32_t fileSize = 0;
+    int32_t compressedSize = 0;
+    int32_t flags = 0;
+    int64_t encryptionKey = 0;
+    int64_t encryptionKeyRaw = 0;
+};
+
+// Checksums of each file's data in (attributes), by file index. An array is empty when
+// (attributes) is missing or does not have it, and all-zero values were never computed.
+struct MpqFileAttributes {
+    std::vector<uint32_t> crc32s;
+    std::vector<Md5Digest> md5s;
+};
+
 bool OpenMpqArchive(const std::string &filename, HANDLE *hArchive, int32_t flags);
+// Open an archive read-only through a memory mapping of the whole file
+bool OpenMpqArchiveMapped(const std::string &filename, HANDLE *hArchive, int32_t flags);
 bool CloseMpqArchive(HANDLE hArchive);
+// Whether the file is stored under exactly this locale
+bool FileExistsInArchiveForLocale(HANDLE hArchive, const std::string &filePath, LCID locale);
 bool SignMpqArchive(HANDLE hArchive);
+// Extract all files in the order they are stored, optionally printing the read bandwidth
 int ExtractFiles(HANDLE hArchive, const std::string &output,
-                 const std::optional<std::string> &listfileName, LCID preferredLocale);
+                 const std::optional<std::string> &listfileName, LCID preferredLocale,
+                 bool reportBandwidth);
+int ExtractFiles(MpqOverlay &overlay, const std::string &output, LCID preferredLocale);
+int ExtractFiles(HANDLE hArchive, const MpqIndex &index, const std::string &output,
+                 LCID preferredLocale, bool reportBandwidth);
+// Extract every locale of every file in one pass, into a directory per locale named by
+// LocaleToLang ("neutral" for the neutral locale). Copies identical to another locale of
+// the same file can be replaced with hard links.
+int ExtractAllLocales(HANDLE hArchive, const std::string &output,
+                      const std::optional<std::string> &listfileName, bool linkIdentical,
+                      bool reportBandwidth);
+MpqFileAttributes ReadFileAttributes(HANDLE hArchive);
+// Extract all files through a content-addressed store: each distinct content is written
+// to the store once, keyed by its MD5, and the output files are links to it. With
+// trustAttributes, files whose (attributes) MD5 is in the store already are linked
+// without being decompressed.
+int ExtractFilesToStore(HANDLE hArchive, const std::string &output,
+                        const std::optional<std::string> &listfileName, LCID preferredLocale,
+                        const std::string &storeDirectory, bool trustAttributes);
 int ExtractFile(HANDLE hArchive, const std::string &output, const std::string &fileName,
                 bool keepFolderStructure, LCID preferredLocale);
+// Write a file stored without compression or encryption straight from the archive file
+// to a descriptor. Unsupported (nothing written) for other files, which need ReadFile.
+RangeCopyResult WriteStoredFile(HANDLE hArchive, const char *fileName, LCID preferredLocale,
+                                int outputFd);
+// The same for an entry already looked up, like one from the sidecar index
+RangeCopyResult WriteStoredFile(HANDLE hArchive, const MpqEntryInfo &entry, int outputFd);
 HANDLE CreateMpqArchive(const std::string &outputArchiveName, uint32_t fileCount,
                         const GameRules &gameRules);
 int AddFiles(HANDLE hArchive, const std::string &inputPath, LCID locale, const GameRules &gameRules,
@@ -27,12 +97,48 @@ int AddFile(HANDLE hArchive, const fs::path &localFile, const std::string &archi
             LCID locale, const GameRules &gameRules,
             const CompressionSettingsOverrides &overrides = CompressionSettingsOverrides(),
             bool overwrite = false);
+// Add exactly fileSize bytes read from a stream, such as stdin. Size-based game rules
+// match on the declared size.
+int AddFileFromStream(HANDLE hArchive, std::istream &input, DWORD fileSize,
+                      const std::string &archiveFilePath, LCID locale, const GameRules &gameRules,
+                      const CompressionSettingsOverrides &overrides, bool overwrite,
+                      int64_t fileTime);
+// Add every regular file of a tar stream, compressing the data as it is read
+int AddFilesFromTar(HANDLE hArchive, std::istream &input, LCID locale,
+                    const GameRules &gameRules, const CompressionSettingsOverrides &overrides,
+                    bool overwrite);
 int RemoveFile(HANDLE hArchive, const std::string &archiveFilePath, LCID locale);
 int ListFiles(HANDLE hArchive, const std::optional<std::string> &listfileName, bool listAll,
               bool listDetailed, const std::vector<std::string> &properties);
+int ListFiles(MpqOverlay &overlay, bool listAll, bool listDetailed,
+              const std::vector<std::string> &properties);
+int ListFiles(const MpqIndex &index, bool listAll, bool listDetailed,
+              const std::vector<std::string> &properties);
+MpqEntryInfo GetEntryInfo(HANDLE hFile);
+// Get the properties of a file under every locale it is stored with
+std::vector<MpqEntryInfo> GetFileEntries(HANDLE hArchive, const char *fileName);
+std::string GetArchiveFileName(HANDLE hArchive);
+// Get every locale a file is stored under, or an empty list on internal errors
+std::vector<LCID> GetFileLocales(HANDLE hArchive, const char *fileName);
 std::unique_ptr<char[]> ReadFile(HANDLE hArchive, const char *szFileName, unsigned int *fileSize,
                                  LCID preferredLocale);
+int FlattenArchives(const std::string &baseArchive, const std::vector<std::string> &overlays,
+                    const std::vector<std::string> &patches,
+                    const std::optional<std::string> &listfileName,
+                    const std::string &outputArchiveName, unsigned int threads = 0);
+int CopyFiles(HANDLE hSourceArchive, const std::string &targetArchiveName,
+              const std::vector<std::string> &fileMasks,
+              const std::optional<std::string> &nameInArchive, bool overwrite,
+              const std::optional<std::string> &listfileName);
+int MergeArchives(const std::vector<std::string> &archiveNames,
+                  const std::optional<std::string> &listfileName,
+                  const std::string &outputArchiveName, unsigned int threads = 0);
+int RenameFiles(HANDLE hArchive, const std::string &oldPattern, const std::string &newPattern,
+                const std::optional<LCID> &locale,
+                const std::optional<std::string> &listfileName);
+MpqArchiveInfo GetMpqArchiveInfo(HANDLE hArchive);
 void PrintMpqInfo(HANDLE hArchive, const std::optional<std::string> &infoProperty);
+void PrintMpqInfo(const MpqArchiveInfo &info, const std::optional<std::string> &infoProperty);
 uint32_t VerifyMpqArchive(HANDLE hArchive);
 int32_t PrintMpqSignature(HANDLE hArchive, const std::string &target);
 
@@ -0,0 +1,324 @@
+#include "mpqindex.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <system_error>
+#include <type_traits>
+#include <vector>
+
+#include <StormLib.h>
+
+#include "filelookup.h"
+#include "helpers.h"
+#include "locales.h"
+#include "mpq.h"
+#include "mpqwriter.h"
+
+namespace fs = std::filesystem;
+
+namespace {
+constexpr char kIndexMagic[8] = {'M', 'P', 'Q', 'I', 'D', 'X', '\r', '\n'};
+constexpr uint32_t kIndexVersion = 2;
+constexpr uint32_t kByteOrderMark = 0x01020304;  // Rejects an index from another byte order
+constexpr size_t kHashedBytes = 4096;             // Hashed at the head and the tail
+constexpr uint32_t kEmptySlot = 0xFFFFFFFF;
+
+// What the index was built from. The head holds the MPQ header of all but
+// self-extracting archives, the tail usually holds the hash and block tables.
+struct ArchiveKey {
+    uint64_t archiveSize = 0;
+    int64_t archiveTime = 0;
+    uint64_t headerHash = 0;
+};
+
+// Layout of the sidecar: IndexHeader, IndexEntry[entryCount], IndexSlot[slotCount],
+// then all names
+struct IndexHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t byteOrder;
+    ArchiveKey key;
+    uint64_t entryCount;
+    uint64_t slotCount;  // A power of two, at least twice the entry count
+    uint64_t namesSize;
+    MpqArchiveInfo info;
+};
+
+struct IndexEntry {
+    uint64_t nameOffset;
+    uint32_t nameLength;
+    uint32_t localeRank;  // Position among the locales of the name, as StormLib enumerates them
+    MpqEntryInfo info;
+};
+
+// Open-addressed lookup table of the entries, hashed like an MPQ hash table: a name
+// starts probing at its TableIndex hash and is told apart by its NameA and NameB hashes
+struct IndexSlot {
+    uint32_t nameA;
+    uint32_t nameB;
+    uint32_t entry;  // kEmptySlot ends a probe
+};
+
+static_assert(std::is_trivially_copyable_v<IndexHeader>);
+static_assert(std::is_trivially_copyable_v<IndexEntry>);
+static_assert(std::is_trivially_copyable_v<IndexSlot>);
+static_assert(sizeof(IndexHeader) % alignof(IndexEntry) == 0);
+
+uint64_t HashBytes(uint64_t hash, const char *bytes, size_t count) {
+    // FNV-1a
+    for (size_t i = 0; i < count; i++) {
+        hash ^= static_cast<unsigned char>(bytes[i]);
+        hash *= 0x100000001B3ULL;
+    }
+    return hash;
+}
+
+bool ReadArchiveKey(const std::string &archiveName, ArchiveKey *key) {
+    std::error_code error;
+    const fs::path archivePath = fs::u8path(archiveName);
+    key->archiveSize = fs::file_size(archivePath, error);
+    if (error) {
+        return false;
+    }
+    key->archiveTime = fs::last_write_time(archivePath, error).time_since_epoch().count();
+    if (error) {
+        return false;
+    }
+
+    std::ifstream archive(archivePath, std::ios::binary);
+    std::vector<char> bytes(kHashedBytes);
+    uint64_t hash = 0xCBF29CE484222325ULL;
+    archive.read(bytes.data(), static_cast<std::streamsize>(bytes.size()));
+    hash = HashBytes(hash, bytes.data(), static_cast<size_t>(archive.gcount()));
+    if (key->archiveSize > kHashedBytes) {
+        archive.clear();
+        archive.seekg(static_cast<std::streamoff>(key->archiveSize - kHashedBytes));
+        archive.read(bytes.data(), static_cast<std::streamsize>(bytes.size()));
+        hash = HashBytes(hash, bytes.data(), static_cast<size_t>(archive.gcount()));
+    }
+    key->headerHash = hash;
+    return static_cast<bool>(archive) || archive.eof();
+}
+
+bool SameKey(const ArchiveKey &a, const ArchiveKey &b) {
+    return a.archiveSize == b.archiveSize && a.archiveTime == b.archiveTime &&
+           a.headerHash == b.headerHash;
+}
+
+const IndexHeader *HeaderOf(const char *data) {
+    return reinterpret_cast<const IndexHeader *>(data);
+}
+
+const IndexEntry *EntriesOf(const char *data) {
+    return reinterpret_cast<const IndexEntry *>(data + sizeof(IndexHeader));
+}
+
+const IndexSlot *SlotsOf(const char *data) {
+    return reinterpret_cast<const IndexSlot *>(data + sizeof(IndexHeader) +
+                                               HeaderOf(data)->entryCount * sizeof(IndexEntry));
+}
+
+const char *NamesOf(const char *data) {
+    return reinterpret_cast<const char *>(SlotsOf(data) + HeaderOf(data)->slotCount);
+}
+
+// MPQ names match in any case and with either slash
+char NormalizeNameChar(char c) {
+    return c == '/' ? '\\' : static_cast<char>(std::toupper(static_cast<unsigned char>(c)));
+}
+}  // namespace
+
+std::string MpqIndex::SidecarPath(const std::string &archiveName) {
+    return archiveName + ".mpqidx";
+}
+
+bool MpqIndex::Open(const std::string &archiveName) {
+    const std::string sidecarPath = SidecarPath(archiveName);
+    if (Load(sidecarPath, archiveName)) {
+        return true;
+    }
+    return Build(sidecarPath, archiveName);
+}
+
+const MpqArchiveInfo &MpqIndex::ArchiveInfo() const { return HeaderOf(data)->info; }
+
+size_t MpqIndex::EntryCount() const { return static_cast<size_t>(HeaderOf(data)->entryCount); }
+
+std::string_view MpqIndex::EntryName(size_t index) const {
+    const IndexEntry &entry = EntriesOf(data)[index];
+    if (entry.nameOffset + entry.nameLength > HeaderOf(data)->namesSize) {
+        return {};  // Corrupt entry
+    }
+    return {NamesOf(data) + entry.nameOffset, static_cast<size_t>(entry.nameLength)};
+}
+
+const MpqEntryInfo &MpqIndex::Entry(size_t index) const { return EntriesOf(data)[index].info; }
+
+uint32_t MpqIndex::LocaleRank(size_t index) const { return EntriesOf(data)[index].localeRank; }
+
+std::optional<size_t> MpqIndex::FindEntry(const std::string &name, LCID locale) const {
+    auto sameName = [&name](std::string_view entryName) {
+        return entryName.size() == name.size() &&
+               std::equal(entryName.begin(), entryName.end(), name.begin(), [](char a, char b) {
+                   return NormalizeNameChar(a) == NormalizeNameChar(b);
+               });
+    };
+
+    // Every locale of the name is in the probe sequence, which ends at an empty slot
+    const uint64_t slotCount = HeaderOf(data)->slotCount;
+    if (slotCount == 0) {
+        return std::nullopt;
+    }
+    const IndexSlot *slots = SlotsOf(data);
+    const uint32_t nameA = MpqHashString(name, MpqHash::NameA);
+    const uint32_t nameB = MpqHashString(name, MpqHash::NameB);
+    std::optional<size_t> neutral;
+    for (uint64_t probe = 0, i = MpqHashString(name, MpqHash::TableIndex) & (slotCount - 1);
+         probe < slotCount; probe++, i = (i + 1) & (slotCount - 1)) {
+        const IndexSlot &slot = slots[i];
+        if (slot.entry == kEmptySlot) {
+            break;
+        }
+        if (slot.nameA != nameA || slot.nameB != nameB || slot.entry >= EntryCount() ||
+            !sameName(EntryName(slot.entry))) {
+            continue;
+        }
+        const auto entryLocale = static_cast<LCID>(Entry(slot.entry).locale);
+        if (entryLocale == locale) {
+            return slot.entry;
+        }
+        if (entryLocale == defaultLocale && !neutral.has_value()) {
+            neutral = slot.entry;
+        }
+    }
+    return neutral;
+}
+
+bool MpqIndex::Load(const std::string &sidecarPath, const std::string &archiveName) {
+    ArchiveKey key;
+    if (!ReadArchiveKey(archiveName, &key) || !mapping.Open(sidecarPath)) {
+        return false;
+    }
+
+    const IndexHeader *header = HeaderOf(mapping.Data());
+    const bool fresh =
+        mapping.Size() >= sizeof(IndexHeader) &&
+        std::memcmp(header->magic, kIndexMagic, sizeof(kIndexMagic)) == 0 &&
+        header->version == kIndexVersion && header->byteOrder == kByteOrderMark &&
+        SameKey(header->key, key) &&
+        (header->slotCount & (header->slotCount - 1)) == 0 &&
+        mapping.Size() == sizeof(IndexHeader) + header->entryCount * sizeof(IndexEntry) +
+                              header->slotCount * sizeof(IndexSlot) + header->namesSize;
+    if (!fresh) {
+        mapping.Close();
+        return false;
+    }
+    data = mapping.Data();
+    return true;
+}
+
+bool MpqIndex::Build(const std::string &sidecarPath, const std::string &archiveName) {
+    ArchiveKey key;
+    if (!ReadArchiveKey(archiveName, &key)) {
+        std::cerr << "[!] Failed to read: " << archiveName << std::endl;
+        return false;
+    }
+    HANDLE hArchive;
+    if (!OpenMpqArchive(archiveName, &hArchive, MPQ_OPEN_READ_ONLY)) {
+        return false;
+    }
+
+    IndexHeader header{};
+    std::memcpy(header.magic, kIndexMagic, sizeof(kIndexMagic));
+    header.version = kIndexVersion;
+    header.byteOrder = kByteOrderMark;
+    header.key = key;
+    header.info = GetMpqArchiveInfo(hArchive);
+
+    std::vector<IndexEntry> entries;
+    std::string names;
+    SFILE_FIND_DATA findData;
+    HANDLE findHandle = SFileFindFirstFile(hArchive, "*", &findData, nullptr);
+    if (findHandle != nullptr) {
+        do {
+            IndexEntry entry{};
+            entry.nameOffset = names.size();
+            entry.nameLength = static_cast<uint32_t>(std::strlen(findData.cFileName));
+            names += findData.cFileName;
+
+            const std::vector<LCID> locales = GetFileLocales(hArchive, findData.cFileName);
+            entry.localeRank = static_cast<uint32_t>(
+                std::find(locales.begin(), locales.end(), findData.lcLocale) - locales.begin());
+
+            HANDLE hFile;
+            if (OpenFileForLocale(hArchive, findData.cFileName, findData.lcLocale, &hFile)) {
+                entry.info = GetEntryInfo(hFile);
+                SFileCloseFile(hFile);
+            } else {
+                // Keep what the search already knows about the entry
+                entry.info.hashIndex = static_cast<int32_t>(findData.dwHashIndex);
+                entry.info.fileIndex = static_cast<int32_t>(findData.dwBlockIndex);
+                entry.info.locale = static_cast<int32_t>(findData.lcLocale);
+                entry.info.fileSize = static_cast<int32_t>(findData.dwFileSize);
+                entry.info.compressedSize = static_cast<int32_t>(findData.dwCompSize);
+                entry.info.flags = static_cast<int32_t>(findData.dwFileFlags);
+                entry.info.fileTime = static_cast<int64_t>(
+                    (static_cast<uint64_t>(findData.dwFileTimeHi) << 32) | findData.dwFileTimeLo);
+            }
+            entries.push_back(entry);
+        } while (SFileFindNextFile(findHandle, &findData));
+        SFileFindClose(findHandle);
+    }
+    CloseMpqArchive(hArchive);
+
+    // Hash every entry into the lookup table, in entry order
+    std::vector<IndexSlot> slots(NextPowerOfTwo(static_cast<uint32_t>(entries.size() * 2 + 1)),
+                                 IndexSlot{0, 0, kEmptySlot});
+    for (size_t i = 0; i < entries.size(); i++) {
+        const std::string name = names.substr(entries[i].nameOffset, entries[i].nameLength);
+        size_t slot = MpqHashString(name, MpqHash::TableIndex) & (slots.size() - 1);
+        while (slots[slot].entry != kEmptySlot) {
+            slot = (slot + 1) & (slots.size() - 1);
+        }
+        slots[slot] = {MpqHashString(name, MpqHash::NameA), MpqHashString(name, MpqHash::NameB),
+                       static_cast<uint32_t>(i)};
+    }
+
+    header.entryCount = entries.size();
+    header.slotCount = slots.size();
+    header.namesSize = names.size();
+    buffer.clear();
+    buffer.reserve(sizeof(header) + entries.size() * sizeof(IndexEntry) +
+                   slots.size() * sizeof(IndexSlot) + names.size());
+    buffer.append(reinterpret_cast<const char *>(&header), sizeof(header));
+    buffer.append(reinterpret_cast<const char *>(entries.data()),
+                  entries.size() * sizeof(IndexEntry));
+    buffer.append(reinterpret_cast<const char *>(slots.data()), slots.size() * sizeof(IndexSlot));
+    buffer.append(names);
+    data = buffer.data();
+    rebuilt = true;
+
+    // Readers never see a partly written index
+    const fs::path temporaryPath = fs::u8path(sidecarPath + ".tmp");
+    std::error_code error;
+    {
+        std::ofstream sidecar(temporaryPath, std::ios::binary | std::ios::trunc);
+        sidecar.write(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+        if (!sidecar) {
+            error = std::make_error_code(std::errc::io_error);
+        }
+    }
+    if (!error) {
+        fs::rename(temporaryPath, fs::u8path(sidecarPath), error);
+    }
+    if (error) {
+        fs::remove(temporaryPath, error);
+        std::cerr << "[!] Warning: Cannot save index: " << sidecarPath << std::endl;
+    }
+    return true;
+}
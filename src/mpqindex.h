@@ -0,0 +1,47 @@
+#ifndef MPQINDEX_H
+#define MPQINDEX_H
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+
+#include "mappedfile.h"
+#include "mpq.h"
+
+// Sidecar index of an archive (<archive>.mpqidx) holding the archive properties and
+// the details of every file entry, in the order StormLib finds them using the
+// internal listfile, and a hash table of the entries for lookups by name. It is keyed
+// on the archive size, modification time and a hash of the archive head and tail, and
+// is rebuilt when any of them changes. A fresh index is memory-mapped, so loading it
+// only touches the pages that are used.
+class MpqIndex {
+public:
+    // Load the sidecar index of an archive, building and saving it when missing or stale
+    bool Open(const std::string &archiveName);
+
+    [[nodiscard]] bool Rebuilt() const { return rebuilt; }
+    [[nodiscard]] const MpqArchiveInfo &ArchiveInfo() const;
+    [[nodiscard]] size_t EntryCount() const;
+    [[nodiscard]] std::string_view EntryName(size_t index) const;
+    [[nodiscard]] const MpqEntryInfo &Entry(size_t index) const;
+    // Order of the entry among the entries of its name in a detailed listing
+    [[nodiscard]] uint32_t LocaleRank(size_t index) const;
+    // The entry a lookup of the name for the locale finds: the locale itself, else the
+    // neutral one. Names are compared in any case and with either slash, like StormLib does.
+    [[nodiscard]] std::optional<size_t> FindEntry(const std::string &name, LCID locale) const;
+
+    static std::string SidecarPath(const std::string &archiveName);
+
+private:
+    MappedFile mapping;
+    std::string buffer;  // Freshly built index, used instead of the mapping
+    const char *data = nullptr;
+    bool rebuilt = false;
+
+    bool Load(const std::string &sidecarPath, const std::string &archiveName);
+    bool Build(const std::string &sidecarPath, const std::string &archiveName);
+};
+
+#endif  // MPQINDEX_H
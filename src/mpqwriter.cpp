@@ -0,0 +1,558 @@
+#include "mpqwriter.h"
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <atomic>
+#include <filesystem>
+#include <iostream>
+#include <thread>
+
+#include <StormLib.h>
+
+#include "filelookup.h"
+#include "helpers.h"
+#include "instrumentation.h"
+#include "locales.h"
+#include "mpq.h"
+
+namespace fs = std::filesystem;
+
+namespace {
+// Space reserved for the header, large enough for a version 2 header
+constexpr size_t kHeaderReserve = 0x2C;
+constexpr DWORD kMpqHeaderSizeV1 = 0x20;
+constexpr DWORD kMpqHeaderSizeV2 = 0x2C;
+// Files with fewer sectors are compressed on the calling thread
+constexpr DWORD kParallelSectorCount = 256;
+
+// The crypt table used by both name hashing and block encryption
+const std::array<DWORD, 0x500> kCryptTable = []() {
+    std::array<DWORD, 0x500> table{};
+    DWORD seed = 0x00100001;
+    for (DWORD index1 = 0; index1 < 0x100; index1++) {
+        for (DWORD index2 = index1, i = 0; i < 5; i++, index2 += 0x100) {
+            seed = (seed * 125 + 3) % 0x2AAAAB;
+            const DWORD temp1 = (seed & 0xFFFF) << 0x10;
+            seed = (seed * 125 + 3) % 0x2AAAAB;
+            const DWORD temp2 = seed & 0xFFFF;
+            table[index2] = temp1 | temp2;
+        }
+    }
+    return table;
+}();
+
+// Adler-32 with a starting value of 0, which is what MPQ sector checksums use
+DWORD SectorChecksum(const char *data, size_t size) {
+    DWORD a = 0;
+    DWORD b = 0;
+    for (size_t i = 0; i < size; i++) {
+        a = (a + static_cast<unsigned char>(data[i])) % 65521;
+        b = (b + a) % 65521;
+    }
+    return (b << 16) | a;
+}
+
+// Compress one sector, keeping it uncompressed when compression does not make it smaller
+std::vector<char> CompressSector(const char *data, DWORD size, DWORD compression) {
+    std::vector<char> compressed(size + 1);
+    int compressedSize = static_cast<int>(compressed.size());
+    if (compression != 0 && size > 0 &&
+        SCompCompress(compressed.data(), &compressedSize, const_cast<char *>(data),
+                      static_cast<int>(size), compression, 0, 0) &&
+        static_cast<DWORD>(compressedSize) < size) {
+        compressed.resize(static_cast<size_t>(compressedSize));
+        return compressed;
+    }
+    return {data, data + size};
+}
+
+struct CompressedSector {
+    std::vector<char> data;  // Compressed, then encrypted if the file is
+    DWORD checksum = 0;      // Of the compressed data, when sector checksums are kept
+};
+
+// Compress, checksum and encrypt the sectors of a file, spread over all cores for large
+// files. Every sector is processed on its own, so the output is identical to
+// processing them in turn.
+std::vector<CompressedSector> CompressSectors(const char *data, DWORD dataSize, DWORD sectorSize,
+                                              DWORD compression, DWORD compressionNext,
+                                              bool sectorCrc, bool encrypted, DWORD key,
+                                              unsigned int threads) {
+    const DWORD sectorCount = (dataSize + sectorSize - 1) / sectorSize;
+    std::vector<CompressedSector> sectors(sectorCount);
+    std::atomic<DWORD> nextSector{0};
+    auto work = [&]() {
+        PhaseSpan span("compress");
+        for (DWORD i = nextSector++; i < sectorCount; i = nextSector++) {
+            const DWORD begin = i * sectorSize;
+            const DWORD length = std::min(sectorSize, dataSize - begin);
+            CompressedSector &sector = sectors[i];
+            sector.data =
+                CompressSector(data + begin, length, i == 0 ? compression : compressionNext);
+            if (sectorCrc) {
+                sector.checksum = SectorChecksum(sector.data.data(), sector.data.size());
+            }
+            if (encrypted) {
+                MpqEncryptBlock(sector.data.data(), sector.data.size(), key + i);
+            }
+        }
+    };
+
+    if (threads == 0) {
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    const unsigned int threadCount =
+        sectorCount < kParallelSectorCount ? 1 : std::min<DWORD>(threads, sectorCount);
+    std::vector<std::thread> workers;
+    for (unsigned int i = 1; i < threadCount; i++) {
+        workers.emplace_back(work);
+    }
+    work();
+    for (auto &thread : workers) {
+        thread.join();
+    }
+    return sectors;
+}
+
+void AppendDwords(std::vector<char> &out, const std::vector<DWORD> &values) {
+    const auto *bytes = reinterpret_cast<const char *>(values.data());
+    out.insert(out.end(), bytes, bytes + values.size() * sizeof(DWORD));
+}
+}  // namespace
+
+DWORD MpqHashString(const std::string &str, MpqHash hashType) {
+    DWORD seed1 = 0x7FED7FED;
+    DWORD seed2 = 0xEEEEEEEE;
+    for (const unsigned char c : ArchivePathKey(str)) {
+        seed1 = kCryptTable[static_cast<DWORD>(hashType) + c] ^ (seed1 + seed2);
+        seed2 = c + seed1 + seed2 + (seed2 << 5) + 3;
+    }
+    return seed1;
+}
+
+void MpqEncryptBlock(void *data, size_t length, DWORD key) {
+    auto *bytes = static_cast<char *>(data);
+    DWORD seed = 0xEEEEEEEE;
+    // Trailing bytes that do not fill a whole DWORD are left unencrypted
+    for (size_t i = 0; i + sizeof(DWORD) <= length; i += sizeof(DWORD)) {
+        DWORD value;
+        std::memcpy(&value, bytes + i, sizeof(DWORD));
+        seed += kCryptTable[0x400 + (key & 0xFF)];
+        const DWORD encrypted = value ^ (key + seed);
+        key = ((~key << 0x15) + 0x11111111) | (key >> 0x0B);
+        seed = value + seed + (seed << 5) + 3;
+        std::memcpy(bytes + i, &encrypted, sizeof(DWORD));
+    }
+}
+
+void MpqDecryptBlock(void *data, size_t length, DWORD key) {
+    auto *bytes = static_cast<char *>(data);
+    DWORD seed = 0xEEEEEEEE;
+    for (size_t i = 0; i + sizeof(DWORD) <= length; i += sizeof(DWORD)) {
+        DWORD value;
+        std::memcpy(&value, bytes + i, sizeof(DWORD));
+        seed += kCryptTable[0x400 + (key & 0xFF)];
+        value ^= key + seed;
+        key = ((~key << 0x15) + 0x11111111) | (key >> 0x0B);
+        seed = value + seed + (seed << 5) + 3;
+        std::memcpy(bytes + i, &value, sizeof(DWORD));
+    }
+}
+
+DWORD MpqFileKey(const std::string &archiveFilePath, uint64_t byteOffset, DWORD fileSize,
+                 DWORD flags) {
+    // The key is derived from the plain file name, without directories
+    const size_t separator = archiveFilePath.find_last_of("\\/");
+    const std::string plainName = separator == std::string::npos
+                                      ? archiveFilePath
+                                      : archiveFilePath.substr(separator + 1);
+
+    DWORD key = MpqHashString(plainName, MpqHash::FileKey);
+    if (flags & MPQ_FILE_FIX_KEY) {
+        key = (key + static_cast<DWORD>(byteOffset)) ^ fileSize;
+    }
+    return key;
+}
+
+MpqWriter::MpqWriter(DWORD sectorSize, unsigned int threads)
+    : sectorSize(sectorSize), threads(threads) {
+    // Sector sizes are stored as a power of two, starting at 512 bytes
+    if (sectorSize < 0x200 || (sectorSize & (sectorSize - 1)) != 0) {
+        this->sectorSize = 0x1000;
+    }
+}
+
+MpqWriter::~MpqWriter() {
+    if (!workingName.empty()) {
+        output.close();
+        std::error_code error;
+        fs::remove(fs::u8path(workingName), error);
+    }
+}
+
+bool MpqWriter::Open(const std::string &outputArchiveName) {
+    if (fs::exists(outputArchiveName)) {
+        std::cerr << "[!] File already exists: " << outputArchiveName << " Exiting..." << std::endl;
+        return false;
+    }
+
+    // A failed run leaves nothing under the output name, so it can simply be run again
+    const std::string temporaryName = outputArchiveName + ".tmp";
+    output.open(fs::u8path(temporaryName), std::ios::binary | std::ios::trunc);
+    if (!output) {
+        std::cerr << "[!] Failed to create MPQ archive: " << outputArchiveName << std::endl;
+        return false;
+    }
+    outputName = outputArchiveName;
+    workingName = temporaryName;
+
+    // The header is written last, once the table positions are known
+    const std::array<char, kHeaderReserve> header{};
+    output.write(header.data(), header.size());
+    position = kHeaderReserve;
+    return static_cast<bool>(output);
+}
+
+bool MpqWriter::HasEntry(const std::string &archiveFilePath, LCID locale) const {
+    return entryKeys.find({ArchivePathKey(archiveFilePath), locale}) != entryKeys.end();
+}
+
+bool MpqWriter::WriteBlock(const std::string &archiveFilePath, LCID locale,
+                           const std::vector<char> &data, DWORD fileSize, DWORD flags) {
+    output.write(data.data(), static_cast<std::streamsize>(data.size()));
+    if (!output) {
+        std::cerr << "[!] Failed to write to MPQ archive: " << outputName << std::endl;
+        return false;
+    }
+
+    entries.push_back({archiveFilePath, locale, static_cast<DWORD>(blocks.size())});
+    entryKeys.emplace(ArchivePathKey(archiveFilePath), locale);
+    blocks.push_back(
+        {position, static_cast<DWORD>(data.size()), fileSize, flags | MPQ_FILE_EXISTS});
+    position += data.size();
+    return true;
+}
+
+bool MpqWriter::RekeyBlock(std::vector<char> &data, DWORD fileSize, DWORD flags, DWORD oldKey,
+                           DWORD newKey) const {
+    if (flags & MPQ_FILE_SINGLE_UNIT) {
+        MpqDecryptBlock(data.data(), data.size(), oldKey);
+        MpqEncryptBlock(data.data(), data.size(), newKey);
+        return true;
+    }
+
+    const DWORD sectorCount = (fileSize + sectorSize - 1) / sectorSize;
+    if (!(flags & MPQ_FILE_COMPRESS_MASK)) {
+        // Uncompressed files have no sector offset table, sectors are stored back to back
+        for (DWORD i = 0; i < sectorCount; i++) {
+            const size_t begin = static_cast<size_t>(i) * sectorSize;
+            const size_t length = std::min<size_t>(sectorSize, data.size() - begin);
+            MpqDecryptBlock(data.data() + begin, length, oldKey + i);
+            MpqEncryptBlock(data.data() + begin, length, newKey + i);
+        }
+        return true;
+    }
+
+    // The sector offset table is encrypted with the file key minus one
+    const DWORD offsetCount = sectorCount + 1 + ((flags & MPQ_FILE_SECTOR_CRC) ? 1 : 0);
+    const size_t offsetBytes = offsetCount * sizeof(DWORD);
+    if (data.size() < offsetBytes) {
+        return false;
+    }
+    std::vector<DWORD> offsets(offsetCount);
+    std::memcpy(offsets.data(), data.data(), offsetBytes);
+    MpqDecryptBlock(offsets.data(), offsetBytes, oldKey - 1);
+    if (offsets[0] != offsetBytes) {
+        return false;  // Unexpected table layout, let the caller recompress instead
+    }
+
+    for (DWORD i = 0; i < sectorCount; i++) {
+        if (offsets[i] > offsets[i + 1] || offsets[i + 1] > data.size()) {
+            return false;
+        }
+        MpqDecryptBlock(data.data() + offsets[i], offsets[i + 1] - offsets[i], oldKey + i);
+        MpqEncryptBlock(data.data() + offsets[i], offsets[i + 1] - offsets[i], newKey + i);
+    }
+
+    MpqEncryptBlock(offsets.data(), offsetBytes, newKey - 1);
+    std::memcpy(data.data(), offsets.data(), offsetBytes);
+    return true;
+}
+
+int MpqWriter::TransplantFile(HANDLE hSourceArchive, const std::string &fileName,
+                              LCID locale, const std::string &archiveFilePath, bool *copiedRaw) {
+    *copiedRaw = false;
+
+    HANDLE hFile;
+    if (!OpenFileForLocale(hSourceArchive, fileName.c_str(), locale, &hFile)) {
+        std::cerr << "[!] Failed: File cannot be opened: " << fileName << std::endl;
+        return -1;
+    }
+    const auto flags = GetFileInfo<DWORD>(hFile, SFileInfoFlags);
+    const auto fileSize = GetFileInfo<DWORD>(hFile, SFileInfoFileSize);
+    const auto compressedSize = GetFileInfo<DWORD>(hFile, SFileInfoCompressedSize);
+    const auto byteOffset = GetFileInfo<int64_t>(hFile, SFileInfoByteOffset);
+    const auto fileKey = GetFileInfo<DWORD>(hFile, SFileInfoEncryptionKey);
+    const auto fileLocale = GetFileInfo<LCID>(hFile, SFileInfoLocale);
+    SFileCloseFile(hFile);
+
+    if (HasEntry(archiveFilePath, fileLocale)) {
+        std::cerr << "[!] File" << PrettyPrintLocale(fileLocale, " for locale ")
+                  << " already exists in MPQ archive: " << archiveFilePath << " - Skipping..."
+                  << std::endl;
+        return -1;
+    }
+
+    // Sectors can only be copied as they are if both archives split files the same way
+    const std::string sourceName = GetArchiveFileName(hSourceArchive);
+    const auto headerOffset = GetFileInfo<int64_t>(hSourceArchive, SFileMpqHeaderOffset);
+    const auto sourceSectorSize = GetFileInfo<DWORD>(hSourceArchive, SFileMpqSectorSize);
+    const bool sameLayout = (flags & MPQ_FILE_SINGLE_UNIT) || sourceSectorSize == sectorSize ||
+                            !(flags & (MPQ_FILE_COMPRESS_MASK | MPQ_FILE_ENCRYPTED));
+    const bool transplantable = sameLayout && !sourceName.empty() &&
+                                !(flags & (MPQ_FILE_PATCH_FILE | MPQ_FILE_DELETE_MARKER)) &&
+                                !SFileIsPatchedArchive(hSourceArchive);
+
+    if (transplantable) {
+        std::ifstream &source = sources[sourceName];
+        if (!source.is_open()) {
+            source.open(sourceName, std::ios::binary);
+        }
+
+        std::vector<char> block(compressedSize);
+        source.clear();
+        source.seekg(headerOffset + byteOffset, std::ios::beg);
+        source.read(block.data(), static_cast<std::streamsize>(block.size()));
+
+        if (source && static_cast<DWORD>(source.gcount()) == compressedSize) {
+            // Encrypted files need a new key if it depends on their position or name
+            bool keyValid = true;
+            if (flags & MPQ_FILE_ENCRYPTED) {
+                const DWORD newKey = MpqFileKey(archiveFilePath, position, fileSize, flags);
+                if (newKey != fileKey) {
+                    keyValid = RekeyBlock(block, fileSize, flags, fileKey, newKey);
+                }
+            }
+            if (keyValid) {
+                if (!WriteBlock(archiveFilePath, fileLocale, block, fileSize, flags)) {
+                    return -1;
+                }
+                *copiedRaw = true;
+                return 0;
+            }
+        }
+    }
+
+    // Fall back to decompressing the file through StormLib and compressing it again
+    unsigned int contentSize;
+    auto content = ReadFile(hSourceArchive, fileName.c_str(), &contentSize, fileLocale);
+    if (!content) {
+        return -1;
+    }
+    DWORD newFlags = flags & ~(MPQ_FILE_PATCH_FILE | MPQ_FILE_DELETE_MARKER);
+    if (newFlags & MPQ_FILE_COMPRESS_MASK) {
+        newFlags = (newFlags & ~MPQ_FILE_COMPRESS_MASK) | MPQ_FILE_COMPRESS;
+    }
+    return AddFileData(archiveFilePath, fileLocale, content.get(), contentSize, newFlags,
+                       MPQ_COMPRESSION_ZLIB);
+}
+
+int MpqWriter::AddFileData(const std::string &archiveFilePath, LCID locale, const char *data,
+                           DWORD dataSize, DWORD flags, DWORD compression,
+                           DWORD compressionNext) {
+    if (HasEntry(archiveFilePath, locale)) {
+        std::cerr << "[!] File" << PrettyPrintLocale(locale, " for locale ")
+                  << " already exists in MPQ archive: " << archiveFilePath << " - Skipping..."
+                  << std::endl;
+        return -1;
+    }
+
+    // Imploded files are written with PKWARE compression, which StormLib reads the same way
+    if (flags & MPQ_FILE_IMPLODE) {
+        flags = (flags & ~MPQ_FILE_COMPRESS_MASK) | MPQ_FILE_COMPRESS;
+        compression = MPQ_COMPRESSION_PKWARE;
+    }
+    if (compressionNext == MPQ_COMPRESSION_NEXT_SAME) {
+        compressionNext = compression;
+    }
+    const bool compressed = flags & MPQ_FILE_COMPRESS;
+    const bool encrypted = flags & MPQ_FILE_ENCRYPTED;
+    const DWORD key = encrypted ? MpqFileKey(archiveFilePath, position, dataSize, flags) : 0;
+
+    std::vector<char> block;
+    if (dataSize == 0) {
+        // Empty files have no data at all
+    } else if (flags & MPQ_FILE_SINGLE_UNIT) {
+        block = compressed ? CompressSector(data, dataSize, compression)
+                           : std::vector<char>(data, data + dataSize);
+        if (encrypted) {
+            MpqEncryptBlock(block.data(), block.size(), key);
+        }
+    } else if (compressed) {
+        const DWORD sectorCount = (dataSize + sectorSize - 1) / sectorSize;
+        const bool sectorCrc = flags & MPQ_FILE_SECTOR_CRC;
+        std::vector<DWORD> offsets(sectorCount + 1 + (sectorCrc ? 1 : 0));
+        std::vector<DWORD> checksums;
+        std::vector<char> sectors;
+
+        // The offset table and sectors are assembled in order once every sector is done
+        const std::vector<CompressedSector> compressedSectors =
+            CompressSectors(data, dataSize, sectorSize, compression, compressionNext, sectorCrc,
+                            encrypted, key, threads);
+        offsets[0] = static_cast<DWORD>(offsets.size() * sizeof(DWORD));
+        for (DWORD i = 0; i < sectorCount; i++) {
+            const std::vector<char> &sector = compressedSectors[i].data;
+            if (sectorCrc) {
+                checksums.push_back(compressedSectors[i].checksum);
+            }
+            sectors.insert(sectors.end(), sector.begin(), sector.end());
+            offsets[i + 1] = offsets[i] + static_cast<DWORD>(sector.size());
+        }
+
+        // Sector checksums follow the last sector, compressed but never encrypted
+        if (sectorCrc) {
+            std::vector<char> checksumBytes;
+            AppendDwords(checksumBytes, checksums);
+            std::vector<char> checksumSector =
+                CompressSector(checksumBytes.data(), static_cast<DWORD>(checksumBytes.size()),
+                               MPQ_COMPRESSION_ZLIB);
+            sectors.insert(sectors.end(), checksumSector.begin(), checksumSector.end());
+            offsets[sectorCount + 1] =
+                offsets[sectorCount] + static_cast<DWORD>(checksumSector.size());
+        }
+
+        if (encrypted) {
+            MpqEncryptBlock(offsets.data(), offsets.size() * sizeof(DWORD), key - 1);
+        }
+        AppendDwords(block, offsets);
+        block.insert(block.end(), sectors.begin(), sectors.end());
+    } else {
+        block.assign(data, data + dataSize);
+        if (encrypted) {
+            for (DWORD i = 0, begin = 0; begin < dataSize; i++, begin += sectorSize) {
+                MpqEncryptBlock(block.data() + begin, std::min(sectorSize, dataSize - begin),
+                                key + i);
+            }
+        }
+    }
+
+    return WriteBlock(archiveFilePath, locale, block, dataSize, flags) ? 0 : -1;
+}
+
+bool MpqWriter::Finish() {
+    // Write a fresh (listfile) naming every file once
+    if (!HasEntry("(listfile)", defaultLocale)) {
+        std::vector<std::string> names;
+        for (const auto &entry : entries) {
+            names.push_back(entry.archiveFilePath);
+        }
+        std::sort(names.begin(), names.end());
+        names.erase(std::unique(names.begin(), names.end()), names.end());
+
+        std::string listfile;
+        for (const auto &name : names) {
+            listfile += name + "\r\n";
+        }
+        if (AddFileData("(listfile)", defaultLocale, listfile.data(),
+                        static_cast<DWORD>(listfile.size()), MPQ_FILE_COMPRESS,
+                        MPQ_COMPRESSION_ZLIB) != 0) {
+            return false;
+        }
+    }
+
+    // Keep the hash table at most three quarters full, so lookups stay short
+    const auto entryCount = static_cast<DWORD>(entries.size());
+    const DWORD hashTableSize =
+        std::max<DWORD>(16, NextPowerOfTwo(entryCount + entryCount / 3 + 1));
+    std::vector<DWORD> hashTable(static_cast<size_t>(hashTableSize) * 4, HASH_ENTRY_FREE);
+    for (const auto &entry : entries) {
+        DWORD index =
+            MpqHashString(entry.archiveFilePath, MpqHash::TableIndex) & (hashTableSize - 1);
+        while (hashTable[index * 4 + 3] != HASH_ENTRY_FREE) {
+            index = (index + 1) & (hashTableSize - 1);
+        }
+        hashTable[index * 4 + 0] = MpqHashString(entry.archiveFilePath, MpqHash::NameA);
+        hashTable[index * 4 + 1] = MpqHashString(entry.archiveFilePath, MpqHash::NameB);
+        hashTable[index * 4 + 2] = entry.locale & 0xFFFF;  // Platform is always zero
+        hashTable[index * 4 + 3] = entry.blockIndex;
+    }
+
+    std::vector<DWORD> blockTable;
+    std::vector<USHORT> hiBlockTable;
+    bool needsHiBlockTable = false;
+    for (const auto &block : blocks) {
+        blockTable.push_back(static_cast<DWORD>(block.filePos));
+        blockTable.push_back(block.compressedSize);
+        blockTable.push_back(block.fileSize);
+        blockTable.push_back(block.flags);
+        hiBlockTable.push_back(static_cast<USHORT>(block.filePos >> 32));
+        needsHiBlockTable |= (block.filePos >> 32) != 0;
+    }
+
+    const uint64_t hashTablePos = position;
+    MpqEncryptBlock(hashTable.data(), hashTable.size() * sizeof(DWORD),
+                    MpqHashString("(hash table)", MpqHash::FileKey));
+    std::vector<char> tables;
+    AppendDwords(tables, hashTable);
+
+    const uint64_t blockTablePos = hashTablePos + tables.size();
+    MpqEncryptBlock(blockTable.data(), blockTable.size() * sizeof(DWORD),
+                    MpqHashString("(block table)", MpqHash::FileKey));
+    AppendDwords(tables, blockTable);
+
+    // Archives beyond 4 GB need the version 2 header and the hi-block table
+    const uint64_t hiBlockTablePos = hashTablePos + tables.size();
+    needsHiBlockTable |= (hiBlockTablePos >> 32) != 0;
+    if (needsHiBlockTable) {
+        const auto *bytes = reinterpret_cast<const char *>(hiBlockTable.data());
+        tables.insert(tables.end(), bytes, bytes + hiBlockTable.size() * sizeof(USHORT));
+    }
+    output.write(tables.data(), static_cast<std::streamsize>(tables.size()));
+    position += tables.size();
+
+    DWORD sectorShift = 0;
+    while ((0x200u << sectorShift) < sectorSize) {
+        sectorShift++;
+    }
+
+    std::array<char, kHeaderReserve> header{};
+    auto putDword = [&header](size_t offset, DWORD value) {
+        std::memcpy(header.data() + offset, &value, sizeof(DWORD));
+    };
+    putDword(0x00, ID_MPQ);
+    putDword(0x04, needsHiBlockTable ? kMpqHeaderSizeV2 : kMpqHeaderSizeV1);
+    putDword(0x08, static_cast<DWORD>(position));
+    putDword(0x0C, (needsHiBlockTable ? MPQ_FORMAT_VERSION_2 : MPQ_FORMAT_VERSION_1) |
+                       (sectorShift << 16));
+    putDword(0x10, static_cast<DWORD>(hashTablePos));
+    putDword(0x14, static_cast<DWORD>(blockTablePos));
+    putDword(0x18, hashTableSize);
+    putDword(0x1C, static_cast<DWORD>(blocks.size()));
+    if (needsHiBlockTable) {
+        const uint64_t hiPos = hiBlockTablePos;
+        std::memcpy(header.data() + 0x20, &hiPos, sizeof(hiPos));
+        const auto hashTablePosHi = static_cast<USHORT>(hashTablePos >> 32);
+        const auto blockTablePosHi = static_cast<USHORT>(blockTablePos >> 32);
+        std::memcpy(header.data() + 0x28, &hashTablePosHi, sizeof(USHORT));
+        std::memcpy(header.data() + 0x2A, &blockTablePosHi, sizeof(USHORT));
+    }
+
+    output.seekp(0, std::ios::beg);
+    output.write(header.data(), header.size());
+    output.close();
+    if (!output) {
+        std::cerr << "[!] Failed to write to MPQ archive: " << outputName << std::endl;
+        return false;
+    }
+
+    std::error_code error;
+    fs::rename(fs::u8path(workingName), fs::u8path(outputName), error);
+    if (error) {
+        std::cerr << "[!] Failed to create MPQ archive: " << outputName << " ("
+                  << error.message() << ")" << std::endl;
+        return false;
+    }
+    workingName.clear();
+    return true;
+}
@@ -0,0 +1,97 @@
+#ifndef MPQWRITER_H
+#define MPQWRITER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <map>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <StormLib.h>
+
+// Hash types of the MPQ name hashing function, as offsets into the crypt table
+enum class MpqHash : DWORD {
+    TableIndex = 0x000,  // Start index in the hash table
+    NameA = 0x100,       // First name hash stored in the hash table
+    NameB = 0x200,       // Second name hash stored in the hash table
+    FileKey = 0x300      // Encryption key of a file or table
+};
+
+DWORD MpqHashString(const std::string &str, MpqHash hashType);
+void MpqEncryptBlock(void *data, size_t length, DWORD key);
+void MpqDecryptBlock(void *data, size_t length, DWORD key);
+// Encryption key of a file, which depends on its position when MPQ_FILE_FIX_KEY is set
+DWORD MpqFileKey(const std::string &archiveFilePath, uint64_t byteOffset, DWORD fileSize,
+                 DWORD flags);
+
+// Writes a new MPQ archive without StormLib, so file blocks that are already
+// compressed can be copied from other archives as raw bytes. Blocks are only
+// decrypted and encrypted again when their file key changes.
+class MpqWriter {
+public:
+    // Large files are compressed on several threads, 0 for one per CPU
+    explicit MpqWriter(DWORD sectorSize, unsigned int threads = 0);
+    // Removes the working file of an archive that was not finished
+    ~MpqWriter();
+
+    MpqWriter(const MpqWriter &) = delete;
+    MpqWriter &operator=(const MpqWriter &) = delete;
+
+    // Start the output archive, which must not exist yet. It is written under a working
+    // name (<output>.tmp) and only appears under its own name once Finish succeeds.
+    bool Open(const std::string &outputArchiveName);
+
+    // Copy a file from an opened archive, stored as archiveFilePath. The compressed
+    // block is copied as is when the sector layout is compatible, otherwise the file
+    // is decompressed and compressed again. Sets copiedRaw accordingly.
+    int TransplantFile(HANDLE hSourceArchive, const std::string &fileName, LCID locale,
+                       const std::string &archiveFilePath, bool *copiedRaw);
+
+    // Compress (and optionally encrypt) file data into a new block
+    int AddFileData(const std::string &archiveFilePath, LCID locale, const char *data,
+                    DWORD dataSize, DWORD flags, DWORD compression,
+                    DWORD compressionNext = MPQ_COMPRESSION_NEXT_SAME);
+
+    // Write (listfile), the hash table, the block table and the header, then move the
+    // archive to its output name
+    bool Finish();
+
+    // Whether a file was already written under this name and locale
+    [[nodiscard]] bool HasEntry(const std::string &archiveFilePath, LCID locale) const;
+
+    [[nodiscard]] size_t FileCount() const { return entries.size(); }
+
+private:
+    struct BlockEntry {
+        uint64_t filePos;
+        DWORD compressedSize;
+        DWORD fileSize;
+        DWORD flags;
+    };
+    struct NameEntry {
+        std::string archiveFilePath;
+        LCID locale;
+        DWORD blockIndex;
+    };
+
+    DWORD sectorSize;
+    unsigned int threads;
+    std::string outputName;
+    std::string workingName;  // Empty once the archive is finished
+    std::ofstream output;
+    uint64_t position = 0;
+    std::vector<BlockEntry> blocks;
+    std::vector<NameEntry> entries;
+    std::set<std::pair<std::string, LCID>> entryKeys;  // Guards against duplicate hash entries
+    std::map<std::string, std::ifstream> sources;      // Source archives read for raw copies
+
+    bool WriteBlock(const std::string &archiveFilePath, LCID locale, const std::vector<char> &data,
+                    DWORD fileSize, DWORD flags);
+    bool RekeyBlock(std::vector<char> &data, DWORD fileSize, DWORD flags, DWORD oldKey,
+                    DWORD newKey) const;
+};
+
+#endif  // MPQWRITER_H
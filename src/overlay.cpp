@@ -0,0 +1,120 @@
+#include "overlay.h"
+
+#include <algorithm>
+#include <iostream>
+
+#include <StormLib.h>
+
+#include "filelookup.h"
+#include "helpers.h"
+#include "locales.h"
+#include "mpq.h"
+
+MpqOverlay::~MpqOverlay() {
+    for (HANDLE hArchive : archives) {
+        CloseMpqArchive(hArchive);
+    }
+}
+
+bool MpqOverlay::Open(const std::string &baseArchive,
+                      const std::vector<std::string> &overlayArchives,
+                      const std::vector<std::string> &patchArchives,
+                      const std::optional<std::string> &listfileName) {
+    HANDLE hBase;
+    if (!OpenMpqArchive(baseArchive, &hBase, MPQ_OPEN_READ_ONLY)) {
+        return false;
+    }
+    archives.push_back(hBase);
+
+    // Patch archives are applied by StormLib itself, files opened from the base
+    // archive resolve to their newest (and incrementally patched) version
+    for (const auto &patchArchive : patchArchives) {
+        if (!SFileOpenPatchArchive(hBase, patchArchive.c_str(), nullptr, 0)) {
+            int32_t error = SErrGetLastError();
+            std::cerr << "[!] Error: " << error << " Failed to open patch archive: " << patchArchive
+                      << std::endl;
+            return false;
+        }
+    }
+
+    for (const auto &overlayArchive : overlayArchives) {
+        HANDLE hOverlay;
+        if (!OpenMpqArchive(overlayArchive, &hOverlay, MPQ_OPEN_READ_ONLY)) {
+            return false;
+        }
+        archives.push_back(hOverlay);
+    }
+
+    // Index from lowest to highest priority, so later archives overwrite the provider
+    for (size_t provider = 0; provider < archives.size(); provider++) {
+        IndexArchive(provider, listfileName);
+    }
+    return true;
+}
+
+void MpqOverlay::IndexArchive(size_t provider, const std::optional<std::string> &listfileName) {
+    const char *listfile = listfileName.has_value() ? listfileName->c_str() : nullptr;
+
+    SFILE_FIND_DATA findData;
+    HANDLE findHandle = SFileFindFirstFile(archives[provider], "*", &findData, listfile);
+    if (findHandle == nullptr) {
+        return;  // Nothing to index, e.g. an empty archive
+    }
+
+    do {
+        std::string key = ArchivePathKey(findData.cFileName);
+        auto it = nameIndex.find(key);
+        if (it == nameIndex.end()) {
+            fileNames.emplace_back(findData.cFileName);
+            nameIndex.emplace(std::move(key), provider);
+        } else {
+            it->second = provider;
+        }
+    } while (SFileFindNextFile(findHandle, &findData));
+
+    SFileFindClose(findHandle);
+}
+
+// Whether the archive stores the name for the locale, by the same rule OpenFileForLocale
+// picks its entry with. Names the hash table does not have (files only a patch adds, pseudo
+// names) are left to StormLib.
+static bool ProvidesFile(HANDLE hArchive, const std::string &fileName,
+                         std::optional<LCID> locale) {
+    const auto locales = LookupFileLocales(hArchive, fileName.c_str());
+    if (locales.has_value() && !locales->empty()) {
+        auto stores = [&](LCID candidate) {
+            return std::find(locales->begin(), locales->end(), candidate) != locales->end();
+        };
+        return !locale.has_value() || stores(locale.value()) || stores(defaultLocale);
+    }
+
+    LocaleLock lock(locale.value_or(defaultLocale));
+    return SFileHasFile(hArchive, fileName.c_str());
+}
+
+HANDLE MpqOverlay::Resolve(const std::string &fileName, std::optional<LCID> locale) {
+    std::string key = ArchivePathKey(fileName);
+
+    // The listfiles index every name for any locale, the archive listing it last wins
+    if (!locale.has_value()) {
+        auto it = nameIndex.find(key);
+        if (it != nameIndex.end()) {
+            return archives[it->second];
+        }
+    }
+
+    auto probeKey = std::make_pair(std::move(key), locale);
+    auto it = probed.find(probeKey);
+    if (it == probed.end()) {
+        // Probe the archives once from highest to lowest priority
+        std::optional<size_t> provider;
+        for (size_t candidate = archives.size(); candidate-- > 0;) {
+            if (ProvidesFile(archives[candidate], fileName, locale)) {
+                provider = candidate;
+                break;
+            }
+        }
+        it = probed.emplace(std::move(probeKey), provider).first;
+    }
+    return it->second.has_value() ? archives[it->second.value()] : nullptr;
+}
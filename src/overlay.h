@@ -0,0 +1,53 @@
+#ifndef OVERLAY_H
+#define OVERLAY_H
+
+#include <cstddef>
+#include <map>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <StormLib.h>
+
+// An ordered stack of MPQ archives, loaded the same way games do (for example
+// d2data.mpq -> d2exp.mpq -> patch_d2.mpq). Archives later in the stack take
+// priority over earlier ones. Each file name (and locale) is resolved to its highest-priority
+// provider once, and names that no archive provides are remembered as misses.
+class MpqOverlay {
+public:
+    MpqOverlay() = default;
+    ~MpqOverlay();
+
+    MpqOverlay(const MpqOverlay &) = delete;
+    MpqOverlay &operator=(const MpqOverlay &) = delete;
+
+    // Open the base archive, attach StormLib patch archives to it, then open the
+    // overlay archives on top. Returns false if any archive fails to open.
+    bool Open(const std::string &baseArchive, const std::vector<std::string> &overlayArchives,
+              const std::vector<std::string> &patchArchives,
+              const std::optional<std::string> &listfileName);
+
+    // Resolve a file name to the highest-priority archive that provides it, or nullptr. For a
+    // locale the archive must store the entry OpenFileForLocale opens (the locale itself or the
+    // neutral one), without a locale any stored locale counts.
+    HANDLE Resolve(const std::string &fileName, std::optional<LCID> locale = std::nullopt);
+
+    // Merged file names of all archives, in first-seen order
+    [[nodiscard]] const std::vector<std::string> &FileNames() const { return fileNames; }
+
+    // Base (lowest priority) archive handle
+    [[nodiscard]] HANDLE Base() const { return archives.empty() ? nullptr : archives.front(); }
+
+private:
+    std::vector<HANDLE> archives;  // Lowest priority first
+    std::vector<std::string> fileNames;
+    std::unordered_map<std::string, size_t> nameIndex;  // Name key -> provider for any locale
+    // Probed name keys and locales -> provider, or none
+    std::map<std::pair<std::string, std::optional<LCID>>, std::optional<size_t>> probed;
+
+    void IndexArchive(size_t provider, const std::optional<std::string> &listfileName);
+};
+
+#endif  // OVERLAY_H
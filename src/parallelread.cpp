@@ -0,0 +1,172 @@
+#include "parallelread.h"
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <StormLib.h>
+
+#include "filelookup.h"
+#include "instrumentation.h"
+#include "mpq.h"
+
+namespace {
+constexpr uint64_t kParallelThreshold = 64 * 1024 * 1024;  // Smaller files use one thread
+constexpr uint64_t kChunkBytes = 4 * 1024 * 1024;          // Decompressed per work item
+
+// One thread's own view of the file, with its own archive handle
+struct SectorReader {
+    HANDLE hArchive = nullptr;
+    HANDLE hFile = nullptr;
+};
+}  // namespace
+
+bool ShouldReadInParallel(HANDLE hArchive, const MpqEntryInfo &entry) {
+    const auto flags = static_cast<uint32_t>(entry.flags);
+    return std::thread::hardware_concurrency() > 1 &&
+           static_cast<uint32_t>(entry.fileSize) >= kParallelThreshold &&
+           (flags & MPQ_FILE_COMPRESS_MASK) != 0 &&
+           (flags & (MPQ_FILE_SINGLE_UNIT | MPQ_FILE_PATCH_FILE)) == 0 &&
+           !SFileIsPatchedArchive(hArchive);
+}
+
+bool ShouldReadInParallel(HANDLE hArchive, const char *fileName, LCID locale) {
+    HANDLE hFile;
+    if (!OpenFileForLocale(hArchive, fileName, locale, &hFile)) {
+        return false;
+    }
+    const MpqEntryInfo entry = GetEntryInfo(hFile);
+    SFileCloseFile(hFile);
+    return ShouldReadInParallel(hArchive, entry);
+}
+
+bool ReadFileInParallel(HANDLE hArchive, const char *fileName, LCID locale,
+                        std::ostream &output) {
+    const std::string archiveName = GetArchiveFileName(hArchive);
+    DWORD sectorSize = 0;
+    SFileGetFileInfo(hArchive, SFileMpqSectorSize, &sectorSize, sizeof(sectorSize), nullptr);
+    // Every reader opens the entry the name resolves to here, whatever the other handles find
+    const LCID fileLocale = ResolveFileLocale(hArchive, fileName, locale);
+    HANDLE hFile;
+    if (archiveName.empty() || sectorSize == 0 ||
+        !OpenFileForLocale(hArchive, fileName, fileLocale, &hFile)) {
+        return false;
+    }
+    const uint64_t fileSize = SFileGetFileSize(hFile, nullptr);
+    SFileCloseFile(hFile);
+
+    // Work items are runs of whole sectors, so no sector is decompressed twice
+    const uint64_t chunkSize =
+        std::max<uint64_t>(sectorSize, kChunkBytes / sectorSize * sectorSize);
+    const uint64_t chunkCount = (fileSize + chunkSize - 1) / chunkSize;
+    const uint64_t threadCount =
+        std::min<uint64_t>(std::max(1u, std::thread::hardware_concurrency()), chunkCount);
+
+    std::vector<SectorReader> readers;
+    for (uint64_t i = 0; i < threadCount; i++) {
+        SectorReader reader;
+        if (!OpenMpqArchiveMapped(archiveName, &reader.hArchive,
+                                  MPQ_OPEN_NO_LISTFILE | MPQ_OPEN_NO_ATTRIBUTES)) {
+            break;
+        }
+        if (!OpenFileForLocale(reader.hArchive, fileName, fileLocale, &reader.hFile)) {
+            SFileCloseArchive(reader.hArchive);
+            break;
+        }
+        readers.push_back(reader);
+    }
+    if (readers.empty()) {
+        return false;
+    }
+
+    // Finished chunks wait here until every chunk before them is written. Workers stay
+    // at most two chunks each ahead of the writer, which bounds memory use.
+    std::mutex mutex;
+    std::condition_variable changed;
+    std::map<uint64_t, std::vector<char>> finished;
+    uint64_t nextChunk = 0;
+    uint64_t nextToWrite = 0;
+    bool failed = false;
+    const uint64_t window = readers.size() * 2;
+
+    auto work = [&](const SectorReader &reader) {
+        while (true) {
+            uint64_t chunk;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                changed.wait(lock, [&] {
+                    return failed || nextChunk >= chunkCount || nextChunk < nextToWrite + window;
+                });
+                if (failed || nextChunk >= chunkCount) {
+                    return;
+                }
+                chunk = nextChunk++;
+            }
+
+            const uint64_t offset = chunk * chunkSize;
+            std::vector<char> buffer(std::min(chunkSize, fileSize - offset));
+            LONG offsetHigh = static_cast<LONG>(offset >> 32);
+            SFileSetFilePointer(reader.hFile, static_cast<LONG>(offset & 0xFFFFFFFF), &offsetHigh,
+                                FILE_BEGIN);
+            DWORD bytesRead = 0;
+            PhaseSpan span("decompress");
+            const bool ok = SFileReadFile(reader.hFile, buffer.data(),
+                                          static_cast<DWORD>(buffer.size()), &bytesRead, nullptr) &&
+                            bytesRead == buffer.size();
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (ok) {
+                    finished.emplace(chunk, std::move(buffer));
+                } else {
+                    failed = true;
+                }
+            }
+            changed.notify_all();
+        }
+    };
+
+    std::vector<std::thread> threads;
+    threads.reserve(readers.size());
+    for (const auto &reader : readers) {
+        threads.emplace_back(work, std::cref(reader));
+    }
+
+    while (nextToWrite < chunkCount) {
+        std::vector<char> buffer;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            changed.wait(lock, [&] { return failed || finished.count(nextToWrite) > 0; });
+            if (failed) {
+                break;
+            }
+            auto node = finished.extract(nextToWrite);
+            buffer = std::move(node.mapped());
+            nextToWrite++;
+        }
+        changed.notify_all();
+
+        PhaseSpan span("write");
+        output.write(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+        if (!output) {
+            std::lock_guard<std::mutex> lock(mutex);
+            failed = true;
+            break;
+        }
+    }
+    changed.notify_all();
+
+    for (auto &thread : threads) {
+        thread.join();
+    }
+    for (const auto &reader : readers) {
+        SFileCloseFile(reader.hFile);
+        SFileCloseArchive(reader.hArchive);
+    }
+    output.flush();
+    return !failed && static_cast<bool>(output);
+}
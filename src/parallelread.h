@@ -0,0 +1,22 @@
+#ifndef PARALLELREAD_H
+#define PARALLELREAD_H
+
+#include <ostream>
+
+#include <StormLib.h>
+
+struct MpqEntryInfo;
+
+// Whether a file is worth decompressing on several threads: large, compressed in
+// sectors, and not patched. The overload taking a name opens the file for the locale.
+bool ShouldReadInParallel(HANDLE hArchive, const MpqEntryInfo &entry);
+bool ShouldReadInParallel(HANDLE hArchive, const char *fileName, LCID locale);
+
+// Decompress a file on several threads and write it to output in file order. Every
+// thread has its own archive handle and reads runs of whole sectors, which StormLib
+// decompresses independently. Returns false if a read or write fails, output may
+// then be partially written.
+bool ReadFileInParallel(HANDLE hArchive, const char *fileName, LCID locale,
+                        std::ostream &output);
+
+#endif  // PARALLELREAD_H
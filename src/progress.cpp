@@ -0,0 +1,203 @@
+#include "progress.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <streambuf>
+#include <string>
+
+#include "helpers.h"
+#include "logging.h"
+
+namespace {
+constexpr auto kFirstDrawDelay = std::chrono::milliseconds(500);
+constexpr auto kRedrawInterval = std::chrono::milliseconds(100);
+constexpr int kBarWidth = 24;
+
+std::atomic<bool> progressShown{false};
+std::atomic<uint64_t> expectedFiles{0};
+std::atomic<uint64_t> filesDone{0};
+std::atomic<uint64_t> bytesDone{0};
+std::atomic<uint64_t> currentFileDone{0};
+std::atomic<uint64_t> currentFileTotal{0};
+
+std::mutex terminalMutex;  // Held while drawing the bar, or writing over it
+size_t barLength = 0;      // Characters of the bar on screen, 0 once wiped
+
+// Call with terminalMutex held
+void WipeBar() {
+    if (barLength > 0) {
+        const std::string blank = "\r" + std::string(barLength, ' ') + "\r";
+        std::fwrite(blank.data(), 1, blank.size(), stderr);
+        barLength = 0;
+    }
+}
+
+// Wipes the bar before passing on anything written to a stream on the same terminal.
+// Line-buffered output reaches the screen on its newline, which wipes the bar again.
+class BarWipingBuffer : public std::streambuf {
+public:
+    explicit BarWipingBuffer(std::streambuf *target) : target(target) {}
+
+protected:
+    int overflow(int c) override {
+        if (traits_type::eq_int_type(c, traits_type::eof())) {
+            return traits_type::not_eof(c);
+        }
+        std::lock_guard<std::mutex> lock(terminalMutex);
+        WipeBar();
+        return target->sputc(traits_type::to_char_type(c));
+    }
+
+    std::streamsize xsputn(const char *s, std::streamsize n) override {
+        std::lock_guard<std::mutex> lock(terminalMutex);
+        WipeBar();
+        return target->sputn(s, n);
+    }
+
+    int sync() override { return target->pubsync(); }
+
+private:
+    std::streambuf *target;
+};
+
+std::string FormatDuration(double seconds) {
+    const auto total = static_cast<uint64_t>(seconds + 0.5);
+    std::ostringstream text;
+    if (total >= 3600) {
+        text << total / 3600 << ":" << std::setfill('0') << std::setw(2) << total / 60 % 60;
+    } else {
+        text << total / 60;
+    }
+    text << ":" << std::setfill('0') << std::setw(2) << total % 60;
+    return text.str();
+}
+
+void WINAPI AddFileCallback(void *, DWORD bytesWritten, DWORD totalBytes, bool finalCall) {
+    if (finalCall) {
+        ProgressFileBytes(0, 0);
+    } else {
+        ProgressFileBytes(bytesWritten, totalBytes);
+    }
+}
+}  // namespace
+
+ProgressBar::ProgressBar(const char *action) : action(action) {
+    expectedFiles = 0;
+    filesDone = 0;
+    bytesDone = 0;
+    currentFileDone = 0;
+    currentFileTotal = 0;
+    if (!LogEnabled(LogLevel::NORMAL) || !IsTerminal(stderr)) {
+        return;
+    }
+
+    active = true;
+    progressShown = true;
+    start = std::chrono::steady_clock::now();
+    cerrWrapper = std::make_unique<BarWipingBuffer>(std::cerr.rdbuf());
+    cerrBuffer = std::cerr.rdbuf(cerrWrapper.get());
+    if (IsTerminal(stdout)) {
+        coutWrapper = std::make_unique<BarWipingBuffer>(std::cout.rdbuf());
+        coutBuffer = std::cout.rdbuf(coutWrapper.get());
+    }
+    thread = std::thread(&ProgressBar::Run, this);
+}
+
+ProgressBar::~ProgressBar() {
+    if (!active) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(stopMutex);
+        stopping = true;
+    }
+    stopped.notify_all();
+    thread.join();
+
+    std::cerr.rdbuf(cerrBuffer);
+    if (coutWrapper) {
+        std::cout.rdbuf(coutBuffer);
+    }
+    std::lock_guard<std::mutex> lock(terminalMutex);
+    WipeBar();
+    progressShown = false;
+}
+
+void ProgressBar::Run() {
+    std::unique_lock<std::mutex> lock(stopMutex);
+    if (stopped.wait_for(lock, kFirstDrawDelay, [this] { return stopping; })) {
+        return;
+    }
+    do {
+        Draw();
+    } while (!stopped.wait_for(lock, kRedrawInterval, [this] { return stopping; }));
+}
+
+void ProgressBar::Draw() {
+    const double elapsed =
+        std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    const uint64_t expected = expectedFiles.load(std::memory_order_relaxed);
+    const uint64_t files = filesDone.load(std::memory_order_relaxed);
+    const uint64_t currentDone = currentFileDone.load(std::memory_order_relaxed);
+    const uint64_t currentTotal = currentFileTotal.load(std::memory_order_relaxed);
+    const double partial =
+        currentTotal > 0 ? static_cast<double>(currentDone) / static_cast<double>(currentTotal)
+                         : 0.0;
+    const double mebibytes =
+        static_cast<double>(bytesDone.load(std::memory_order_relaxed) + currentDone) /
+        (1024.0 * 1024.0);
+
+    std::ostringstream line;
+    line << "[*] " << action << " ";
+    double fraction = 0;
+    if (expected > 0) {
+        fraction = std::min(1.0, (static_cast<double>(files) + partial) /
+                                     static_cast<double>(expected));
+        const int filled = static_cast<int>(fraction * kBarWidth);
+        line << "[" << std::string(filled, '#') << std::string(kBarWidth - filled, '-') << "] "
+             << files << "/" << expected << " files";
+    } else {
+        line << files << " files";
+    }
+    line << std::fixed << std::setprecision(1) << ", " << mebibytes << " MiB, "
+         << (elapsed > 0 ? mebibytes / elapsed : 0.0) << " MiB/s";
+    if (fraction > 0) {
+        line << ", ETA " << FormatDuration(elapsed * (1 - fraction) / fraction);
+    } else if (currentTotal > 0) {
+        line << ", current file " << static_cast<int>(partial * 100) << "%";
+    }
+
+    const std::string text = line.str();
+    std::lock_guard<std::mutex> lock(terminalMutex);
+    std::string output = "\r" + text;
+    if (text.size() < barLength) {
+        output += std::string(barLength - text.size(), ' ');  // Cover the longer old bar
+    }
+    std::fwrite(output.data(), 1, output.size(), stderr);
+    std::fflush(stderr);
+    barLength = std::max(barLength, text.size());
+}
+
+bool ProgressShown() { return progressShown.load(std::memory_order_relaxed); }
+
+void ProgressExpectFiles(uint64_t files) { expectedFiles.store(files, std::memory_order_relaxed); }
+
+void ProgressFileDone(uint64_t bytes) {
+    filesDone.fetch_add(1, std::memory_order_relaxed);
+    bytesDone.fetch_add(bytes, std::memory_order_relaxed);
+    currentFileTotal.store(0, std::memory_order_relaxed);
+    currentFileDone.store(0, std::memory_order_relaxed);
+}
+
+void ProgressFileBytes(uint64_t done, uint64_t total) {
+    currentFileDone.store(done, std::memory_order_relaxed);
+    currentFileTotal.store(total, std::memory_order_relaxed);
+}
+
+void WatchAddProgress(HANDLE hArchive) {
+    SFileSetAddFileCallback(hArchive, AddFileCallback, nullptr);
+}
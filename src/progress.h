@@ -0,0 +1,64 @@
+#ifndef PROGRESS_H
+#define PROGRESS_H
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <iosfwd>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#include <StormLib.h>
+
+// Shows a progress bar with rate and ETA on stderr while files are added or extracted,
+// when stderr is a terminal and output is not quiet. Workers only bump the atomic
+// counters below; a background thread redraws the bar ten times a second, starting
+// after half a second so short commands never show one. Messages printed meanwhile
+// wipe the bar first, and it is redrawn on the next tick.
+class ProgressBar {
+public:
+    explicit ProgressBar(const char *action);  // "Adding", "Extracting", ...
+    ~ProgressBar();
+
+    ProgressBar(const ProgressBar &) = delete;
+    ProgressBar &operator=(const ProgressBar &) = delete;
+
+private:
+    void Run();
+    void Draw();
+
+    const char *action;
+    bool active = false;
+    std::chrono::steady_clock::time_point start;
+
+    std::mutex stopMutex;
+    std::condition_variable stopped;
+    bool stopping = false;
+    std::thread thread;
+
+    std::unique_ptr<std::streambuf> cerrWrapper;
+    std::unique_ptr<std::streambuf> coutWrapper;
+    std::streambuf *cerrBuffer = nullptr;
+    std::streambuf *coutBuffer = nullptr;
+};
+
+// True while a progress bar is on screen, for callers that would otherwise skip the
+// work of measuring a file
+bool ProgressShown();
+
+// The number of files the command works through, when known up front. Without it
+// the bar shows a count and rate but no ETA.
+void ProgressExpectFiles(uint64_t files);
+
+// A file is done, bytes is its size
+void ProgressFileDone(uint64_t bytes);
+
+// Bytes done of the file in progress, so huge files move the bar while they are added
+void ProgressFileBytes(uint64_t done, uint64_t total);
+
+// Report the bytes written of each file added to the archive through StormLib's add
+// file callback
+void WatchAddProgress(HANDLE hArchive);
+
+#endif  // PROGRESS_H
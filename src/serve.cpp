@@ -0,0 +1,646 @@
+#include "serve.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+#ifndef _WIN32
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+#include <StormLib.h>
+
+#include "batch.h"
+#include "filelookup.h"
+#include "helpers.h"
+#include "locales.h"
+#include "lrucache.h"
+#include "mpq.h"
+
+#ifndef _WIN32
+namespace {
+#ifdef MSG_NOSIGNAL
+constexpr int kSendFlags = MSG_NOSIGNAL;
+#else
+constexpr int kSendFlags = 0;  // SIGPIPE is ignored instead
+#endif
+constexpr size_t kMaxLineLength = 64 * 1024;
+
+std::atomic<bool> stopRequested{false};
+
+void RequestStop(int) { stopRequested = true; }
+
+// Read-only handles of one archive. StormLib handles are not thread-safe, so every
+// handle is used by one client thread at a time.
+class HandlePool {
+public:
+    HandlePool() = default;
+    ~HandlePool() {
+        for (HANDLE hArchive : handles) {
+            CloseMpqArchive(hArchive);
+        }
+    }
+
+    HandlePool(const HandlePool &) = delete;
+    HandlePool &operator=(const HandlePool &) = delete;
+
+    bool Open(const std::string &archiveName, unsigned int count) {
+        for (unsigned int i = 0; i < count; i++) {
+            HANDLE hArchive;
+            if (!OpenMpqArchive(archiveName, &hArchive, MPQ_OPEN_READ_ONLY)) {
+                return false;
+            }
+            handles.push_back(hArchive);
+            idle.push_back(hArchive);
+        }
+        return true;
+    }
+
+    HANDLE Acquire() {
+        std::unique_lock<std::mutex> lock(mutex);
+        available.wait(lock, [this]() { return !idle.empty(); });
+        HANDLE hArchive = idle.back();
+        idle.pop_back();
+        return hArchive;
+    }
+
+    void Release(HANDLE hArchive) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            idle.push_back(hArchive);
+        }
+        available.notify_one();
+    }
+
+private:
+    std::vector<HANDLE> handles;
+    std::vector<HANDLE> idle;
+    std::mutex mutex;
+    std::condition_variable available;
+};
+
+class PooledHandle {
+public:
+    explicit PooledHandle(HandlePool &pool) : pool(pool), hArchive(pool.Acquire()) {}
+    ~PooledHandle() { pool.Release(hArchive); }
+
+    PooledHandle(const PooledHandle &) = delete;
+    PooledHandle &operator=(const PooledHandle &) = delete;
+
+    [[nodiscard]] HANDLE Get() const { return hArchive; }
+
+private:
+    HandlePool &pool;
+    HANDLE hArchive;
+};
+
+// Reads byte ranges of files, keeping recently read files decompressed in memory
+class FileServer {
+public:
+    FileServer(HandlePool &pool, size_t cacheBytes) : pool(pool), cache(cacheBytes) {}
+
+    // Read up to length bytes from offset (the whole file without a length). The file size is
+    // set once the file is opened, also when the range is not satisfiable.
+    bool ReadRange(const std::string &fileName, LCID locale, uint64_t offset,
+                   std::optional<uint64_t> length, std::string *data,
+                   std::optional<uint64_t> *fileSize, std::string *error) {
+        requests++;
+        const std::string key = ArchivePathKey(fileName) + ":" + std::to_string(locale);
+        LruCache<std::string>::Value content = cache.Get(key);
+
+        if (content == nullptr) {
+            PooledHandle handle(pool);
+            HANDLE hFile;
+            if (!OpenFileForLocale(handle.Get(), fileName.c_str(), locale, &hFile)) {
+                *error = "File doesn't exist: " + fileName;
+                return false;
+            }
+
+            const DWORD size = SFileGetFileSize(hFile, nullptr);
+            if (size == SFILE_INVALID_SIZE) {
+                SFileCloseFile(hFile);
+                *error = "Invalid file size for: " + fileName;
+                return false;
+            }
+
+            // Files larger than the whole cache are read range by range
+            if (size > cache.ByteBudget()) {
+                const bool read = ReadUncached(hFile, size, offset, length, data, error);
+                SFileCloseFile(hFile);
+                *fileSize = size;
+                return read;
+            }
+
+            auto buffer = std::make_shared<std::string>(size, '\0');
+            DWORD bytesRead = 0;
+            const bool read = SFileReadFile(hFile, buffer->data(), size, &bytesRead, nullptr);
+            SFileCloseFile(hFile);
+            if (!read || bytesRead != size) {
+                *error = "Cannot read file contents for: " + fileName;
+                return false;
+            }
+            content = buffer;
+            cache.Put(key, content);
+        }
+
+        *fileSize = content->size();
+        if (offset > content->size()) {
+            *error = "Range not satisfiable for: " + fileName;
+            return false;
+        }
+        const uint64_t available = content->size() - offset;
+        data->assign(*content, offset, std::min(length.value_or(available), available));
+        return true;
+    }
+
+    [[nodiscard]] std::string Stats() const {
+        std::ostringstream stats;
+        stats << "requests " << requests << "\n"
+              << "hits " << cache.Hits() << "\n"
+              << "misses " << cache.Misses() << "\n"
+              << "entries " << cache.Size() << "\n"
+              << "bytes " << cache.Bytes() << "\n"
+              << "budget " << cache.ByteBudget() << "\n";
+        return stats.str();
+    }
+
+private:
+    HandlePool &pool;
+    LruCache<std::string> cache;
+    std::atomic<uint64_t> requests{0};
+
+    static bool ReadUncached(HANDLE hFile, DWORD size, uint64_t offset,
+                             std::optional<uint64_t> length, std::string *data,
+                             std::string *error) {
+        if (offset > size) {
+            *error = "Range not satisfiable";
+            return false;
+        }
+        const uint64_t available = size - offset;
+        data->resize(std::min(length.value_or(available), available));
+
+        LONG offsetHigh = 0;
+        SFileSetFilePointer(hFile, static_cast<LONG>(offset), &offsetHigh, FILE_BEGIN);
+        DWORD bytesRead = 0;
+        SFileReadFile(hFile, data->data(), static_cast<DWORD>(data->size()), &bytesRead,
+                      nullptr);
+        if (bytesRead != data->size()) {
+            *error = "Cannot read file contents";
+            return false;
+        }
+        return true;
+    }
+};
+
+bool WriteAll(int fd, const char *data, size_t size) {
+    while (size > 0) {
+        ssize_t written = send(fd, data, size, kSendFlags);
+        if (written < 0 && errno == EINTR) {
+            continue;
+        }
+        if (written <= 0) {
+            return false;
+        }
+        data += written;
+        size -= static_cast<size_t>(written);
+    }
+    return true;
+}
+
+bool WriteAll(int fd, const std::string &data) { return WriteAll(fd, data.data(), data.size()); }
+
+// Buffered reading of newline-terminated lines from a socket
+class LineReader {
+public:
+    explicit LineReader(int fd) : fd(fd) {}
+
+    bool ReadLine(std::string *line) {
+        for (;;) {
+            size_t newline = buffer.find('\n');
+            if (newline != std::string::npos) {
+                line->assign(buffer, 0, newline);
+                buffer.erase(0, newline + 1);
+                if (!line->empty() && line->back() == '\r') {
+                    line->pop_back();
+                }
+                return true;
+            }
+            if (buffer.size() > kMaxLineLength) {
+                return false;
+            }
+
+            char chunk[4096];
+            ssize_t received = recv(fd, chunk, sizeof(chunk), 0);
+            if (received < 0 && errno == EINTR) {
+                continue;
+            }
+            if (received <= 0) {
+                return false;
+            }
+            buffer.append(chunk, static_cast<size_t>(received));
+        }
+    }
+
+private:
+    int fd;
+    std::string buffer;
+};
+
+// Command protocol over the Unix socket, one connection serves many commands:
+//   read <file> [locale] [offset] [length]    stats    quit
+// Responses use the framing of the batch subcommand: "ok <length>\n<payload>"
+void ServeCommandConnection(int fd, FileServer &server) {
+    LineReader reader(fd);
+    std::string line;
+    while (!stopRequested && reader.ReadLine(&line)) {
+        std::vector<std::string> tokens;
+        if (!TokenizeBatchCommand(line, &tokens) || tokens.empty()) {
+            continue;
+        }
+
+        bool ok = false;
+        std::string payload;
+        if (tokens[0] == "quit") {
+            break;
+        } else if (tokens[0] == "stats") {
+            ok = true;
+            payload = server.Stats();
+        } else if (tokens[0] == "read" && tokens.size() >= 2) {
+            const LCID locale =
+                tokens.size() >= 3 && !tokens[2].empty() ? LangToLocale(tokens[2]) : defaultLocale;
+            const uint64_t offset =
+                tokens.size() >= 4 ? std::strtoull(tokens[3].c_str(), nullptr, 10) : 0;
+            std::optional<uint64_t> length;
+            if (tokens.size() >= 5) {
+                length = std::strtoull(tokens[4].c_str(), nullptr, 10);
+            }
+            std::optional<uint64_t> fileSize;
+            std::string error;
+            ok = server.ReadRange(tokens[1], locale, offset, length, &payload, &fileSize, &error);
+            if (!ok) {
+                payload = error;
+            }
+        } else {
+            payload = "Unknown command: " + tokens[0];
+        }
+
+        const std::string header =
+            (ok ? "ok " : "error ") + std::to_string(payload.size()) + "\n";
+        if (!WriteAll(fd, header) || !WriteAll(fd, payload)) {
+            break;
+        }
+    }
+}
+
+std::string UrlDecode(const std::string &value) {
+    std::string decoded;
+    for (size_t i = 0; i < value.size(); i++) {
+        if (value[i] == '%' && i + 2 < value.size() &&
+            std::isxdigit(static_cast<unsigned char>(value[i + 1])) &&
+            std::isxdigit(static_cast<unsigned char>(value[i + 2]))) {
+            decoded += static_cast<char>(std::stoi(value.substr(i + 1, 2), nullptr, 16));
+            i += 2;
+        } else if (value[i] == '+') {
+            decoded += ' ';
+        } else {
+            decoded += value[i];
+        }
+    }
+    return decoded;
+}
+
+void WriteHttpResponse(int fd, const std::string &status, const std::string &body,
+                       const std::string &extraHeaders = "", bool headOnly = false) {
+    std::ostringstream response;
+    response << "HTTP/1.1 " << status << "\r\n"
+             << "Content-Length: " << body.size() << "\r\n"
+             << "Content-Type: application/octet-stream\r\n"
+             << "Accept-Ranges: bytes\r\n"
+             << extraHeaders << "Connection: close\r\n\r\n";
+    if (WriteAll(fd, response.str()) && !headOnly) {
+        WriteAll(fd, body);
+    }
+}
+
+// Loopback HTTP, one request per connection: GET /<path in archive>?locale=<locale>
+// with an optional "Range: bytes=<first>-[<last>]" header, or GET /_stats
+void ServeHttpConnection(int fd, FileServer &server) {
+    LineReader reader(fd);
+    std::string requestLine;
+    if (!reader.ReadLine(&requestLine)) {
+        return;
+    }
+
+    std::optional<std::pair<uint64_t, std::optional<uint64_t>>> range;
+    std::string header;
+    while (reader.ReadLine(&header) && !header.empty()) {
+        const std::string kRangePrefix = "range: bytes=";
+        std::string lowered = header.substr(0, kRangePrefix.size());
+        std::transform(lowered.begin(), lowered.end(), lowered.begin(),
+                       [](unsigned char c) { return std::tolower(c); });
+        const size_t dash = header.find('-', kRangePrefix.size());
+        // Suffix ranges ("bytes=-500") and multiple ranges are answered with the whole file
+        if (lowered == kRangePrefix && dash != std::string::npos && dash > kRangePrefix.size() &&
+            header.find(',') == std::string::npos) {
+            const uint64_t first = std::strtoull(header.c_str() + kRangePrefix.size(), nullptr, 10);
+            std::optional<uint64_t> last;
+            if (dash + 1 < header.size()) {
+                last = std::strtoull(header.c_str() + dash + 1, nullptr, 10);
+            }
+            range = std::make_pair(first, last);
+        }
+    }
+
+    std::istringstream requestStream(requestLine);
+    std::string method;
+    std::string target;
+    requestStream >> method >> target;
+    if (method != "GET" && method != "HEAD") {
+        WriteHttpResponse(fd, "405 Method Not Allowed", "");
+        return;
+    }
+    const bool headOnly = method == "HEAD";
+
+    LCID locale = defaultLocale;
+    const size_t query = target.find('?');
+    if (query != std::string::npos) {
+        const std::string parameters = target.substr(query + 1);
+        const size_t localeParameter = parameters.find("locale=");
+        if (localeParameter != std::string::npos) {
+            locale = LangToLocale(parameters.substr(localeParameter + 7, 4));
+        }
+        target.erase(query);
+    }
+    std::string fileName = UrlDecode(target.substr(target.empty() ? 0 : 1));
+    std::replace(fileName.begin(), fileName.end(), '/', '\\');
+
+    if (fileName == "_stats") {
+        WriteHttpResponse(fd, "200 OK", server.Stats(), "", headOnly);
+        return;
+    }
+
+    const uint64_t offset = range.has_value() ? range->first : 0;
+    std::optional<uint64_t> length;
+    if (range.has_value() && range->second.has_value()) {
+        if (*range->second < range->first) {
+            WriteHttpResponse(fd, "416 Range Not Satisfiable", "");
+            return;
+        }
+        length = *range->second - range->first + 1;
+    }
+
+    std::string data;
+    std::string error;
+    std::optional<uint64_t> fileSize;
+    const bool read = server.ReadRange(fileName, locale, offset, length, &data, &fileSize, &error);
+    // A range has to start inside the file, so an empty file has no satisfiable range
+    if (range.has_value() && fileSize.has_value() && offset >= fileSize.value()) {
+        WriteHttpResponse(fd, "416 Range Not Satisfiable", "",
+                          "Content-Range: bytes */" + std::to_string(fileSize.value()) + "\r\n");
+        return;
+    }
+    if (!read) {
+        WriteHttpResponse(fd, "404 Not Found", error);
+        return;
+    }
+
+    if (range.has_value()) {
+        std::ostringstream contentRange;
+        contentRange << "Content-Range: bytes " << offset << "-" << offset + data.size() - 1 << "/"
+                     << fileSize.value() << "\r\n";
+        WriteHttpResponse(fd, "206 Partial Content", data, contentRange.str(), headOnly);
+    } else {
+        WriteHttpResponse(fd, "200 OK", data, "", headOnly);
+    }
+}
+
+int ListenUnixSocket(const std::string &socketPath) {
+    sockaddr_un address{};
+    if (socketPath.size() >= sizeof(address.sun_path)) {
+        std::cerr << "[!] Socket path is too long: " << socketPath << std::endl;
+        return -1;
+    }
+    address.sun_family = AF_UNIX;
+    std::strncpy(address.sun_path, socketPath.c_str(), sizeof(address.sun_path) - 1);
+
+    // Remove a stale socket left behind by a previous server, but never other files
+    struct stat socketStat {};
+    if (lstat(socketPath.c_str(), &socketStat) == 0 && S_ISSOCK(socketStat.st_mode)) {
+        unlink(socketPath.c_str());
+    }
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0 || bind(fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) != 0 ||
+        listen(fd, SOMAXCONN) != 0) {
+        std::cerr << "[!] Failed to listen on socket: " << socketPath << " ("
+                  << std::strerror(errno) << ")" << std::endl;
+        if (fd >= 0) {
+            close(fd);
+        }
+        return -1;
+    }
+    return fd;
+}
+
+int ListenHttp(uint16_t port) {
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(port);
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    int reuse = 1;
+    if (fd >= 0) {
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+    }
+    if (fd < 0 || bind(fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) != 0 ||
+        listen(fd, SOMAXCONN) != 0) {
+        std::cerr << "[!] Failed to listen on port: " << port << " (" << std::strerror(errno)
+                  << ")" << std::endl;
+        if (fd >= 0) {
+            close(fd);
+        }
+        return -1;
+    }
+    return fd;
+}
+
+// A fixed number of worker threads serve the client connections, one connection each.
+// While every worker is busy, new clients wait in the listen backlog. The handle pool
+// bounds how many of the workers access the archive at the same time.
+class ConnectionPool {
+public:
+    ConnectionPool(unsigned int workerCount, FileServer &server) {
+        for (unsigned int i = 0; i < workerCount; i++) {
+            workers.emplace_back([this, &server]() { Work(server); });
+        }
+    }
+
+    ConnectionPool(const ConnectionPool &) = delete;
+    ConnectionPool &operator=(const ConnectionPool &) = delete;
+
+    // Wait up to the timeout for a worker to take a connection
+    bool WaitForIdleWorker(std::chrono::milliseconds timeout) {
+        std::unique_lock<std::mutex> lock(mutex);
+        return changed.wait_for(lock, timeout, [this]() { return busy < workers.size(); });
+    }
+
+    // Hand an accepted connection to the next idle worker
+    void Submit(int fd, bool http) {
+        std::lock_guard<std::mutex> lock(mutex);
+        pending.push_back({fd, http});
+        busy++;
+        changed.notify_all();
+    }
+
+    // Disconnect all clients and join the workers
+    void StopAll() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+            for (int fd : connections) {
+                shutdown(fd, SHUT_RDWR);
+            }
+            for (const auto &connection : pending) {
+                close(connection.fd);
+            }
+            pending.clear();
+            changed.notify_all();
+        }
+        for (auto &worker : workers) {
+            worker.join();
+        }
+    }
+
+private:
+    struct Connection {
+        int fd;
+        bool http;
+    };
+
+    std::vector<std::thread> workers;
+    std::vector<Connection> pending;
+    std::set<int> connections;  // Being served, shut down on stop
+    size_t busy = 0;            // Pending and served connections
+    bool stopping = false;
+    std::mutex mutex;
+    std::condition_variable changed;
+
+    void Work(FileServer &server) {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (true) {
+            changed.wait(lock, [this]() { return stopping || !pending.empty(); });
+            if (stopping) {
+                return;
+            }
+            const Connection connection = pending.front();
+            pending.erase(pending.begin());
+            connections.insert(connection.fd);
+            lock.unlock();
+
+            if (connection.http) {
+                ServeHttpConnection(connection.fd, server);
+            } else {
+                ServeCommandConnection(connection.fd, server);
+            }
+
+            lock.lock();
+            connections.erase(connection.fd);
+            close(connection.fd);
+            busy--;
+            changed.notify_all();
+        }
+    }
+};
+}  // namespace
+
+int RunServer(const std::string &archiveName, const ServeSettings &settings) {
+    signal(SIGPIPE, SIG_IGN);
+    signal(SIGINT, RequestStop);
+    signal(SIGTERM, RequestStop);
+
+    HandlePool pool;
+    if (!pool.Open(archiveName, std::max(1u, settings.handles))) {
+        return 1;
+    }
+    FileServer server(pool, settings.cacheBytes);
+
+    const int socketFd = ListenUnixSocket(settings.socketPath);
+    if (socketFd < 0) {
+        return 1;
+    }
+    int httpFd = -1;
+    if (settings.httpPort.has_value()) {
+        httpFd = ListenHttp(settings.httpPort.value());
+        if (httpFd < 0) {
+            close(socketFd);
+            unlink(settings.socketPath.c_str());
+            return 1;
+        }
+    }
+
+    std::cout << "[*] Serving " << archiveName << " on " << settings.socketPath;
+    if (settings.httpPort.has_value()) {
+        std::cout << " and http://127.0.0.1:" << settings.httpPort.value() << "/";
+    }
+    std::cout << std::endl;
+
+    // Wake up regularly to notice a stop request
+    ConnectionPool connections(std::max(1u, settings.maxClients), server);
+    std::vector<pollfd> listeners = {{socketFd, POLLIN, 0}};
+    if (httpFd >= 0) {
+        listeners.push_back({httpFd, POLLIN, 0});
+    }
+    while (!stopRequested) {
+        if (!connections.WaitForIdleWorker(std::chrono::milliseconds(200)) ||
+            poll(listeners.data(), listeners.size(), 200) <= 0) {
+            continue;
+        }
+        for (const auto &listener : listeners) {
+            if ((listener.revents & POLLIN) &&
+                connections.WaitForIdleWorker(std::chrono::milliseconds(0))) {
+                int clientFd = accept(listener.fd, nullptr, nullptr);
+                if (clientFd >= 0) {
+                    connections.Submit(clientFd, listener.fd == httpFd);
+                }
+            }
+        }
+    }
+
+    connections.StopAll();
+    close(socketFd);
+    if (httpFd >= 0) {
+        close(httpFd);
+    }
+    unlink(settings.socketPath.c_str());
+
+    std::cout << "[*] Stopped serving " << archiveName << std::endl << server.Stats();
+    return 0;
+}
+#else
+int RunServer(const std::string &archiveName, const ServeSettings &settings) {
+    (void)archiveName;
+    (void)settings;
+    std::cerr << "[!] The serve subcommand is not supported on Windows." << std::endl;
+    return 1;
+}
+#endif
@@ -0,0 +1,21 @@
+#ifndef SERVE_H
+#define SERVE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string>
+
+struct ServeSettings {
+    std::string socketPath;           // Unix domain socket to listen on
+    std::optional<uint16_t> httpPort;  // Optional HTTP port, bound to 127.0.0.1 only
+    size_t cacheBytes;                 // Budget of the decompressed file cache
+    unsigned int handles;              // Read-only archive handles shared by clients
+    unsigned int maxClients;           // Clients served at once, more wait to be accepted
+};
+
+// Serve the files of an archive to local clients until interrupted (SIGINT or
+// SIGTERM). Only available on POSIX systems.
+int RunServer(const std::string &archiveName, const ServeSettings &settings);
+
+#endif  // SERVE_H
@@ -0,0 +1,221 @@
+#include "tarreader.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+
+namespace {
+constexpr size_t kBlockSize = 512;
+
+// Header fields, as offsets and lengths into a header block
+constexpr size_t kNameOffset = 0;
+constexpr size_t kNameLength = 100;
+constexpr size_t kSizeOffset = 124;
+constexpr size_t kSizeLength = 12;
+constexpr size_t kTimeOffset = 136;
+constexpr size_t kTimeLength = 12;
+constexpr size_t kChecksumOffset = 148;
+constexpr size_t kChecksumLength = 8;
+constexpr size_t kTypeOffset = 156;
+constexpr size_t kMagicOffset = 257;  // "ustar\0" and version "00" for POSIX ustar
+constexpr size_t kPrefixOffset = 345;
+constexpr size_t kPrefixLength = 155;
+
+std::string Field(const char *block, size_t offset, size_t length) {
+    const char *begin = block + offset;
+    return {begin, static_cast<size_t>(std::find(begin, begin + length, '\0') - begin)};
+}
+
+// Octal numbers, or base-256 (GNU) when the top bit of the first byte is set
+uint64_t Number(const char *block, size_t offset, size_t length) {
+    const auto *bytes = reinterpret_cast<const unsigned char *>(block + offset);
+    uint64_t value = 0;
+    if (bytes[0] & 0x80) {
+        value = bytes[0] & 0x7F;
+        for (size_t i = 1; i < length; i++) {
+            value = (value << 8) | bytes[i];
+        }
+        return value;
+    }
+    for (size_t i = 0; i < length && bytes[i] != '\0'; i++) {
+        if (bytes[i] >= '0' && bytes[i] <= '7') {
+            value = (value << 3) | (bytes[i] - '0');
+        }
+    }
+    return value;
+}
+
+// The checksum is the sum of the header bytes, counting its own field as spaces
+bool ChecksumMatches(const char *block) {
+    uint64_t sum = 0;
+    for (size_t i = 0; i < kBlockSize; i++) {
+        const bool inField = i >= kChecksumOffset && i < kChecksumOffset + kChecksumLength;
+        sum += inField ? ' ' : static_cast<unsigned char>(block[i]);
+    }
+    return sum == Number(block, kChecksumOffset, kChecksumLength);
+}
+
+// Apply the records of a pax header ("<length> <key>=<value>\n") to a member
+void ApplyPaxRecords(const std::string &records, TarMember *member, bool *hasPath,
+                     bool *hasSize) {
+    size_t position = 0;
+    while (position < records.size()) {
+        const size_t space = records.find(' ', position);
+        if (space == std::string::npos) {
+            return;
+        }
+        const size_t length = std::strtoull(records.c_str() + position, nullptr, 10);
+        if (length == 0 || position + length > records.size()) {
+            return;
+        }
+        const std::string record = records.substr(space + 1, position + length - space - 2);
+        const size_t equals = record.find('=');
+        if (equals != std::string::npos) {
+            const std::string key = record.substr(0, equals);
+            const std::string value = record.substr(equals + 1);
+            if (key == "path") {
+                member->path = value;
+                *hasPath = true;
+            } else if (key == "size") {
+                member->size = std::strtoull(value.c_str(), nullptr, 10);
+                *hasSize = true;
+            } else if (key == "mtime") {
+                member->modifiedTime = std::strtoll(value.c_str(), nullptr, 10);
+            }
+        }
+        position += length;
+    }
+}
+}  // namespace
+
+void TarReader::MemberBuffer::Reset(uint64_t size) {
+    remaining = size;
+    setg(nullptr, nullptr, nullptr);
+}
+
+bool TarReader::MemberBuffer::Skip() {
+    while (remaining > 0) {
+        const auto length = static_cast<std::streamsize>(std::min<uint64_t>(remaining,
+                                                                          buffer.size()));
+        input.read(buffer.data(), length);
+        if (input.gcount() != length) {
+            return false;
+        }
+        remaining -= static_cast<uint64_t>(length);
+    }
+    setg(nullptr, nullptr, nullptr);
+    return true;
+}
+
+TarReader::MemberBuffer::int_type TarReader::MemberBuffer::underflow() {
+    if (gptr() < egptr()) {
+        return traits_type::to_int_type(*gptr());
+    }
+    if (remaining == 0) {
+        return traits_type::eof();
+    }
+    const auto length = static_cast<std::streamsize>(std::min<uint64_t>(remaining, buffer.size()));
+    input.read(buffer.data(), length);
+    const std::streamsize bytesRead = input.gcount();
+    if (bytesRead <= 0) {
+        return traits_type::eof();
+    }
+    remaining -= static_cast<uint64_t>(bytesRead);
+    setg(buffer.data(), buffer.data(), buffer.data() + bytesRead);
+    return traits_type::to_int_type(*gptr());
+}
+
+TarReader::TarReader(std::istream &input)
+    : input(input), memberBuffer(input), data(&memberBuffer) {}
+
+bool TarReader::ReadBlock(char *block) {
+    input.read(block, kBlockSize);
+    return input.gcount() == static_cast<std::streamsize>(kBlockSize);
+}
+
+// Read the data of a member holding text (long names and pax records)
+bool TarReader::ReadMemberText(uint64_t size, std::string *text) {
+    if (size > 1024 * 1024) {
+        return false;
+    }
+    text->assign(static_cast<size_t>(size), '\0');
+    input.read(text->data(), static_cast<std::streamsize>(size));
+    if (static_cast<uint64_t>(input.gcount()) != size) {
+        return false;
+    }
+    const uint64_t textPadding = (kBlockSize - size % kBlockSize) % kBlockSize;
+    input.ignore(static_cast<std::streamsize>(textPadding));
+    return static_cast<uint64_t>(input.gcount()) == textPadding;
+}
+
+bool TarReader::Next(TarMember *member) {
+    if (failed) {
+        return false;
+    }
+    // Skip what was not read of the previous member, then its padding
+    if (!memberBuffer.Skip() || !input.ignore(static_cast<std::streamsize>(padding))) {
+        failed = true;
+        return false;
+    }
+    padding = 0;
+
+    *member = TarMember();
+    bool hasPath = false;
+    bool hasSize = false;
+    char block[kBlockSize];
+    while (true) {
+        if (!ReadBlock(block)) {
+            failed = true;  // Archives end with zero blocks, not in the middle of a header
+            return false;
+        }
+        if (std::all_of(block, block + kBlockSize, [](char c) { return c == '\0'; })) {
+            return false;
+        }
+        if (!ChecksumMatches(block)) {
+            failed = true;
+            return false;
+        }
+
+        const char type = block[kTypeOffset];
+        const uint64_t size = Number(block, kSizeOffset, kSizeLength);
+        std::string text;
+        if (type == 'L' || type == 'K' || type == 'x' || type == 'g') {
+            // Extended headers describe the member that follows them
+            if (!ReadMemberText(size, &text)) {
+                failed = true;
+                return false;
+            }
+            if (type == 'L') {
+                member->path = text.substr(0, text.find('\0'));
+                hasPath = true;
+            } else if (type == 'x') {
+                ApplyPaxRecords(text, member, &hasPath, &hasSize);
+            }
+            continue;
+        }
+
+        if (!hasPath) {
+            member->path = Field(block, kNameOffset, kNameLength);
+            const std::string prefix = Field(block, kPrefixOffset, kPrefixLength);
+            // GNU headers ("ustar  \0") keep the access and change times in the prefix field
+            if (std::memcmp(block + kMagicOffset, "ustar\0" "00", 8) == 0 && !prefix.empty()) {
+                member->path = prefix + "/" + member->path;
+            }
+        }
+        if (!hasSize) {
+            member->size = size;
+        }
+        if (member->modifiedTime == 0) {
+            member->modifiedTime = static_cast<int64_t>(Number(block, kTimeOffset, kTimeLength));
+        }
+        member->regularFile = type == '0' || type == '\0' || type == '7';
+
+        // Links, devices, directories and FIFOs have no data whatever their size says
+        const bool hasData = std::strchr("123456", type) == nullptr || type == '\0';
+        const uint64_t dataSize = hasData ? member->size : 0;
+        memberBuffer.Reset(dataSize);
+        data.clear();
+        padding = (kBlockSize - dataSize % kBlockSize) % kBlockSize;
+        return true;
+    }
+}
@@ -0,0 +1,60 @@
+#ifndef TARREADER_H
+#define TARREADER_H
+
+#include <cstdint>
+#include <istream>
+#include <streambuf>
+#include <string>
+#include <vector>
+
+// One member of a tar archive
+struct TarMember {
+    std::string path;  // As stored, with long names (GNU and pax) applied
+    uint64_t size = 0;
+    int64_t modifiedTime = 0;  // Unix time
+    bool regularFile = false;  // Directories, links and devices have no data to add
+};
+
+// Reads a tar stream (ustar, GNU or pax) front to back without seeking, so it also
+// works on pipes. The data of the current member is read from Data(), whatever is not
+// read is skipped by the next call to Next().
+class TarReader {
+public:
+    explicit TarReader(std::istream &input);
+
+    // Read the header of the next member. False at the end of the archive, or when the
+    // stream is damaged (see Failed).
+    bool Next(TarMember *member);
+
+    std::istream &Data() { return data; }
+
+    [[nodiscard]] bool Failed() const { return failed; }
+
+private:
+    // Stream buffer handing out exactly the data of the current member
+    class MemberBuffer : public std::streambuf {
+    public:
+        explicit MemberBuffer(std::istream &input) : input(input) {}
+        void Reset(uint64_t size);
+        bool Skip();  // Discard the unread rest of the member
+
+    protected:
+        int_type underflow() override;
+
+    private:
+        std::istream &input;
+        uint64_t remaining = 0;
+        std::vector<char> buffer = std::vector<char>(64 * 1024);
+    };
+
+    std::istream &input;
+    MemberBuffer memberBuffer;
+    std::istream data;
+    uint64_t padding = 0;  // Bytes after the current member's data up to the next header
+    bool failed = false;
+
+    bool ReadBlock(char *block);
+    bool ReadMemberText(uint64_t size, std::string *text);
+};
+
+#endif  // TARREADER_H
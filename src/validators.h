@@ -6,8 +6,25 @@
 #include "gamerules.h"
 #include "locales.h"
 
-// Defined in gamerules.cpp
-extern const CLI::Validator GameProfileValid;
+// Inline game profile validator - accepts all profile names but only displays canonical ones
+inline const auto GameProfileValid = CLI::Validator(
+    [](const std::string &str) {
+        if (str == "default") return std::string();
+
+        // Try to convert the string to a profile
+        GameProfile profile = GameRules::StringToProfile(str);
+
+        // If it's GENERIC and the input wasn't "generic", it means the profile wasn't found
+        if (profile == GameProfile::GENERIC && str != "generic") {
+            std::string validProfiles = "Game profile must be one of:";
+            for (const auto &p : GameRules::GetCanonicalProfiles()) {
+                validProfiles += " " + p;
+            }
+            return validProfiles;
+        }
+        return std::string();
+    },
+    "", "GameProfileValidator");
 
 // Inline locale validator
 inline const auto LocaleValid = CLI::Validator(
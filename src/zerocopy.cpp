@@ -0,0 +1,135 @@
+#include "zerocopy.h"
+
+#include <algorithm>
+#include <vector>
+
+#if defined(__linux__)
+#include <fcntl.h>
+#include <sys/sendfile.h>
+#include <unistd.h>
+
+#include <cerrno>
+#endif
+
+#if defined(__linux__)
+namespace {
+constexpr size_t kChunkSize = 1 << 30;        // Per system call, well below the 2 GiB limit
+constexpr size_t kBufferSize = 1024 * 1024;  // For the plain read and write fallback
+
+// Copy with pread and write, for descriptors the kernel cannot copy between
+bool CopyWithBuffer(int sourceFd, off_t offset, uint64_t length, int outputFd) {
+    std::vector<char> buffer(std::min<uint64_t>(length, kBufferSize));
+    while (length > 0) {
+        const ssize_t bytesRead =
+            pread(sourceFd, buffer.data(), std::min<uint64_t>(length, buffer.size()), offset);
+        if (bytesRead <= 0) {
+            return false;  // Error, or the block runs past the end of the archive
+        }
+        for (ssize_t written = 0; written < bytesRead;) {
+            const ssize_t result = write(outputFd, buffer.data() + written, bytesRead - written);
+            if (result < 0) {
+                return false;
+            }
+            written += result;
+        }
+        offset += bytesRead;
+        length -= static_cast<uint64_t>(bytesRead);
+    }
+    return true;
+}
+
+// Copy with sendfile, which accepts any output descriptor. When it stops early,
+// *supported tells whether the rest can still be copied with reads and writes.
+bool CopyWithSendfile(int sourceFd, off_t *offset, uint64_t *length, int outputFd,
+                      bool *supported) {
+    *supported = true;
+    while (*length > 0) {
+        const ssize_t result =
+            sendfile(outputFd, sourceFd, offset, std::min<uint64_t>(*length, kChunkSize));
+        if (result < 0 && errno == EINTR) {
+            continue;
+        }
+        if (result <= 0) {
+            *supported = result < 0 && (errno == EINVAL || errno == ENOSYS);
+            return false;
+        }
+        *length -= static_cast<uint64_t>(result);
+    }
+    return true;
+}
+
+bool SendRange(int sourceFd, uint64_t offset, uint64_t length, int outputFd) {
+    auto position = static_cast<off_t>(offset);
+    bool supported;
+    if (CopyWithSendfile(sourceFd, &position, &length, outputFd, &supported)) {
+        return true;
+    }
+    return supported && CopyWithBuffer(sourceFd, position, length, outputFd);
+}
+}  // namespace
+#endif
+
+RangeCopyResult CopyRangeToFile(const std::string &sourcePath, uint64_t offset, uint64_t length,
+                                const std::string &outputPath) {
+#if defined(__linux__)
+    const int sourceFd = open(sourcePath.c_str(), O_RDONLY | O_CLOEXEC);
+    if (sourceFd < 0) {
+        return RangeCopyResult::kUnsupported;
+    }
+    const int outputFd = open(outputPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (outputFd < 0) {
+        close(sourceFd);
+        return RangeCopyResult::kFailed;
+    }
+
+    // copy_file_range shares extents on filesystems with reflinks, and otherwise
+    // copies in the kernel. Across filesystems (before Linux 5.19) it fails with EXDEV.
+    auto position = static_cast<off_t>(offset);
+    bool copied = true;
+    while (length > 0) {
+        const ssize_t result = copy_file_range(sourceFd, &position, outputFd, nullptr,
+                                               std::min<uint64_t>(length, kChunkSize), 0);
+        if (result < 0 && errno == EINTR) {
+            continue;
+        }
+        if (result <= 0) {
+            copied = result < 0 && (errno == EXDEV || errno == EINVAL || errno == ENOSYS ||
+                                    errno == EOPNOTSUPP) &&
+                     SendRange(sourceFd, static_cast<uint64_t>(position), length, outputFd);
+            break;
+        }
+        length -= static_cast<uint64_t>(result);
+    }
+
+    close(sourceFd);
+    if (close(outputFd) != 0) {
+        copied = false;
+    }
+    return copied ? RangeCopyResult::kCopied : RangeCopyResult::kFailed;
+#else
+    (void)sourcePath;
+    (void)offset;
+    (void)length;
+    (void)outputPath;
+    return RangeCopyResult::kUnsupported;
+#endif
+}
+
+RangeCopyResult SendRangeToDescriptor(const std::string &sourcePath, uint64_t offset,
+                                      uint64_t length, int outputFd) {
+#if defined(__linux__)
+    const int sourceFd = open(sourcePath.c_str(), O_RDONLY | O_CLOEXEC);
+    if (sourceFd < 0) {
+        return RangeCopyResult::kUnsupported;
+    }
+    const bool sent = SendRange(sourceFd, offset, length, outputFd);
+    close(sourceFd);
+    return sent ? RangeCopyResult::kCopied : RangeCopyResult::kFailed;
+#else
+    (void)sourcePath;
+    (void)offset;
+    (void)length;
+    (void)outputFd;
+    return RangeCopyResult::kUnsupported;
+#endif
+}
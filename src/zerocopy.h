@@ -0,0 +1,24 @@
+#ifndef ZEROCOPY_H
+#define ZEROCOPY_H
+
+#include <cstdint>
+#include <string>
+
+enum class RangeCopyResult {
+    kCopied,
+    kUnsupported,  // Nothing was written, the caller can copy the data itself
+    kFailed,       // Output may be partially written
+};
+
+// Copy a byte range of a file into a new output file, inside the kernel where the
+// filesystems allow (copy_file_range, then sendfile, then plain reads and writes).
+// Linux only, elsewhere every copy is unsupported.
+RangeCopyResult CopyRangeToFile(const std::string &sourcePath, uint64_t offset, uint64_t length,
+                                const std::string &outputPath);
+
+// Send a byte range of a file to an open descriptor such as stdout (sendfile, falling
+// back to plain reads and writes). Linux only.
+RangeCopyResult SendRangeToDescriptor(const std::string &sourcePath, uint64_t offset,
+                                      uint64_t length, int outputFd);
+
+#endif  // ZEROCOPY_H
@@ -205,6 +205,74 @@ def generate_path_traversal_mpq(binary_path):
     yield mpq_file
 
 
+@pytest.fixture(scope="function")
+def generate_overlay_mpq_test_files(binary_path):
+    script_dir = Path(__file__).parent
+
+    data_dir = script_dir / "data"
+    data_dir.mkdir(parents=True, exist_ok=True)
+
+    archives = {
+        "overlay_base.mpq": {
+            "cats.txt": "This is the base file about cats.",
+            "dogs.txt": "This is the base file about dogs.",
+        },
+        "overlay_top.mpq": {
+            "cats.txt": "This is the overlay file about cats.",
+            "birds.txt": "This is the overlay file about birds.",
+        },
+    }
+
+    # Create one MPQ archive per layer, lowest priority first
+    created_archives = []
+    for archive_name, files in archives.items():
+        files_dir = data_dir / archive_name.replace(".mpq", "_files")
+        shutil.rmtree(files_dir, ignore_errors=True)
+        files_dir.mkdir(parents=True, exist_ok=True)
+        for file_name, content in files.items():
+            (files_dir / file_name).write_text(content, newline="\n")
+
+        mpq_file = data_dir / archive_name
+        mpq_file.unlink(missing_ok=True)
+        result = subprocess.run(
+            [str(binary_path), "create", "-o", str(mpq_file), str(files_dir)],
+            stdout=subprocess.PIPE,
+            stderr=subprocess.PIPE,
+            text=True
+        )
+        assert result.returncode == 0, f"mpqcli failed with error: {result.stderr}"
+        created_archives.append(mpq_file)
+
+    yield created_archives
+
+
+@pytest.fixture(scope="function")
+def generate_stored_mpq(binary_path):
+    script_dir = Path(__file__).parent
+
+    data_dir = script_dir / "data"
+    data_dir.mkdir(parents=True, exist_ok=True)
+
+    # Several sectors of incompressible-looking data, added without compression
+    files_dir = data_dir / "stored_files"
+    shutil.rmtree(files_dir, ignore_errors=True)
+    files_dir.mkdir(parents=True, exist_ok=True)
+    content = bytes((i * 7919 + (i >> 8)) % 251 for i in range(300 * 1024))
+    (files_dir / "video.bin").write_bytes(content)
+
+    mpq_file = data_dir / "mpq_with_stored_files.mpq"
+    mpq_file.unlink(missing_ok=True)
+    result = subprocess.run(
+        [str(binary_path), "create", "-o", str(mpq_file), "--flags", "2147483648", str(files_dir)],
+        stdout=subprocess.PIPE,
+        stderr=subprocess.PIPE,
+        text=True
+    )
+    assert result.returncode == 0, f"mpqcli failed with error: {result.stderr}"
+
+    yield mpq_file, content
+
+
 @pytest.fixture(scope="session")
 def download_test_files():
     script_dir = Path(__file__).parent
@@ -0,0 +1,152 @@
+// Exercises the MpqArchive API of libmpqcli in-process: creating, opening, listing,
+// finding, reading, extracting, removing and closing, and the failures of each.
+// Prints the checks that fail and exits with 1 if there are any. The failure paths
+// also print the errors of the library to stderr.
+
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "archive.h"
+#include "logging.h"
+
+namespace fs = std::filesystem;
+
+namespace {
+
+int failures = 0;
+
+void Check(bool condition, const std::string &description) {
+    if (!condition) {
+        std::cerr << "[!] Check failed: " << description << std::endl;
+        failures++;
+    }
+}
+
+void WriteFile(const fs::path &path, const std::string &content) {
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    file.write(content.data(), static_cast<std::streamsize>(content.size()));
+}
+
+}  // namespace
+
+int main() {
+    StartLogging(LogLevel::QUIET);
+
+    const fs::path workDir = fs::temp_directory_path() / "mpqcli_archive_test";
+    std::error_code ec;
+    fs::remove_all(workDir, ec);
+    fs::create_directories(workDir);
+
+    const std::string catsContent = "This is a file about cats.\n";
+    // Larger than the pieces Extract hands to its sink, so the sink is called several times
+    std::string bigContent;
+    for (int i = 0; bigContent.size() < 600 * 1024; i++) {
+        bigContent += "Line " + std::to_string(i) + " of a file spanning several pieces.\n";
+    }
+    WriteFile(workDir / "cats.txt", catsContent);
+    WriteFile(workDir / "big.txt", bigContent);
+    const std::string archivePath = (workDir / "test.mpq").u8string();
+
+    {
+        const GameRules gameRules(GameRules::GetDefaultProfile());
+        MpqArchive archive;
+        Check(!archive.IsOpen(), "A new archive is not open");
+        Check(archive.Create(archivePath, 16, gameRules), "Create a new archive");
+        Check(archive.Add(workDir / "cats.txt", "cats.txt", defaultLocale, gameRules),
+              "Add cats.txt");
+        Check(archive.Add(workDir / "big.txt", "dir\\big.txt", defaultLocale, gameRules),
+              "Add dir\\big.txt");
+        Check(!archive.Add(workDir / "cats.txt", "cats.txt", defaultLocale, gameRules),
+              "Adding an existing file without overwrite fails");
+        Check(archive.Close(), "Close the created archive");
+        Check(archive.Close(), "Closing twice succeeds");
+        Check(!archive.IsOpen(), "A closed archive is not open");
+    }
+
+    {
+        MpqArchive archive;
+        Check(!archive.Open((workDir / "missing.mpq").u8string()),
+              "Opening a missing archive fails");
+        Check(!archive.IsOpen(), "A failed open leaves the archive closed");
+    }
+
+    for (const bool useMmap : {false, true}) {
+        const std::string mode = useMmap ? " (mmap)" : "";
+        MpqArchive archive;
+        Check(archive.Open(archivePath, MPQ_OPEN_READ_ONLY, useMmap), "Open the archive" + mode);
+        Check(archive.Info().fileCount >= 2, "Info counts the added files" + mode);
+
+        std::set<std::string> names;
+        for (const MpqEntry &entry : archive.Entries()) {
+            names.insert(entry.name);
+        }
+        Check(names.count("cats.txt") == 1 && names.count("dir\\big.txt") == 1,
+              "Entries lists the added files" + mode);
+
+        const auto cats = archive.Find("cats.txt");
+        Check(cats.has_value() && cats->fileSize == static_cast<int32_t>(catsContent.size()),
+              "Find returns the size of cats.txt" + mode);
+        Check(archive.Find("DIR\\BIG.TXT").has_value(), "Find ignores case" + mode);
+        Check(!archive.Find("missing.txt").has_value(), "Find fails for a missing file" + mode);
+
+        std::string buffer(64, '\0');
+        auto bytesRead = archive.Read("cats.txt", buffer.data(), buffer.size());
+        Check(bytesRead == catsContent.size() && buffer.substr(0, *bytesRead) == catsContent,
+              "Read returns the whole file when the buffer is larger" + mode);
+        bytesRead = archive.Read("cats.txt", buffer.data(), 4, 5);
+        Check(bytesRead == 4u && buffer.substr(0, 4) == "is a", "Read at an offset" + mode);
+        Check(!archive.Read("missing.txt", buffer.data(), buffer.size()).has_value(),
+              "Read fails for a missing file" + mode);
+
+        std::string extracted;
+        size_t pieces = 0;
+        Check(archive.Extract("dir\\big.txt",
+                              [&](const char *data, size_t size) {
+                                  extracted.append(data, size);
+                                  pieces++;
+                                  return true;
+                              }),
+              "Extract dir\\big.txt" + mode);
+        Check(extracted == bigContent && pieces > 1,
+              "Extract hands over the whole file in pieces" + mode);
+        pieces = 0;
+        Check(!archive.Extract("dir\\big.txt",
+                               [&](const char *, size_t) {
+                                   pieces++;
+                                   return false;
+                               }),
+              "Extract fails when the sink stops it" + mode);
+        Check(pieces == 1, "Extract stops at the first piece the sink refuses" + mode);
+        Check(!archive.Extract("missing.txt", [](const char *, size_t) { return true; }),
+              "Extract fails for a missing file" + mode);
+
+        MpqArchive moved = std::move(archive);
+        Check(moved.IsOpen() && !archive.IsOpen(), "Moving hands over the handle" + mode);
+        Check(moved.Find("cats.txt").has_value(), "The moved archive reads files" + mode);
+    }
+
+    {
+        MpqArchive archive;
+        Check(archive.Open(archivePath, 0), "Open the archive for writing");
+        Check(archive.Remove("cats.txt"), "Remove cats.txt");
+        Check(!archive.Remove("missing.txt"), "Removing a missing file fails");
+        Check(archive.Close(), "Close the changed archive");
+        Check(archive.Open(archivePath), "Open the changed archive");
+        Check(!archive.Find("cats.txt").has_value(), "A removed file is not found");
+        Check(archive.Find("dir\\big.txt").has_value(), "Other files are kept");
+    }
+
+    fs::remove_all(workDir, ec);
+    if (failures > 0) {
+        std::cerr << "[!] " << failures << " checks failed" << std::endl;
+        return 1;
+    }
+    std::cout << "[*] All library checks passed" << std::endl;
+    return 0;
+}
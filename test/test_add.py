@@ -1,7 +1,15 @@
+import io
+import os
+import re
 import subprocess
 import shutil
+import signal
+import sys
+import tarfile
 from pathlib import Path
 
+import pytest
+
 
 def test_add_target_mpq_does_not_exist(binary_path, generate_test_files):
     """
@@ -597,6 +605,288 @@ def test_add_file_with_all_game_profiles(binary_path, generate_test_files):
         assert found_with_compression, f"Profile {profile}: no compression flag found on added file"
 
 
+def test_add_file_to_mpq_archive_atomic(binary_path, generate_test_files):
+    """
+    Test MPQ file addition using a copy-on-write working copy.
+
+    This test checks:
+    - If the file is added to the MPQ archive.
+    - That no working copy is left next to the archive.
+    """
+    _ = generate_test_files
+    script_dir = Path(__file__).parent
+    target_file = script_dir / "data" / "files.mpq"
+
+    # Start by creating an MPQ archive for this test
+    create_mpq_archive_for_test(binary_path, script_dir)
+
+    test_file = script_dir / "data" / "test.txt"
+    test_file.write_text("This is a test file for MPQ addition.")
+
+    result = subprocess.run(
+        [str(binary_path), "add", str(test_file), str(target_file), "--atomic"],
+        stdout=subprocess.PIPE,
+        stderr=subprocess.PIPE,
+        text=True
+    )
+
+    assert result.returncode == 0, f"mpqcli failed with error: {result.stderr}"
+    assert not target_file.with_name(target_file.name + ".atomic").exists()
+
+    expected_content = {
+        "enUS  bytes",
+        "enUS  dogs.txt",
+        "enUS  cats.txt",
+        "enUS  test.txt",
+    }
+    verify_archive_file_content(binary_path, target_file, expected_content)
+
+
+def test_add_file_to_mpq_archive_atomic_in_progress(binary_path, generate_test_files):
+    """
+    Test MPQ file addition while another atomic write holds the working copy.
+
+    This test checks:
+    - That the add fails and leaves the MPQ archive unchanged.
+    """
+    _ = generate_test_files
+    script_dir = Path(__file__).parent
+    target_file = script_dir / "data" / "files.mpq"
+
+    create_mpq_archive_for_test(binary_path, script_dir)
+    original = target_file.read_bytes()
+
+    working_copy = target_file.with_name(target_file.name + ".atomic")
+    working_copy.write_bytes(b"")
+
+    test_file = script_dir / "data" / "test.txt"
+    test_file.write_text("This is a test file for MPQ addition.")
+
+    result = subprocess.run(
+        [str(binary_path), "add", str(test_file), str(target_file), "--atomic"],
+        stdout=subprocess.PIPE,
+        stderr=subprocess.PIPE,
+        text=True
+    )
+    assert working_copy.read_bytes() == b"", "A stale working copy must not be overwritten"
+    working_copy.unlink()
+
+    assert result.returncode == 1, f"mpqcli failed with error: {result.stderr}"
+    assert "or was interrupted" in result.stderr
+    assert target_file.read_bytes() == original
+
+
+@pytest.mark.skipif(sys.platform == "win32", reason="Needs a file size limit (RLIMIT_FSIZE)")
+def test_add_file_to_mpq_archive_atomic_write_fails(binary_path, generate_test_files):
+    """
+    Test MPQ file addition when writing the working copy fails.
+
+    This test checks:
+    - That the MPQ archive is left byte-identical.
+    - That the command fails.
+    - That the failed working copy is removed.
+    """
+    import resource
+
+    _ = generate_test_files
+    script_dir = Path(__file__).parent
+    target_file = script_dir / "data" / "files.mpq"
+
+    create_mpq_archive_for_test(binary_path, script_dir)
+    original = target_file.read_bytes()
+
+    test_file = script_dir / "data" / "random.bin"
+    test_file.write_bytes(os.urandom(1024 * 1024))
+
+    # The working copy fits under the limit, the incompressible file added to it does not
+    limit = len(original) + 64 * 1024
+
+    def limit_file_size():
+        signal.signal(signal.SIGXFSZ, signal.SIG_IGN)  # Fail the write instead of exiting
+        resource.setrlimit(resource.RLIMIT_FSIZE, (limit, limit))
+
+    result = subprocess.run(
+        [str(binary_path), "add", str(test_file), str(target_file), "--atomic"],
+        stdout=subprocess.PIPE,
+        stderr=subprocess.PIPE,
+        text=True,
+        preexec_fn=limit_file_size
+    )
+    test_file.unlink()
+
+    assert result.returncode != 0, f"mpqcli unexpectedly succeeded: {result.stdout}"
+    assert "[!]" in result.stderr, f"Writing did not fail: {result.stdout}"
+    assert target_file.read_bytes() == original
+    assert not target_file.with_name(target_file.name + ".atomic").exists()
+
+
+def test_add_file_from_stdin(binary_path, generate_test_files):
+    """
+    Test MPQ file addition from data piped to stdin.
+
+    This test checks:
+    - If the piped data is added under the given path.
+    - That reading the file back returns the piped data.
+    """
+    _ = generate_test_files
+    script_dir = Path(__file__).parent
+    target_file = script_dir / "data" / "files.mpq"
+
+    create_mpq_archive_for_test(binary_path, script_dir)
+
+    content = b"Generated data piped into the archive.\n" * 1000
+    result = subprocess.run(
+        [str(binary_path), "add", "-", str(target_file), "-p", "generated.txt",
+         "--size", str(len(content))],
+        input=content,
+        stdout=subprocess.PIPE,
+        stderr=subprocess.PIPE,
+    )
+
+    assert result.returncode == 0, f"mpqcli failed with error: {result.stderr}"
+    assert result.stdout.decode().splitlines() == ["[+] Adding file: generated.txt"]
+
+    read = subprocess.run(
+        [str(binary_path), "read", "generated.txt", str(target_file)],
+        stdout=subprocess.PIPE,
+        stderr=subprocess.PIPE,
+    )
+    assert read.returncode == 0, f"mpqcli failed with error: {read.stderr}"
+    assert read.stdout == content, "Piped file content differs"
+
+
+def test_add_file_from_stdin_without_size(binary_path, generate_test_files):
+    """
+    Test MPQ file addition from stdin without a declared size.
+
+    This test checks:
+    - That the add fails and leaves the MPQ archive unchanged.
+    """
+    _ = generate_test_files
+    script_dir = Path(__file__).parent
+    target_file = script_dir / "data" / "files.mpq"
+
+    create_mpq_archive_for_test(binary_path, script_dir)
+    original = target_file.read_bytes()
+
+    result = subprocess.run(
+        [str(binary_path), "add", "-", str(target_file), "-p", "generated.txt"],
+        input=b"Some data",
+        stdout=subprocess.PIPE,
+        stderr=subprocess.PIPE,
+    )
+
+    assert result.returncode == 1, f"mpqcli unexpectedly succeeded: {result.stdout}"
+    assert target_file.read_bytes() == original
+
+
+def test_add_file_from_stdin_shorter_than_size(binary_path, generate_test_files):
+    """
+    Test MPQ file addition from stdin that ends before the declared size.
+
+    This test checks:
+    - That the add fails with an error naming the bytes that were read.
+    """
+    _ = generate_test_files
+    script_dir = Path(__file__).parent
+    target_file = script_dir / "data" / "files.mpq"
+
+    create_mpq_archive_for_test(binary_path, script_dir)
+
+    content = b"Some data"
+    result = subprocess.run(
+        [str(binary_path), "add", "-", str(target_file), "-p", "generated.txt",
+         "--size", str(len(content) + 100)],
+        input=content,
+        stdout=subprocess.PIPE,
+        stderr=subprocess.PIPE,
+    )
+
+    assert result.returncode == 1, f"mpqcli unexpectedly succeeded: {result.stdout}"
+    assert f"[!] Failed: Input ended after {len(content)} of {len(content) + 100} bytes" \
+        in result.stderr.decode()
+
+
+def test_add_files_from_damaged_tar(binary_path, generate_test_files):
+    """
+    Test MPQ file addition from tar streams that are damaged.
+
+    This test checks:
+    - That a tar stream ending in the middle of a file fails the add.
+    - That a tar header with a wrong checksum fails the add.
+    """
+    _ = generate_test_files
+    script_dir = Path(__file__).parent
+    target_file = script_dir / "data" / "files.mpq"
+
+    buffer = io.BytesIO()
+    with tarfile.open(fileobj=buffer, mode="w", format=tarfile.USTAR_FORMAT) as tar:
+        for name, size in [("small.bin", 1000), ("large.bin", 100000)]:
+            info = tarfile.TarInfo(name)
+            info.size = size
+            tar.addfile(info, io.BytesIO(b"x" * size))
+    tar_data = buffer.getvalue()
+
+    truncated = tar_data[:50000]
+    # The header of large.bin follows the header and the two data blocks of small.bin
+    bad_checksum = bytearray(tar_data)
+    bad_checksum[3 * 512] ^= 0xFF
+
+    for damaged in [truncated, bytes(bad_checksum)]:
+        create_mpq_archive_for_test(binary_path, script_dir)
+        result = subprocess.run(
+            [str(binary_path), "add", "-", str(target_file), "--from-tar"],
+            input=damaged,
+            stdout=subprocess.PIPE,
+            stderr=subprocess.PIPE,
+        )
+
+        assert result.returncode == 1, f"mpqcli unexpectedly succeeded: {result.stdout}"
+        assert "[!] Failed: The tar stream is damaged or ends early." \
+            in result.stderr.decode().splitlines()
+
+
+def test_add_file_to_mpq_archive_quiet_and_verbose(binary_path, generate_test_files):
+    """
+    Test MPQ file addition with the -q and -v log levels.
+
+    This test checks:
+    - That -q prints nothing for a file that is added.
+    - That -v also prints the flags and compression of the file.
+    """
+    _ = generate_test_files
+    script_dir = Path(__file__).parent
+    target_file = script_dir / "data" / "files.mpq"
+
+    create_mpq_archive_for_test(binary_path, script_dir)
+
+    test_file = script_dir / "data" / "test.txt"
+    test_file.write_text("This is a test file for MPQ addition.")
+
+    result = subprocess.run(
+        [str(binary_path), "-q", "add", str(test_file), str(target_file)],
+        stdout=subprocess.PIPE,
+        stderr=subprocess.PIPE,
+        text=True
+    )
+
+    assert result.returncode == 0, f"mpqcli failed with error: {result.stderr}"
+    assert result.stdout == "", f"Unexpected output: {result.stdout}"
+
+    result = subprocess.run(
+        [str(binary_path), "add", "-v", "--overwrite", str(test_file), str(target_file)],
+        stdout=subprocess.PIPE,
+        stderr=subprocess.PIPE,
+        text=True
+    )
+
+    output_lines = result.stdout.splitlines()
+    assert result.returncode == 0, f"mpqcli failed with error: {result.stderr}"
+    assert output_lines[-2] == "[+] Adding file: test.txt", f"Unexpected output: {output_lines}"
+    assert re.fullmatch(r"    Flags: 0x[0-9a-f]+, compression: 0x[0-9a-f]+, next: 0x[0-9a-f]+",
+                        output_lines[-1]), f"Unexpected output: {output_lines}"
+
+
 def create_mpq_archive_for_test(binary_path, script_dir):
     target_dir = script_dir / "data" / "files"
     target_file = target_dir.with_suffix(".mpq")
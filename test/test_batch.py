@@ -0,0 +1,139 @@
+import subprocess
+
+
+def parse_responses(output, json=False):
+    """Split framed batch output into (status, payload) tuples."""
+    responses = []
+    while output:
+        header, output = output.split(b"\n", 1)
+        if json:
+            status = b'"status":"ok"' in header and "ok" or "error"
+            length = int(header.rsplit(b":", 1)[1].rstrip(b"}"))
+        else:
+            status, length = header.decode().split(" ")
+            length = int(length)
+        responses.append((status, output[:length]))
+        output = output[length:]
+    return responses
+
+
+def test_batch_read_and_list(binary_path, generate_overlay_mpq_test_files):
+    """
+    Test running several commands against one opened MPQ archive.
+
+    This test checks:
+    - That every command gets a framed response, in order.
+    - That a failing command does not stop the batch.
+    """
+    base_file, _ = generate_overlay_mpq_test_files
+
+    commands = "read cats.txt\nread fish.txt\n# comment\n\nlist\nread \"dogs.txt\"\n"
+    result = subprocess.run(
+        [str(binary_path), "batch", str(base_file), "--read-only"],
+        input=commands.encode(),
+        stdout=subprocess.PIPE,
+        stderr=subprocess.PIPE,
+    )
+
+    assert result.returncode == 1, f"mpqcli failed with error: {result.stderr}"
+    responses = parse_responses(result.stdout)
+    assert len(responses) == 4, f"Unexpected output: {result.stdout}"
+    assert responses[0] == ("ok", b"This is the base file about cats.")
+    assert responses[1][0] == "error"
+    assert responses[2][0] == "ok"
+    assert set(responses[2][1].decode().splitlines()) >= {"cats.txt", "dogs.txt"}
+    assert responses[3] == ("ok", b"This is the base file about dogs.")
+
+
+def test_batch_empty_command(binary_path, generate_overlay_mpq_test_files):
+    """
+    Test a batch line whose command is an empty quoted string.
+
+    This test checks:
+    - That the line fails as an unknown command, and the batch goes on.
+    """
+    base_file, _ = generate_overlay_mpq_test_files
+
+    commands = "\"\" cats.txt\nread cats.txt\n"
+    result = subprocess.run(
+        [str(binary_path), "batch", str(base_file), "--read-only"],
+        input=commands.encode(),
+        stdout=subprocess.PIPE,
+        stderr=subprocess.PIPE,
+    )
+
+    assert result.returncode == 1, f"mpqcli unexpectedly succeeded: {result.stdout}"
+    responses = parse_responses(result.stdout)
+    assert len(responses) == 2, f"Unexpected output: {result.stdout}"
+    assert responses[0] == ("error", b"Unknown command: ")
+    assert responses[1] == ("ok", b"This is the base file about cats.")
+
+
+def test_batch_list_matches_list_subcommand(binary_path, generate_overlay_mpq_test_files):
+    """
+    Test the list command of a batch against the list subcommand.
+
+    This test checks:
+    - That list options and properties give the output of the list subcommand.
+    - That unknown list options fail.
+    """
+    base_file, _ = generate_overlay_mpq_test_files
+
+    commands = "list -a\nlist -d locale,file-size\nlist -x\n"
+    result = subprocess.run(
+        [str(binary_path), "batch", str(base_file), "--read-only"],
+        input=commands.encode(),
+        stdout=subprocess.PIPE,
+        stderr=subprocess.PIPE,
+    )
+    responses = parse_responses(result.stdout)
+    assert len(responses) == 3, f"Unexpected output: {result.stdout}"
+
+    for response, arguments in zip(responses, [["-a"], ["-d", "-p", "locale", "-p", "file-size"]]):
+        expected = subprocess.run(
+            [str(binary_path), "list", str(base_file), *arguments],
+            stdout=subprocess.PIPE,
+            stderr=subprocess.PIPE,
+        )
+        assert response == ("ok", expected.stdout)
+    assert "(listfile)" in responses[0][1].decode().splitlines()
+    assert responses[2][0] == "error"
+    assert result.returncode == 1
+
+
+def test_batch_json_add_and_read(binary_path, generate_overlay_mpq_test_files):
+    """
+    Test NDJSON commands that change the MPQ archive.
+
+    This test checks:
+    - That a file added in a batch can be read by a later command.
+    - That the change is written to the archive.
+    """
+    base_file, _ = generate_overlay_mpq_test_files
+    new_file = base_file.parent / "batch_fish.txt"
+    new_file.write_text("This is a file about fish.", newline="\n")
+
+    commands = "\n".join([
+        '{"cmd": "add", "path": "%s", "name": "fish.txt"}' % str(new_file).replace("\\", "\\\\"),
+        '{"cmd": "read", "file": "fish.txt"}',
+    ]) + "\n"
+    result = subprocess.run(
+        [str(binary_path), "batch", str(base_file), "--json"],
+        input=commands.encode(),
+        stdout=subprocess.PIPE,
+        stderr=subprocess.PIPE,
+    )
+
+    assert result.returncode == 0, f"mpqcli failed with error: {result.stderr}"
+    responses = parse_responses(result.stdout, json=True)
+    assert len(responses) == 2, f"Unexpected output: {result.stdout}"
+    assert responses[0] == ("ok", b"[+] Adding file: fish.txt\n")
+    assert responses[1] == ("ok", b"This is a file about fish.")
+
+    result = subprocess.run(
+        [str(binary_path), "read", "fish.txt", str(base_file)],
+        stdout=subprocess.PIPE,
+        stderr=subprocess.PIPE,
+        text=True
+    )
+    assert result.returncode == 0, f"mpqcli failed with error: {result.stderr}"
@@ -0,0 +1,68 @@
+import hashlib
+import shutil
+import subprocess
+
+
+def test_catalog_build_query_and_update(binary_path, generate_overlay_mpq_test_files, tmp_path):
+    """
+    Test cataloguing a directory of MPQ archives and searching it.
+
+    This test checks:
+    - That a name is found in every archive containing it, in any case.
+    - That a mask and an MD5 find the matching files.
+    - That an update drops the archives that were removed.
+    """
+    base_file, overlay_file = generate_overlay_mpq_test_files
+    archives_dir = tmp_path / "archives"
+    (archives_dir / "patches").mkdir(parents=True)
+    shutil.copy(base_file, archives_dir / "base.mpq")
+    shutil.copy(overlay_file, archives_dir / "patches" / "top.mpq")
+    catalog_file = tmp_path / "archives.mpqcat"
+
+    result = subprocess.run(
+        [str(binary_path), "catalog", "build", str(archives_dir), "-o", str(catalog_file), "--hash"],
+        stdout=subprocess.PIPE,
+        stderr=subprocess.PIPE,
+        text=True
+    )
+    assert result.returncode == 0, f"mpqcli failed with error: {result.stderr}"
+    assert "[*] Catalogued" in result.stdout
+
+    def query(*arguments):
+        return subprocess.run(
+            [str(binary_path), "catalog", "query", str(catalog_file), *arguments],
+            stdout=subprocess.PIPE,
+            stderr=subprocess.PIPE,
+            text=True
+        )
+
+    result = query("CATS.TXT")
+    assert result.returncode == 0, f"mpqcli failed with error: {result.stderr}"
+    lines = result.stdout.splitlines()
+    assert len(lines) == 2, f"Unexpected output: {lines}"
+    assert lines[0].endswith("base.mpq cats.txt")
+    assert lines[1].endswith("top.mpq cats.txt")
+
+    result = query("b*.txt")
+    assert result.returncode == 0, f"mpqcli failed with error: {result.stderr}"
+    assert [line.split()[-1] for line in result.stdout.splitlines()] == ["birds.txt"]
+
+    birds_md5 = hashlib.md5(b"This is the overlay file about birds.").hexdigest()
+    result = query("--md5", birds_md5)
+    assert result.returncode == 0, f"mpqcli failed with error: {result.stderr}"
+    lines = result.stdout.splitlines()
+    assert len(lines) == 1 and birds_md5 in lines[0] and lines[0].endswith("top.mpq birds.txt")
+
+    (archives_dir / "patches" / "top.mpq").unlink()
+    result = subprocess.run(
+        [str(binary_path), "catalog", "update", str(catalog_file)],
+        stdout=subprocess.PIPE,
+        stderr=subprocess.PIPE,
+        text=True
+    )
+    assert result.returncode == 0, f"mpqcli failed with error: {result.stderr}"
+    assert "[*] Rescanning 0 of 1 archives, 1 removed" in result.stdout.splitlines()
+
+    result = query("birds.txt")
+    assert result.returncode == 1
+    assert len(query("cats.txt").stdout.splitlines()) == 1
@@ -0,0 +1,172 @@
+import subprocess
+
+
+def read_file(binary_path, file_name, mpq_file):
+    result = subprocess.run(
+        [str(binary_path), "read", file_name, str(mpq_file)],
+        stdout=subprocess.PIPE,
+        stderr=subprocess.PIPE,
+        text=True
+    )
+    return result
+
+
+def test_copy_file_between_mpqs(binary_path, generate_overlay_mpq_test_files):
+    """
+    Test copying a file from one MPQ archive to another.
+
+    This test checks:
+    - That the copied file is added to the target archive.
+    - That files already in the target archive are kept.
+    """
+    base_file, overlay_file = generate_overlay_mpq_test_files
+
+    result = subprocess.run(
+        [str(binary_path), "copy", str(overlay_file), str(base_file), "birds.txt"],
+        stdout=subprocess.PIPE,
+        stderr=subprocess.PIPE,
+        text=True
+    )
+
+    assert result.returncode == 0, f"mpqcli failed with error: {result.stderr}"
+    assert "[*] Copied 1 files (1 without recompression)" in result.stdout
+
+    result = subprocess.run(
+        [str(binary_path), "list", str(base_file)],
+        stdout=subprocess.PIPE,
+        stderr=subprocess.PIPE,
+        text=True
+    )
+    output_lines = set(result.stdout.splitlines())
+    assert output_lines == {"cats.txt", "dogs.txt", "birds.txt"}, f"Unexpected output: {output_lines}"
+
+    result = read_file(binary_path, "birds.txt", base_file)
+    assert result.returncode == 0, f"mpqcli failed with error: {result.stderr}"
+    assert result.stdout.strip() == "This is the overlay file about birds."
+
+
+def test_copy_file_already_exists(binary_path, generate_overlay_mpq_test_files):
+    """
+    Test copying a file that already exists in the target archive.
+
+    This test checks:
+    - That the existing file is kept without --overwrite.
+    - That the existing file is replaced with --overwrite.
+    """
+    base_file, overlay_file = generate_overlay_mpq_test_files
+
+    result = subprocess.run(
+        [str(binary_path), "copy", str(overlay_file), str(base_file), "cats.txt"],
+        stdout=subprocess.PIPE,
+        stderr=subprocess.PIPE,
+        text=True
+    )
+    assert "already exists in MPQ archive: cats.txt" in result.stderr
+    result = read_file(binary_path, "cats.txt", base_file)
+    assert result.stdout.strip() == "This is the base file about cats."
+
+    result = subprocess.run(
+        [str(binary_path), "copy", str(overlay_file), str(base_file), "cats.txt", "--overwrite"],
+        stdout=subprocess.PIPE,
+        stderr=subprocess.PIPE,
+        text=True
+    )
+    assert result.returncode == 0, f"mpqcli failed with error: {result.stderr}"
+    result = read_file(binary_path, "cats.txt", base_file)
+    assert result.stdout.strip() == "This is the overlay file about cats."
+
+
+def test_copy_file_with_new_name(binary_path, generate_overlay_mpq_test_files):
+    """
+    Test copying a file under a new name, using a wildcard.
+
+    This test checks:
+    - That the file is readable under its new name.
+    """
+    base_file, overlay_file = generate_overlay_mpq_test_files
+
+    result = subprocess.run(
+        [str(binary_path), "copy", str(overlay_file), str(base_file), "bird*",
+         "--name-in-archive", "animals\\parrots.txt"],
+        stdout=subprocess.PIPE,
+        stderr=subprocess.PIPE,
+        text=True
+    )
+    assert result.returncode == 0, f"mpqcli failed with error: {result.stderr}"
+
+    result = read_file(binary_path, "animals\\parrots.txt", base_file)
+    assert result.returncode == 0, f"mpqcli failed with error: {result.stderr}"
+    assert result.stdout.strip() == "This is the overlay file about birds."
+
+
+def test_copy_file_no_match(binary_path, generate_overlay_mpq_test_files):
+    """
+    Test copying a file that is not in the source archive.
+
+    This test checks:
+    - That mpqcli fails and leaves the target archive untouched.
+    """
+    base_file, overlay_file = generate_overlay_mpq_test_files
+    original = base_file.read_bytes()
+
+    result = subprocess.run(
+        [str(binary_path), "copy", str(overlay_file), str(base_file), "fish.txt"],
+        stdout=subprocess.PIPE,
+        stderr=subprocess.PIPE,
+        text=True
+    )
+    assert result.returncode == 1, f"mpqcli failed with error: {result.stderr}"
+    assert base_file.read_bytes() == original
+
+
+def test_copy_into_v4_archive_with_attributes(binary_path, generate_overlay_mpq_test_files, tmp_path):
+    """
+    Test copying a file into an archive the rebuild cannot reproduce.
+
+    This test checks:
+    - That the file is added to a format version 4 target with (attributes).
+    - That the target archive keeps its header version and (attributes).
+    """
+    base_file, overlay_file = generate_overlay_mpq_test_files
+    files_dir = base_file.parent / "overlay_base_files"
+    target_file = tmp_path / "target_v4.mpq"
+
+    result = subprocess.run(
+        [str(binary_path), "create", "--version", "4", "--attr-flags", "15",
+         "-o", str(target_file), str(files_dir)],
+        stdout=subprocess.PIPE,
+        stderr=subprocess.PIPE,
+        text=True
+    )
+    assert result.returncode == 0, f"mpqcli failed with error: {result.stderr}"
+
+    result = subprocess.run(
+        [str(binary_path), "copy", str(overlay_file), str(target_file), "birds.txt"],
+        stdout=subprocess.PIPE,
+        stderr=subprocess.PIPE,
+        text=True
+    )
+    assert result.returncode == 0, f"mpqcli failed with error: {result.stderr}"
+    assert "[*] Copied 1 files (0 without recompression) into: " + str(target_file) \
+        in result.stdout.splitlines()
+    assert not target_file.with_name(target_file.name + ".atomic").exists()
+
+    result = read_file(binary_path, "birds.txt", target_file)
+    assert result.returncode == 0, f"mpqcli failed with error: {result.stderr}"
+    assert result.stdout == read_file(binary_path, "birds.txt", overlay_file).stdout
+
+    result = subprocess.run(
+        [str(binary_path), "info", "-p", "format-version", str(target_file)],
+        stdout=subprocess.PIPE,
+        stderr=subprocess.PIPE,
+        text=True
+    )
+    assert result.stdout.strip() == "4"
+
+    result = subprocess.run(
+        [str(binary_path), "list", "-a", str(target_file)],
+        stdout=subprocess.PIPE,
+        stderr=subprocess.PIPE,
+        text=True
+    )
+    assert "(attributes)" in result.stdout.splitlines()
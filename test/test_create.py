@@ -1,5 +1,7 @@
+import io
 import subprocess
 import shutil
+import tarfile
 from pathlib import Path
 
 
@@ -667,6 +669,126 @@ def test_create_mpq_skips_special_files(binary_path, tmp_path):
         assert name not in listing.stdout, f"Special file {name!r} unexpectedly found in archive listing"
 
 
+def test_create_mpq_from_tar_stdin(binary_path, tmp_path):
+    """
+    Test MPQ archive creation from a tar stream piped to stdin.
+
+    This test checks:
+    - That regular files are added with Windows path separators and no "./" prefix.
+    - That directories are not added as files.
+    - That reading the files back returns the tar member content.
+    """
+    members = {
+        "./readme.txt": b"hello",
+        "./units/human/footman.txt": b"Footman data\n" * 2000,
+    }
+    buffer = io.BytesIO()
+    with tarfile.open(fileobj=buffer, mode="w") as tar:
+        directory = tarfile.TarInfo("./units/human")
+        directory.type = tarfile.DIRTYPE
+        tar.addfile(directory)
+        for name, content in members.items():
+            info = tarfile.TarInfo(name)
+            info.size = len(content)
+            tar.addfile(info, io.BytesIO(content))
+
+    output_file = tmp_path / "output.mpq"
+    result = subprocess.run(
+        [str(binary_path), "create", "-", "--from-tar", "-o", str(output_file)],
+        input=buffer.getvalue(),
+        stdout=subprocess.PIPE,
+        stderr=subprocess.PIPE,
+    )
+
+    assert result.returncode == 0, f"mpqcli failed with error: {result.stderr}"
+    assert output_file.exists(), "MPQ file was not created"
+
+    listing = subprocess.run(
+        [str(binary_path), "list", str(output_file)],
+        stdout=subprocess.PIPE,
+        stderr=subprocess.PIPE,
+        text=True
+    )
+    assert listing.returncode == 0, f"mpqcli list failed with error: {listing.stderr}"
+    assert set(listing.stdout.splitlines()) == {"readme.txt", "units\\human\\footman.txt"}
+
+    for name, content in members.items():
+        read = subprocess.run(
+            [str(binary_path), "read", name[2:].replace("/", "\\"), str(output_file)],
+            stdout=subprocess.PIPE,
+            stderr=subprocess.PIPE,
+        )
+        assert read.returncode == 0, f"mpqcli read failed with error: {read.stderr}"
+        assert read.stdout == content, f"Content of {name} differs"
+
+
+def test_create_mpq_from_gnu_tar_with_times(binary_path, tmp_path):
+    """
+    Test MPQ archive creation from a GNU tar stream with access and change times.
+
+    This test checks:
+    - That the times GNU tar keeps where POSIX ustar has the path prefix are not
+      prepended to the path.
+    """
+    content = b"Footman data\n"
+    buffer = io.BytesIO()
+    with tarfile.open(fileobj=buffer, mode="w", format=tarfile.GNU_FORMAT) as tar:
+        info = tarfile.TarInfo("units/footman.txt")
+        info.size = len(content)
+        tar.addfile(info, io.BytesIO(content))
+    tar_data = bytearray(buffer.getvalue())
+    assert tar_data[257:265] == b"ustar  \0"
+
+    # Set the GNU atime and ctime fields, then fix the header checksum
+    tar_data[345:357] = b"14712345670\0"
+    tar_data[357:369] = b"14712345670\0"
+    tar_data[148:156] = b" " * 8
+    tar_data[148:156] = b"%06o\0 " % sum(tar_data[:512])
+
+    output_file = tmp_path / "output.mpq"
+    result = subprocess.run(
+        [str(binary_path), "create", "-", "--from-tar", "-o", str(output_file)],
+        input=bytes(tar_data),
+        stdout=subprocess.PIPE,
+        stderr=subprocess.PIPE,
+    )
+    assert result.returncode == 0, f"mpqcli failed with error: {result.stderr}"
+
+    listing = subprocess.run(
+        [str(binary_path), "list", str(output_file)],
+        stdout=subprocess.PIPE,
+        stderr=subprocess.PIPE,
+        text=True
+    )
+    assert listing.returncode == 0, f"mpqcli list failed with error: {listing.stderr}"
+    assert listing.stdout.splitlines() == ["units\\footman.txt"]
+
+
+def test_create_mpq_from_truncated_tar(binary_path, tmp_path):
+    """
+    Test MPQ archive creation from a tar stream that ends in the middle of a file.
+
+    This test checks:
+    - That the creation fails and no partial archive is left behind.
+    """
+    buffer = io.BytesIO()
+    with tarfile.open(fileobj=buffer, mode="w") as tar:
+        info = tarfile.TarInfo("large.bin")
+        info.size = 100000
+        tar.addfile(info, io.BytesIO(b"x" * info.size))
+
+    output_file = tmp_path / "output.mpq"
+    result = subprocess.run(
+        [str(binary_path), "create", "-", "--from-tar", "-o", str(output_file)],
+        input=buffer.getvalue()[:50000],
+        stdout=subprocess.PIPE,
+        stderr=subprocess.PIPE,
+    )
+
+    assert result.returncode == 1, f"mpqcli unexpectedly succeeded: {result.stdout}"
+    assert not output_file.exists(), "Partial MPQ file was left behind"
+
+
 def verify_archive_file_content(binary_path, test_file, expected_output):
     result = subprocess.run(
         [str(binary_path), "list", str(test_file), "-d", "-p", "locale"],
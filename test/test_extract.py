@@ -1,4 +1,8 @@
+import hashlib
+import json
 import os
+import random
+import re
 import shutil
 import subprocess
 from pathlib import Path
@@ -761,3 +765,391 @@ def test_extract_path_traversal_is_blocked(binary_path, generate_path_traversal_
 
     # Confirm no file escaped outside the intended output directory
     assert not (output_dir.parent / "sneaky.txt").exists(), "Path traversal was not blocked: sneaky.txt escaped"
+
+
+def test_extract_mpq_with_overlay(binary_path, generate_overlay_mpq_test_files):
+    """
+    Test MPQ archive extraction of an overlay archive stack.
+
+    This test checks:
+    - That every file of the stack is extracted once.
+    - That files provided by several archives come from the highest-priority archive.
+    """
+    base_file, overlay_file = generate_overlay_mpq_test_files
+    output_dir = base_file.parent / "extracted_overlay"
+    if output_dir.exists():
+        shutil.rmtree(output_dir)
+
+    result = subprocess.run(
+        [str(binary_path), "extract", "-o", str(output_dir), str(base_file), "--overlay", str(overlay_file)],
+        stdout=subprocess.PIPE,
+        stderr=subprocess.PIPE,
+        text=True
+    )
+
+    expected_content = {
+        "cats.txt": "This is the overlay file about cats.",
+        "dogs.txt": "This is the base file about dogs.",
+        "birds.txt": "This is the overlay file about birds.",
+    }
+
+    assert result.returncode == 0, f"mpqcli failed with error: {result.stderr}"
+    for file_name, content in expected_content.items():
+        assert (output_dir / file_name).read_text() == content, f"Unexpected content: {file_name}"
+
+
+def test_extract_mpq_with_bandwidth(binary_path, generate_test_files):
+    """
+    Test MPQ archive extraction with a bandwidth report.
+
+    This test checks:
+    - That all files are still extracted.
+    - That the last line reports the read bandwidth.
+    """
+    _ = generate_test_files
+    script_dir = Path(__file__).parent
+    test_file = script_dir / "data" / "mpq_with_output_v1.mpq"
+    output_dir = script_dir / "data" / "extracted_bandwidth"
+    if output_dir.exists():
+        shutil.rmtree(output_dir)
+
+    result = subprocess.run(
+        [str(binary_path), "extract", "-o", str(output_dir), "--bandwidth", str(test_file)],
+        stdout=subprocess.PIPE,
+        stderr=subprocess.PIPE,
+        text=True
+    )
+
+    expected_output = {
+        "cats.txt",
+        "dogs.txt",
+        "bytes",
+        "(listfile)",
+        "(attributes)",
+    }
+    output_lines = result.stdout.splitlines()
+    output_files = set(fi.name for fi in output_dir.glob("*"))
+
+    assert result.returncode == 0, f"mpqcli failed with error: {result.stderr}"
+    assert output_files == expected_output, f"Unexpected files: {output_files}"
+    assert set(output_lines[:-1]) == {f"[*] Extracted: {line}" for line in expected_output}
+    assert re.fullmatch(r"\[\*\] Read \d+\.\d\d MiB from the archive in \d+\.\d\d s \(\d+\.\d\d MiB/s\)",
+                        output_lines[-1]), f"Unexpected report: {output_lines[-1]}"
+
+
+def test_extract_stored_file(binary_path, generate_stored_mpq):
+    """
+    Test extracting a file stored without compression.
+
+    This test checks:
+    - That the extracted file matches the added file.
+    """
+    mpq_file, content = generate_stored_mpq
+    output_dir = mpq_file.parent / "extracted_stored"
+    if output_dir.exists():
+        shutil.rmtree(output_dir)
+
+    result = subprocess.run(
+        [str(binary_path), "extract", "-o", str(output_dir), "-f", "video.bin", str(mpq_file)],
+        stdout=subprocess.PIPE,
+        stderr=subprocess.PIPE,
+        text=True
+    )
+
+    assert result.returncode == 0, f"mpqcli failed with error: {result.stderr}"
+    assert result.stdout.splitlines() == ["[*] Extracted: video.bin"]
+    assert (output_dir / "video.bin").read_bytes() == content, "Stored file content differs"
+
+
+def test_extract_mpq_with_stats_and_trace(binary_path, generate_test_files):
+    """
+    Test MPQ archive extraction with --stats and --trace.
+
+    This test checks:
+    - That the stats report goes to stderr and counts every file.
+    - That the trace file is valid JSON with a span per extracted file.
+    """
+    _ = generate_test_files
+    script_dir = Path(__file__).parent
+    test_file = script_dir / "data" / "mpq_with_output_v1.mpq"
+    output_dir = script_dir / "data" / "extracted_stats"
+    trace_file = script_dir / "data" / "extract_trace.json"
+    if output_dir.exists():
+        shutil.rmtree(output_dir)
+
+    result = subprocess.run(
+        [str(binary_path), "extract", "-o", str(output_dir), str(test_file),
+         "--stats", "--trace", str(trace_file)],
+        stdout=subprocess.PIPE,
+        stderr=subprocess.PIPE,
+        text=True
+    )
+
+    expected_output = {
+        "cats.txt",
+        "dogs.txt",
+        "bytes",
+        "(listfile)",
+        "(attributes)",
+    }
+    output_lines = result.stdout.splitlines()
+    trace = json.loads(trace_file.read_text())
+    file_spans = {event["name"] for event in trace["traceEvents"] if event.get("cat") == "extract"}
+
+    assert result.returncode == 0, f"mpqcli failed with error: {result.stderr}"
+    assert set(output_lines) == {f"[*] Extracted: {line}" for line in expected_output}
+    assert "[*] Stats:" in result.stderr, f"Missing stats: {result.stderr}"
+    assert re.search(r"Files: 5, Bytes: \d+", result.stderr), f"Unexpected stats: {result.stderr}"
+    assert file_spans == expected_output, f"Unexpected file spans: {file_spans}"
+
+
+def test_extract_all_locales_with_link_identical(binary_path, generate_locales_mpq_test_files, tmp_path):
+    """
+    Test extracting every locale of every file in one pass.
+
+    This test checks:
+    - That each locale of a file is extracted into the directory of its locale.
+    - That a file identical to another locale of it is a hard link to that file.
+    """
+    _ = generate_locales_mpq_test_files
+    script_dir = Path(__file__).parent
+    test_file = tmp_path / "locales.mpq"
+    shutil.copy(script_dir / "data" / "mpq_with_many_locales.mpq", test_file)
+    output_dir = tmp_path / "extracted"
+
+    # The same file under two locales
+    dogs_file = tmp_path / "dogs.txt"
+    dogs_file.write_text("This is a file about dogs.", newline="\n")
+    for locale in ["deDE", "esES"]:
+        result = subprocess.run(
+            [str(binary_path), "add", str(dogs_file), str(test_file), "--locale", locale],
+            stdout=subprocess.PIPE,
+            stderr=subprocess.PIPE,
+            text=True
+        )
+        assert result.returncode == 0, f"mpqcli failed with error: {result.stderr}"
+
+    result = subprocess.run(
+        [str(binary_path), "extract", "--all-locales", "--link-identical", "-o", str(output_dir), str(test_file)],
+        stdout=subprocess.PIPE,
+        stderr=subprocess.PIPE,
+        text=True
+    )
+
+    expected_content = {
+        Path("neutral") / "cats.txt": "This is a file about cats.",
+        Path("041D") / "cats.txt": "Detta är en fil om katter.",
+        Path("deDE") / "cats.txt": "Dies ist eine Datei über Katzen.",
+        Path("esES") / "cats.txt": "Este es un archivo sobre gatos.",
+        Path("deDE") / "dogs.txt": "This is a file about dogs.",
+        Path("esES") / "dogs.txt": "This is a file about dogs.",
+    }
+
+    assert result.returncode == 0, f"mpqcli failed with error: {result.stderr}"
+    for file_path, content in expected_content.items():
+        output_file = output_dir / file_path
+        assert output_file.exists(), f"File was not extracted: {file_path}"
+        assert output_file.read_text(encoding="utf-8") == content, f"Unexpected file content: {file_path}"
+    assert os.path.samefile(output_dir / "deDE" / "dogs.txt", output_dir / "esES" / "dogs.txt")
+    assert not os.path.samefile(output_dir / "deDE" / "cats.txt", output_dir / "esES" / "cats.txt")
+    assert "[*] Linked 1 files identical to another locale" in result.stdout.splitlines()
+
+
+def test_extract_mpq_into_content_store(binary_path, generate_test_files, tmp_path):
+    """
+    Test extracting an MPQ archive through a content-addressed store.
+
+    This test checks:
+    - That the extracted files have the content of the archived files.
+    - That a second extraction stores nothing new and links to the same stored content.
+    """
+    _ = generate_test_files
+    script_dir = Path(__file__).parent
+    test_file = script_dir / "data" / "mpq_with_output_v1.mpq"
+    store_dir = tmp_path / "store"
+    output_dirs = [tmp_path / "first", tmp_path / "second"]
+
+    results = []
+    for output_dir in output_dirs:
+        result = subprocess.run(
+            [str(binary_path), "extract", "--cas", str(store_dir), "--trust-attributes", "-o", str(output_dir), str(test_file)],
+            stdout=subprocess.PIPE,
+            stderr=subprocess.PIPE,
+            text=True
+        )
+        assert result.returncode == 0, f"mpqcli failed with error: {result.stderr}"
+        results.append(result)
+
+    assert (output_dirs[0] / "cats.txt").read_text() == "This is a file about cats.\n"
+    assert (output_dirs[0] / "dogs.txt").read_text() == "This is a file about dogs.\n"
+    for file_name in ["cats.txt", "dogs.txt", "bytes"]:
+        assert os.path.samefile(output_dirs[0] / file_name, output_dirs[1] / file_name)
+    assert "[*] Extracted: cats.txt" in results[1].stdout.splitlines()
+    assert any(line.startswith("[*] Content store: 0 stored,") for line in results[1].stdout.splitlines())
+
+
+def test_extract_mpq_into_content_store_with_md5_collision(binary_path, generate_test_files, tmp_path):
+    """
+    Test extracting into a content store that has other content under the MD5 of a file.
+
+    This test checks:
+    - That a file is not linked to stored content that only shares its MD5.
+    - That the stored content is kept, and the collision is reported.
+    """
+    _ = generate_test_files
+    script_dir = Path(__file__).parent
+    test_file = script_dir / "data" / "mpq_with_output_v1.mpq"
+    store_dir = tmp_path / "store"
+    output_dir = tmp_path / "output"
+
+    # Stand in for a real collision by storing other content under the MD5 of cats.txt
+    digest = hashlib.md5(b"This is a file about cats.\n").hexdigest()
+    object_file = store_dir / digest[:2] / digest[2:]
+    object_file.parent.mkdir(parents=True)
+    object_file.write_text("This is not a file about cats.\n")
+
+    result = subprocess.run(
+        [str(binary_path), "extract", "--cas", str(store_dir), "-o", str(output_dir), str(test_file)],
+        stdout=subprocess.PIPE,
+        stderr=subprocess.PIPE,
+        text=True
+    )
+
+    assert result.returncode == 0, f"mpqcli failed with error: {result.stderr}"
+    assert (output_dir / "cats.txt").read_text() == "This is a file about cats.\n"
+    assert not os.path.samefile(output_dir / "cats.txt", object_file)
+    assert object_file.read_text() == "This is not a file about cats.\n"
+    assert "other content with the same MD5 as: cats.txt" in result.stderr
+    assert "[*] Extracted 1 files outside the content store, because of MD5 collisions" in result.stdout.splitlines()
+
+
+def test_extract_many_files_byte_for_byte(binary_path, tmp_path):
+    """
+    Test extracting an archive with more files than the async writer keeps in flight.
+
+    This test checks:
+    - That every extracted file is byte-identical to the file that was added,
+      whether the files are written through io_uring or one after another.
+    """
+    files_dir = tmp_path / "many_files"
+    expected_content = {}
+    for i in range(150):
+        size = 1 + (i * 7919) % (64 * 1024)
+        content = bytes((j * (i + 3) + (j >> 10)) % 256 for j in range(size))
+        relative_path = Path(f"dir{i % 3}") / f"file{i:03}.bin"
+        (files_dir / relative_path).parent.mkdir(parents=True, exist_ok=True)
+        (files_dir / relative_path).write_bytes(content)
+        expected_content[relative_path] = content
+
+    mpq_file = tmp_path / "many_files.mpq"
+    result = subprocess.run(
+        [str(binary_path), "create", "-o", str(mpq_file), str(files_dir)],
+        stdout=subprocess.PIPE,
+        stderr=subprocess.PIPE,
+        text=True
+    )
+    assert result.returncode == 0, f"mpqcli failed with error: {result.stderr}"
+
+    output_dir = tmp_path / "extracted"
+    result = subprocess.run(
+        [str(binary_path), "extract", "-o", str(output_dir), str(mpq_file)],
+        stdout=subprocess.PIPE,
+        stderr=subprocess.PIPE,
+        text=True
+    )
+    assert result.returncode == 0, f"mpqcli failed with error: {result.stderr}"
+
+    for relative_path, content in expected_content.items():
+        output_file = output_dir / relative_path
+        assert output_file.exists(), f"File was not extracted: {relative_path}"
+        assert output_file.read_bytes() == content, f"Unexpected file content: {relative_path}"
+
+
+def test_extract_stored_file_with_patch(binary_path, generate_stored_mpq, tmp_path):
+    """
+    Test extracting a stored file that a patch archive replaces.
+
+    This test checks:
+    - That the patched content is extracted, not the stored bytes of the base archive,
+      both when extracting all files and a single file.
+    """
+    mpq_file, content = generate_stored_mpq
+
+    # The same name with different content, also stored without compression
+    patch_dir = tmp_path / "patch_files"
+    patch_dir.mkdir()
+    patched_content = bytes(reversed(content))
+    (patch_dir / "video.bin").write_bytes(patched_content)
+    patch_file = tmp_path / "patch.mpq"
+    result = subprocess.run(
+        [str(binary_path), "create", "-o", str(patch_file), "--flags", "2147483648", str(patch_dir)],
+        stdout=subprocess.PIPE,
+        stderr=subprocess.PIPE,
+        text=True
+    )
+    assert result.returncode == 0, f"mpqcli failed with error: {result.stderr}"
+
+    for arguments in [[], ["-f", "video.bin"]]:
+        output_dir = tmp_path / f"extracted{len(arguments)}"
+        result = subprocess.run(
+            [str(binary_path), "extract", "-o", str(output_dir), *arguments, str(mpq_file),
+             "--patch", str(patch_file)],
+            stdout=subprocess.PIPE,
+            stderr=subprocess.PIPE,
+            text=True
+        )
+        assert result.returncode == 0, f"mpqcli failed with error: {result.stderr}"
+        assert (output_dir / "video.bin").read_bytes() == patched_content, "Patched content differs"
+
+
+def test_extract_large_files_around_parallel_threshold(binary_path, tmp_path):
+    """
+    Test extracting compressed files at and just under the 64 MiB parallel read threshold.
+
+    This test checks:
+    - That a file decompressed on several threads is byte-identical to the added file.
+    - That a file just under the threshold, read on one thread, is byte-identical too.
+    - That reading the large file to stdout returns the same bytes.
+    """
+    threshold = 64 * 1024 * 1024
+    generator = random.Random(39)
+    # Random blocks between runs of zeros, so the data compresses but not trivially
+    block = generator.randbytes(4096) + bytes(4096)
+    pattern = b"".join(generator.randbytes(64) + block[generator.randrange(4096):]
+                       for _ in range(64))
+
+    files_dir = tmp_path / "large_files"
+    files_dir.mkdir()
+    expected_content = {}
+    for name, size in [("parallel.bin", threshold), ("serial.bin", threshold - 1)]:
+        content = (pattern * (size // len(pattern) + 1))[:size]
+        (files_dir / name).write_bytes(content)
+        expected_content[name] = content
+
+    mpq_file = tmp_path / "large_files.mpq"
+    result = subprocess.run(
+        [str(binary_path), "create", "-o", str(mpq_file), str(files_dir)],
+        stdout=subprocess.PIPE,
+        stderr=subprocess.PIPE,
+        text=True
+    )
+    assert result.returncode == 0, f"mpqcli failed with error: {result.stderr}"
+
+    output_dir = tmp_path / "extracted"
+    result = subprocess.run(
+        [str(binary_path), "extract", "-o", str(output_dir), str(mpq_file)],
+        stdout=subprocess.PIPE,
+        stderr=subprocess.PIPE,
+        text=True
+    )
+    assert result.returncode == 0, f"mpqcli failed with error: {result.stderr}"
+    for name, content in expected_content.items():
+        assert (output_dir / name).read_bytes() == content, f"Unexpected file content: {name}"
+
+    result = subprocess.run(
+        [str(binary_path), "read", "parallel.bin", str(mpq_file)],
+        stdout=subprocess.PIPE,
+        stderr=subprocess.PIPE,
+    )
+    assert result.returncode == 0, f"mpqcli failed with error: {result.stderr}"
+    assert result.stdout == expected_content["parallel.bin"], "Read file content differs"
@@ -0,0 +1,286 @@
+import hashlib
+import shutil
+import struct
+import subprocess
+from pathlib import Path
+
+
+def test_flatten_mpq_with_overlay(binary_path, generate_overlay_mpq_test_files):
+    """
+    Test flattening an archive with an overlay archive on top.
+
+    This test checks:
+    - That files from all archives are merged into the output archive.
+    - That the highest-priority version of a file wins.
+    - That files are copied without recompression.
+    """
+    base_file, overlay_file = generate_overlay_mpq_test_files
+    output_file = base_file.parent / "overlay_flat.mpq"
+    output_file.unlink(missing_ok=True)
+
+    result = subprocess.run(
+        [str(binary_path), "flatten", str(base_file), "--overlay", str(overlay_file),
+         "-o", str(output_file)],
+        stdout=subprocess.PIPE,
+        stderr=subprocess.PIPE,
+        text=True
+    )
+
+    assert result.returncode == 0, f"mpqcli failed with error: {result.stderr}"
+    assert "[*] Flattened 3 files (3 copied without recompression)" in result.stdout
+    assert output_file.exists(), "MPQ file was not created"
+
+    result = subprocess.run(
+        [str(binary_path), "list", str(output_file)],
+        stdout=subprocess.PIPE,
+        stderr=subprocess.PIPE,
+        text=True
+    )
+
+    output_lines = set(result.stdout.splitlines())
+    assert result.returncode == 0, f"mpqcli failed with error: {result.stderr}"
+    assert output_lines == {"cats.txt", "dogs.txt", "birds.txt"}, f"Unexpected output: {output_lines}"
+
+    expected_content = {
+        "cats.txt": "This is the overlay file about cats.",
+        "dogs.txt": "This is the base file about dogs.",
+        "birds.txt": "This is the overlay file about birds.",
+    }
+    for file_name, content in expected_content.items():
+        result = subprocess.run(
+            [str(binary_path), "read", file_name, str(output_file)],
+            stdout=subprocess.PIPE,
+            stderr=subprocess.PIPE,
+            text=True
+        )
+        assert result.returncode == 0, f"mpqcli failed with error: {result.stderr}"
+        assert result.stdout.strip() == content, f"Unexpected output: {result.stdout}"
+
+
+def test_flatten_mpq_with_encrypted_files(binary_path):
+    """
+    Test flattening an archive whose files are encrypted with a position-dependent key.
+
+    This test checks:
+    - That encrypted files are readable after being moved to a new position.
+    - That files spanning several sectors are copied correctly.
+    """
+    script_dir = Path(__file__).parent
+    files_dir = script_dir / "data" / "flatten_files"
+    shutil.rmtree(files_dir, ignore_errors=True)
+    files_dir.mkdir(parents=True, exist_ok=True)
+
+    files = {
+        "cats.txt": "This is a file about cats.",
+        "big.txt": "".join(f"Line {i} of a file spanning several sectors.\n" for i in range(2000)),
+    }
+    for file_name, content in files.items():
+        (files_dir / file_name).write_text(content, newline="\n")
+
+    source_file = script_dir / "data" / "flatten_encrypted.mpq"
+    output_file = script_dir / "data" / "flatten_encrypted_flat.mpq"
+    source_file.unlink(missing_ok=True)
+    output_file.unlink(missing_ok=True)
+
+    # The Diablo II profile encrypts every file with MPQ_FILE_KEY_V2
+    result = subprocess.run(
+        [str(binary_path), "create", "-g", "d2", "-o", str(source_file), str(files_dir)],
+        stdout=subprocess.PIPE,
+        stderr=subprocess.PIPE,
+        text=True
+    )
+    assert result.returncode == 0, f"mpqcli failed with error: {result.stderr}"
+
+    result = subprocess.run(
+        [str(binary_path), "flatten", str(source_file), "-o", str(output_file)],
+        stdout=subprocess.PIPE,
+        stderr=subprocess.PIPE,
+        text=True
+    )
+    assert result.returncode == 0, f"mpqcli failed with error: {result.stderr}"
+
+    for file_name, content in files.items():
+        result = subprocess.run(
+            [str(binary_path), "read", file_name, str(output_file)],
+            stdout=subprocess.PIPE,
+            stderr=subprocess.PIPE,
+            text=True
+        )
+        assert result.returncode == 0, f"mpqcli failed with error: {result.stderr}"
+        assert result.stdout.strip() == content.strip(), f"Unexpected content for {file_name}"
+
+
+def make_copy_patch(before, after):
+    """
+    Build an incremental patch (PTCH) file whose COPY transform replaces the content.
+    """
+    header_size = 0x44
+    return (b"PTCH" + struct.pack("<III", header_size + len(after), len(before), len(after))
+            + b"MD5_" + struct.pack("<I", 0x28)
+            + hashlib.md5(before).digest() + hashlib.md5(after).digest()
+            + b"XFRM" + struct.pack("<I", 12 + len(after)) + b"COPY" + after)
+
+
+def test_flatten_mpq_with_patch(binary_path, tmp_path):
+    """
+    Test flattening an archive with a patch archive applied.
+
+    This test checks:
+    - That a file changed by an incremental patch gets its patched content.
+    - That a file the patch archive replaces whole gets the content of the patch archive.
+    - That a file only the patch archive has is added.
+    - That a file no patch touches keeps its content.
+    """
+    base_dir = tmp_path / "base_files"
+    base_dir.mkdir()
+    base_content = {
+        "cats.txt": b"This is a file about cats.\n",
+        "dogs.txt": b"This is a file about dogs.\n",
+        "fish.txt": b"This is a file about fish.\n",
+    }
+    for file_name, content in base_content.items():
+        (base_dir / file_name).write_bytes(content)
+    base_file = tmp_path / "base.mpq"
+    result = subprocess.run(
+        [str(binary_path), "create", "-o", str(base_file), str(base_dir)],
+        stdout=subprocess.PIPE,
+        stderr=subprocess.PIPE,
+        text=True
+    )
+    assert result.returncode == 0, f"mpqcli failed with error: {result.stderr}"
+
+    expected_content = dict(base_content)
+    expected_content["cats.txt"] = b"This is a patched file about cats.\n"
+    expected_content["dogs.txt"] = b"This is a replaced file about dogs.\n"
+    expected_content["birds.txt"] = b"This is a new file about birds.\n"
+
+    # cats.txt is an incremental patch file (MPQ_FILE_EXISTS | MPQ_FILE_PATCH_FILE)
+    patch_dir = tmp_path / "patch_files"
+    patch_dir.mkdir()
+    (patch_dir / "cats.txt").write_bytes(
+        make_copy_patch(base_content["cats.txt"], expected_content["cats.txt"]))
+    patch_file = tmp_path / "patch.mpq"
+    result = subprocess.run(
+        [str(binary_path), "create", "-o", str(patch_file), "--flags", "2148532224", str(patch_dir)],
+        stdout=subprocess.PIPE,
+        stderr=subprocess.PIPE,
+        text=True
+    )
+    assert result.returncode == 0, f"mpqcli failed with error: {result.stderr}"
+
+    # dogs.txt replaces the base file whole, birds.txt is only in the patch archive
+    for file_name in ["dogs.txt", "birds.txt"]:
+        local_file = tmp_path / file_name
+        local_file.write_bytes(expected_content[file_name])
+        result = subprocess.run(
+            [str(binary_path), "add", str(local_file), str(patch_file)],
+            stdout=subprocess.PIPE,
+            stderr=subprocess.PIPE,
+            text=True
+        )
+        assert result.returncode == 0, f"mpqcli failed with error: {result.stderr}"
+
+    output_file = tmp_path / "flat.mpq"
+    result = subprocess.run(
+        [str(binary_path), "flatten", str(base_file), "-o", str(output_file),
+         "--patch", str(patch_file)],
+        stdout=subprocess.PIPE,
+        stderr=subprocess.PIPE,
+        text=True
+    )
+    assert result.returncode == 0, f"mpqcli failed with error: {result.stderr}"
+
+    output_dir = tmp_path / "extracted"
+    result = subprocess.run(
+        [str(binary_path), "extract", "-o", str(output_dir), str(output_file)],
+        stdout=subprocess.PIPE,
+        stderr=subprocess.PIPE,
+        text=True
+    )
+    assert result.returncode == 0, f"mpqcli failed with error: {result.stderr}"
+    for file_name, content in expected_content.items():
+        assert (output_dir / file_name).read_bytes() == content, f"Unexpected content for {file_name}"
+
+
+def test_flatten_mpq_output_exists(binary_path, generate_overlay_mpq_test_files):
+    """
+    Test flattening into an output archive that already exists.
+
+    This test checks:
+    - That the existing archive is not overwritten.
+    """
+    base_file, overlay_file = generate_overlay_mpq_test_files
+
+    result = subprocess.run(
+        [str(binary_path), "flatten", str(base_file), "--overlay", str(overlay_file),
+         "-o", str(overlay_file)],
+        stdout=subprocess.PIPE,
+        stderr=subprocess.PIPE,
+        text=True
+    )
+
+    assert result.returncode == 1, f"mpqcli failed with error: {result.stderr}"
+
+
+def test_flatten_mpq_recompressed_with_threads(binary_path):
+    """
+    Test flattening a large file that is recompressed, with one and with several threads.
+
+    This test checks:
+    - That compressing the sectors of a large file on several threads gives the same archive.
+    - That the recompressed file is read back unchanged.
+    """
+    script_dir = Path(__file__).parent
+    base_dir = script_dir / "data" / "flatten_threads_base"
+    overlay_dir = script_dir / "data" / "flatten_threads_overlay"
+    for files_dir in (base_dir, overlay_dir):
+        shutil.rmtree(files_dir, ignore_errors=True)
+        files_dir.mkdir(parents=True, exist_ok=True)
+
+    (base_dir / "cats.txt").write_text("This is a file about cats.", newline="\n")
+    # Compressible, and spanning several hundred sectors
+    big_content = "".join(f"Line {i} of a large compressible file.\n" for i in range(50000))
+    (overlay_dir / "big.txt").write_text(big_content, newline="\n")
+
+    base_file = script_dir / "data" / "flatten_threads_base.mpq"
+    overlay_file = script_dir / "data" / "flatten_threads_overlay.mpq"
+    base_file.unlink(missing_ok=True)
+    overlay_file.unlink(missing_ok=True)
+
+    # A different sector size makes flatten recompress the files of the overlay
+    for archive, files_dir, sector_size in ((base_file, base_dir, "4096"),
+                                            (overlay_file, overlay_dir, "8192")):
+        result = subprocess.run(
+            [str(binary_path), "create", "--sector-size", sector_size, "-o", str(archive),
+             str(files_dir)],
+            stdout=subprocess.PIPE,
+            stderr=subprocess.PIPE,
+            text=True
+        )
+        assert result.returncode == 0, f"mpqcli failed with error: {result.stderr}"
+
+    output_files = []
+    for threads in ("1", "4"):
+        output_file = script_dir / "data" / f"flatten_threads_{threads}.mpq"
+        output_file.unlink(missing_ok=True)
+        result = subprocess.run(
+            [str(binary_path), "flatten", str(base_file), "-o", str(output_file),
+             "-j", threads, "--overlay", str(overlay_file)],
+            stdout=subprocess.PIPE,
+            stderr=subprocess.PIPE,
+            text=True
+        )
+        assert result.returncode == 0, f"mpqcli failed with error: {result.stderr}"
+        output_files.append(output_file)
+
+    assert output_files[0].read_bytes() == output_files[1].read_bytes(), \
+        "Archives compressed with 1 and 4 threads differ"
+
+    result = subprocess.run(
+        [str(binary_path), "read", "big.txt", str(output_files[1])],
+        stdout=subprocess.PIPE,
+        stderr=subprocess.PIPE,
+        text=True
+    )
+    assert result.returncode == 0, f"mpqcli failed with error: {result.stderr}"
+    assert result.stdout.strip() == big_content.strip(), "Unexpected content for big.txt"
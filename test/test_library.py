@@ -0,0 +1,34 @@
+import platform
+import subprocess
+from pathlib import Path
+
+import pytest
+
+
+def test_library_archive_api():
+    """
+    Test the MpqArchive API of libmpqcli, through the mpqcli_archive_test program.
+
+    This test checks:
+    - That archives are created, opened, listed, read, extracted and closed in-process.
+    - That opening a missing archive, and finding, reading, extracting or removing a
+      missing file, fail without leaving the archive in a bad state.
+    """
+    script_dir = Path(__file__).parent
+    if platform.system() == "Windows":
+        binary = script_dir.parent / "build" / "bin" / "mpqcli_archive_test.exe"
+    else:
+        binary = script_dir.parent / "build" / "bin" / "mpqcli_archive_test"
+
+    if not binary.exists():
+        pytest.skip(f"Library test not built (BUILD_LIBRARY_TESTS=OFF): {binary}")
+
+    result = subprocess.run(
+        [str(binary)],
+        stdout=subprocess.PIPE,
+        stderr=subprocess.PIPE,
+        text=True
+    )
+
+    assert result.returncode == 0, f"Library checks failed: {result.stderr}"
+    assert "[*] All library checks passed" in result.stdout.splitlines()
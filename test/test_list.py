@@ -358,3 +358,76 @@ def test_list_mpq_providing_complete_external_listfile(binary_path, generate_mpq
     assert len(result.stdout.splitlines()) == len(expected_output)
     assert result.returncode == 0, f"mpqcli failed with error: {result.stderr}"
     assert output_lines == expected_output, f"Unexpected output: {output_lines}"
+
+
+def test_list_mpq_with_overlay(binary_path, generate_overlay_mpq_test_files):
+    """
+    Test MPQ file listing of an archive with an overlay archive on top.
+
+    This test checks:
+    - That files from all archives in the stack are listed.
+    - That a file provided by several archives is only listed once.
+    """
+    base_file, overlay_file = generate_overlay_mpq_test_files
+
+    expected_output = {
+        "cats.txt",
+        "dogs.txt",
+        "birds.txt",
+    }
+
+    result = subprocess.run(
+        [str(binary_path), "list", str(base_file), "--overlay", str(overlay_file)],
+        stdout=subprocess.PIPE,
+        stderr=subprocess.PIPE,
+        text=True
+    )
+
+    output_lines = set(result.stdout.splitlines())
+    assert len(result.stdout.splitlines()) == len(expected_output)
+    assert result.returncode == 0, f"mpqcli failed with error: {result.stderr}"
+    assert output_lines == expected_output, f"Unexpected output: {output_lines}"
+
+
+def test_list_mpq_with_index(binary_path, generate_locales_mpq_test_files):
+    """
+    Test MPQ file listing using the sidecar index.
+
+    This test checks:
+    - That the index is written next to the archive on first use.
+    - That listings from a built and from a loaded index match the plain listing.
+    - That the index is rebuilt after the archive changes.
+    """
+    mpq_many_locales_file_name, _ = generate_locales_mpq_test_files
+    index_file = Path(str(mpq_many_locales_file_name) + ".mpqidx")
+    index_file.unlink(missing_ok=True)
+
+    def list_files(*arguments):
+        result = subprocess.run(
+            [str(binary_path), "list", str(mpq_many_locales_file_name), "-a", "-d", *arguments],
+            stdout=subprocess.PIPE,
+            stderr=subprocess.PIPE,
+            text=True
+        )
+        assert result.returncode == 0, f"mpqcli failed with error: {result.stderr}"
+        return result.stdout
+
+    expected_output = list_files()
+    assert list_files("--index") == expected_output
+    assert index_file.exists()
+    assert list_files("--index") == expected_output
+
+    new_file = mpq_many_locales_file_name.parent / "index_fish.txt"
+    new_file.write_text("This is a file about fish.", newline="\n")
+    result = subprocess.run(
+        [str(binary_path), "add", str(new_file), str(mpq_many_locales_file_name)],
+        stdout=subprocess.PIPE,
+        stderr=subprocess.PIPE,
+        text=True
+    )
+    assert result.returncode == 0, f"mpqcli failed with error: {result.stderr}"
+
+    output = list_files("--index")
+    assert "index_fish.txt" in output
+    assert output == list_files()
+    index_file.unlink()
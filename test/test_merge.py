@@ -0,0 +1,62 @@
+import subprocess
+
+
+def test_merge_mpqs(binary_path, generate_overlay_mpq_test_files):
+    """
+    Test merging two MPQ archives into a new archive.
+
+    This test checks:
+    - That files from both archives are in the merged archive.
+    - That the later archive wins for files in both archives.
+    """
+    base_file, overlay_file = generate_overlay_mpq_test_files
+    output_file = base_file.parent / "overlay_merged.mpq"
+    output_file.unlink(missing_ok=True)
+
+    result = subprocess.run(
+        [str(binary_path), "merge", str(base_file), str(overlay_file), "-o", str(output_file)],
+        stdout=subprocess.PIPE,
+        stderr=subprocess.PIPE,
+        text=True
+    )
+    assert result.returncode == 0, f"mpqcli failed with error: {result.stderr}"
+    assert "[*] Merged 3 files (3 copied without recompression)" in result.stdout
+
+    result = subprocess.run(
+        [str(binary_path), "list", str(output_file)],
+        stdout=subprocess.PIPE,
+        stderr=subprocess.PIPE,
+        text=True
+    )
+    output_lines = set(result.stdout.splitlines())
+    assert output_lines == {"cats.txt", "dogs.txt", "birds.txt"}, f"Unexpected output: {output_lines}"
+
+    result = subprocess.run(
+        [str(binary_path), "read", "cats.txt", str(output_file)],
+        stdout=subprocess.PIPE,
+        stderr=subprocess.PIPE,
+        text=True
+    )
+    assert result.returncode == 0, f"mpqcli failed with error: {result.stderr}"
+    assert result.stdout.strip() == "This is the overlay file about cats."
+
+
+def test_merge_single_mpq(binary_path, generate_overlay_mpq_test_files):
+    """
+    Test merging with only one input archive.
+
+    This test checks:
+    - That mpqcli refuses to merge a single archive.
+    """
+    base_file, _ = generate_overlay_mpq_test_files
+    output_file = base_file.parent / "overlay_merged_single.mpq"
+    output_file.unlink(missing_ok=True)
+
+    result = subprocess.run(
+        [str(binary_path), "merge", str(base_file), "-o", str(output_file)],
+        stdout=subprocess.PIPE,
+        stderr=subprocess.PIPE,
+        text=True
+    )
+    assert result.returncode == 1, f"mpqcli failed with error: {result.stderr}"
+    assert not output_file.exists()
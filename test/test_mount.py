@@ -0,0 +1,50 @@
+import os
+import platform
+import shutil
+import subprocess
+import time
+
+import pytest
+
+
+pytestmark = pytest.mark.skipif(
+    platform.system() != "Linux" or not os.path.exists("/dev/fuse"),
+    reason="mount requires FUSE on Linux",
+)
+
+
+def test_mount_read_files(binary_path, generate_overlay_mpq_test_files):
+    """
+    Test mounting an MPQ archive as a read-only directory.
+
+    This test checks:
+    - That files in the archive are listed and readable.
+    - That the mounted directory cannot be written.
+    """
+    base_file, _ = generate_overlay_mpq_test_files
+    mount_point = base_file.parent / "mounted"
+    mount_point.mkdir(exist_ok=True)
+
+    server = subprocess.Popen(
+        [str(binary_path), "mount", str(base_file), str(mount_point), "--foreground"],
+        stdout=subprocess.PIPE,
+        stderr=subprocess.PIPE,
+    )
+    try:
+        for _ in range(100):
+            if server.poll() is not None or (mount_point / "cats.txt").exists():
+                break
+            time.sleep(0.05)
+        if server.poll() is not None:
+            pytest.skip(f"mount is not available: {server.stderr.read()}")
+
+        assert {"cats.txt", "dogs.txt"} <= set(os.listdir(mount_point))
+        assert (mount_point / "cats.txt").read_text() == "This is the base file about cats."
+        with open(mount_point / "cats.txt", "rb") as mounted_file:
+            mounted_file.seek(12)
+            assert mounted_file.read(4) == b"base"
+        with pytest.raises(OSError):
+            (mount_point / "fish.txt").write_text("This is a file about fish.")
+    finally:
+        subprocess.run([shutil.which("fusermount3") or "fusermount", "-u", str(mount_point)])
+        server.wait(timeout=10)
@@ -234,3 +234,150 @@ def test_read_file_from_mpq_with_wrong_locale_argument_and_no_default_locale(bin
     assert result.returncode == 1, f"mpqcli failed with error: {result.stderr}"
     assert stdout_output_lines == expected_stdout_output, f"Unexpected output: {stdout_output_lines}"
     assert stderr_output_lines == expected_stderr_output, f"Unexpected output: {stderr_output_lines}"
+
+
+def test_read_file_from_mpq_with_overlay(binary_path, generate_overlay_mpq_test_files):
+    """
+    Test MPQ archive file reading through an overlay archive stack.
+
+    This test checks:
+    - That a file in several archives is read from the highest-priority archive.
+    - That a file only in the base archive is still found.
+    - That a file in no archive fails.
+    """
+    base_file, overlay_file = generate_overlay_mpq_test_files
+
+    expected_content = {
+        "cats.txt": "This is the overlay file about cats.",
+        "dogs.txt": "This is the base file about dogs.",
+        "birds.txt": "This is the overlay file about birds.",
+    }
+
+    for file_to_read, content in expected_content.items():
+        result = subprocess.run(
+            [str(binary_path), "read", file_to_read, str(base_file), "--overlay", str(overlay_file)],
+            stdout=subprocess.PIPE,
+            stderr=subprocess.PIPE,
+            text=True
+        )
+
+        output_lines = set(result.stdout.splitlines())
+        assert result.returncode == 0, f"mpqcli failed with error: {result.stderr}"
+        assert output_lines == {content}, f"Unexpected output: {output_lines}"
+
+    result = subprocess.run(
+        [str(binary_path), "read", "fish.txt", str(base_file), "--overlay", str(overlay_file)],
+        stdout=subprocess.PIPE,
+        stderr=subprocess.PIPE,
+        text=True
+    )
+
+    assert result.returncode == 1, f"mpqcli unexpectedly succeeded: {result.stdout}"
+
+
+def test_read_file_from_mpq_with_overlay_in_one_locale(binary_path, generate_overlay_mpq_test_files, generate_locales_mpq_test_files):
+    """
+    Test MPQ archive file reading through an overlay that stores a file under one locale only.
+
+    This test checks:
+    - That the overlay provides the file for its locale.
+    - That the base archive provides the file for the default locale.
+    """
+    base_file, _ = generate_overlay_mpq_test_files
+    _ = generate_locales_mpq_test_files
+    script_dir = Path(__file__).parent
+    overlay_file = script_dir / "data" / "mpq_with_one_locale.mpq"  # cats.txt for esES only
+
+    expected_content = [
+        (["--locale", "esES"], "Este es un archivo sobre gatos."),
+        ([], "This is the base file about cats."),  # Default locale
+    ]
+
+    for arguments, content in expected_content:
+        result = subprocess.run(
+            [str(binary_path), "read", "cats.txt", str(base_file), *arguments, "--overlay", str(overlay_file)],
+            stdout=subprocess.PIPE,
+            stderr=subprocess.PIPE,
+            text=True
+        )
+
+        output_lines = set(result.stdout.splitlines())
+        assert result.returncode == 0, f"mpqcli failed with error: {result.stderr}"
+        assert output_lines == {content}, f"Unexpected output: {output_lines}"
+
+
+def test_read_mpq_v1_without_mmap(binary_path):
+    """
+    Test reading a file with and without the memory-mapped stream.
+
+    This test checks:
+    - That both ways of reading the archive return the same content.
+    """
+    script_dir = Path(__file__).parent
+    test_file = script_dir / "data" / "mpq_with_output_v1.mpq"
+
+    outputs = []
+    for arguments in ([], ["--no-mmap"]):
+        result = subprocess.run(
+            [str(binary_path), "read", "cats.txt", str(test_file), *arguments],
+            stdout=subprocess.PIPE,
+            stderr=subprocess.PIPE,
+        )
+        assert result.returncode == 0, f"mpqcli failed with error: {result.stderr}"
+        outputs.append(result.stdout)
+
+    assert outputs[0] == outputs[1]
+    assert outputs[0].strip() == b"This is a file about cats."
+
+
+def test_read_stored_file(binary_path, generate_stored_mpq):
+    """
+    Test reading a file stored without compression.
+
+    This test checks:
+    - That the file is sent to stdout unchanged.
+    """
+    mpq_file, content = generate_stored_mpq
+
+    result = subprocess.run(
+        [str(binary_path), "read", "video.bin", str(mpq_file)],
+        stdout=subprocess.PIPE,
+        stderr=subprocess.PIPE,
+    )
+
+    assert result.returncode == 0, f"mpqcli failed with error: {result.stderr}"
+    assert result.stdout == content, "Stored file content differs"
+
+
+def test_read_file_through_index(binary_path, generate_locales_mpq_test_files, generate_stored_mpq):
+    """
+    Test reading files resolved through the sidecar index.
+
+    This test checks:
+    - That the index resolves the requested locale, and the neutral file otherwise.
+    - That a stored file is sent from the indexed entry unchanged.
+    """
+    _ = generate_locales_mpq_test_files
+    script_dir = Path(__file__).parent
+    test_file = script_dir / "data" / "mpq_with_many_locales.mpq"
+
+    for locale, expected in [("deDE", "Dies ist eine Datei über Katzen."),
+                             ("frFR", "This is a file about cats.")]:
+        result = subprocess.run(
+            [str(binary_path), "read", "CATS.TXT", str(test_file), "--locale", locale, "--index"],
+            stdout=subprocess.PIPE,
+            stderr=subprocess.PIPE,
+            text=True
+        )
+        assert result.returncode == 0, f"mpqcli failed with error: {result.stderr}"
+        assert result.stdout.splitlines() == [expected]
+    assert Path(str(test_file) + ".mpqidx").exists()
+
+    mpq_file, content = generate_stored_mpq
+    result = subprocess.run(
+        [str(binary_path), "read", "video.bin", str(mpq_file), "--index"],
+        stdout=subprocess.PIPE,
+        stderr=subprocess.PIPE,
+    )
+    assert result.returncode == 0, f"mpqcli failed with error: {result.stderr}"
+    assert result.stdout == content, "Stored file content differs"
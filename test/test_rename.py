@@ -0,0 +1,116 @@
+import subprocess
+from pathlib import Path
+
+
+def list_files(binary_path, mpq_file):
+    result = subprocess.run(
+        [str(binary_path), "list", str(mpq_file)],
+        stdout=subprocess.PIPE,
+        stderr=subprocess.PIPE,
+        text=True
+    )
+    return set(result.stdout.splitlines())
+
+
+def test_rename_file(binary_path, generate_overlay_mpq_test_files):
+    """
+    Test renaming a single file inside an MPQ archive.
+
+    This test checks:
+    - That the file is listed and readable under its new name only.
+    """
+    base_file, _ = generate_overlay_mpq_test_files
+
+    result = subprocess.run(
+        [str(binary_path), "rename", str(base_file), "cats.txt", "kittens.txt"],
+        stdout=subprocess.PIPE,
+        stderr=subprocess.PIPE,
+        text=True
+    )
+    assert result.returncode == 0, f"mpqcli failed with error: {result.stderr}"
+    assert "[*] Renamed 1 files" in result.stdout
+
+    output_lines = list_files(binary_path, base_file)
+    assert output_lines == {"kittens.txt", "dogs.txt"}, f"Unexpected output: {output_lines}"
+
+    result = subprocess.run(
+        [str(binary_path), "read", "kittens.txt", str(base_file)],
+        stdout=subprocess.PIPE,
+        stderr=subprocess.PIPE,
+        text=True
+    )
+    assert result.returncode == 0, f"mpqcli failed with error: {result.stderr}"
+    assert result.stdout.strip() == "This is the base file about cats."
+
+
+def test_rename_files_with_pattern(binary_path, generate_overlay_mpq_test_files):
+    """
+    Test moving files into a directory inside an MPQ archive, using a pattern.
+
+    This test checks:
+    - That every matching file is renamed in one run.
+    """
+    base_file, _ = generate_overlay_mpq_test_files
+
+    result = subprocess.run(
+        [str(binary_path), "rename", str(base_file), "*.txt", "animals\\*.txt"],
+        stdout=subprocess.PIPE,
+        stderr=subprocess.PIPE,
+        text=True
+    )
+    assert result.returncode == 0, f"mpqcli failed with error: {result.stderr}"
+    assert "[*] Renamed 2 files" in result.stdout
+
+    output_lines = list_files(binary_path, base_file)
+    assert output_lines == {"animals\\cats.txt", "animals\\dogs.txt"}, f"Unexpected output: {output_lines}"
+
+
+def test_rename_file_not_in_archive(binary_path, generate_overlay_mpq_test_files):
+    """
+    Test renaming a file that is not in the MPQ archive.
+
+    This test checks:
+    - That mpqcli reports a failure.
+    """
+    base_file, _ = generate_overlay_mpq_test_files
+
+    result = subprocess.run(
+        [str(binary_path), "rename", str(base_file), "fish.txt", "trout.txt"],
+        stdout=subprocess.PIPE,
+        stderr=subprocess.PIPE,
+        text=True
+    )
+    assert result.returncode == 1, f"mpqcli failed with error: {result.stderr}"
+
+
+def test_rename_file_without_neutral_locale(binary_path, generate_locales_mpq_test_files):
+    """
+    Test renaming a file stored only under a non-neutral locale, without --locale.
+
+    This test checks:
+    - That the file is found and renamed under the locale it is stored with.
+    """
+    _ = generate_locales_mpq_test_files
+    script_dir = Path(__file__).parent
+    mpq_file = script_dir / "data" / "mpq_with_one_locale.mpq"
+
+    result = subprocess.run(
+        [str(binary_path), "rename", str(mpq_file), "cats.txt", "gatos.txt"],
+        stdout=subprocess.PIPE,
+        stderr=subprocess.PIPE,
+        text=True
+    )
+    assert result.returncode == 0, f"mpqcli failed with error: {result.stderr}"
+    assert "[*] Renamed 1 files" in result.stdout
+
+    output_lines = list_files(binary_path, mpq_file)
+    assert output_lines == {"gatos.txt"}, f"Unexpected output: {output_lines}"
+
+    result = subprocess.run(
+        [str(binary_path), "read", "gatos.txt", str(mpq_file), "--locale", "esES"],
+        stdout=subprocess.PIPE,
+        stderr=subprocess.PIPE,
+        text=True
+    )
+    assert result.returncode == 0, f"mpqcli failed with error: {result.stderr}"
+    assert result.stdout.strip() == "Este es un archivo sobre gatos."
@@ -0,0 +1,230 @@
+import http.client
+import os
+import platform
+import socket
+import subprocess
+import tempfile
+import threading
+import time
+from pathlib import Path
+
+import pytest
+
+
+pytestmark = pytest.mark.skipif(
+    platform.system() == "Windows", reason="serve requires Unix sockets"
+)
+
+
+def read_response(reader):
+    """Read one framed response from the server."""
+    status, length = reader.readline().decode().split(" ")
+    return status, reader.read(int(length))
+
+
+def test_serve_read_and_cache(binary_path, generate_overlay_mpq_test_files):
+    """
+    Test reading files from a running server over a Unix domain socket.
+
+    This test checks:
+    - That whole files and byte ranges are served.
+    - That a repeated read is answered from the cache.
+    - That the socket is removed when the server stops.
+    """
+    base_file, _ = generate_overlay_mpq_test_files
+    # Keep the socket path short, Unix socket paths are limited to about 100 bytes
+    socket_path = os.path.join(tempfile.gettempdir(), f"mpqcli-test-{os.getpid()}.sock")
+
+    server = subprocess.Popen(
+        [str(binary_path), "serve", str(base_file), "--socket", socket_path, "--threads", "2"],
+        stdout=subprocess.PIPE,
+        stderr=subprocess.PIPE,
+    )
+    try:
+        for _ in range(100):
+            if os.path.exists(socket_path):
+                break
+            time.sleep(0.05)
+
+        with socket.socket(socket.AF_UNIX, socket.SOCK_STREAM) as client:
+            client.connect(socket_path)
+            client.sendall(b"read cats.txt\nread cats.txt \"\" 12 4\nread fish.txt\nstats\nquit\n")
+            reader = client.makefile("rb")
+
+            assert read_response(reader) == ("ok", b"This is the base file about cats.")
+            assert read_response(reader) == ("ok", b"base")
+            assert read_response(reader)[0] == "error"
+            status, stats = read_response(reader)
+            assert status == "ok"
+            assert "hits 1" in stats.decode().splitlines()
+    finally:
+        server.terminate()
+        server.wait(timeout=10)
+
+    assert server.returncode == 0, f"mpqcli failed with error: {server.stderr.read()}"
+    assert not os.path.exists(socket_path)
+
+
+def test_serve_http_ranges(binary_path, generate_overlay_mpq_test_files):
+    """
+    Test byte ranges served over HTTP.
+
+    This test checks:
+    - That a range inside the file is answered with 206 Partial Content.
+    - That ranges starting at or past the end of the file are answered with 416.
+    """
+    base_file, _ = generate_overlay_mpq_test_files
+    content = b"This is the base file about cats."
+    socket_path = os.path.join(tempfile.gettempdir(), f"mpqcli-test-http-{os.getpid()}.sock")
+    with socket.socket(socket.AF_INET, socket.SOCK_STREAM) as probe:
+        probe.bind(("127.0.0.1", 0))
+        port = probe.getsockname()[1]
+
+    server = subprocess.Popen(
+        [str(binary_path), "serve", str(base_file), "--socket", socket_path, "--http", str(port)],
+        stdout=subprocess.PIPE,
+        stderr=subprocess.PIPE,
+    )
+    try:
+        # The HTTP port is listened on after the Unix socket
+        for _ in range(100):
+            try:
+                socket.create_connection(("127.0.0.1", port), timeout=1).close()
+                break
+            except OSError:
+                time.sleep(0.05)
+
+        def get(byte_range):
+            connection = http.client.HTTPConnection("127.0.0.1", port, timeout=10)
+            connection.request("GET", "/cats.txt", headers={"Range": f"bytes={byte_range}"})
+            response = connection.getresponse()
+            result = response.status, response.getheader("Content-Range"), response.read()
+            connection.close()
+            return result
+
+        assert get("12-15") == (206, f"bytes 12-15/{len(content)}", b"base")
+        assert get(f"{len(content) - 1}-") == (206, f"bytes {len(content) - 1}-{len(content) - 1}/{len(content)}", b".")
+        assert get(f"{len(content)}-") == (416, f"bytes */{len(content)}", b"")
+        assert get(f"{len(content) + 10}-") == (416, f"bytes */{len(content)}", b"")
+    finally:
+        server.terminate()
+        server.wait(timeout=10)
+
+    assert server.returncode == 0, f"mpqcli failed with error: {server.stderr.read()}"
+
+
+def test_serve_concurrent_locales(binary_path, generate_locales_mpq_test_files):
+    """
+    Stress test reading one file under different locales from many threads at once.
+
+    This test checks:
+    - That every read returns the file of the requested locale, while other
+      threads open the same file under other locales.
+    - That a locale the file is not stored under falls back to the neutral file.
+    """
+    _ = generate_locales_mpq_test_files
+    script_dir = Path(__file__).parent
+    test_file = script_dir / "data" / "mpq_with_many_locales.mpq"
+    socket_path = os.path.join(tempfile.gettempdir(), f"mpqcli-locales-{os.getpid()}.sock")
+
+    expected_content = {
+        '""': "This is a file about cats.",
+        "deDE": "Dies ist eine Datei über Katzen.",
+        "esES": "Este es un archivo sobre gatos.",
+        "frFR": "This is a file about cats.",  # Not stored, the neutral file is read
+    }
+    locales = list(expected_content)
+    reads_per_thread = 200
+
+    # Without a cache every read opens the file again, under its own locale
+    server = subprocess.Popen(
+        [str(binary_path), "serve", str(test_file), "--socket", socket_path,
+         "--threads", "8", "--cache-size", "0"],
+        stdout=subprocess.PIPE,
+        stderr=subprocess.PIPE,
+    )
+    failures = []
+
+    def read_locales(first):
+        with socket.socket(socket.AF_UNIX, socket.SOCK_STREAM) as client:
+            client.connect(socket_path)
+            reader = client.makefile("rb")
+            for i in range(reads_per_thread):
+                locale = locales[(first + i) % len(locales)]
+                client.sendall(f"read cats.txt {locale}\n".encode())
+                response = read_response(reader)
+                expected = ("ok", expected_content[locale].encode())
+                if response != expected:
+                    failures.append((locale, response))
+            client.sendall(b"quit\n")
+
+    try:
+        for _ in range(100):
+            if os.path.exists(socket_path):
+                break
+            time.sleep(0.05)
+
+        threads = [threading.Thread(target=read_locales, args=(i,)) for i in range(16)]
+        for thread in threads:
+            thread.start()
+        for thread in threads:
+            thread.join()
+    finally:
+        server.terminate()
+        server.wait(timeout=10)
+
+    assert server.returncode == 0, f"mpqcli failed with error: {server.stderr.read()}"
+    assert not failures, f"Reads returned the wrong locale: {failures[:5]}"
+
+
+def test_serve_max_clients(binary_path, generate_overlay_mpq_test_files):
+    """
+    Test the limit on clients served at the same time.
+
+    This test checks:
+    - That a client beyond the limit waits until a served client disconnects.
+    - That the server stops cleanly with a waiting client.
+    """
+    base_file, _ = generate_overlay_mpq_test_files
+    socket_path = os.path.join(tempfile.gettempdir(), f"mpqcli-limit-{os.getpid()}.sock")
+
+    server = subprocess.Popen(
+        [str(binary_path), "serve", str(base_file), "--socket", socket_path, "--max-clients", "1"],
+        stdout=subprocess.PIPE,
+        stderr=subprocess.PIPE,
+    )
+    try:
+        for _ in range(100):
+            if os.path.exists(socket_path):
+                break
+            time.sleep(0.05)
+
+        with socket.socket(socket.AF_UNIX, socket.SOCK_STREAM) as first:
+            first.connect(socket_path)
+            first_reader = first.makefile("rb")
+            first.sendall(b"read cats.txt\n")
+            assert read_response(first_reader) == ("ok", b"This is the base file about cats.")
+
+            with socket.socket(socket.AF_UNIX, socket.SOCK_STREAM) as second:
+                second.connect(socket_path)
+                second.sendall(b"read dogs.txt\n")
+                second.settimeout(0.5)
+                with pytest.raises(socket.timeout):
+                    second.recv(1)
+
+                first.sendall(b"quit\n")
+                first.close()
+                second.settimeout(10)
+                assert read_response(second.makefile("rb")) == (
+                    "ok", b"This is the base file about dogs.")
+
+                # Stop while one client is served and another one waits
+                with socket.socket(socket.AF_UNIX, socket.SOCK_STREAM) as waiting:
+                    waiting.connect(socket_path)
+                    server.terminate()
+                    server.wait(timeout=10)
+    finally:
+        server.terminate()
+        server.wait(timeout=10)
+
+    assert server.returncode == 0, f"mpqcli failed with error: {server.stderr.read()}"